@@ -27,6 +27,7 @@
 #include "vnr-message-area.h"
 #include "vnr-file.h"
 #include "vnr-tools.h"
+#include "vnr-pyramid.h"
 
 #define PIXMAP_DIR        PACKAGE_DATA_DIR"/viewnior/pixmaps/"
 
@@ -34,6 +35,9 @@ static gchar **files = NULL;     //array of files specified to be opened
 static gboolean version = FALSE;
 static gboolean slideshow = FALSE;
 static gboolean fullscreen = FALSE;
+static gboolean recursive = FALSE;
+static gchar *files_from = NULL;
+static gboolean build_pyramid = FALSE;
 
 /* List of option entries
  * The only option is for specifying file to be opened. */
@@ -42,6 +46,9 @@ static GOptionEntry opt_entries[] = {
     {"version", 0, 0, G_OPTION_ARG_NONE, &version, NULL, NULL},
     {"slideshow", 0, 0, G_OPTION_ARG_NONE, &slideshow, NULL, NULL},
     {"fullscreen", 0, 0, G_OPTION_ARG_NONE, &fullscreen, NULL, NULL},
+    {"recursive", 'r', 0, G_OPTION_ARG_NONE, &recursive, NULL, NULL},
+    {"files-from", 0, 0, G_OPTION_ARG_FILENAME, &files_from, NULL, "FILE"},
+    {"build-pyramid", 0, 0, G_OPTION_ARG_NONE, &build_pyramid, NULL, NULL},
     {NULL}
 };
 
@@ -53,7 +60,9 @@ main (int argc, char *argv[])
     GtkWindow *window;
 
     GSList *uri_list = NULL;
-    GList *file_list = NULL;
+    VnrFileList *file_list = NULL;
+    gboolean load_dir = FALSE;
+    gboolean load_paths = FALSE;
 
 
     bindtextdomain (GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR);
@@ -62,7 +71,8 @@ main (int argc, char *argv[])
 
     opt_context = g_option_context_new ("- Elegant Image Viewer");
     g_option_context_add_main_entries (opt_context, opt_entries, NULL);
-    g_option_context_add_group (opt_context, gtk_get_option_group (TRUE));
+    /* The display is only opened once we know a window is needed */
+    g_option_context_add_group (opt_context, gtk_get_option_group (FALSE));
     g_option_context_parse (opt_context, &argc, &argv, &error);
 
     if (error != NULL)
@@ -77,6 +87,26 @@ main (int argc, char *argv[])
         printf("%s\n", PACKAGE_STRING);
         return 0;
     }
+    else if (build_pyramid)
+    {
+        return vnr_pyramid_build_files (files);
+    }
+
+    gtk_init (&argc, &argv);
+
+    uri_list = vnr_tools_get_list_from_array (files);
+
+    if (files_from != NULL)
+    {
+        GSList *path_list = vnr_tools_read_path_list (files_from, &error);
+
+        if (error != NULL)
+        {
+            printf ("%s\n", error->message);
+            return 1;
+        }
+        uri_list = g_slist_concat (uri_list, path_list);
+    }
 
     gtk_icon_theme_append_search_path(gtk_icon_theme_get_default(), PIXMAP_DIR);
 
@@ -84,20 +114,27 @@ main (int argc, char *argv[])
     gtk_window_set_default_size (window, 480, 300);
     gtk_window_set_position (window, GTK_WIN_POS_CENTER);
 
-    uri_list = vnr_tools_get_list_from_array (files);
-
     if(uri_list != NULL)
     {
         if (g_slist_length(uri_list) == 1)
         {
-            vnr_file_load_single_uri (uri_list->data, &file_list, VNR_WINDOW(window)->prefs->show_hidden, &error);
+            load_dir = vnr_file_load_single_image (uri_list->data, &file_list, VNR_WINDOW(window)->prefs->show_hidden);
+            if (!load_dir && (recursive || VNR_WINDOW(window)->prefs->recursive))
+                load_paths = g_file_test (uri_list->data, G_FILE_TEST_IS_DIR);
+            if (!load_dir && !load_paths)
+                vnr_file_load_single_uri (uri_list->data, &file_list, VNR_WINDOW(window)->prefs->show_hidden, &error);
         }
         else
         {
-            vnr_file_load_uri_list (uri_list, &file_list, VNR_WINDOW(window)->prefs->show_hidden, &error);
+            load_paths = TRUE;
         }
 
-        if(error != NULL && file_list != NULL)
+        if(load_paths)
+        {
+            vnr_window_load_paths_async(VNR_WINDOW(window), uri_list,
+                                        recursive || VNR_WINDOW(window)->prefs->recursive);
+        }
+        else if(error != NULL && file_list != NULL)
         {
             deny_slideshow(VNR_WINDOW(window));
             vnr_message_area_show(VNR_MESSAGE_AREA (VNR_WINDOW(window)->msg_area),
@@ -120,6 +157,10 @@ main (int argc, char *argv[])
         else
         {
             vnr_window_set_list(VNR_WINDOW(window), file_list, TRUE);
+            if (load_dir)
+                vnr_window_load_dir_async(VNR_WINDOW(window), uri_list->data);
+            if (g_slist_length(uri_list) == 1)
+                vnr_window_watch_dir(VNR_WINDOW(window), uri_list->data);
         }
     }
     
@@ -131,5 +172,8 @@ main (int argc, char *argv[])
     gtk_widget_show (GTK_WIDGET (window));
     gtk_main ();
 
+    /* Half-written pyramids are not left behind */
+    vnr_pyramid_stop_builds ();
+
     return 0;
 }
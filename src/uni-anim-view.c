@@ -24,6 +24,7 @@
 #include <glib.h>
 #include <gdk/gdkkeysyms.h>
 #include "uni-anim-view.h"
+#include "uni-utils.h"
 
 /*************************************************************/
 /***** Private data ******************************************/
@@ -38,15 +39,376 @@ static guint uni_anim_view_signals[LAST_SIGNAL] = { 0 };
 
 G_DEFINE_TYPE (UniAnimView, uni_anim_view, UNI_TYPE_IMAGE_VIEW);
 
+/* Upper bound for the memory used by the frame store. Longer
+ * animations keep playing from the GdkPixbufAnimation. */
+#define UNI_ANIM_STORE_MAX_SIZE (256 * 1024 * 1024)
+
+/* A frame of the frame store. Frames with at most 256 colours, which
+ * is all of them for GIFs, are held as one palette index per pixel.
+ * Others keep a copy of the pixbuf. */
+typedef struct {
+    guchar *indices;
+    guint32 palette[256];
+    GdkPixbuf *pixbuf;
+
+    int delay;
+
+    /* Area in which the frame differs from the one before it. */
+    GdkRectangle damage;
+} UniAnimFrame;
+
 /*************************************************************/
 /***** Static stuff ******************************************/
 /*************************************************************/
 
+static void
+uni_anim_frame_free (UniAnimFrame * frame)
+{
+    if (frame->pixbuf)
+        g_object_unref (frame->pixbuf);
+    g_free (frame->indices);
+    g_free (frame);
+}
+
+/* Packs an 8 bit RGB(A) pixel as 0xRRGGBBAA. */
+static guint32
+uni_anim_frame_pack (const guchar * p, int chans)
+{
+    return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) |
+        ((guint32) p[2] << 8) | (chans == 4 ? p[3] : 0xff);
+}
+
+static UniAnimFrame *
+uni_anim_frame_new (GdkPixbuf * pixbuf, int delay, GdkRectangle * damage)
+{
+    UniAnimFrame *frame = g_new0 (UniAnimFrame, 1);
+    int width = gdk_pixbuf_get_width (pixbuf);
+    int height = gdk_pixbuf_get_height (pixbuf);
+    int chans = gdk_pixbuf_get_n_channels (pixbuf);
+    int stride = gdk_pixbuf_get_rowstride (pixbuf);
+    const guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    GHashTable *colors;
+    guint32 last = 0;
+    int n_colors = 0, last_index = -1, x, y;
+
+    frame->delay = delay;
+    frame->damage = *damage;
+
+    if (gdk_pixbuf_get_bits_per_sample (pixbuf) != 8 || chans < 3)
+    {
+        frame->pixbuf = gdk_pixbuf_copy (pixbuf);
+        return frame;
+    }
+
+    /* Maps colours to their palette index plus one. */
+    colors = g_hash_table_new (NULL, NULL);
+    frame->indices = g_malloc ((gsize) width * height);
+
+    for (y = 0; y < height && frame->indices; y++)
+    {
+        const guchar *p = pixels + y * stride;
+        guchar *dst = frame->indices + (gsize) y * width;
+
+        for (x = 0; x < width; x++, p += chans)
+        {
+            guint32 color = uni_anim_frame_pack (p, chans);
+            if (color != last || last_index < 0)
+            {
+                last = color;
+                last_index = GPOINTER_TO_INT (g_hash_table_lookup
+                                              (colors,
+                                               GUINT_TO_POINTER (color))) - 1;
+                if (last_index < 0)
+                {
+                    if (n_colors == 256)
+                    {
+                        g_free (frame->indices);
+                        frame->indices = NULL;
+                        break;
+                    }
+                    frame->palette[n_colors] = color;
+                    last_index = n_colors++;
+                    g_hash_table_insert (colors, GUINT_TO_POINTER (color),
+                                         GINT_TO_POINTER (last_index + 1));
+                }
+            }
+            dst[x] = last_index;
+        }
+    }
+    g_hash_table_destroy (colors);
+
+    if (!frame->indices)
+        frame->pixbuf = gdk_pixbuf_copy (pixbuf);
+    return frame;
+}
+
+static gsize
+uni_anim_frame_get_size (UniAnimFrame * frame, int width, int height)
+{
+    if (frame->pixbuf)
+        return sizeof (UniAnimFrame) +
+            (gsize) gdk_pixbuf_get_rowstride (frame->pixbuf) *
+            gdk_pixbuf_get_height (frame->pixbuf);
+    return sizeof (UniAnimFrame) + (gsize) width * height;
+}
+
+/* Writes the pixels of @frame inside @rect to @canvas. */
+static void
+uni_anim_frame_expand (UniAnimFrame * frame,
+                       GdkPixbuf * canvas, GdkRectangle * rect)
+{
+    int width = gdk_pixbuf_get_width (canvas);
+    int chans = gdk_pixbuf_get_n_channels (canvas);
+    int stride = gdk_pixbuf_get_rowstride (canvas);
+    guchar *pixels = gdk_pixbuf_get_pixels (canvas);
+    int x, y;
+
+    if (!rect->width || !rect->height)
+        return;
+
+    if (frame->pixbuf)
+    {
+        gdk_pixbuf_copy_area (frame->pixbuf,
+                              rect->x, rect->y, rect->width, rect->height,
+                              canvas, rect->x, rect->y);
+        return;
+    }
+
+    for (y = rect->y; y < rect->y + rect->height; y++)
+    {
+        const guchar *src = frame->indices + (gsize) y * width + rect->x;
+        guchar *dst = pixels + y * stride + rect->x * chans;
+
+        for (x = 0; x < rect->width; x++, dst += chans)
+        {
+            guint32 color = frame->palette[src[x]];
+            dst[0] = color >> 24;
+            dst[1] = (color >> 16) & 0xff;
+            dst[2] = (color >> 8) & 0xff;
+            if (chans == 4)
+                dst[3] = color & 0xff;
+        }
+    }
+}
+
+static void
+uni_anim_view_free_store (UniAnimView * aview)
+{
+    if (aview->store)
+    {
+        g_ptr_array_foreach (aview->store, (GFunc) uni_anim_frame_free, NULL);
+        g_ptr_array_free (aview->store, TRUE);
+    }
+    aview->store = NULL;
+    aview->store_size = 0;
+    aview->store_complete = FALSE;
+
+    if (aview->canvas)
+        g_object_unref (aview->canvas);
+    aview->canvas = NULL;
+}
+
+static void
+uni_anim_view_reset_frames (UniAnimView * aview, gboolean start)
+{
+    aview->started = start;
+
+    if (aview->last_frame)
+        g_object_unref (aview->last_frame);
+    aview->last_frame = NULL;
+
+    uni_anim_view_free_store (aview);
+    if (start)
+        aview->store = g_ptr_array_new ();
+    aview->frame = 0;
+}
+
+/* Tells whether the iterator is back at the first frame. The pixbuf
+ * it hands out can not tell, as loaders may composite every frame
+ * into the same one. Instead, a second iterator is started at the
+ * same time as the first and taken straight to the current time: it
+ * only reports a change if it ends up on another frame. */
+static gboolean
+uni_anim_view_at_first_frame (UniAnimView * aview)
+{
+    GdkPixbufAnimationIter *probe;
+    gboolean moved;
+
+    probe = gdk_pixbuf_animation_get_iter (aview->anim, &aview->start);
+    moved = gdk_pixbuf_animation_iter_advance (probe, &aview->time);
+    g_object_unref (probe);
+    return !moved;
+}
+
+/* Finds the area in which @pixbuf, which the animation composited the
+ * new frame into in place, differs from the frame before. The copy of
+ * that frame is brought up to date for the next one. */
+static void
+uni_anim_view_diff_in_place (UniAnimView * aview, GdkPixbuf * pixbuf,
+                             GdkRectangle * damage)
+{
+    if (!aview->last_frame)
+    {
+        damage->x = 0;
+        damage->y = 0;
+        damage->width = gdk_pixbuf_get_width (pixbuf);
+        damage->height = gdk_pixbuf_get_height (pixbuf);
+        aview->last_frame = gdk_pixbuf_copy (pixbuf);
+        return;
+    }
+
+    if (uni_pixbuf_get_changed_rect (aview->last_frame, pixbuf, damage))
+        gdk_pixbuf_copy_area (pixbuf,
+                              damage->x, damage->y,
+                              damage->width, damage->height,
+                              aview->last_frame, damage->x, damage->y);
+}
+
+/* Adds the frame shown for the first time to the store. The store only
+ * makes sense while frames come in order, which is the case as long
+ * as the animation is played or stepped through. Frames are copied
+ * by their index, so loaders which composite every frame into the same
+ * pixbuf are captured as well. */
+static void
+uni_anim_view_store_frame (UniAnimView * aview, GdkPixbuf * pixbuf,
+                           int index, GdkRectangle * damage)
+{
+    UniAnimFrame *frame;
+
+    if (!aview->store)
+        return;
+
+    if ((guint) index != aview->store->len ||
+        aview->store_size > UNI_ANIM_STORE_MAX_SIZE)
+    {
+        uni_anim_view_free_store (aview);
+        return;
+    }
+
+    frame = uni_anim_frame_new (pixbuf, aview->delay, damage);
+    aview->store_size +=
+        uni_anim_frame_get_size (frame, gdk_pixbuf_get_width (pixbuf),
+                                 gdk_pixbuf_get_height (pixbuf));
+    g_ptr_array_add (aview->store, frame);
+}
+
+/* Called when the animation is back at its first frame. If all frames
+ * were captured, the animation and the RGBA frames it composited are
+ * released, and from now on frames are expanded from the store into
+ * a single canvas. */
+static gboolean
+uni_anim_view_complete_store (UniAnimView * aview, GdkPixbuf * first,
+                              GdkRectangle * damage)
+{
+    UniImageView *view = UNI_IMAGE_VIEW (aview);
+    UniAnimFrame *frame;
+
+    if (!aview->store || aview->store_complete)
+        return FALSE;
+
+    if (aview->frame != (int) aview->store->len - 1 ||
+        aview->store->len < 2)
+    {
+        uni_anim_view_free_store (aview);
+        return FALSE;
+    }
+
+    frame = g_ptr_array_index (aview->store, 0);
+    frame->damage = *damage;
+
+    aview->canvas = gdk_pixbuf_copy (first);
+    aview->store_complete = TRUE;
+    aview->frame = 0;
+
+    g_object_unref (aview->iter);
+    aview->iter = NULL;
+    g_object_unref (aview->anim);
+    aview->anim = NULL;
+    if (aview->last_frame)
+        g_object_unref (aview->last_frame);
+    aview->last_frame = NULL;
+
+    uni_image_view_set_frame (view, aview->canvas, 0, &frame->damage);
+    return TRUE;
+}
+
+static void
+uni_anim_view_play_store (UniAnimView * aview)
+{
+    UniAnimFrame *frame;
+
+    aview->frame = (aview->frame + 1) % aview->store->len;
+    frame = g_ptr_array_index (aview->store, aview->frame);
+
+    uni_anim_frame_expand (frame, aview->canvas, &frame->damage);
+    uni_image_view_set_frame (UNI_IMAGE_VIEW (aview), aview->canvas,
+                              aview->frame, &frame->damage);
+
+    /* See the workaround for #437791 in uni_anim_view_updator(). */
+    aview->delay = frame->delay == 20 ? 100 : frame->delay;
+}
+
+/* Frames are numbered as the iterator moves on, starting over each
+ * time it is back at the first frame, so the scaled rendition of each
+ * frame is parked in the draw cache under its index. That holds for
+ * loaders which composite every frame into the same pixbuf as well,
+ * whose changes are found against a copy of the frame before.
+ *
+ * Either way, only the area in which the new frame differs from the
+ * previous one is redrawn. */
+static void
+uni_anim_view_show_frame (UniAnimView * aview, GdkPixbuf * pixbuf)
+{
+    UniImageView *view = UNI_IMAGE_VIEW (aview);
+    GdkRectangle damage;
+    int index;
+
+    index = uni_anim_view_at_first_frame (aview) ? 0 : aview->frame + 1;
+
+    if (!view->pixbuf)
+    {
+        uni_anim_view_free_store (aview);
+        aview->frame = index;
+        uni_image_view_set_frame (view, pixbuf, aview->frame, NULL);
+        return;
+    }
+
+    if (pixbuf == view->pixbuf)
+        uni_anim_view_diff_in_place (aview, pixbuf, &damage);
+    else
+    {
+        if (aview->last_frame)
+            g_object_unref (aview->last_frame);
+        aview->last_frame = NULL;
+        uni_pixbuf_get_changed_rect (view->pixbuf, pixbuf, &damage);
+    }
+
+    if (index == 0)
+    {
+        if (uni_anim_view_complete_store (aview, pixbuf, &damage))
+            return;
+    }
+    else if (aview->store && !aview->store_complete)
+        uni_anim_view_store_frame (aview, pixbuf, index, &damage);
+
+    aview->frame = index;
+    uni_image_view_set_frame (view, pixbuf, aview->frame, &damage);
+}
+
 static gboolean
 uni_anim_view_updator (gpointer data)
 {
     UniAnimView *aview = (UniAnimView *) data;
 
+    if (aview->store_complete)
+    {
+        uni_anim_view_set_is_playing (aview, FALSE);
+        uni_anim_view_play_store (aview);
+        aview->timer_id = g_timeout_add (aview->delay,
+                                         uni_anim_view_updator, aview);
+        return FALSE;
+    }
+
     // Workaround for #437791.
     glong delay_us = aview->delay * 1000;
     if (aview->delay == 20)
@@ -71,11 +433,31 @@ uni_anim_view_updator (gpointer data)
         return FALSE;
 
     GdkPixbuf *pixbuf = gdk_pixbuf_animation_iter_get_pixbuf (aview->iter);
-    uni_image_view_set_pixbuf (UNI_IMAGE_VIEW (aview), pixbuf, FALSE);
+    uni_anim_view_show_frame (aview, pixbuf);
 
     return FALSE;
 }
 
+/* Starts playing the animation with @pixbuf as its first frame. */
+static void
+uni_anim_view_start (UniAnimView * aview, GdkPixbuf * pixbuf)
+{
+    GdkRectangle damage = { 0, 0,
+        gdk_pixbuf_get_width (pixbuf), gdk_pixbuf_get_height (pixbuf)
+    };
+
+    uni_anim_view_reset_frames (aview, TRUE);
+    aview->last_frame = gdk_pixbuf_copy (pixbuf);
+    uni_image_view_set_frame (UNI_IMAGE_VIEW (aview), pixbuf, 0, NULL);
+
+    uni_anim_view_set_is_playing (aview, FALSE);
+    aview->delay = gdk_pixbuf_animation_iter_get_delay_time (aview->iter);
+    uni_anim_view_store_frame (aview, pixbuf, 0, &damage);
+
+    aview->timer_id = g_timeout_add (aview->delay,
+                                     uni_anim_view_updator, aview);
+}
+
 /*************************************************************/
 /***** Private signal handlers *******************************/
 /*************************************************************/
@@ -92,7 +474,11 @@ uni_anim_view_toggle_running (UniAnimView * aview)
 static void
 uni_anim_view_step (UniAnimView * aview)
 {
-    if (aview->anim)
+    if (aview->store_complete)
+    {
+        uni_anim_view_play_store (aview);
+    }
+    else if (aview->anim)
     {
         /* Part of workaround for #437791. uni_anim_view_updator()
          * might not always immidiately step to the next frame, so we
@@ -107,9 +493,8 @@ uni_anim_view_step (UniAnimView * aview)
          * exactly 10 chances to advance the frame before bailing out.
          * */
         int n = 0;
-        GdkPixbuf *old = gdk_pixbuf_animation_iter_get_pixbuf (aview->iter);
-        while ((gdk_pixbuf_animation_iter_get_pixbuf (aview->iter) == old)
-               && (n < 10))
+        int old = aview->frame;
+        while ((aview->frame == old) && (n < 10))
         {
             uni_anim_view_updator (aview);
             n++;
@@ -127,12 +512,20 @@ uni_anim_view_init (UniAnimView * aview)
     aview->anim = NULL;
     aview->iter = NULL;
     aview->timer_id = 0;
+    aview->started = FALSE;
+    aview->last_frame = NULL;
+    aview->store = NULL;
+    aview->store_size = 0;
+    aview->store_complete = FALSE;
+    aview->canvas = NULL;
+    aview->frame = 0;
 }
 
 static void
 uni_anim_view_finalize (GObject * object)
 {
     uni_anim_view_set_is_playing (UNI_ANIM_VIEW (object), FALSE);
+    uni_anim_view_reset_frames (UNI_ANIM_VIEW (object), FALSE);
 
     /* Chain up. */
     G_OBJECT_CLASS (uni_anim_view_parent_class)->finalize (object);
@@ -248,6 +641,7 @@ uni_anim_view_set_anim (UniAnimView * aview, GdkPixbufAnimation * anim)
 
     if (!anim)
     {
+        uni_anim_view_reset_frames (aview, FALSE);
         uni_anim_view_set_is_playing (aview, FALSE);
         uni_image_view_set_pixbuf (UNI_IMAGE_VIEW (aview), NULL, TRUE);
         return TRUE;
@@ -258,6 +652,7 @@ uni_anim_view_set_anim (UniAnimView * aview, GdkPixbufAnimation * anim)
         g_object_unref (aview->iter);
 
     g_get_current_time (&aview->time);
+    aview->start = aview->time;
     aview->iter = gdk_pixbuf_animation_get_iter (aview->anim, &aview->time);
 
     GdkPixbuf *pixbuf;
@@ -275,12 +670,15 @@ uni_anim_view_set_anim (UniAnimView * aview, GdkPixbufAnimation * anim)
 
     uni_image_view_set_pixbuf (UNI_IMAGE_VIEW (aview), pixbuf, TRUE);
 
-    uni_anim_view_set_is_playing (aview, FALSE);
-    aview->delay = gdk_pixbuf_animation_iter_get_delay_time (aview->iter);
+    if (is_static)
+    {
+        uni_anim_view_reset_frames (aview, FALSE);
+        uni_anim_view_set_is_playing (aview, FALSE);
+        aview->delay = gdk_pixbuf_animation_iter_get_delay_time (aview->iter);
+    }
+    else
+        uni_anim_view_start (aview, pixbuf);
 
-    if(!is_static)
-        aview->timer_id = g_timeout_add (aview->delay,
-                                         uni_anim_view_updator, aview);
     return is_static;
 }
 
@@ -308,6 +706,7 @@ uni_anim_view_set_static (UniAnimView * aview, GdkPixbuf * pixbuf)
     if (aview->iter)
         g_object_unref (aview->iter);
 
+    uni_anim_view_reset_frames (aview, FALSE);
     uni_image_view_set_pixbuf (UNI_IMAGE_VIEW (aview), pixbuf, TRUE);
     uni_anim_view_set_is_playing (aview, FALSE);
     aview->delay = -1;
@@ -334,6 +733,45 @@ uni_anim_view_set_is_playing (UniAnimView * aview, gboolean playing)
         g_source_remove (aview->timer_id);
         aview->timer_id = 0;
     }
-    else if (playing && aview->anim)
+    else if (playing && (aview->anim || aview->store_complete))
         uni_anim_view_updator (aview);
 }
+
+/**
+ * uni_anim_view_anim_updated:
+ * @aview: a #UniAnimView
+ *
+ * Tells the view that more data was loaded into its animation, which
+ * is still being read by a #GdkPixbufLoader. An animation of which
+ * only the first frame was available when it was set, and which was
+ * therefore shown as a static image, starts playing.
+ **/
+void
+uni_anim_view_anim_updated (UniAnimView * aview)
+{
+    if (!aview->anim || !aview->iter || aview->timer_id ||
+        aview->started || aview->store_complete)
+        return;
+
+    if (gdk_pixbuf_animation_is_static_image (aview->anim))
+        return;
+
+    uni_anim_view_start (aview,
+                         gdk_pixbuf_animation_iter_get_pixbuf (aview->iter));
+}
+
+/**
+ * uni_anim_view_needs_data:
+ * @aview: a #UniAnimView
+ * @returns: %TRUE if playback has reached the frame being loaded.
+ *
+ * Tells whether the animation is waiting for its loader. Loaders use
+ * it to decode only as far ahead of playback as necessary.
+ **/
+gboolean
+uni_anim_view_needs_data (UniAnimView * aview)
+{
+    if (!aview->iter || aview->store_complete)
+        return FALSE;
+    return gdk_pixbuf_animation_iter_on_currently_loading_frame (aview->iter);
+}
@@ -58,6 +58,29 @@ struct _UniAnimView {
     GTimeVal time;
     int delay;
 
+    /* Time the iterator was started at, to tell when it is back at
+     * the first frame. */
+    GTimeVal start;
+
+    /* Whether the animation was started. Frames are counted from
+     * then on. */
+    gboolean started;
+
+    /* Copy of the frame on screen when the animation composites every
+     * frame into the same pixbuf, to find the area the next frame
+     * changes. */
+    GdkPixbuf *last_frame;
+
+    /* Frames captured as palette indices during the first loop. Once
+     * the loop is complete, the animation is released and the frames
+     * are expanded into canvas as they are shown. */
+    GPtrArray *store;
+    gsize store_size;
+    gboolean store_complete;
+    GdkPixbuf *canvas;
+
+    /* Index of the frame on screen, counted from the first one. */
+    int frame;
 };
 
 struct _UniAnimViewClass {
@@ -83,5 +106,9 @@ void        uni_anim_view_set_static        (UniAnimView * aview,
 void        uni_anim_view_set_is_playing    (UniAnimView * aview,
                                              gboolean playing);
 
+/* Incremental loading */
+void        uni_anim_view_anim_updated      (UniAnimView * aview);
+gboolean    uni_anim_view_needs_data        (UniAnimView * aview);
+
 G_END_DECLS
 #endif /* __UNI_ANIM_VIEW_H__ */
@@ -23,16 +23,15 @@
 #include "uni-cache.h"
 #include "uni-utils.h"
 #include <string.h>
+#include <math.h>
 
-static gboolean
-uni_rectangle_contains_rect (GdkRectangle r1, GdkRectangle r2)
-{
-    return
-        r1.x <= r2.x &&
-        r1.y <= r2.y &&
-        (r2.x + r2.width) <= (r1.x + r1.width) &&
-        (r2.y + r2.height) <= (r1.y + r1.height);
-}
+/* Upper bound for the memory held by parked frame renditions. */
+#define UNI_PIXBUF_DRAW_CACHE_FRAMES_SIZE (128 * 1024 * 1024)
+
+typedef struct {
+    GdkPixbuf *last_pixbuf;
+    UniPixbufDrawOpts old;
+} UniPixbufDrawCacheFrame;
 
 static void
 uni_pixbuf_copy_area_intact (GdkPixbuf * src,
@@ -79,6 +78,30 @@ uni_pixbuf_copy_area_intact (GdkPixbuf * src,
     }
 }
 
+static gsize
+uni_pixbuf_get_byte_size (GdkPixbuf * pixbuf)
+{
+    return (gsize) gdk_pixbuf_get_rowstride (pixbuf) *
+        gdk_pixbuf_get_height (pixbuf);
+}
+
+static void
+uni_pixbuf_draw_cache_clear_frames (UniPixbufDrawCache * cache)
+{
+    guint n;
+    for (n = 0; n < cache->frames->len; n++)
+    {
+        UniPixbufDrawCacheFrame *slot = g_ptr_array_index (cache->frames, n);
+        if (!slot)
+            continue;
+        g_object_unref (slot->last_pixbuf);
+        g_free (slot);
+    }
+    g_ptr_array_set_size (cache->frames, 0);
+    cache->frames_size = 0;
+    cache->frame = -1;
+}
+
 /**
  * uni_pixbuf_draw_cache_get_method:
  * @old: the last draw options used
@@ -126,6 +149,8 @@ uni_pixbuf_draw_cache_new ()
         {
         0, 0, 0, 0}
     , 0, 0, GDK_INTERP_NEAREST, cache->last_pixbuf};
+    cache->frames = g_ptr_array_new ();
+    cache->frame = -1;
     return cache;
 }
 
@@ -138,6 +163,8 @@ uni_pixbuf_draw_cache_new ()
 void
 uni_pixbuf_draw_cache_free (UniPixbufDrawCache * cache)
 {
+    uni_pixbuf_draw_cache_clear_frames (cache);
+    g_ptr_array_free (cache->frames, TRUE);
     g_object_unref (cache->last_pixbuf);
     g_free (cache);
 }
@@ -156,15 +183,127 @@ uni_pixbuf_draw_cache_free (UniPixbufDrawCache * cache)
  *
  * However, when the image data is modified, this assumtion breaks,
  * which is why this method must be used to tell draw cache about it.
+ *
+ * The renditions of animation frames are dropped as well.
  **/
 void
 uni_pixbuf_draw_cache_invalidate (UniPixbufDrawCache * cache)
 {
+    uni_pixbuf_draw_cache_clear_frames (cache);
+
     /* Set the cached zoom to a bogus value, to force a
        DRAW_FLAGS_SCALE. */
     cache->old.zoom = -1234.0;
 }
 
+/**
+ * uni_pixbuf_draw_cache_damage:
+ * @cache: a #UniPixbufDrawCache
+ * @rect: the modified area, in image space coordinates
+ *
+ * Tells the cache that the pixels in @rect of the last drawn pixbuf
+ * have been modified. Only the part of the cached rendition showing
+ * them is scaled again, the rest stays good to use.
+ **/
+void
+uni_pixbuf_draw_cache_damage (UniPixbufDrawCache * cache,
+                              GdkRectangle * rect)
+{
+    UniPixbufDrawOpts *old = &cache->old;
+    GdkRectangle zoomed, inter;
+
+    /* Nothing valid is cached. */
+    if (old->zoom <= 0 || !rect->width || !rect->height)
+        return;
+
+    /* Widen the area by a source pixel on each side, which covers the
+       spread of the interpolation filters. */
+    zoomed.x = (int) floor ((rect->x - 1) * old->zoom);
+    zoomed.y = (int) floor ((rect->y - 1) * old->zoom);
+    zoomed.width =
+        (int) ceil ((rect->x + rect->width + 1) * old->zoom) - zoomed.x;
+    zoomed.height =
+        (int) ceil ((rect->y + rect->height + 1) * old->zoom) - zoomed.y;
+
+    if (!gdk_rectangle_intersect (&old->zoom_rect, &zoomed, &inter))
+        return;
+
+    uni_pixbuf_scale_blend (old->pixbuf,
+                            cache->last_pixbuf,
+                            inter.x - old->zoom_rect.x,
+                            inter.y - old->zoom_rect.y,
+                            inter.width, inter.height,
+                            -old->zoom_rect.x, -old->zoom_rect.y,
+                            old->zoom, old->interp, inter.x, inter.y);
+}
+
+/**
+ * uni_pixbuf_draw_cache_set_frame:
+ * @cache: a #UniPixbufDrawCache
+ * @frame: index of the animation frame that is drawn next
+ *
+ * Switches the cache to the rendition of another animation frame.
+ *
+ * The rendition of the current frame is parked under its index
+ * and the one of @frame, if any, is brought back. As each rendition
+ * remembers the #UniPixbufDrawOpts it was drawn with,
+ * uni_pixbuf_draw_cache_get_method() only scales a frame again when
+ * the zoom or the viewport has changed since it was last shown.
+ *
+ * Parked renditions are bounded in size. Once the bound is reached,
+ * the remaining frames share a single rendition and are scaled on
+ * every draw, like a plain pixbuf.
+ **/
+void
+uni_pixbuf_draw_cache_set_frame (UniPixbufDrawCache * cache, int frame)
+{
+    UniPixbufDrawCacheFrame *slot = NULL;
+    GdkPixbuf *spare = cache->last_pixbuf;
+
+    if (frame == cache->frame)
+        return;
+
+    if (cache->frame >= 0)
+    {
+        gsize size = uni_pixbuf_get_byte_size (cache->last_pixbuf);
+        if (cache->frames_size + size <= UNI_PIXBUF_DRAW_CACHE_FRAMES_SIZE)
+        {
+            slot = g_new (UniPixbufDrawCacheFrame, 1);
+            slot->last_pixbuf = cache->last_pixbuf;
+            slot->old = cache->old;
+            if ((guint) cache->frame >= cache->frames->len)
+                g_ptr_array_set_size (cache->frames, cache->frame + 1);
+            g_ptr_array_index (cache->frames, cache->frame) = slot;
+            cache->frames_size += size;
+            spare = NULL;
+        }
+    }
+
+    cache->frame = frame;
+    slot = NULL;
+    if (frame >= 0 && (guint) frame < cache->frames->len)
+    {
+        slot = g_ptr_array_index (cache->frames, frame);
+        g_ptr_array_index (cache->frames, frame) = NULL;
+    }
+
+    if (slot)
+    {
+        if (spare)
+            g_object_unref (spare);
+        cache->last_pixbuf = slot->last_pixbuf;
+        cache->old = slot->old;
+        cache->frames_size -= uni_pixbuf_get_byte_size (slot->last_pixbuf);
+        g_free (slot);
+        return;
+    }
+
+    if (!spare)
+        spare = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 1, 1);
+    cache->last_pixbuf = spare;
+    cache->old.zoom = -1234.0;
+}
+
 static GdkPixbuf *
 uni_pixbuf_draw_cache_scroll_intersection (GdkPixbuf * pixbuf,
                                            int new_width,
@@ -77,11 +77,23 @@ struct _UniPixbufDrawCache {
     GdkPixbuf *last_pixbuf;
     UniPixbufDrawOpts old;
     int check_size;
+
+    /* Scaled renditions of the animation frames which are not on
+     * screen, indexed by frame. See uni_pixbuf_draw_cache_set_frame(). */
+    GPtrArray *frames;
+    gsize frames_size;
+
+    /* Frame that last_pixbuf and old belong to, or -1. */
+    int frame;
 };
 
 UniPixbufDrawCache* uni_pixbuf_draw_cache_new   (void);
 void    uni_pixbuf_draw_cache_free          (UniPixbufDrawCache * cache);
 void    uni_pixbuf_draw_cache_invalidate    (UniPixbufDrawCache * cache);
+void    uni_pixbuf_draw_cache_damage        (UniPixbufDrawCache * cache,
+                                             GdkRectangle * rect);
+void    uni_pixbuf_draw_cache_set_frame     (UniPixbufDrawCache * cache,
+                                             int frame);
 void    uni_pixbuf_draw_cache_draw          (UniPixbufDrawCache * cache,
                                              UniPixbufDrawOpts * opts,
                                              GdkWindow * window);
@@ -134,7 +134,16 @@ void
 uni_dragger_pixbuf_changed (UniDragger * tool,
                             gboolean reset_fit, GdkRectangle * rect)
 {
-    uni_pixbuf_draw_cache_invalidate (tool->cache);
+    if (rect)
+        uni_pixbuf_draw_cache_damage (tool->cache, rect);
+    else
+        uni_pixbuf_draw_cache_invalidate (tool->cache);
+}
+
+void
+uni_dragger_frame_changed (UniDragger * tool, int frame)
+{
+    uni_pixbuf_draw_cache_set_frame (tool->cache, frame);
 }
 
 void
@@ -83,6 +83,7 @@ void    uni_dragger_pixbuf_changed      (UniDragger * tool,
                                          gboolean reset_fit,
                                          GdkRectangle * rect);
 
+void    uni_dragger_frame_changed       (UniDragger * tool, int frame);
 
 void    uni_dragger_paint_image         (UniDragger * tool,
                                          UniPixbufDrawOpts * opts,
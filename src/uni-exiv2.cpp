@@ -21,6 +21,8 @@
  */
 
 #include <exiv2/exiv2.hpp>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
 #include "uni-exiv2.hpp"
@@ -29,13 +31,40 @@
 
 static Exiv2::Image::AutoPtr cached_image;
 
+/* Exiv2 sets up its XMP parser on first use, which is only safe while
+ * a single thread uses it. Previews are read on the workers. */
+static gpointer
+uni_init_exiv2_once(gpointer data)
+{
+    Exiv2::LogMsg::setLevel(Exiv2::LogMsg::mute);
+    Exiv2::XmpParser::initialize();
+    return NULL;
+}
+
+static void
+uni_init_exiv2()
+{
+    static GOnce once = G_ONCE_INIT;
+
+    g_once(&once, uni_init_exiv2_once, NULL);
+}
+
+/* Opens an image over bytes already in memory. MemIo only copies them
+ * if asked to write. */
+static Exiv2::Image::AutoPtr
+uni_open_exiv2_from_memory(const unsigned char *data, long size)
+{
+    Exiv2::BasicIo::AutoPtr io(new Exiv2::MemIo(data, size));
+    return Exiv2::ImageFactory::open(io);
+}
+
 extern "C"
 void
-uni_read_exiv2_map(const char *uri, void (*callback)(const char*, const char*, void*), void *user_data)
+uni_read_exiv2_map(const unsigned char *data, long size, void (*callback)(const char*, const char*, void*), void *user_data)
 {
-    Exiv2::LogMsg::setLevel(Exiv2::LogMsg::mute);
+    uni_init_exiv2();
     try {
-        Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(uri);
+        Exiv2::Image::AutoPtr image = uni_open_exiv2_from_memory(data, size);
         if ( image.get() == 0 ) {
             return;
         }
@@ -87,9 +116,9 @@ uni_read_exiv2_map(const char *uri, void (*callback)(const char*, const char*, v
 
 extern "C"
 int
-uni_read_exiv2_to_cache(const char *uri)
+uni_read_exiv2_to_cache(const unsigned char *data, long size)
 {
-    Exiv2::LogMsg::setLevel(Exiv2::LogMsg::mute);
+    uni_init_exiv2();
 
     if ( cached_image.get() != NULL ) {
         cached_image->clearMetadata();
@@ -97,7 +126,7 @@ uni_read_exiv2_to_cache(const char *uri)
     }
 
     try {
-        cached_image = Exiv2::ImageFactory::open(uri);
+        cached_image = uni_open_exiv2_from_memory(data, size);
         if ( cached_image.get() == 0 ) {
             return 1;
         }
@@ -110,11 +139,72 @@ uni_read_exiv2_to_cache(const char *uri)
     return 0;
 }
 
+/* Reads the smallest preview embedded in the image which is at least
+ * @min_size pixels wide or high, into a buffer to be freed with
+ * g_free(). Previews of another shape than the image, letterboxed by
+ * the camera, are skipped. Returns the Exif orientation of the image,
+ * which the previews share, or 1 if it has none. */
+extern "C"
+int
+uni_read_exiv2_preview(const unsigned char *data, long size, int min_size,
+                       unsigned char **preview, long *preview_size)
+{
+    int orientation = 1;
+
+    uni_init_exiv2();
+    *preview = NULL;
+    *preview_size = 0;
+
+    try {
+        Exiv2::Image::AutoPtr image = uni_open_exiv2_from_memory(data, size);
+        if ( image.get() == 0 ) {
+            return orientation;
+        }
+
+        image->readMetadata();
+        Exiv2::ExifData &exifData = image->exifData();
+        Exiv2::ExifData::const_iterator pos = Exiv2::orientation(exifData);
+        if ( pos != exifData.end() && pos->count() > 0 ) {
+            orientation = pos->toLong();
+        }
+
+        double width = image->pixelWidth();
+        double height = image->pixelHeight();
+
+        Exiv2::PreviewManager manager(*image);
+        Exiv2::PreviewPropertiesList list = manager.getPreviewProperties();
+
+        /* The list is sorted by size, smallest first */
+        for ( uint i = 0; i < list.size(); i++ ) {
+            const Exiv2::PreviewProperties &props = list[i];
+
+            if ( (int) props.width_ < min_size && (int) props.height_ < min_size ) {
+                continue;
+            }
+            if ( width > 0 && height > 0 &&
+                 fabs(props.width_ / width - props.height_ / height) >
+                 0.02 * props.width_ / width ) {
+                continue;
+            }
+
+            Exiv2::PreviewImage previewImage = manager.getPreviewImage(props);
+            *preview = (unsigned char *) g_malloc(previewImage.size());
+            memcpy(*preview, previewImage.pData(), previewImage.size());
+            *preview_size = previewImage.size();
+            break;
+        }
+    } catch (Exiv2::AnyError& e) {
+        std::cerr << "Exiv2: '" << e << "'\n";
+    }
+
+    return orientation;
+}
+
 extern "C"
 int
 uni_write_exiv2_from_cache(const char *uri)
 {
-    Exiv2::LogMsg::setLevel(Exiv2::LogMsg::mute);
+    uni_init_exiv2();
 
     if ( cached_image.get() == NULL ) {
         return 1;
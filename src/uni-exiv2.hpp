@@ -70,11 +70,14 @@ extern "C" {
 
 #endif /* __cplusplus */
 
-void    uni_read_exiv2_map          (const char *uri, 
+void    uni_read_exiv2_map          (const unsigned char *data, long size,
                                      void (*callback)(const char*, const char*, void*), 
                                      void *user_data);
 
-int     uni_read_exiv2_to_cache     (const char *uri);
+int     uni_read_exiv2_to_cache     (const unsigned char *data, long size);
+int     uni_read_exiv2_preview      (const unsigned char *data, long size,
+                                     int min_size, unsigned char **preview,
+                                     long *preview_size);
 int     uni_write_exiv2_from_cache  (const char *uri);
 
 #ifdef __cplusplus
@@ -72,10 +72,16 @@ uni_image_view_get_pixbuf_size (UniImageView * view)
     Size s = { 0, 0 };
     if (!view->pixbuf)
         return s;
+    return uni_pixbuf_get_image_size (view->pixbuf);
+}
 
-    s.width = gdk_pixbuf_get_width (view->pixbuf);
-    s.height = gdk_pixbuf_get_height (view->pixbuf);
-    return s;
+/* Zoom at which the pixbuf is drawn, which is the one of the view
+ * unless the pixbuf is an overview of a larger image. */
+static gdouble
+uni_image_view_get_pixbuf_zoom (UniImageView * view)
+{
+    Size s = uni_image_view_get_pixbuf_size (view);
+    return view->zoom * gdk_pixbuf_get_width (view->pixbuf) / s.width;
 }
 
 static Size
@@ -236,6 +242,225 @@ uni_image_view_draw_background (UniImageView * view,
     }
 }
 
+/**
+ * uni_image_view_queue_draw_image_area:
+ * @rect: The rectangle, in image space coordinates, to redraw.
+ *
+ * Queues a redraw of the part of the widget showing @rect. The area
+ * is widened by a pixel of the image on each side, because the
+ * interpolation filters spread each pixel over its neighbours.
+ **/
+static void
+uni_image_view_queue_draw_image_area (UniImageView * view,
+                                      GdkRectangle * rect)
+{
+    GdkRectangle image_area, area, widget_rect;
+
+    if (!rect->width || !rect->height ||
+        !uni_image_view_get_draw_rect (view, &image_area))
+        return;
+
+    area.x = (int) floor ((rect->x - 1) * view->zoom - view->offset_x);
+    area.y = (int) floor ((rect->y - 1) * view->zoom - view->offset_y);
+    area.width = (int) ceil ((rect->x + rect->width + 1) * view->zoom
+                             - view->offset_x) - area.x;
+    area.height = (int) ceil ((rect->y + rect->height + 1) * view->zoom
+                              - view->offset_y) - area.y;
+    area.x += image_area.x;
+    area.y += image_area.y;
+
+    if (gdk_rectangle_intersect (&image_area, &area, &widget_rect))
+        gtk_widget_queue_draw_area (GTK_WIDGET (view),
+                                    widget_rect.x, widget_rect.y,
+                                    widget_rect.width, widget_rect.height);
+}
+
+/**
+ * uni_image_view_paint_pixels:
+ * @image_area: The area of the widget the image is drawn in.
+ * @paint_area: The area of the widget to redraw.
+ * @rect: The area of the image, in image space coordinates, that
+ *   @pixbuf shows.
+ *
+ * Draws @pixbuf, a part of the image at any resolution, over the
+ * overview it is part of, where it covers @paint_area.
+ **/
+static void
+uni_image_view_paint_pixels (UniImageView * view,
+                             GdkRectangle * image_area,
+                             GdkRectangle * paint_area,
+                             GdkRectangle * rect, GdkPixbuf * pixbuf)
+{
+    GdkRectangle area, inter;
+    GdkPixbuf *dst;
+
+    area.x = (int) floor (rect->x * view->zoom - view->offset_x);
+    area.y = (int) floor (rect->y * view->zoom - view->offset_y);
+    area.width = (int) ceil ((rect->x + rect->width) * view->zoom
+                             - view->offset_x) - area.x;
+    area.height = (int) ceil ((rect->y + rect->height) * view->zoom
+                              - view->offset_y) - area.y;
+    area.x += image_area->x;
+    area.y += image_area->y;
+    if (!gdk_rectangle_intersect (paint_area, &area, &inter))
+        return;
+
+    gdouble src_x = view->offset_x + inter.x - image_area->x;
+    gdouble src_y = view->offset_y + inter.y - image_area->y;
+
+    dst = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                          inter.width, inter.height);
+    uni_pixbuf_scale_blend (pixbuf, dst,
+                            0, 0, inter.width, inter.height,
+                            rect->x * view->zoom - src_x,
+                            rect->y * view->zoom - src_y,
+                            view->zoom * rect->width /
+                            gdk_pixbuf_get_width (pixbuf),
+                            view->interp, (int) src_x, (int) src_y);
+    gdk_draw_pixbuf (gtk_widget_get_window (GTK_WIDGET (view)), NULL, dst,
+                     0, 0, inter.x, inter.y, inter.width, inter.height,
+                     GDK_RGB_DITHER_MAX, inter.x, inter.y);
+    g_object_unref (dst);
+}
+
+/**
+ * uni_image_view_get_tile_range:
+ * @area: An area of the widget, in widget space coordinates relative
+ *   to the image area.
+ * @range: Set to the columns and rows of the tiles covering @area.
+ *
+ * Returns the level of the tiles to draw the image with at the
+ * current zoom, or -1 if the pixbuf has enough detail already.
+ **/
+static int
+uni_image_view_get_tile_range (UniImageView * view,
+                               GdkRectangle * area, GdkRectangle * range)
+{
+    Size img = uni_image_view_get_pixbuf_size (view);
+    int level, size, x0, y0, x1, y1;
+
+    if (!view->tile_source || uni_image_view_get_pixbuf_zoom (view) <= 1.0)
+        return -1;
+
+    /* The coarsest level which still has a pixel per screen pixel */
+    level = (int) floor (log2 (1.0 / view->zoom));
+    level = MAX (level, 0);
+    size = UNI_TILE_SIZE << level;
+
+    x0 = (int) floor ((view->offset_x + area->x) / view->zoom);
+    y0 = (int) floor ((view->offset_y + area->y) / view->zoom);
+    x1 = (int) ceil ((view->offset_x + area->x + area->width) / view->zoom);
+    y1 = (int) ceil ((view->offset_y + area->y + area->height) / view->zoom);
+    x0 = CLAMP (x0, 0, img.width - 1);
+    y0 = CLAMP (y0, 0, img.height - 1);
+    x1 = CLAMP (x1, x0 + 1, img.width);
+    y1 = CLAMP (y1, y0 + 1, img.height);
+
+    range->x = x0 / size;
+    range->y = y0 / size;
+    range->width = (x1 - 1) / size - range->x + 1;
+    range->height = (y1 - 1) / size - range->y + 1;
+    return level;
+}
+
+/**
+ * uni_image_view_paint_tiles:
+ * @image_area: The area of the widget the image is drawn in.
+ * @paint_area: The area of the widget to redraw.
+ *
+ * Draws the tiles held for the current zoom over the overview, where
+ * they cover @paint_area. Missing tiles leave the overview showing.
+ **/
+static void
+uni_image_view_paint_tiles (UniImageView * view,
+                            GdkRectangle * image_area,
+                            GdkRectangle * paint_area)
+{
+    Size img = uni_image_view_get_pixbuf_size (view);
+    GdkRectangle whole = { 0, 0, img.width, img.height };
+    GdkRectangle area, range, rect;
+    UniTileKey key;
+    GdkPixbuf *tile;
+
+    area = *paint_area;
+    area.x -= image_area->x;
+    area.y -= image_area->y;
+    key.level = uni_image_view_get_tile_range (view, &area, &range);
+    if (key.level < 0)
+        return;
+
+    for (key.row = range.y; key.row < range.y + range.height; key.row++)
+        for (key.col = range.x; key.col < range.x + range.width; key.col++)
+        {
+            tile = uni_tile_cache_lookup (view->tiles, &key);
+            if (!tile)
+                continue;
+            uni_tile_get_rect (&key, &rect);
+            gdk_rectangle_intersect (&whole, &rect, &rect);
+            uni_image_view_paint_pixels (view, image_area, paint_area,
+                                         &rect, tile);
+        }
+}
+
+/**
+ * uni_image_view_request_tiles:
+ *
+ * Asks the tile source for the tiles the viewport needs at the
+ * current zoom and does not have, the visible ones first and then a
+ * ring of tiles around them for scrolling. Nothing is asked for as
+ * long as the viewport stays on the same tiles.
+ **/
+static void
+uni_image_view_request_tiles (UniImageView * view)
+{
+    Size img = uni_image_view_get_pixbuf_size (view);
+    GdkRectangle viewport, range, outer;
+    GArray *keys;
+    UniTileKey key;
+    int level, size, pass;
+
+    if (!view->tile_source || !uni_image_view_get_viewport (view, &viewport))
+        return;
+
+    viewport.x -= (int) view->offset_x;
+    viewport.y -= (int) view->offset_y;
+    level = uni_image_view_get_tile_range (view, &viewport, &range);
+    if (level < 0)
+        return;
+    if (level == view->tiles_level &&
+        uni_rectangle_contains_rect (view->tiles_range, range))
+        return;
+    view->tiles_level = level;
+    view->tiles_range = range;
+
+    size = UNI_TILE_SIZE << level;
+    outer.x = MAX (range.x - 1, 0);
+    outer.y = MAX (range.y - 1, 0);
+    outer.width = MIN (range.x + range.width + 1,
+                       (img.width + size - 1) / size) - outer.x;
+    outer.height = MIN (range.y + range.height + 1,
+                        (img.height + size - 1) / size) - outer.y;
+
+    keys = g_array_new (FALSE, FALSE, sizeof (UniTileKey));
+    key.level = level;
+    for (pass = 0; pass < 2; pass++)
+        for (key.row = outer.y; key.row < outer.y + outer.height; key.row++)
+            for (key.col = outer.x; key.col < outer.x + outer.width; key.col++)
+            {
+                gboolean visible =
+                    key.col >= range.x && key.col < range.x + range.width &&
+                    key.row >= range.y && key.row < range.y + range.height;
+
+                if (visible == (pass == 0) &&
+                    !uni_tile_cache_lookup (view->tiles, &key))
+                    g_array_append_val (keys, key);
+            }
+
+    view->tile_source->request (view->tile_source,
+                                (UniTileKey *) keys->data, keys->len);
+    g_array_free (keys, TRUE);
+}
+
 /**
  * uni_image_view_repaint_area:
  * @paint_rect: The rectangle on the widget that needs to be redrawn.
@@ -281,7 +506,7 @@ uni_image_view_repaint_area (UniImageView * view, GdkRectangle * paint_rect)
                     (gdouble) image_area.y) + 0.5);
 
         UniPixbufDrawOpts opts = {
-            view->zoom,
+            uni_image_view_get_pixbuf_zoom (view),
             (GdkRectangle) {src_x, src_y,
                             paint_area.width, paint_area.height},
             paint_area.x, paint_area.y,
@@ -290,6 +515,9 @@ uni_image_view_repaint_area (UniImageView * view, GdkRectangle * paint_rect)
         };
         uni_dragger_paint_image (UNI_DRAGGER(view->tool), &opts,
                                  gtk_widget_get_window (widget));
+
+        uni_image_view_paint_tiles (view, &image_area, &paint_area);
+        uni_image_view_request_tiles (view);
     }
 
     view->is_rendering = FALSE;
@@ -787,6 +1015,9 @@ uni_image_view_init (UniImageView * view)
     view->interp = GDK_INTERP_BILINEAR;
     view->fitting = UNI_FITTING_NORMAL;
     view->pixbuf = NULL;
+    view->tile_source = NULL;
+    view->tiles = uni_tile_cache_new ();
+    view->tiles_level = -1;
     view->zoom = 1.0;
     view->offset_x = 0.0;
     view->offset_y = 0.0;
@@ -831,6 +1062,12 @@ uni_image_view_finalize (GObject * object)
         g_object_unref (view->pixbuf);
         view->pixbuf = NULL;
     }
+    if (view->tile_source)
+    {
+        view->tile_source->free (view->tile_source);
+        view->tile_source = NULL;
+    }
+    uni_tile_cache_free (view->tiles);
     g_object_unref (view->tool);
     /* Chain up. */
     G_OBJECT_CLASS (uni_image_view_parent_class)->finalize (object);
@@ -1221,6 +1458,8 @@ uni_image_view_set_pixbuf (UniImageView * view,
             g_object_ref (pixbuf);
     }
 
+    uni_image_view_set_tile_source (view, NULL);
+
     if (reset_fit)
         uni_image_view_set_fitting (view, UNI_FITTING_NORMAL);
     else
@@ -1242,6 +1481,111 @@ uni_image_view_set_pixbuf (UniImageView * view,
     uni_dragger_pixbuf_changed (UNI_DRAGGER(view->tool), reset_fit, NULL);
 }
 
+/**
+ * uni_image_view_set_frame:
+ * @view: A #UniImageView.
+ * @pixbuf: The animation frame to display.
+ * @frame: The index of @pixbuf in its animation.
+ * @damage: The area, in image space coordinates, in which @pixbuf
+ *   differs from the frame shown before, or %NULL if unknown.
+ *
+ * Shows another frame of the animation currently displayed. Unlike
+ * uni_image_view_set_pixbuf(), the draw cache keeps the scaled
+ * renditions of the other frames, so a frame which has already been
+ * shown at the current zoom and viewport is blitted instead of being
+ * scaled again. Only the part of the widget covering @damage is
+ * redrawn.
+ *
+ * Frames are expected to have the same size. If @pixbuf does not,
+ * this is the same as calling uni_image_view_set_pixbuf() with
+ * @reset_fit set to %FALSE.
+ *
+ * The ::pixbuf-changed signal is emitted.
+ **/
+void
+uni_image_view_set_frame (UniImageView * view,
+                          GdkPixbuf * pixbuf,
+                          int frame, GdkRectangle * damage)
+{
+    Size old_size = uni_image_view_get_pixbuf_size (view);
+
+    if (!view->pixbuf ||
+        old_size.width != gdk_pixbuf_get_width (pixbuf) ||
+        old_size.height != gdk_pixbuf_get_height (pixbuf))
+    {
+        uni_image_view_set_pixbuf (view, pixbuf, FALSE);
+        return;
+    }
+
+    if (view->pixbuf != pixbuf)
+    {
+        g_object_unref (view->pixbuf);
+        view->pixbuf = g_object_ref (pixbuf);
+    }
+
+    if (damage)
+        uni_image_view_queue_draw_image_area (view, damage);
+    else
+        gtk_widget_queue_draw (GTK_WIDGET (view));
+
+    g_signal_emit (G_OBJECT (view),
+                   uni_image_view_signals[PIXBUF_CHANGED], 0);
+    uni_dragger_frame_changed (UNI_DRAGGER(view->tool), frame);
+}
+
+/**
+ * uni_image_view_set_tile_source:
+ * @view: A #UniImageView.
+ * @source: The #UniTileSource of the image, or %NULL.
+ *
+ * Sets where the tiles of the image come from when the pixbuf is an
+ * overview of it, see uni_pixbuf_set_image_size(). Zooming in past
+ * the resolution of the overview then draws the tiles of the
+ * viewport as they are decoded. The view takes ownership of @source,
+ * which is freed along with the tiles when another source or pixbuf
+ * is set.
+ **/
+void
+uni_image_view_set_tile_source (UniImageView * view,
+                                UniTileSource * source)
+{
+    g_return_if_fail (UNI_IS_IMAGE_VIEW (view));
+
+    if (view->tile_source)
+        view->tile_source->free (view->tile_source);
+    view->tile_source = source;
+    view->tiles_level = -1;
+    uni_tile_cache_clear (view->tiles);
+
+    if (source)
+        gtk_widget_queue_draw (GTK_WIDGET (view));
+}
+
+/**
+ * uni_image_view_add_tile:
+ * @view: A #UniImageView.
+ * @key: The tile @pixbuf is.
+ * @pixbuf: The pixels of the tile, of the image within it.
+ *
+ * Hands over a tile asked for from the tile source. The part of the
+ * widget it covers is redrawn.
+ **/
+void
+uni_image_view_add_tile (UniImageView * view,
+                         const UniTileKey * key, GdkPixbuf * pixbuf)
+{
+    GdkRectangle rect;
+
+    g_return_if_fail (UNI_IS_IMAGE_VIEW (view));
+
+    uni_tile_cache_insert (view->tiles, key, pixbuf);
+    if (key->level != view->tiles_level)
+        return;
+
+    uni_tile_get_rect (key, &rect);
+    uni_image_view_queue_draw_image_area (view, &rect);
+}
+
 /**
  * uni_image_view_set_zoom:
  * @view: a #UniImageView
@@ -1313,3 +1657,32 @@ uni_image_view_zoom_out (UniImageView * view)
     zoom = CLAMP (view->zoom / UNI_ZOOM_STEP, UNI_ZOOM_MIN, UNI_ZOOM_MAX);
     uni_image_view_set_zoom (view, zoom);
 }
+
+/**
+ * uni_image_view_damage_pixels:
+ * @view: a #UniImageView
+ * @rect: #GdkRectangle in image space coordinates to mark as damaged
+ *   or %NULL, to mark the whole pixbuf as damaged.
+ *
+ * Mark the pixels in the rectangle as damaged. That the pixels are
+ * damaged means that they have been modified and that the view must
+ * redraw them to ensure that the visible part of the image
+ * corresponds to the pixels in that image. Only the damaged part of
+ * the widget is scaled and redrawn.
+ *
+ * The ::pixbuf-changed signal is emitted.
+ **/
+void
+uni_image_view_damage_pixels (UniImageView * view, GdkRectangle * rect)
+{
+    g_return_if_fail (UNI_IS_IMAGE_VIEW (view));
+
+    if (rect)
+        uni_image_view_queue_draw_image_area (view, rect);
+    else
+        gtk_widget_queue_draw (GTK_WIDGET (view));
+
+    g_signal_emit (G_OBJECT (view),
+                   uni_image_view_signals[PIXBUF_CHANGED], 0);
+    uni_dragger_pixbuf_changed (UNI_DRAGGER(view->tool), FALSE, rect);
+}
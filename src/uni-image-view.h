@@ -27,6 +27,7 @@
 #include <gtk/gtk.h>
 
 #include "vnr-prefs.h"
+#include "uni-tile-cache.h"
 
 G_BEGIN_DECLS
 #define UNI_TYPE_IMAGE_VIEW             (uni_image_view_get_type ())
@@ -51,6 +52,12 @@ struct _UniImageView {
     GdkInterpType interp;
     UniFittingMode fitting;
     GdkPixbuf *pixbuf;
+    /* Tiles drawn over the pixbuf when it is an overview of a larger
+     * image, and the level and range of them last asked for. */
+    UniTileSource *tile_source;
+    UniTileCache *tiles;
+    int tiles_level;
+    GdkRectangle tiles_range;
     gdouble zoom;
     /* Offset in zoom space coordinates of the image area in the
      * widget. */
@@ -109,6 +116,12 @@ GdkPixbuf*  uni_image_view_get_pixbuf   (UniImageView * view);
 void        uni_image_view_set_pixbuf   (UniImageView * view,
                                          GdkPixbuf * pixbuf,
                                          gboolean reset_fit);
+void        uni_image_view_set_frame    (UniImageView * view,
+                                         GdkPixbuf * pixbuf,
+                                         int frame,
+                                         GdkRectangle * damage);
+void        uni_image_view_set_tile_source (UniImageView * view,
+                                            UniTileSource * source);
 
 void        uni_image_view_set_zoom      (UniImageView * view, gdouble zoom);
 void        uni_image_view_set_zoom_mode (UniImageView * view, VnrPrefsZoom mode);
@@ -118,6 +131,9 @@ void        uni_image_view_zoom_in      (UniImageView * view);
 void        uni_image_view_zoom_out     (UniImageView * view);
 void        uni_image_view_damage_pixels(UniImageView * view,
                                          GdkRectangle * rect);
+void        uni_image_view_add_tile     (UniImageView * view,
+                                         const UniTileKey * key,
+                                         GdkPixbuf * pixbuf);
 
 G_END_DECLS
 #endif /* __UNI_IMAGE_VIEW_H__ */
@@ -40,11 +40,10 @@ uni_nav_get_zoom (UniNav * nav)
         return 0.0;
     }
 
-    int img_width = gdk_pixbuf_get_width (pixbuf);
-    int img_height = gdk_pixbuf_get_height (pixbuf);
+    Size img = uni_pixbuf_get_image_size (pixbuf);
 
-    gdouble width_zoom = (gdouble) UNI_NAV_MAX_WIDTH / (gdouble) img_width;
-    gdouble height_zoom = (gdouble) UNI_NAV_MAX_HEIGHT / (gdouble) img_height;
+    gdouble width_zoom = (gdouble) UNI_NAV_MAX_WIDTH / (gdouble) img.width;
+    gdouble height_zoom = (gdouble) UNI_NAV_MAX_HEIGHT / (gdouble) img.height;
     return MIN (width_zoom, height_zoom);
 }
 
@@ -57,14 +56,13 @@ uni_nav_get_preview_size (UniNav * nav)
         return (Size)
     {
     UNI_NAV_MAX_WIDTH, UNI_NAV_MAX_HEIGHT};
-    int img_width = gdk_pixbuf_get_width (pixbuf);
-    int img_height = gdk_pixbuf_get_height (pixbuf);
+    Size img = uni_pixbuf_get_image_size (pixbuf);
 
     gdouble zoom = uni_nav_get_zoom (nav);
 
     Size s;
-    s.width = (int) (img_width * zoom + 0.5);
-    s.height = (int) (img_height * zoom + 0.5);
+    s.width = (int) (img.width * zoom + 0.5);
+    s.height = (int) (img.height * zoom + 0.5);
     return s;
 }
 
@@ -162,7 +160,9 @@ uni_nav_update_pixbuf (UniNav * nav)
     uni_pixbuf_scale_blend (pixbuf, nav->pixbuf,
                             0, 0, pw.width, pw.height,
                             0, 0,
-                            uni_nav_get_zoom (nav),
+                            uni_nav_get_zoom (nav) *
+                            gdk_pixbuf_get_width (pixbuf) /
+                            uni_pixbuf_get_image_size (pixbuf).width,
                             GDK_INTERP_BILINEAR, 0, 0);
     // Lower the flag so the pixbuf isn't recreated more than
     // necessarily.
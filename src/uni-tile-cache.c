@@ -0,0 +1,167 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uni-tile-cache.h"
+
+/* Upper bound for the memory held by decoded tiles. */
+#define UNI_TILE_CACHE_SIZE (96 * 1024 * 1024)
+
+typedef struct {
+    UniTileKey key;
+    GdkPixbuf *pixbuf;
+
+    /* Link of the tile in the LRU queue */
+    GList *link;
+} UniTileCacheEntry;
+
+static guint
+uni_tile_key_hash (gconstpointer key)
+{
+    const UniTileKey *k = key;
+
+    return (k->col * 65599 + k->row) * 31 + k->level;
+}
+
+static gboolean
+uni_tile_key_equal (gconstpointer a, gconstpointer b)
+{
+    const UniTileKey *ka = a;
+    const UniTileKey *kb = b;
+
+    return ka->level == kb->level && ka->col == kb->col && ka->row == kb->row;
+}
+
+static gsize
+uni_tile_cache_entry_size (UniTileCacheEntry * entry)
+{
+    return (gsize) gdk_pixbuf_get_rowstride (entry->pixbuf) *
+        gdk_pixbuf_get_height (entry->pixbuf);
+}
+
+static void
+uni_tile_cache_entry_free (UniTileCacheEntry * entry)
+{
+    g_object_unref (entry->pixbuf);
+    g_slice_free (UniTileCacheEntry, entry);
+}
+
+static void
+uni_tile_cache_remove (UniTileCache * cache, UniTileCacheEntry * entry)
+{
+    cache->size -= uni_tile_cache_entry_size (entry);
+    g_queue_delete_link (cache->lru, entry->link);
+    g_hash_table_remove (cache->tiles, &entry->key);
+}
+
+UniTileCache *
+uni_tile_cache_new (void)
+{
+    UniTileCache *cache = g_new0 (UniTileCache, 1);
+
+    cache->tiles = g_hash_table_new_full (uni_tile_key_hash,
+                                          uni_tile_key_equal, NULL,
+                                          (GDestroyNotify)
+                                          uni_tile_cache_entry_free);
+    cache->lru = g_queue_new ();
+    return cache;
+}
+
+void
+uni_tile_cache_free (UniTileCache * cache)
+{
+    g_hash_table_destroy (cache->tiles);
+    g_queue_free (cache->lru);
+    g_free (cache);
+}
+
+/**
+ * uni_tile_cache_clear:
+ *
+ * Drops every tile, as when the image they belong to is replaced.
+ **/
+void
+uni_tile_cache_clear (UniTileCache * cache)
+{
+    g_queue_clear (cache->lru);
+    g_hash_table_remove_all (cache->tiles);
+    cache->size = 0;
+}
+
+/**
+ * uni_tile_cache_lookup:
+ *
+ * Returns the pixels of the tile @key, owned by the cache, or %NULL
+ * if it is not held. A tile found becomes the most recently used.
+ **/
+GdkPixbuf *
+uni_tile_cache_lookup (UniTileCache * cache, const UniTileKey * key)
+{
+    UniTileCacheEntry *entry = g_hash_table_lookup (cache->tiles, key);
+
+    if (!entry)
+        return NULL;
+
+    g_queue_unlink (cache->lru, entry->link);
+    g_queue_push_head_link (cache->lru, entry->link);
+    return entry->pixbuf;
+}
+
+/**
+ * uni_tile_cache_insert:
+ *
+ * Adds the tile @key, replacing the pixels held for it if any. The
+ * least recently used tiles are dropped to make room.
+ **/
+void
+uni_tile_cache_insert (UniTileCache * cache,
+                       const UniTileKey * key, GdkPixbuf * pixbuf)
+{
+    UniTileCacheEntry *entry = g_hash_table_lookup (cache->tiles, key);
+
+    if (entry)
+        uni_tile_cache_remove (cache, entry);
+
+    entry = g_slice_new (UniTileCacheEntry);
+    entry->key = *key;
+    entry->pixbuf = g_object_ref (pixbuf);
+    g_queue_push_head (cache->lru, entry);
+    entry->link = cache->lru->head;
+    g_hash_table_insert (cache->tiles, &entry->key, entry);
+    cache->size += uni_tile_cache_entry_size (entry);
+
+    while (cache->size > UNI_TILE_CACHE_SIZE && cache->lru->length > 1)
+        uni_tile_cache_remove (cache, g_queue_peek_tail (cache->lru));
+}
+
+/**
+ * uni_tile_get_rect:
+ *
+ * Sets @rect to the area of the image, at full resolution, that the
+ * tile @key covers. Tiles at the edges may extend past the image.
+ **/
+void
+uni_tile_get_rect (const UniTileKey * key, GdkRectangle * rect)
+{
+    int size = UNI_TILE_SIZE << key->level;
+
+    rect->x = key->col * size;
+    rect->y = key->row * size;
+    rect->width = size;
+    rect->height = size;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UNI_TILE_CACHE_H__
+#define __UNI_TILE_CACHE_H__
+
+#include <gdk/gdk.h>
+
+/* Width and height of a tile, in pixels of its level */
+#define UNI_TILE_SIZE 256
+
+typedef struct _UniTileKey UniTileKey;
+typedef struct _UniTileSource UniTileSource;
+typedef struct _UniTileCache UniTileCache;
+
+/**
+ * UniTileKey:
+ *
+ * Names a tile of an image. Level 0 is the image at full resolution,
+ * each level above it halves its size. Tile @col, @row of level @level
+ * thus covers UNI_TILE_SIZE << @level pixels of the image from
+ * (@col, @row) times that.
+ **/
+struct _UniTileKey {
+    int level;
+    int col;
+    int row;
+};
+
+/**
+ * UniTileSource:
+ *
+ * Decodes the tiles of an image too large to be held whole, for a
+ * #UniImageView that only shows an overview of it otherwise.
+ *
+ * @request is called with the tiles the view is missing, the most
+ * wanted first. It replaces the tiles asked for before, which the
+ * source may then drop. Tiles are handed back as they are decoded,
+ * with uni_image_view_add_tile(). @free is called once the view no
+ * longer uses the source.
+ **/
+struct _UniTileSource {
+    void (*request) (UniTileSource * source,
+                     const UniTileKey * keys, guint n_keys);
+    void (*free)    (UniTileSource * source);
+};
+
+/**
+ * UniTileCache:
+ *
+ * Holds the most recently used tiles, up to a number of bytes.
+ **/
+struct _UniTileCache {
+    GHashTable *tiles;
+
+    /* Keys of the tiles, the most recently used first */
+    GQueue *lru;
+    gsize size;
+};
+
+UniTileCache*   uni_tile_cache_new      (void);
+void            uni_tile_cache_free     (UniTileCache * cache);
+void            uni_tile_cache_clear    (UniTileCache * cache);
+GdkPixbuf*      uni_tile_cache_lookup   (UniTileCache * cache,
+                                         const UniTileKey * key);
+void            uni_tile_cache_insert   (UniTileCache * cache,
+                                         const UniTileKey * key,
+                                         GdkPixbuf * pixbuf);
+
+void            uni_tile_get_rect       (const UniTileKey * key,
+                                         GdkRectangle * rect);
+
+#endif /* __UNI_TILE_CACHE_H__ */
@@ -21,6 +21,7 @@
  */
 
 #include "uni-utils.h"
+#include <string.h>
 
 /**
  * uni_pixbuf_scale_blend:
@@ -56,6 +57,127 @@ uni_pixbuf_scale_blend (GdkPixbuf * src,
                           offset_x, offset_y, zoom, zoom, interp);
 }
 
+/**
+ * uni_pixbuf_set_image_size:
+ * @pixbuf: a reduced rendition of an image
+ * @width: width of the image at full resolution
+ * @height: height of the image at full resolution
+ *
+ * Marks @pixbuf as an overview of a larger image, for images too big
+ * to be decoded whole. Views then lay it out at the size of the image.
+ **/
+void
+uni_pixbuf_set_image_size (GdkPixbuf * pixbuf, int width, int height)
+{
+    Size *size = g_new (Size, 1);
+    size->width = width;
+    size->height = height;
+    g_object_set_data_full (G_OBJECT (pixbuf), "uni-image-size", size,
+                            g_free);
+}
+
+/**
+ * uni_pixbuf_get_image_size:
+ * @pixbuf: a #GdkPixbuf
+ * @returns: the size of the image @pixbuf shows, which is its own
+ *   unless it was set with uni_pixbuf_set_image_size()
+ **/
+Size
+uni_pixbuf_get_image_size (GdkPixbuf * pixbuf)
+{
+    Size *size = g_object_get_data (G_OBJECT (pixbuf), "uni-image-size");
+    Size s;
+
+    if (size)
+        return *size;
+    s.width = gdk_pixbuf_get_width (pixbuf);
+    s.height = gdk_pixbuf_get_height (pixbuf);
+    return s;
+}
+
+/**
+ * uni_pixbuf_get_changed_rect:
+ * @old: the previous contents of the image
+ * @new_: the current contents of the image
+ * @rect: set to the bounding box of the pixels that differ
+ * @returns: %FALSE if the two pixbufs are identical
+ *
+ * Finds the area that changed between two versions of an image, such
+ * as two consecutive frames of an animation. If the pixbufs differ in
+ * size or layout, @rect covers the whole of @new_.
+ **/
+gboolean
+uni_pixbuf_get_changed_rect (GdkPixbuf * old,
+                             GdkPixbuf * new_, GdkRectangle * rect)
+{
+    int width = gdk_pixbuf_get_width (new_);
+    int height = gdk_pixbuf_get_height (new_);
+    int chans = gdk_pixbuf_get_n_channels (new_);
+    int top, bottom, left, right, x, y;
+
+    rect->x = 0;
+    rect->y = 0;
+    rect->width = width;
+    rect->height = height;
+
+    if (gdk_pixbuf_get_width (old) != width ||
+        gdk_pixbuf_get_height (old) != height ||
+        gdk_pixbuf_get_n_channels (old) != chans ||
+        gdk_pixbuf_get_bits_per_sample (old) != 8 ||
+        gdk_pixbuf_get_bits_per_sample (new_) != 8)
+        return TRUE;
+
+    int old_stride = gdk_pixbuf_get_rowstride (old);
+    int new_stride = gdk_pixbuf_get_rowstride (new_);
+    const guchar *old_pixels = gdk_pixbuf_get_pixels (old);
+    const guchar *new_pixels = gdk_pixbuf_get_pixels (new_);
+    int linelen = width * chans;
+
+    for (top = 0; top < height; top++)
+        if (memcmp (old_pixels + top * old_stride,
+                    new_pixels + top * new_stride, linelen))
+            break;
+
+    if (top == height)
+    {
+        rect->width = 0;
+        rect->height = 0;
+        return FALSE;
+    }
+
+    for (bottom = height - 1; bottom > top; bottom--)
+        if (memcmp (old_pixels + bottom * old_stride,
+                    new_pixels + bottom * new_stride, linelen))
+            break;
+
+    left = width;
+    right = -1;
+    for (y = top; y <= bottom; y++)
+    {
+        const guchar *o = old_pixels + y * old_stride;
+        const guchar *n = new_pixels + y * new_stride;
+
+        for (x = 0; x < left; x++)
+            if (memcmp (o + x * chans, n + x * chans, chans))
+            {
+                left = x;
+                break;
+            }
+        for (x = width - 1; x > right; x--)
+            if (memcmp (o + x * chans, n + x * chans, chans))
+            {
+                right = x;
+                break;
+            }
+    }
+
+    rect->x = left;
+    rect->y = top;
+    rect->width = right - left + 1;
+    rect->height = bottom - top + 1;
+    return TRUE;
+}
+
 /**
  * uni_draw_rect:
  *
@@ -73,6 +195,16 @@ uni_draw_rect (GdkWindow * window,
                         rect->x, rect->y, rect->width - 1, rect->height - 1);
 }
 
+gboolean
+uni_rectangle_contains_rect (GdkRectangle r1, GdkRectangle r2)
+{
+    return
+        r1.x <= r2.x &&
+        r1.y <= r2.y &&
+        (r2.x + r2.width) <= (r1.x + r1.width) &&
+        (r2.y + r2.height) <= (r1.y + r1.height);
+}
+
 void
 uni_rectangle_get_rects_around (GdkRectangle * outer,
                                 GdkRectangle * inner, GdkRectangle around[4])
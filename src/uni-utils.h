@@ -46,9 +46,19 @@ void    uni_pixbuf_scale_blend          (GdkPixbuf * src,
                                          gdouble zoom,
                                          GdkInterpType interp, int check_x, int check_y);
 
+void    uni_pixbuf_set_image_size       (GdkPixbuf * pixbuf,
+                                         int width, int height);
+Size    uni_pixbuf_get_image_size       (GdkPixbuf * pixbuf);
+
+gboolean uni_pixbuf_get_changed_rect    (GdkPixbuf * old,
+                                         GdkPixbuf * new_,
+                                         GdkRectangle * rect);
+
 void    uni_draw_rect                   (GdkWindow * window,
                                          GdkGC * gc, gboolean filled, GdkRectangle * rect);
 
+gboolean uni_rectangle_contains_rect    (GdkRectangle r1, GdkRectangle r2);
+
 void    uni_rectangle_get_rects_around  (GdkRectangle * outer,
                                          GdkRectangle * inner,
                                          GdkRectangle around[4]);
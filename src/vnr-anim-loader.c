@@ -0,0 +1,368 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libintl.h>
+#include <glib/gi18n.h>
+#define _(String) gettext (String)
+
+#include <gtk/gtk.h>
+#include <gdk/gdkpixbuf.h>
+#include "vnr-anim-loader.h"
+
+/* Size of the writes fed to the loader. */
+#define VNR_ANIM_LOADER_CHUNK (64 * 1024)
+
+/* How far the loader may read past the point where playback last had
+ * to wait for it. */
+#define VNR_ANIM_LOADER_READ_AHEAD (4 * 1024 * 1024)
+
+/* Interval at which a loader which is far enough ahead checks whether
+ * playback has caught up. */
+#define VNR_ANIM_LOADER_WAIT 100
+
+/**
+ * VnrAnimLoader:
+ *
+ * Decodes an animation incrementally through the #GdkPixbufLoader of
+ * a #VnrLoadContext. The first frame is decoded synchronously, so that
+ * it can be shown right away. The rest of the file is fed from idle
+ * callbacks while the animation plays, staying at most
+ * %VNR_ANIM_LOADER_READ_AHEAD bytes ahead of the frame playback is
+ * waiting for.
+ **/
+struct _VnrAnimLoader {
+    GdkPixbufLoader *loader;
+    GdkPixbufAnimation *anim;
+    VnrLoadContext *context;
+    UniAnimView *view;
+
+    const guchar *data;
+    gsize length;
+
+    /* Bytes fed to the loader, and how many had been fed when playback
+     * last waited for the loader. */
+    gsize fed;
+    gsize frontier;
+
+    /* Whether the loader was closed, at the end of the file or by a
+     * failed write */
+    gboolean closed;
+
+    guint wait_id;
+    guint feed_id;
+};
+
+static void vnr_anim_loader_continue (VnrAnimLoader *loader);
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+/* Releases the loader and the file once all of it was fed. The
+ * animation stays alive as long as the view holds on to it. */
+static void
+vnr_anim_loader_finish (VnrAnimLoader *loader)
+{
+    if (loader->wait_id)
+        g_source_remove (loader->wait_id);
+    loader->wait_id = 0;
+    if (loader->feed_id)
+        g_source_remove (loader->feed_id);
+    loader->feed_id = 0;
+
+    if (loader->loader)
+    {
+        if (!loader->closed)
+            gdk_pixbuf_loader_close (loader->loader, NULL);
+        g_object_unref (loader->loader);
+        loader->loader = NULL;
+    }
+    if (loader->context)
+    {
+        vnr_load_context_unref (loader->context);
+        loader->context = NULL;
+    }
+}
+
+static void
+vnr_anim_loader_destroy (VnrAnimLoader *loader)
+{
+    vnr_anim_loader_finish (loader);
+    if (loader->anim)
+        g_object_unref (loader->anim);
+    if (loader->view)
+        g_object_unref (loader->view);
+    g_free (loader);
+}
+
+/* Feeds the next chunk of the file to the loader. Returns the number
+ * of bytes fed, 0 at the end of the file, or -1 on error. */
+static gssize
+vnr_anim_loader_feed (VnrAnimLoader *loader, GError **error)
+{
+    gsize count = MIN (loader->length - loader->fed, VNR_ANIM_LOADER_CHUNK);
+
+    if (count == 0)
+    {
+        loader->closed = TRUE;
+        return gdk_pixbuf_loader_close (loader->loader, error) ? 0 : -1;
+    }
+
+    /* A failed write closes the loader itself */
+    if (!gdk_pixbuf_loader_write (loader->loader, loader->data + loader->fed,
+                                  count, error))
+    {
+        loader->closed = TRUE;
+        return -1;
+    }
+
+    loader->fed += count;
+    return count;
+}
+
+static gboolean
+vnr_anim_loader_feed_cb (gpointer user_data)
+{
+    VnrAnimLoader *loader = user_data;
+    GError *error = NULL;
+
+    loader->feed_id = 0;
+
+    if (vnr_anim_loader_feed (loader, &error) <= 0)
+    {
+        if (error != NULL)
+        {
+            g_warning ("Error while loading animation: %s", error->message);
+            g_error_free (error);
+        }
+        vnr_anim_loader_finish (loader);
+        uni_anim_view_anim_updated (loader->view);
+        return FALSE;
+    }
+
+    uni_anim_view_anim_updated (loader->view);
+    vnr_anim_loader_continue (loader);
+    return FALSE;
+}
+
+static gboolean
+vnr_anim_loader_wait_cb (gpointer user_data)
+{
+    VnrAnimLoader *loader = user_data;
+
+    loader->wait_id = 0;
+    vnr_anim_loader_continue (loader);
+    return FALSE;
+}
+
+static void
+vnr_anim_loader_continue (VnrAnimLoader *loader)
+{
+    if (uni_anim_view_needs_data (loader->view))
+        loader->frontier = loader->fed;
+
+    if (loader->fed - loader->frontier >= VNR_ANIM_LOADER_READ_AHEAD)
+    {
+        loader->wait_id = g_timeout_add (VNR_ANIM_LOADER_WAIT,
+                                         vnr_anim_loader_wait_cb, loader);
+        return;
+    }
+
+    loader->feed_id = g_idle_add_full (G_PRIORITY_LOW,
+                                       vnr_anim_loader_feed_cb, loader, NULL);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_anim_loader_new:
+ * @context: the file to load
+ * @error: return location for a #GError
+ * @returns: a new #VnrAnimLoader, or %NULL on error
+ *
+ * Takes the loader of @context and decodes the file up to the end of
+ * its first frame. The animation is available through
+ * vnr_anim_loader_get_animation().
+ **/
+VnrAnimLoader *
+vnr_anim_loader_new (VnrLoadContext *context, GError **error)
+{
+    VnrAnimLoader *loader;
+    GdkPixbufLoader *pixbuf_loader;
+    GdkPixbufAnimationIter *iter = NULL;
+    gsize fed;
+
+    pixbuf_loader = vnr_load_context_take_loader (context, &fed, error);
+    if (pixbuf_loader == NULL)
+        return NULL;
+
+    loader = g_new0 (VnrAnimLoader, 1);
+    loader->loader = pixbuf_loader;
+    loader->context = vnr_load_context_ref (context);
+    loader->data = vnr_load_context_get_data (context, &loader->length);
+    loader->fed = fed;
+
+    while (loader->loader)
+    {
+        gssize count;
+
+        /* The first frame is complete once the loader has moved on to
+         * the second one. */
+        if (loader->anim == NULL)
+        {
+            loader->anim = gdk_pixbuf_loader_get_animation (loader->loader);
+            if (loader->anim != NULL)
+            {
+                g_object_ref (loader->anim);
+                iter = gdk_pixbuf_animation_get_iter (loader->anim, NULL);
+            }
+        }
+        if (iter != NULL &&
+            !gdk_pixbuf_animation_iter_on_currently_loading_frame (iter))
+            break;
+
+        /* Reaching the end means the whole file fit in the first
+         * frame. */
+        count = vnr_anim_loader_feed (loader, error);
+        if (count < 0)
+        {
+            if (iter != NULL)
+                g_object_unref (iter);
+            vnr_anim_loader_destroy (loader);
+            return NULL;
+        }
+
+        if (count == 0)
+        {
+            if (loader->anim == NULL)
+            {
+                loader->anim =
+                    gdk_pixbuf_loader_get_animation (loader->loader);
+                if (loader->anim != NULL)
+                    g_object_ref (loader->anim);
+            }
+            vnr_anim_loader_finish (loader);
+        }
+    }
+
+    if (iter != NULL)
+        g_object_unref (iter);
+
+    if (loader->anim == NULL)
+    {
+        g_set_error_literal (error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                             _("The image contains no frames."));
+        vnr_anim_loader_destroy (loader);
+        return NULL;
+    }
+
+    return loader;
+}
+
+/**
+ * vnr_anim_loader_free:
+ * @loader: a #VnrAnimLoader
+ *
+ * Stops decoding and releases @loader. Frames decoded so far stay in
+ * the animation.
+ **/
+void
+vnr_anim_loader_free (VnrAnimLoader *loader)
+{
+    if (loader == NULL)
+        return;
+
+    vnr_anim_loader_destroy (loader);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+/**
+ * vnr_anim_loader_get_animation:
+ * @loader: a #VnrAnimLoader
+ * @returns: the animation being loaded, owned by @loader
+ *
+ * The animation is available until vnr_anim_loader_start() is
+ * called, after which the view keeps it alive.
+ **/
+GdkPixbufAnimation *
+vnr_anim_loader_get_animation (VnrAnimLoader *loader)
+{
+    return loader->anim;
+}
+
+/**
+ * vnr_anim_loader_supports_format:
+ * @format: a #GdkPixbufFormat, or %NULL
+ * @returns: %TRUE if @format can hold animations
+ *
+ * Files of other formats gain nothing from incremental loading and
+ * are better loaded in one go.
+ **/
+gboolean
+vnr_anim_loader_supports_format (GdkPixbufFormat *format)
+{
+    static const gchar *animated[] = { "gif", "ani", "webp" };
+    gchar *name;
+    gboolean result = FALSE;
+    guint i;
+
+    if (format == NULL)
+        return FALSE;
+
+    name = gdk_pixbuf_format_get_name (format);
+    for (i = 0; i < G_N_ELEMENTS (animated); i++)
+    {
+        if (g_strcmp0 (name, animated[i]) == 0)
+            result = TRUE;
+    }
+    g_free (name);
+    return result;
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_anim_loader_start:
+ * @loader: a #VnrAnimLoader
+ * @view: the #UniAnimView playing the animation of @loader
+ *
+ * Reads the rest of the file in the background, keeping just ahead of
+ * the playback of @view.
+ **/
+void
+vnr_anim_loader_start (VnrAnimLoader *loader, UniAnimView *view)
+{
+    g_object_unref (loader->anim);
+    loader->anim = NULL;
+
+    if (loader->loader == NULL)
+        return;
+
+    loader->view = g_object_ref (view);
+    loader->frontier = loader->fed;
+    vnr_anim_loader_continue (loader);
+}
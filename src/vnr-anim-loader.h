@@ -0,0 +1,45 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VNR_ANIM_LOADER_H__
+#define __VNR_ANIM_LOADER_H__
+
+#include <gtk/gtk.h>
+#include "uni-anim-view.h"
+#include "vnr-load-context.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrAnimLoader VnrAnimLoader;
+
+/* Constructors */
+VnrAnimLoader      *vnr_anim_loader_new     (VnrLoadContext *context,
+                                             GError **error);
+void                vnr_anim_loader_free    (VnrAnimLoader *loader);
+
+/* Read-only properties */
+GdkPixbufAnimation *vnr_anim_loader_get_animation   (VnrAnimLoader *loader);
+gboolean            vnr_anim_loader_supports_format (GdkPixbufFormat *format);
+
+/* Actions */
+void                vnr_anim_loader_start   (VnrAnimLoader *loader,
+                                             UniAnimView *view);
+
+G_END_DECLS
+#endif /* __VNR_ANIM_LOADER_H__ */
@@ -0,0 +1,395 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <locale.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include "vnr-dir-index.h"
+#include "vnr-file.h"
+
+/* Indexes of the first version did not record which loaders and
+ * listing rules picked their files */
+#define VNR_DIR_INDEX_MAGIC "VNRIDX\0\2"
+
+/* Directories with fewer images are quick enough to read again */
+#define VNR_DIR_INDEX_MIN_FILES 256
+
+/* Most indexes kept, the least recently used being deleted first */
+#define VNR_DIR_INDEX_MAX_INDEXES 512
+
+/*
+ * An index file holds the images of one directory as last listed, so
+ * that opening it again needs neither reading the directory nor
+ * making collation keys. It is mapped into memory and its entries are
+ * copied into a file list, collation keys included:
+ *
+ *   VnrDirIndexHeader
+ *   VnrDirIndexEntry[n_entries], sorted like a VnrFileList
+ *   strings, each NUL-terminated, referred to by their offset
+ *
+ * Numbers are in the byte order of the machine, as the cache is not
+ * shared between machines. An index is only used if the directory was
+ * not modified since, strings were collated the same way and files
+ * were listed with the same loaders and rules, as told by
+ * vnr_file_get_filter_fingerprint().
+ *
+ * The modification time of an index file is the last time it was
+ * used. Before an index is written, the least recently used ones are
+ * deleted until fewer than VNR_DIR_INDEX_MAX_INDEXES are left.
+ */
+typedef struct {
+    gchar magic[8];
+    guint32 n_entries;
+    guint32 include_hidden;
+    gint64 stamp;
+    guint32 path;
+    guint32 locale;
+    guint32 strings_size;
+    guint32 filter;
+} VnrDirIndexHeader;
+
+typedef struct {
+    guint32 name;
+    guint32 display_name;
+    guint32 collate_key;
+    guint32 reserved;
+    gint64 mtime;
+    gint64 size;
+} VnrDirIndexEntry;
+
+/* An index file of the cache, when making room in it */
+typedef struct {
+    gchar *file;
+    gint64 used;
+} VnrDirIndexCacheEntry;
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static gchar *
+vnr_dir_index_get_file (const gchar *path, gboolean include_hidden)
+{
+    gchar *key, *checksum, *name, *file;
+
+    key = g_strdup_printf ("%s%c%d", path, '\0', include_hidden);
+    checksum = g_compute_checksum_for_data (G_CHECKSUM_MD5, (guchar *) key,
+                                            strlen (path) + 2);
+    name = g_strconcat (checksum, ".index", NULL);
+    file = g_build_filename (g_get_user_cache_dir (), "viewnior", "dirs",
+                             name, NULL);
+
+    g_free (name);
+    g_free (checksum);
+    g_free (key);
+    return file;
+}
+
+/* Appends @string to @strings, unless it was the last one appended */
+static guint32
+vnr_dir_index_add_string (GString *strings, const gchar *string,
+                          const gchar **last, guint32 *last_offset)
+{
+    if (*last != NULL && string == *last)
+        return *last_offset;
+
+    *last = string;
+    *last_offset = strings->len;
+    g_string_append_len (strings, string, strlen (string) + 1);
+    return *last_offset;
+}
+
+static gint
+vnr_dir_index_cache_entry_compare (gconstpointer a, gconstpointer b)
+{
+    const VnrDirIndexCacheEntry *x = a, *y = b;
+
+    return x->used < y->used ? -1 : x->used > y->used;
+}
+
+/* Deletes the least recently used indexes in @dir, so that one more
+ * fits */
+static void
+vnr_dir_index_make_room (const gchar *dir)
+{
+    VnrDirIndexCacheEntry entry;
+    GArray *entries;
+    GDir *d;
+    const gchar *name;
+    guint i;
+
+    d = g_dir_open (dir, 0, NULL);
+    if (d == NULL)
+        return;
+
+    entries = g_array_new (FALSE, FALSE, sizeof (VnrDirIndexCacheEntry));
+    while ((name = g_dir_read_name (d)) != NULL)
+    {
+        GStatBuf st;
+
+        if (!g_str_has_suffix (name, ".index"))
+            continue;
+
+        entry.file = g_build_filename (dir, name, NULL);
+        if (g_stat (entry.file, &st) != 0)
+        {
+            g_free (entry.file);
+            continue;
+        }
+        entry.used = st.st_mtime;
+        g_array_append_val (entries, entry);
+    }
+    g_dir_close (d);
+
+    g_array_sort (entries, vnr_dir_index_cache_entry_compare);
+    for (i = 0; i < entries->len; i++)
+    {
+        VnrDirIndexCacheEntry *e = &g_array_index (entries,
+                                                   VnrDirIndexCacheEntry, i);
+
+        if (entries->len - i >= VNR_DIR_INDEX_MAX_INDEXES)
+            g_unlink (e->file);
+        g_free (e->file);
+    }
+    g_array_free (entries, TRUE);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+/**
+ * vnr_dir_index_get_stamp:
+ * @path: a directory
+ * @returns: the time @path was last modified, in microseconds, or -1
+ *
+ * To be taken before reading the directory, so that files added while
+ * it is read make the index stale rather than incomplete.
+ **/
+gint64
+vnr_dir_index_get_stamp (const gchar *path)
+{
+    GFile *file = g_file_new_for_path (path);
+    GFileInfo *info;
+    gint64 stamp = -1;
+
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                              0, NULL, NULL);
+    if (info != NULL)
+    {
+        stamp = g_file_info_get_attribute_uint64 (info,
+                    G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+                + g_file_info_get_attribute_uint32 (info,
+                    G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+        g_object_unref (info);
+    }
+    g_object_unref (file);
+    return stamp;
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_dir_index_load:
+ * @path: a directory
+ * @include_hidden: whether hidden files are wanted
+ * @returns: the sorted images of @path, or %NULL if there is no index
+ *   for it or it is stale
+ **/
+VnrFileList *
+vnr_dir_index_load (const gchar *path, gboolean include_hidden)
+{
+    gchar *file;
+    GMappedFile *mapping;
+    const gchar *data, *strings;
+    const VnrDirIndexHeader *header;
+    const VnrDirIndexEntry *entries;
+    const gchar *locale = setlocale (LC_COLLATE, NULL);
+    const gchar *filter = vnr_file_get_filter_fingerprint ();
+    VnrFileList *list = NULL;
+    gsize length;
+    guint32 i;
+
+    file = vnr_dir_index_get_file (path, include_hidden);
+    mapping = g_mapped_file_new (file, FALSE, NULL);
+
+    if (mapping == NULL)
+    {
+        g_free (file);
+        return NULL;
+    }
+
+    data = g_mapped_file_get_contents (mapping);
+    length = g_mapped_file_get_length (mapping);
+    header = (const VnrDirIndexHeader *) data;
+
+    if (length < sizeof (VnrDirIndexHeader) ||
+        memcmp (header->magic, VNR_DIR_INDEX_MAGIC, 8) != 0 ||
+        header->include_hidden != (guint32) include_hidden ||
+        (length - sizeof (VnrDirIndexHeader)) / sizeof (VnrDirIndexEntry)
+            < header->n_entries ||
+        length != sizeof (VnrDirIndexHeader)
+                  + header->n_entries * sizeof (VnrDirIndexEntry)
+                  + header->strings_size ||
+        header->strings_size == 0)
+        goto out;
+
+    entries = (const VnrDirIndexEntry *) (header + 1);
+    strings = (const gchar *) (entries + header->n_entries);
+
+    /* Every offset below is then the start of a terminated string */
+    if (strings[header->strings_size - 1] != '\0' ||
+        header->path >= header->strings_size ||
+        header->locale >= header->strings_size ||
+        header->filter >= header->strings_size ||
+        strcmp (strings + header->path, path) != 0 ||
+        strcmp (strings + header->locale, locale ? locale : "") != 0 ||
+        strcmp (strings + header->filter, filter) != 0 ||
+        header->stamp != vnr_dir_index_get_stamp (path))
+        goto out;
+
+    list = vnr_file_list_new ();
+    for (i = 0; i < header->n_entries; i++)
+    {
+        VnrFileEntry entry;
+
+        if (entries[i].name >= header->strings_size ||
+            entries[i].display_name >= header->strings_size ||
+            entries[i].collate_key >= header->strings_size)
+        {
+            vnr_file_list_free (list);
+            list = NULL;
+            goto out;
+        }
+
+        entry.dir = path;
+        entry.name = strings + entries[i].name;
+        entry.display_name = strings + entries[i].display_name;
+        entry.collate_key = strings + entries[i].collate_key;
+        entry.mtime = entries[i].mtime;
+        entry.size = entries[i].size;
+        vnr_file_list_add_entry (list, &entry);
+    }
+
+    /* Kept the longest in the cache, as the most recently used */
+    g_utime (file, NULL);
+
+out:
+    g_mapped_file_unref (mapping);
+    g_free (file);
+    return list;
+}
+
+/**
+ * vnr_dir_index_save:
+ * @path: a directory
+ * @include_hidden: whether hidden files were listed
+ * @stamp: what vnr_dir_index_get_stamp() returned before listing @path
+ * @list: the images of @path, sorted by name
+ *
+ * Keeps the listing of @path for vnr_dir_index_load(), if it is large
+ * enough to be worth it. Images of @list from other directories are
+ * left out.
+ **/
+void
+vnr_dir_index_save (const gchar *path, gboolean include_hidden,
+                    gint64 stamp, VnrFileList *list)
+{
+    VnrDirIndexHeader header;
+    GArray *entries;
+    GString *strings, *contents;
+    const gchar *locale = setlocale (LC_COLLATE, NULL);
+    const gchar *last = NULL;
+    guint32 last_offset = 0;
+    gchar *file, *dir;
+    guint i;
+
+    if (stamp < 0 || list->entries->len < VNR_DIR_INDEX_MIN_FILES)
+        return;
+
+    entries = g_array_sized_new (FALSE, FALSE, sizeof (VnrDirIndexEntry),
+                                 list->entries->len);
+    strings = g_string_new (NULL);
+
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, VNR_DIR_INDEX_MAGIC, 8);
+    header.include_hidden = include_hidden;
+    header.stamp = stamp;
+    header.path = vnr_dir_index_add_string (strings, path,
+                                            &last, &last_offset);
+    header.locale = vnr_dir_index_add_string (strings, locale ? locale : "",
+                                              &last, &last_offset);
+    header.filter = vnr_dir_index_add_string (strings,
+                                              vnr_file_get_filter_fingerprint (),
+                                              &last, &last_offset);
+
+    for (i = 0; i < list->entries->len; i++)
+    {
+        VnrFileEntry *entry = &g_array_index (list->entries, VnrFileEntry, i);
+        VnrDirIndexEntry index_entry;
+
+        if (strcmp (entry->dir, path) != 0 || entry->collate_key == NULL)
+            continue;
+
+        memset (&index_entry, 0, sizeof (index_entry));
+        index_entry.name = vnr_dir_index_add_string (strings, entry->name,
+                                                     &last, &last_offset);
+        index_entry.display_name = vnr_dir_index_add_string (strings,
+                                       entry->display_name,
+                                       &last, &last_offset);
+        index_entry.collate_key = vnr_dir_index_add_string (strings,
+                                      entry->collate_key,
+                                      &last, &last_offset);
+        index_entry.mtime = entry->mtime;
+        index_entry.size = entry->size;
+        g_array_append_val (entries, index_entry);
+    }
+
+    header.n_entries = entries->len;
+    header.strings_size = strings->len;
+
+    contents = g_string_sized_new (sizeof (header)
+                                   + entries->len * sizeof (VnrDirIndexEntry)
+                                   + strings->len);
+    g_string_append_len (contents, (gchar *) &header, sizeof (header));
+    g_string_append_len (contents, entries->data,
+                         entries->len * sizeof (VnrDirIndexEntry));
+    g_string_append_len (contents, strings->str, strings->len);
+
+    file = vnr_dir_index_get_file (path, include_hidden);
+    dir = g_path_get_dirname (file);
+
+    /* Written to a temporary file and renamed, so a reader never maps
+     * half an index */
+    if (g_mkdir_with_parents (dir, 0700) == 0)
+    {
+        vnr_dir_index_make_room (dir);
+        g_file_set_contents (file, contents->str, contents->len, NULL);
+    }
+
+    g_free (dir);
+    g_free (file);
+    g_string_free (contents, TRUE);
+    g_string_free (strings, TRUE);
+    g_array_free (entries, TRUE);
+}
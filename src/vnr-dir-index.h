@@ -0,0 +1,34 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VNR_DIR_INDEX_H__
+#define __VNR_DIR_INDEX_H__
+
+#include <glib.h>
+#include "vnr-file-list.h"
+
+G_BEGIN_DECLS
+
+gint64       vnr_dir_index_get_stamp (const gchar *path);
+VnrFileList *vnr_dir_index_load      (const gchar *path, gboolean include_hidden);
+void         vnr_dir_index_save      (const gchar *path, gboolean include_hidden,
+                                      gint64 stamp, VnrFileList *list);
+
+G_END_DECLS
+#endif /* __VNR_DIR_INDEX_H__ */
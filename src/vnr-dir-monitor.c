@@ -0,0 +1,253 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <gio/gio.h>
+#include "vnr-dir-monitor.h"
+#include "vnr-file.h"
+
+/* Time the events of a burst are gathered for before being applied,
+ * in milliseconds. */
+#define VNR_DIR_MONITOR_DELAY 250
+
+/**
+ * VnrDirMonitor:
+ *
+ * Keeps a file list in sync with a directory. Events only mark the
+ * names they are about, if they are names of images. Once a burst is over, each marked file is
+ * looked at once, and inserted into, updated in or removed from the
+ * list, however many events it got. The list stays sorted, so each
+ * change is a binary search rather than a rescan.
+ **/
+struct _VnrDirMonitor {
+    GFile *dir;
+    gchar *path;
+    GFileMonitor *monitor;
+    VnrFileList *list;
+    gboolean include_hidden;
+
+    /* Names of the files changed in the current burst */
+    GHashTable *pending;
+    guint source_id;
+
+    VnrDirMonitorFunc func;
+    gpointer user_data;
+};
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+/* Brings the entry of @name in line with the file system. Returns
+ * TRUE if the list changed. */
+static gboolean
+vnr_dir_monitor_apply (VnrDirMonitor *dir_monitor, const gchar *name)
+{
+    gchar *path = g_build_filename (dir_monitor->path, name, NULL);
+    GFile *file = g_file_new_for_path (path);
+    GFileInfo *info;
+    gboolean changed;
+
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                              VNR_FILE_ATTRIBUTES, 0, NULL, NULL);
+
+    if (info != NULL &&
+        g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+        vnr_file_info_is_image (info, dir_monitor->include_hidden))
+    {
+        time_t mtime = g_file_info_get_attribute_uint64 (info,
+                           G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        goffset size = g_file_info_get_size (info);
+
+        if (!vnr_file_list_update (dir_monitor->list, path, mtime, size))
+            vnr_file_list_insert (dir_monitor->list, dir_monitor->path,
+                                  g_file_info_get_name (info),
+                                  g_file_info_get_display_name (info),
+                                  mtime, size);
+        changed = TRUE;
+    }
+    else
+        changed = vnr_file_list_remove (dir_monitor->list, path);
+
+    if (info != NULL)
+        g_object_unref (info);
+    g_object_unref (file);
+    g_free (path);
+    return changed;
+}
+
+static gboolean
+vnr_dir_monitor_flush (VnrDirMonitor *dir_monitor)
+{
+    VnrFileList *list = dir_monitor->list;
+    GHashTableIter iter;
+    gpointer name;
+    gchar *current_path;
+    time_t current_mtime;
+    gboolean changed = FALSE, current_changed;
+
+    dir_monitor->source_id = 0;
+
+    current_path = vnr_file_list_get_nth_path (list,
+                       vnr_file_list_get_position (list));
+    current_mtime = vnr_file_list_get_current (list)->mtime;
+
+    g_hash_table_iter_init (&iter, dir_monitor->pending);
+    while (g_hash_table_iter_next (&iter, &name, NULL))
+        changed |= vnr_dir_monitor_apply (dir_monitor, name);
+    g_hash_table_remove_all (dir_monitor->pending);
+
+    if (vnr_file_list_get_length (list) == 0)
+        current_changed = TRUE;
+    else
+    {
+        gchar *path = vnr_file_list_get_nth_path (list,
+                          vnr_file_list_get_position (list));
+
+        current_changed = strcmp (path, current_path) != 0
+                          || vnr_file_list_get_current (list)->mtime != current_mtime;
+        g_free (path);
+    }
+    g_free (current_path);
+
+    /* The callback may free the monitor, so it comes last */
+    if (changed)
+        dir_monitor->func (current_changed, dir_monitor->user_data);
+
+    return FALSE;
+}
+
+/* Marks @file to be looked at, unless its name rules out its being
+ * listed, which neither a query nor a lookup is needed for */
+static void
+vnr_dir_monitor_mark (VnrDirMonitor *dir_monitor, GFile *file)
+{
+    gchar *name = g_file_get_basename (file);
+
+    if (vnr_file_name_is_image (name))
+        g_hash_table_add (dir_monitor->pending, name);
+    else
+        g_free (name);
+}
+
+static void
+vnr_dir_monitor_changed_cb (GFileMonitor *monitor, GFile *file,
+                            GFile *other_file, GFileMonitorEvent event,
+                            VnrDirMonitor *dir_monitor)
+{
+    switch (event)
+    {
+        case G_FILE_MONITOR_EVENT_MOVED:
+            /* Renamed: the old name is gone and the new one may be new */
+            if (other_file != NULL &&
+                g_file_has_parent (other_file, dir_monitor->dir))
+                vnr_dir_monitor_mark (dir_monitor, other_file);
+            break;
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+        case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+            break;
+        default:
+            /* Files being written are looked at once they are done */
+            return;
+    }
+
+    if (g_file_has_parent (file, dir_monitor->dir))
+        vnr_dir_monitor_mark (dir_monitor, file);
+
+    if (dir_monitor->source_id == 0 &&
+        g_hash_table_size (dir_monitor->pending) != 0)
+        dir_monitor->source_id = g_timeout_add (VNR_DIR_MONITOR_DELAY,
+                                    (GSourceFunc) vnr_dir_monitor_flush,
+                                    dir_monitor);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_dir_monitor_new:
+ * @path: the directory to watch
+ * @list: the sorted list to keep in sync, which must outlive the
+ *   monitor
+ * @include_hidden: whether hidden files are listed
+ * @func: the function to call after changes were applied
+ * @user_data: the data to pass to @func
+ * @returns: a new #VnrDirMonitor, or %NULL if @path cannot be watched
+ **/
+VnrDirMonitor *
+vnr_dir_monitor_new (const gchar *path, VnrFileList *list,
+                     gboolean include_hidden, VnrDirMonitorFunc func,
+                     gpointer user_data)
+{
+    VnrDirMonitor *dir_monitor;
+    GFile *dir = g_file_new_for_path (path);
+    GFileMonitor *monitor;
+
+    monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_SEND_MOVED,
+                                        NULL, NULL);
+    if (monitor == NULL)
+    {
+        g_object_unref (dir);
+        return NULL;
+    }
+
+    dir_monitor = g_new0 (VnrDirMonitor, 1);
+    dir_monitor->dir = dir;
+    dir_monitor->path = g_strdup (path);
+    dir_monitor->monitor = monitor;
+    dir_monitor->list = list;
+    dir_monitor->include_hidden = include_hidden;
+    dir_monitor->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, NULL);
+    dir_monitor->func = func;
+    dir_monitor->user_data = user_data;
+
+    g_signal_connect (monitor, "changed",
+                      G_CALLBACK (vnr_dir_monitor_changed_cb), dir_monitor);
+    return dir_monitor;
+}
+
+/**
+ * vnr_dir_monitor_free:
+ * @dir_monitor: a #VnrDirMonitor, or %NULL
+ *
+ * Stops watching, dropping the changes not applied yet.
+ **/
+void
+vnr_dir_monitor_free (VnrDirMonitor *dir_monitor)
+{
+    if (dir_monitor == NULL)
+        return;
+
+    if (dir_monitor->source_id != 0)
+        g_source_remove (dir_monitor->source_id);
+
+    g_signal_handlers_disconnect_by_func (dir_monitor->monitor,
+                                          vnr_dir_monitor_changed_cb,
+                                          dir_monitor);
+    g_file_monitor_cancel (dir_monitor->monitor);
+    g_object_unref (dir_monitor->monitor);
+    g_object_unref (dir_monitor->dir);
+    g_hash_table_destroy (dir_monitor->pending);
+    g_free (dir_monitor->path);
+    g_free (dir_monitor);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VNR_DIR_MONITOR_H__
+#define __VNR_DIR_MONITOR_H__
+
+#include <glib.h>
+#include "vnr-file-list.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrDirMonitor VnrDirMonitor;
+
+/**
+ * VnrDirMonitorFunc:
+ * @current_changed: Whether the current file of the list was removed
+ *   or modified.
+ * @user_data: The data passed to vnr_dir_monitor_new().
+ *
+ * Called from the main loop after a burst of changes was applied to
+ * the list. The list may have become empty.
+ **/
+typedef void (*VnrDirMonitorFunc) (gboolean current_changed,
+                                   gpointer user_data);
+
+/* Constructors */
+VnrDirMonitor *vnr_dir_monitor_new  (const gchar *path, VnrFileList *list,
+                                     gboolean include_hidden,
+                                     VnrDirMonitorFunc func,
+                                     gpointer user_data);
+void           vnr_dir_monitor_free (VnrDirMonitor *dir_monitor);
+
+G_END_DECLS
+#endif /* __VNR_DIR_MONITOR_H__ */
@@ -0,0 +1,993 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "vnr-file-list.h"
+#include "vnr-workers.h"
+
+/* Lists shorter than this get their collation keys made on the
+ * calling thread. Longer ones are split in chunks of this many files
+ * for a pool of threads. */
+#define VNR_FILE_LIST_KEYS_CHUNK 4096
+
+#define vnr_file_list_entry(list, n) \
+    (&g_array_index ((list)->entries, VnrFileEntry, (n)))
+
+/* Entry shown at @position, and position at which the entry @n is
+ * shown */
+#define vnr_file_list_index(list, position) \
+    ((list)->by_order ? g_array_index ((list)->by_order, guint, (position)) \
+                      : (position))
+#define vnr_file_list_position_of(list, n) \
+    ((list)->positions ? g_array_index ((list)->positions, guint, (n)) : (n))
+
+typedef struct {
+    VnrFileList *list;
+    /* Entries lacking a key, and their keys */
+    guint *missing;
+    gchar **keys;
+    guint start;
+    guint end;
+} VnrFileKeysJob;
+
+/* What an entry is sorted by in orders other than by name. Sorting an
+ * array of these rather than of entry indices keeps the values being
+ * compared next to each other in memory. */
+typedef struct {
+    gint64 value;
+    const gchar *extension;
+    guint index;
+} VnrFileSortKey;
+
+static gint
+vnr_file_list_compare (gconstpointer a, gconstpointer b)
+{
+    return strcmp (((const VnrFileEntry *) a)->collate_key,
+                   ((const VnrFileEntry *) b)->collate_key);
+}
+
+/* Ties are broken by name, which is the order of the entries. */
+static gint
+vnr_file_sort_key_compare (gconstpointer a, gconstpointer b)
+{
+    const VnrFileSortKey *key_a = a;
+    const VnrFileSortKey *key_b = b;
+
+    if (key_a->extension != NULL)
+    {
+        gint result = g_ascii_strcasecmp (key_a->extension, key_b->extension);
+
+        if (result != 0)
+            return result;
+    }
+
+    if (key_a->value != key_b->value)
+        return key_a->value < key_b->value ? -1 : 1;
+
+    return key_a->index < key_b->index ? -1 : key_a->index > key_b->index;
+}
+
+static void
+vnr_file_list_make_sort_key (VnrFileList *list, guint n, VnrFileSortKey *key)
+{
+    VnrFileEntry *entry = vnr_file_list_entry (list, n);
+    const gchar *dot;
+
+    key->index = n;
+    key->value = 0;
+    key->extension = NULL;
+
+    switch (list->order)
+    {
+        case VNR_FILE_LIST_ORDER_MTIME:
+            key->value = entry->mtime;
+            break;
+        case VNR_FILE_LIST_ORDER_SIZE:
+            key->value = entry->size;
+            break;
+        case VNR_FILE_LIST_ORDER_EXTENSION:
+            dot = strrchr (entry->name, '.');
+            key->extension = dot != NULL ? dot + 1 : "";
+            break;
+        default:
+            break;
+    }
+}
+
+/* Index of the first entry whose collation key is not less than
+ * @collate_key */
+static guint
+vnr_file_list_search (VnrFileList *list, const gchar *collate_key)
+{
+    VnrFileEntry key;
+    guint low = 0, high = list->entries->len;
+
+    key.collate_key = collate_key;
+    while (low < high)
+    {
+        guint middle = low + (high - low) / 2;
+
+        if (vnr_file_list_compare (vnr_file_list_entry (list, middle), &key) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static void
+vnr_file_list_update_positions (VnrFileList *list)
+{
+    guint i;
+
+    g_array_set_size (list->positions, list->by_order->len);
+    for (i = 0; i < list->by_order->len; i++)
+        g_array_index (list->positions, guint,
+                       g_array_index (list->by_order, guint, i)) = i;
+}
+
+/* Builds the permutation for the order of @list from scratch. */
+static void
+vnr_file_list_reorder (VnrFileList *list)
+{
+    VnrFileSortKey *keys;
+    guint i, len = list->entries->len;
+
+    if (list->order == VNR_FILE_LIST_ORDER_NAME)
+    {
+        if (list->by_order != NULL)
+        {
+            g_array_free (list->by_order, TRUE);
+            g_array_free (list->positions, TRUE);
+            list->by_order = NULL;
+            list->positions = NULL;
+        }
+        return;
+    }
+
+    if (list->by_order == NULL)
+    {
+        list->by_order = g_array_sized_new (FALSE, FALSE, sizeof (guint), len);
+        list->positions = g_array_sized_new (FALSE, FALSE, sizeof (guint), len);
+    }
+
+    keys = g_new (VnrFileSortKey, len);
+    for (i = 0; i < len; i++)
+        vnr_file_list_make_sort_key (list, i, &keys[i]);
+    qsort (keys, len, sizeof (VnrFileSortKey), vnr_file_sort_key_compare);
+
+    g_array_set_size (list->by_order, len);
+    for (i = 0; i < len; i++)
+        g_array_index (list->by_order, guint, i) = keys[i].index;
+    g_free (keys);
+
+    vnr_file_list_update_positions (list);
+}
+
+static void
+vnr_file_list_make_keys_job (gpointer data, gpointer user_data)
+{
+    VnrFileKeysJob *job = data;
+    guint i;
+
+    for (i = job->start; i < job->end; i++)
+        job->keys[i] = g_utf8_collate_key_for_filename (
+            vnr_file_list_entry (job->list, job->missing[i])->display_name,
+            -1);
+}
+
+/* Makes the collation keys of the entries lacking one. The entries
+ * are only read while the threads run; the keys are moved into the
+ * string arena afterwards, as it cannot be shared. */
+static void
+vnr_file_list_make_keys (VnrFileList *list)
+{
+    guint len = 0, n_jobs, i;
+    VnrFileKeysJob *jobs;
+    guint *missing;
+    gchar **keys;
+
+    missing = g_new (guint, list->entries->len);
+    for (i = 0; i < list->entries->len; i++)
+        if (vnr_file_list_entry (list, i)->collate_key == NULL)
+            missing[len++] = i;
+    if (len == 0)
+    {
+        g_free (missing);
+        return;
+    }
+
+    keys = g_new0 (gchar *, len);
+    n_jobs = (len + VNR_FILE_LIST_KEYS_CHUNK - 1) / VNR_FILE_LIST_KEYS_CHUNK;
+    jobs = g_new (VnrFileKeysJob, n_jobs);
+
+    for (i = 0; i < n_jobs; i++)
+    {
+        jobs[i].list = list;
+        jobs[i].missing = missing;
+        jobs[i].keys = keys;
+        jobs[i].start = i * VNR_FILE_LIST_KEYS_CHUNK;
+        jobs[i].end = MIN (len, (i + 1) * VNR_FILE_LIST_KEYS_CHUNK);
+    }
+
+    if (n_jobs == 1)
+        vnr_file_list_make_keys_job (&jobs[0], NULL);
+    else
+    {
+        VnrWorkGroup *group;
+
+        /* The caller is blocked until the keys are made, and helps with
+         * them meanwhile */
+        group = vnr_work_group_new (VNR_WORK_CURRENT,
+                                    vnr_file_list_make_keys_job, NULL,
+                                    -1, NULL, NULL);
+        for (i = 0; i < n_jobs; i++)
+            vnr_work_group_push (group, &jobs[i]);
+        vnr_work_group_free (group, FALSE, TRUE);
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        vnr_file_list_entry (list, missing[i])->collate_key =
+            g_string_chunk_insert (list->strings, keys[i]);
+        g_free (keys[i]);
+    }
+
+    g_free (jobs);
+    g_free (missing);
+    g_free (keys);
+}
+
+/* Counts an entry named @name in or out of the names of @list, once
+ * they were gathered */
+static void
+vnr_file_list_count_name (VnrFileList *list, const gchar *name, gint delta)
+{
+    guint count;
+
+    if (list->names == NULL)
+        return;
+
+    count = GPOINTER_TO_UINT (g_hash_table_lookup (list->names, name)) + delta;
+    if (count == 0)
+        g_hash_table_remove (list->names, name);
+    else
+        g_hash_table_insert (list->names, (gpointer) name,
+                             GUINT_TO_POINTER (count));
+}
+
+/* Tells whether a file of @list is named @name, gathering the names
+ * on the first call */
+static gboolean
+vnr_file_list_has_name (VnrFileList *list, const gchar *name)
+{
+    guint i;
+
+    if (list->names == NULL)
+    {
+        list->names = g_hash_table_new (g_str_hash, g_str_equal);
+        for (i = 0; i < list->entries->len; i++)
+            vnr_file_list_count_name (list, vnr_file_list_entry (list, i)->name,
+                                      1);
+    }
+
+    return g_hash_table_contains (list->names, name);
+}
+
+static gboolean
+vnr_file_entry_has_path (VnrFileEntry *entry, const gchar *path,
+                         const gchar *name)
+{
+    gchar *entry_path;
+    gboolean result;
+
+    if (strcmp (entry->name, name) != 0)
+        return FALSE;
+
+    entry_path = g_build_filename (entry->dir, entry->name, NULL);
+    result = strcmp (entry_path, path) == 0;
+    g_free (entry_path);
+
+    return result;
+}
+
+/* Fills @entry for vnr_file_list_add() and vnr_file_list_insert(). */
+static void
+vnr_file_list_make_entry (VnrFileList *list, VnrFileEntry *entry,
+                          const gchar *dir, const gchar *name,
+                          const gchar *display_name, time_t mtime,
+                          goffset size)
+{
+    entry->dir = g_string_chunk_insert_const (list->strings, dir);
+    entry->name = g_string_chunk_insert (list->strings, name);
+    if (strcmp (name, display_name) == 0)
+        entry->display_name = entry->name;
+    else
+        entry->display_name = g_string_chunk_insert (list->strings,
+                                                     display_name);
+    entry->collate_key = NULL;
+    entry->mtime = mtime;
+    entry->size = size;
+    vnr_file_list_count_name (list, entry->name, 1);
+}
+
+/* Copies @entry into the arena of @list. */
+static void
+vnr_file_list_append_entry (VnrFileList *list, const VnrFileEntry *entry)
+{
+    VnrFileEntry copy;
+
+    copy.dir = g_string_chunk_insert_const (list->strings, entry->dir);
+    copy.name = g_string_chunk_insert (list->strings, entry->name);
+    if (entry->display_name == entry->name)
+        copy.display_name = copy.name;
+    else
+        copy.display_name = g_string_chunk_insert (list->strings,
+                                                   entry->display_name);
+    if (entry->collate_key != NULL)
+        copy.collate_key = g_string_chunk_insert (list->strings,
+                                                  entry->collate_key);
+    else
+        copy.collate_key = NULL;
+    copy.mtime = entry->mtime;
+    copy.size = entry->size;
+    vnr_file_list_count_name (list, copy.name, 1);
+
+    g_array_append_val (list->entries, copy);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_file_list_new:
+ * @returns: a new, empty #VnrFileList
+ *
+ * Files are added with vnr_file_list_add(), after which the list must
+ * be sorted with vnr_file_list_sort().
+ **/
+VnrFileList *
+vnr_file_list_new (void)
+{
+    VnrFileList *list = g_new0 (VnrFileList, 1);
+
+    list->entries = g_array_new (FALSE, FALSE, sizeof (VnrFileEntry));
+    list->strings = g_string_chunk_new (64 * 1024);
+    list->files = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         NULL, g_object_unref);
+    return list;
+}
+
+void
+vnr_file_list_free (VnrFileList *list)
+{
+    if (list == NULL)
+        return;
+
+    g_hash_table_destroy (list->files);
+    if (list->names != NULL)
+        g_hash_table_destroy (list->names);
+    if (list->by_order != NULL)
+    {
+        g_array_free (list->by_order, TRUE);
+        g_array_free (list->positions, TRUE);
+    }
+    g_array_free (list->entries, TRUE);
+    g_string_chunk_free (list->strings);
+    g_free (list);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+guint
+vnr_file_list_get_length (VnrFileList *list)
+{
+    return list ? list->entries->len : 0;
+}
+
+/**
+ * vnr_file_list_get_position:
+ * @list: a #VnrFileList
+ * @returns: the position of the current file in the order of @list,
+ *   starting at 0
+ **/
+guint
+vnr_file_list_get_position (VnrFileList *list)
+{
+    return list->current;
+}
+
+VnrFile *
+vnr_file_list_get_current (VnrFileList *list)
+{
+    return vnr_file_list_get_nth (list, list->current);
+}
+
+/**
+ * vnr_file_list_get_nth:
+ * @list: a #VnrFileList
+ * @n: a position in @list
+ * @returns: the #VnrFile at @n, owned by @list
+ *
+ * The #VnrFile is made the first time it is asked for, and stays
+ * around until its file is removed from @list.
+ **/
+VnrFile *
+vnr_file_list_get_nth (VnrFileList *list, guint n)
+{
+    VnrFileEntry *entry = vnr_file_list_entry (list,
+                                               vnr_file_list_index (list, n));
+    VnrFile *file;
+
+    file = g_hash_table_lookup (list->files, entry->name);
+    if (file != NULL)
+        return file;
+
+    file = vnr_file_new ();
+    file->display_name = g_strdup (entry->display_name);
+    file->display_name_collate = g_strdup (entry->collate_key);
+    file->path = g_build_filename (entry->dir, entry->name, NULL);
+    file->mtime = entry->mtime;
+
+    g_hash_table_insert (list->files, (gpointer) entry->name, file);
+    return file;
+}
+
+/**
+ * vnr_file_list_get_nth_entry:
+ * @list: a #VnrFileList
+ * @n: a position in @list
+ * @returns: the entry at @n, owned by @list and valid until it changes
+ **/
+const VnrFileEntry *
+vnr_file_list_get_nth_entry (VnrFileList *list, guint n)
+{
+    return vnr_file_list_entry (list, vnr_file_list_index (list, n));
+}
+
+/**
+ * vnr_file_list_get_nth_path:
+ * @list: a #VnrFileList
+ * @n: a position in @list
+ * @returns: the path of the file at @n, to be freed with g_free()
+ **/
+gchar *
+vnr_file_list_get_nth_path (VnrFileList *list, guint n)
+{
+    VnrFileEntry *entry = vnr_file_list_entry (list,
+                                               vnr_file_list_index (list, n));
+
+    return g_build_filename (entry->dir, entry->name, NULL);
+}
+
+/**
+ * vnr_file_list_find:
+ * @list: a #VnrFileList
+ * @path: the path of a file
+ * @position: return location for the position of @path, or %NULL
+ * @returns: %TRUE if @path is in @list
+ *
+ * Files whose name is not in the list are turned down in constant
+ * time. The others are looked up by the collation key of their name,
+ * which the list is sorted by, so this takes logarithmic time.
+ **/
+gboolean
+vnr_file_list_find (VnrFileList *list, const gchar *path, guint *position)
+{
+    VnrFileEntry key;
+    gchar *name, *display_name, *collate_key;
+    guint i;
+    gboolean found = FALSE;
+
+    name = g_path_get_basename (path);
+    if (!vnr_file_list_has_name (list, name))
+    {
+        g_free (name);
+        return FALSE;
+    }
+
+    display_name = g_filename_display_name (name);
+    collate_key = g_utf8_collate_key_for_filename (display_name, -1);
+    key.collate_key = collate_key;
+
+    for (i = vnr_file_list_search (list, collate_key); i < list->entries->len &&
+         vnr_file_list_compare (vnr_file_list_entry (list, i), &key) == 0; i++)
+    {
+        if (vnr_file_entry_has_path (vnr_file_list_entry (list, i), path, name))
+        {
+            found = TRUE;
+            break;
+        }
+    }
+
+    /* The name was displayed differently when the file was listed,
+     * which only files of that name are looked at again for */
+    if (!found)
+    {
+        for (i = 0; i < list->entries->len; i++)
+        {
+            if (vnr_file_entry_has_path (vnr_file_list_entry (list, i),
+                                         path, name))
+            {
+                found = TRUE;
+                break;
+            }
+        }
+    }
+
+    if (found && position != NULL)
+        *position = vnr_file_list_position_of (list, i);
+
+    g_free (name);
+    g_free (display_name);
+    g_free (collate_key);
+    return found;
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_file_list_add:
+ * @list: a #VnrFileList
+ * @dir: the directory of the file
+ * @name: the name of the file in @dir
+ * @display_name: the name of the file to show
+ * @mtime: the time the file was last modified
+ * @size: the size of the file in bytes
+ *
+ * Adds a file at the end of @list.
+ **/
+void
+vnr_file_list_add (VnrFileList *list, const gchar *dir, const gchar *name,
+                   const gchar *display_name, time_t mtime, goffset size)
+{
+    VnrFileEntry entry;
+
+    vnr_file_list_make_entry (list, &entry, dir, name, display_name,
+                              mtime, size);
+    g_array_append_val (list->entries, entry);
+}
+
+/**
+ * vnr_file_list_add_entry:
+ * @list: a #VnrFileList
+ * @entry: a file, whose strings are copied
+ *
+ * Adds a file at the end of @list, along with its collation key if it
+ * has one.
+ **/
+void
+vnr_file_list_add_entry (VnrFileList *list, const VnrFileEntry *entry)
+{
+    vnr_file_list_append_entry (list, entry);
+}
+
+/**
+ * vnr_file_list_append:
+ * @list: a #VnrFileList
+ * @other: a #VnrFileList, which is freed
+ *
+ * Adds the files of @other at the end of @list. Collation keys
+ * already made for them are kept.
+ **/
+void
+vnr_file_list_append (VnrFileList *list, VnrFileList *other)
+{
+    guint i;
+
+    for (i = 0; i < other->entries->len; i++)
+        vnr_file_list_append_entry (list, vnr_file_list_entry (other, i));
+    vnr_file_list_free (other);
+}
+
+/**
+ * vnr_file_list_insert:
+ * @list: a sorted #VnrFileList
+ * @dir: the directory of the file
+ * @name: the name of the file in @dir
+ * @display_name: the name of the file to show
+ * @mtime: the time the file was last modified
+ * @size: the size of the file in bytes
+ *
+ * Adds a file at its place in @list, found by binary search. The
+ * current file stays the same.
+ **/
+void
+vnr_file_list_insert (VnrFileList *list, const gchar *dir, const gchar *name,
+                      const gchar *display_name, time_t mtime, goffset size)
+{
+    VnrFileEntry entry;
+    VnrFileSortKey key;
+    gchar *collate_key;
+    guint n, current = 0, low, high, i;
+    gboolean empty = list->entries->len == 0;
+
+    vnr_file_list_make_entry (list, &entry, dir, name, display_name,
+                              mtime, size);
+    collate_key = g_utf8_collate_key_for_filename (display_name, -1);
+    entry.collate_key = g_string_chunk_insert (list->strings, collate_key);
+    g_free (collate_key);
+
+    if (!empty)
+        current = vnr_file_list_index (list, list->current);
+
+    /* After the files with an equal key, like vnr_file_list_merge() */
+    n = vnr_file_list_search (list, entry.collate_key);
+    while (n < list->entries->len &&
+           vnr_file_list_compare (vnr_file_list_entry (list, n), &entry) == 0)
+        n++;
+    g_array_insert_val (list->entries, n, entry);
+
+    if (list->by_order != NULL)
+    {
+        for (i = 0; i < list->by_order->len; i++)
+        {
+            guint *index = &g_array_index (list->by_order, guint, i);
+
+            if (*index >= n)
+                (*index)++;
+        }
+
+        vnr_file_list_make_sort_key (list, n, &key);
+        low = 0;
+        high = list->by_order->len;
+        while (low < high)
+        {
+            guint middle = low + (high - low) / 2;
+            VnrFileSortKey other;
+
+            vnr_file_list_make_sort_key (list,
+                g_array_index (list->by_order, guint, middle), &other);
+            if (vnr_file_sort_key_compare (&other, &key) < 0)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        g_array_insert_val (list->by_order, low, n);
+        vnr_file_list_update_positions (list);
+    }
+
+    if (!empty)
+        list->current = vnr_file_list_position_of (list,
+                            current >= n ? current + 1 : current);
+}
+
+/**
+ * vnr_file_list_update:
+ * @list: a #VnrFileList
+ * @path: the path of a file
+ * @mtime: the time the file was last modified
+ * @size: the size of the file in bytes
+ * @returns: %TRUE if @path is in @list
+ *
+ * Records that a file of @list was modified. The current file stays
+ * the same.
+ **/
+gboolean
+vnr_file_list_update (VnrFileList *list, const gchar *path,
+                      time_t mtime, goffset size)
+{
+    VnrFileEntry *entry;
+    VnrFile *file;
+    guint position, current;
+    gboolean moved;
+
+    if (!vnr_file_list_find (list, path, &position))
+        return FALSE;
+
+    entry = vnr_file_list_entry (list, vnr_file_list_index (list, position));
+    moved = (list->order == VNR_FILE_LIST_ORDER_MTIME && entry->mtime != mtime)
+            || (list->order == VNR_FILE_LIST_ORDER_SIZE && entry->size != size);
+    entry->mtime = mtime;
+    entry->size = size;
+
+    file = g_hash_table_lookup (list->files, entry->name);
+    if (file != NULL)
+        file->mtime = mtime;
+
+    if (moved)
+    {
+        current = vnr_file_list_index (list, list->current);
+        vnr_file_list_reorder (list);
+        list->current = vnr_file_list_position_of (list, current);
+    }
+    return TRUE;
+}
+
+/**
+ * vnr_file_list_sort:
+ * @list: a #VnrFileList
+ *
+ * Sorts the files in the order of @list, and makes the first one
+ * current.
+ **/
+void
+vnr_file_list_sort (VnrFileList *list)
+{
+    vnr_file_list_make_keys (list);
+    g_array_sort (list->entries, vnr_file_list_compare);
+    vnr_file_list_reorder (list);
+    list->current = 0;
+}
+
+/**
+ * vnr_file_list_set_order:
+ * @list: a sorted #VnrFileList
+ * @order: the order to show the files in
+ *
+ * The current file stays the same.
+ **/
+void
+vnr_file_list_set_order (VnrFileList *list, VnrFileListOrder order)
+{
+    guint current;
+
+    if (order == list->order)
+        return;
+
+    current = vnr_file_list_index (list, list->current);
+    list->order = order;
+    vnr_file_list_reorder (list);
+
+    if (list->entries->len != 0)
+        list->current = vnr_file_list_position_of (list, current);
+}
+
+void
+vnr_file_list_set_position (VnrFileList *list, guint position)
+{
+    g_return_if_fail (position < list->entries->len);
+
+    list->current = position;
+}
+
+/**
+ * vnr_file_list_set_current_path:
+ * @list: a #VnrFileList
+ * @path: the path of a file
+ * @returns: %TRUE if @path is in @list and became the current file
+ **/
+gboolean
+vnr_file_list_set_current_path (VnrFileList *list, const gchar *path)
+{
+    return vnr_file_list_find (list, path, &list->current);
+}
+
+/**
+ * vnr_file_list_next:
+ * @list: a #VnrFileList
+ *
+ * Moves to the next file, or back to the first one after the last.
+ **/
+void
+vnr_file_list_next (VnrFileList *list)
+{
+    list->current = (list->current + 1) % list->entries->len;
+}
+
+/**
+ * vnr_file_list_prev:
+ * @list: a #VnrFileList
+ *
+ * Moves to the previous file, or on to the last one before the first.
+ **/
+void
+vnr_file_list_prev (VnrFileList *list)
+{
+    if (list->current == 0)
+        list->current = list->entries->len;
+    list->current--;
+}
+
+/* Drops the file at @position, keeping the current one unless it is
+ * the file dropped. */
+static void
+vnr_file_list_remove_nth (VnrFileList *list, guint position)
+{
+    guint n = vnr_file_list_index (list, position), i;
+
+    g_hash_table_remove (list->files, vnr_file_list_entry (list, n)->name);
+    vnr_file_list_count_name (list, vnr_file_list_entry (list, n)->name, -1);
+    g_array_remove_index (list->entries, n);
+
+    if (list->by_order != NULL)
+    {
+        g_array_remove_index (list->by_order, position);
+        for (i = 0; i < list->by_order->len; i++)
+        {
+            guint *index = &g_array_index (list->by_order, guint, i);
+
+            if (*index > n)
+                (*index)--;
+        }
+        vnr_file_list_update_positions (list);
+    }
+
+    if (position < list->current)
+        list->current--;
+    if (list->current >= list->entries->len)
+        list->current = 0;
+}
+
+/**
+ * vnr_file_list_remove_current:
+ * @list: a #VnrFileList
+ *
+ * Drops the current file. The file following it, or the first one if
+ * it was the last, becomes the current file.
+ **/
+void
+vnr_file_list_remove_current (VnrFileList *list)
+{
+    vnr_file_list_remove_nth (list, list->current);
+}
+
+/**
+ * vnr_file_list_remove:
+ * @list: a #VnrFileList
+ * @path: the path of a file
+ * @returns: %TRUE if @path was in @list
+ *
+ * Drops a file. If it was the current file, the one following it
+ * becomes current, as with vnr_file_list_remove_current().
+ **/
+gboolean
+vnr_file_list_remove (VnrFileList *list, const gchar *path)
+{
+    guint position;
+
+    if (!vnr_file_list_find (list, path, &position))
+        return FALSE;
+
+    vnr_file_list_remove_nth (list, position);
+    return TRUE;
+}
+
+/* Merges the files added to @list into the permutation @old_order,
+ * given the new index of each file which was in @old_order and of
+ * each file added. Both were sorted by name, so the permutation only
+ * needs the added files sorted and merged in, not a full sort. */
+static void
+vnr_file_list_merge_order (VnrFileList *list, GArray *old_order,
+                           guint *old_to_new, guint *added, guint n_added)
+{
+    VnrFileSortKey *keys = g_new (VnrFileSortKey, n_added);
+    guint i = 0, j = 0;
+
+    for (j = 0; j < n_added; j++)
+        vnr_file_list_make_sort_key (list, added[j], &keys[j]);
+    qsort (keys, n_added, sizeof (VnrFileSortKey), vnr_file_sort_key_compare);
+
+    j = 0;
+    while (i < old_order->len || j < n_added)
+    {
+        VnrFileSortKey key;
+
+        if (i < old_order->len)
+            vnr_file_list_make_sort_key (list,
+                old_to_new[g_array_index (old_order, guint, i)], &key);
+
+        if (j < n_added &&
+            (i == old_order->len || vnr_file_sort_key_compare (&keys[j], &key) < 0))
+        {
+            g_array_append_val (list->by_order, keys[j].index);
+            j++;
+        }
+        else
+        {
+            g_array_append_val (list->by_order, key.index);
+            i++;
+        }
+    }
+    g_free (keys);
+
+    vnr_file_list_update_positions (list);
+}
+
+/**
+ * vnr_file_list_merge:
+ * @list: a #VnrFileList
+ * @batch: a #VnrFileList sorted by name, which is freed
+ *
+ * Inserts the files of @batch, keeping @list sorted. Files which are
+ * already listed are dropped. The current file stays the same.
+ **/
+void
+vnr_file_list_merge (VnrFileList *list, VnrFileList *batch)
+{
+    GArray *old = list->entries;
+    const gchar *current = NULL;
+    guint *old_to_new = NULL, *added = NULL, n_added = 0;
+    guint i = 0, j = 0;
+
+    if (old->len != 0)
+        current = vnr_file_list_entry (list,
+                      vnr_file_list_index (list, list->current))->name;
+
+    if (list->by_order != NULL)
+    {
+        old_to_new = g_new (guint, old->len);
+        added = g_new (guint, batch->entries->len);
+    }
+
+    list->entries = g_array_sized_new (FALSE, FALSE, sizeof (VnrFileEntry),
+                                       old->len + batch->entries->len);
+
+    while (i < old->len || j < batch->entries->len)
+    {
+        VnrFileEntry *entry, *other;
+        gint cmp;
+
+        entry = i < old->len ? &g_array_index (old, VnrFileEntry, i) : NULL;
+        other = j < batch->entries->len ? vnr_file_list_entry (batch, j) : NULL;
+
+        if (other == NULL)
+            cmp = -1;
+        else if (entry == NULL)
+            cmp = 1;
+        else
+            cmp = vnr_file_list_compare (entry, other);
+
+        if (cmp > 0)
+        {
+            if (added != NULL)
+                added[n_added++] = list->entries->len;
+            vnr_file_list_append_entry (list, other);
+            j++;
+            continue;
+        }
+
+        /* Already listed, like the image shown while its directory
+         * was being read */
+        if (cmp == 0 && strcmp (entry->name, other->name) == 0 &&
+            strcmp (entry->dir, other->dir) == 0)
+            j++;
+
+        if (entry->name == current)
+            list->current = list->entries->len;
+        if (old_to_new != NULL)
+            old_to_new[i] = list->entries->len;
+        g_array_append_val (list->entries, *entry);
+        i++;
+    }
+
+    if (list->by_order != NULL)
+    {
+        GArray *old_order = list->by_order;
+
+        list->by_order = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+                                            list->entries->len);
+        vnr_file_list_merge_order (list, old_order, old_to_new,
+                                   added, n_added);
+        g_array_free (old_order, TRUE);
+        list->current = vnr_file_list_position_of (list, list->current);
+    }
+
+    g_free (old_to_new);
+    g_free (added);
+    g_array_free (old, TRUE);
+    vnr_file_list_free (batch);
+}
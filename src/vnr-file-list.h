@@ -0,0 +1,129 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VNR_FILE_LIST_H__
+#define __VNR_FILE_LIST_H__
+
+#include <time.h>
+#include <glib.h>
+#include "vnr-file.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrFileEntry VnrFileEntry;
+
+typedef enum {
+    VNR_FILE_LIST_ORDER_NAME,
+    VNR_FILE_LIST_ORDER_MTIME,
+    VNR_FILE_LIST_ORDER_SIZE,
+    VNR_FILE_LIST_ORDER_EXTENSION,
+} VnrFileListOrder;
+
+/**
+ * VnrFileEntry:
+ *
+ * What a #VnrFileList knows about one of its files. The strings live
+ * in the list's string arena; the directory is stored once for all
+ * the files in it.
+ **/
+struct _VnrFileEntry {
+    const gchar *dir;
+    const gchar *name;
+    /* Same pointer as name if both are equal */
+    const gchar *display_name;
+    /* NULL until the list is sorted */
+    const gchar *collate_key;
+    time_t mtime;
+    goffset size;
+};
+
+/**
+ * VnrFileList:
+ *
+ * The images of a collection, and the one currently shown. Files are
+ * kept as plain entries in an array, so that moving around the
+ * collection and telling the position of an image take constant time,
+ * and a list of a million files costs little more than their names. A
+ * #VnrFile is made for an entry only when asked for.
+ *
+ * The entries are always sorted by name. Other orders are a
+ * permutation of them, so switching between orders needs no rescan,
+ * and positions are counted in the current order.
+ **/
+struct _VnrFileList {
+    GArray *entries;
+    GStringChunk *strings;
+    guint current;
+
+    VnrFileListOrder order;
+    /* Entry at each position, and position of each entry, or NULL when
+     * sorted by name */
+    GArray *by_order;
+    GArray *positions;
+
+    /* Entry name -> VnrFile made for it */
+    GHashTable *files;
+    /* Entry name -> number of entries of that name, gathered on the
+     * first lookup, or NULL */
+    GHashTable *names;
+};
+
+/* Constructors */
+VnrFileList *vnr_file_list_new          (void);
+void         vnr_file_list_free         (VnrFileList *list);
+
+/* Read-only properties */
+guint        vnr_file_list_get_length   (VnrFileList *list);
+guint        vnr_file_list_get_position (VnrFileList *list);
+VnrFile     *vnr_file_list_get_current  (VnrFileList *list);
+VnrFile     *vnr_file_list_get_nth      (VnrFileList *list, guint n);
+gchar       *vnr_file_list_get_nth_path (VnrFileList *list, guint n);
+const VnrFileEntry *vnr_file_list_get_nth_entry (VnrFileList *list,
+                                                guint n);
+gboolean     vnr_file_list_find         (VnrFileList *list, const gchar *path,
+                                         guint *position);
+
+/* Actions */
+void         vnr_file_list_add          (VnrFileList *list, const gchar *dir,
+                                         const gchar *name,
+                                         const gchar *display_name,
+                                         time_t mtime, goffset size);
+void         vnr_file_list_add_entry    (VnrFileList *list,
+                                         const VnrFileEntry *entry);
+void         vnr_file_list_append       (VnrFileList *list, VnrFileList *other);
+void         vnr_file_list_insert       (VnrFileList *list, const gchar *dir,
+                                         const gchar *name,
+                                         const gchar *display_name,
+                                         time_t mtime, goffset size);
+gboolean     vnr_file_list_update       (VnrFileList *list, const gchar *path,
+                                         time_t mtime, goffset size);
+void         vnr_file_list_sort         (VnrFileList *list);
+void         vnr_file_list_set_order    (VnrFileList *list,
+                                         VnrFileListOrder order);
+void         vnr_file_list_set_position (VnrFileList *list, guint position);
+gboolean     vnr_file_list_set_current_path (VnrFileList *list,
+                                             const gchar *path);
+void         vnr_file_list_next         (VnrFileList *list);
+void         vnr_file_list_prev         (VnrFileList *list);
+void         vnr_file_list_remove_current (VnrFileList *list);
+gboolean     vnr_file_list_remove       (VnrFileList *list, const gchar *path);
+void         vnr_file_list_merge        (VnrFileList *list, VnrFileList *batch);
+
+G_END_DECLS
+#endif /* __VNR_FILE_LIST_H__ */
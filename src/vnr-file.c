@@ -21,83 +21,209 @@
 #include <glib/gi18n.h>
 #define _(String) gettext (String)
 
+#include <string.h>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
 #include <gdk/gdkpixbuf.h>
 #include "vnr-file.h"
+#include "vnr-file-list.h"
+#include "vnr-workers.h"
+#include "vnr-dir-index.h"
 #include "vnr-tools.h"
 
-G_DEFINE_TYPE (VnrFile, vnr_file, G_TYPE_OBJECT);
+/* Number of files requested from the enumerator at once when reading
+ * a directory asynchronously. */
+#define VNR_FILE_BATCH_SIZE 1024
 
-GList * supported_mime_types;
+/* Most directories read or files queried at once by a crawl */
+#define VNR_FILE_CRAWL_THREADS 16
 
-static gint
-compare_files(VnrFile *file, char *uri)
-{
-    if(g_strcmp0(uri, file->path) == 0)
-        return 0;
-    else
-        return 1;
-}
+/* Number of given paths each crawler job queries */
+#define VNR_FILE_CRAWL_CHUNK 256
+
+/* Interval at which the images found by a crawl are handed over, in
+ * milliseconds. Each hand-over merges them into the whole list, so
+ * this is not done for every job. The first images found are handed
+ * over at the next check, which happens more often. */
+#define VNR_FILE_CRAWL_DELIVERY 250
+#define VNR_FILE_CRAWL_CHECK 50
+
+G_DEFINE_TYPE (VnrFile, vnr_file, G_TYPE_OBJECT);
+
+typedef struct {
+    gchar *path;
+    gboolean include_hidden;
+    GCancellable *cancellable;
+
+    /* Listing read from the index, or all the images found so far and
+     * the time the directory was modified before reading it */
+    VnrFileList *index;
+    VnrFileList *found;
+    gint64 stamp;
+
+    VnrFileBatchFunc func;
+    gpointer user_data;
+} VnrFileDirLoad;
+
+typedef struct {
+    gboolean include_hidden;
+    gboolean recursive;
+    GCancellable *cancellable;
+    VnrWorkGroup *pool;
+    /* Jobs queued or running */
+    gint outstanding;
+
+    /* Images found by the threads since they were last handed over,
+     * sorted, or NULL. Guarded by lock. */
+    GMutex lock;
+    VnrFileList *found;
+    /* Time images were last handed over, or 0 */
+    gint64 delivered;
+
+    VnrFileBatchFunc func;
+    gpointer user_data;
+} VnrFileCrawl;
+
+/* Changed along with the rules deciding which files are listed, so
+ * that listings kept on disk are made again */
+#define VNR_FILE_FILTER_VERSION 1
+
+/* Set of the MIME types gdk-pixbuf can load */
+static GHashTable *supported_mime_types;
+/* Lowercase file extension -> GdkPixbufFormat loading it */
+static GHashTable *supported_extensions;
+/* Checksum of the filter version and the formats of the loaders */
+static gchar *filter_fingerprint;
 
 /* Modified version of eog's eog_image_get_supported_mime_types */
-static GList *
-vnr_file_get_supported_mime_types (void)
+static void
+vnr_file_init_supported_formats (void)
 {
     GSList *format_list, *it;
+    GString *fingerprint;
 
-    if (!supported_mime_types) {
-        format_list = gdk_pixbuf_get_formats ();
-
-        for (it = format_list; it != NULL; it = it->next) {
-            gchar **mime_types = gdk_pixbuf_format_get_mime_types((GdkPixbufFormat *) it->data);
-
-            int i;
-            for (i = 0; mime_types[i] != NULL; i++) {
-                supported_mime_types =
-                    g_list_prepend (supported_mime_types,
-                            g_strdup (mime_types[i]));
-            }
+    if (supported_mime_types != NULL)
+        return;
 
-            g_strfreev (mime_types);
+    supported_mime_types = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, NULL);
+    supported_extensions = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, NULL);
+
+    format_list = gdk_pixbuf_get_formats ();
+    fingerprint = g_string_new (NULL);
+    g_string_append_printf (fingerprint, "%d", VNR_FILE_FILTER_VERSION);
+
+    for (it = format_list; it != NULL; it = it->next) {
+        GdkPixbufFormat *format = it->data;
+        gchar **mime_types = gdk_pixbuf_format_get_mime_types (format);
+        gchar **extensions = gdk_pixbuf_format_get_extensions (format);
+        gchar *name = gdk_pixbuf_format_get_name (format);
+
+        int i;
+        g_string_append_printf (fingerprint, "\n%s:", name);
+        for (i = 0; mime_types[i] != NULL; i++) {
+            g_hash_table_add (supported_mime_types, g_strdup (mime_types[i]));
+            g_string_append_printf (fingerprint, " %s", mime_types[i]);
+        }
+        for (i = 0; extensions[i] != NULL; i++) {
+            g_hash_table_insert (supported_extensions,
+                                 g_ascii_strdown (extensions[i], -1), format);
+            g_string_append_printf (fingerprint, " .%s", extensions[i]);
         }
 
-        supported_mime_types = g_list_prepend(supported_mime_types,
-                                              "image/vnd.microsoft.icon");
-
-        supported_mime_types = g_list_sort (supported_mime_types,
-                            (GCompareFunc) compare_quarks);
-
-        g_slist_free (format_list);
+        g_free (name);
+        g_strfreev (mime_types);
+        g_strfreev (extensions);
     }
 
-    return supported_mime_types;
+    g_hash_table_add (supported_mime_types,
+                      g_strdup ("image/vnd.microsoft.icon"));
+
+    filter_fingerprint = g_compute_checksum_for_string (G_CHECKSUM_MD5,
+                                                        fingerprint->str,
+                                                        fingerprint->len);
+    g_string_free (fingerprint, TRUE);
+    g_slist_free (format_list);
 }
 
 static gboolean
 vnr_file_is_supported_mime_type (const char *mime_type)
 {
-    GList *result;
-    GQuark quark;
-
     if (mime_type == NULL) {
         return FALSE;
     }
 
-    supported_mime_types = vnr_file_get_supported_mime_types ();
+    vnr_file_init_supported_formats ();
+
+    return g_hash_table_contains (supported_mime_types, mime_type);
+}
+
+static gboolean
+vnr_file_is_supported_extension (const char *name)
+{
+    const char *dot;
+    gchar *extension;
+    gboolean known;
+
+    vnr_file_init_supported_formats ();
+
+    dot = name ? strrchr (name, '.') : NULL;
+    if (dot == NULL || dot == name)
+        return FALSE;
 
-    quark = g_quark_from_string (mime_type);
+    extension = g_ascii_strdown (dot + 1, -1);
+    known = g_hash_table_lookup (supported_extensions, extension) != NULL;
+    g_free (extension);
+    return known;
+}
 
-    result = g_list_find_custom (supported_mime_types,
-                     GINT_TO_POINTER (quark),
-                     (GCompareFunc) compare_quarks);
+static gboolean
+vnr_file_is_supported_content_type (const char *mime_type)
+{
+    if (mime_type == NULL)
+        return FALSE;
 
-    return (result != NULL);
+    return vnr_file_is_supported_mime_type (mime_type)
+           || g_content_type_is_unknown (mime_type);
+}
+
+/* Decides from the name of the file alone whether it is an image, so
+ * that directories can be listed without reading every file. Files
+ * whose name tells nothing about their type are listed as well, as
+ * opening them finds out whether they are images. */
+static gboolean
+vnr_file_is_supported (GFileInfo *file_info)
+{
+    const char *mime_type;
+
+    if (vnr_file_is_supported_extension (g_file_info_get_name (file_info)))
+        return TRUE;
+
+    mime_type = g_file_info_get_attribute_string (file_info,
+                    G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    if (mime_type == NULL)
+        mime_type = g_file_info_get_content_type (file_info);
+
+    return vnr_file_is_supported_content_type (mime_type);
+}
+
+static void
+vnr_file_finalize (GObject *object)
+{
+    VnrFile *file = VNR_FILE (object);
+
+    g_free ((gchar *) file->display_name);
+    g_free ((gchar *) file->display_name_collate);
+    g_free ((gchar *) file->path);
+
+    G_OBJECT_CLASS (vnr_file_parent_class)->finalize (object);
 }
 
 static void
 vnr_file_class_init (VnrFileClass * klass)
 {
+    G_OBJECT_CLASS (klass)->finalize = vnr_file_finalize;
 }
 
 static void
@@ -112,179 +238,608 @@ vnr_file_new ()
     return VNR_FILE (g_object_new (VNR_TYPE_FILE, NULL));
 }
 
-static void
-vnr_file_set_display_name(VnrFile *vnr_file, char *display_name)
+/**
+ * vnr_file_get_filter_fingerprint:
+ * @returns: a string that changes along with the files listed, as the
+ *   gdk-pixbuf loaders installed or the rules of the listing change
+ *
+ * Listings kept on disk are only valid for the fingerprint they were
+ * made with.
+ **/
+const gchar *
+vnr_file_get_filter_fingerprint (void)
 {
-    vnr_file->display_name = g_strdup(display_name);
-    vnr_file->display_name_collate = g_utf8_collate_key_for_filename(display_name, -1);
+    vnr_file_init_supported_formats ();
+    return filter_fingerprint;
 }
 
+/**
+ * vnr_file_name_is_image:
+ * @name: the name of a file
+ * @returns: %FALSE if a file named @name is never listed
+ *
+ * Tells, without looking at the file, whether vnr_file_info_is_image()
+ * may accept it, as it only goes by the name.
+ **/
+gboolean
+vnr_file_name_is_image (const gchar *name)
+{
+    gchar *mime_type;
+    gboolean result;
 
-static gint
-vnr_file_list_compare(gconstpointer a, gconstpointer b, gpointer user_data){
-    return g_strcmp0(VNR_FILE(a)->display_name_collate,
-                     VNR_FILE(b)->display_name_collate);
+    if (vnr_file_is_supported_extension (name))
+        return TRUE;
+
+    mime_type = g_content_type_guess (name, NULL, 0, NULL);
+    result = vnr_file_is_supported_content_type (mime_type);
+    g_free (mime_type);
+    return result;
 }
 
+/**
+ * vnr_file_info_is_image:
+ * @file_info: a #GFileInfo with at least the %VNR_FILE_ATTRIBUTES
+ * @include_hidden: whether hidden files are wanted
+ * @returns: %TRUE if the file belongs in a collection
+ **/
+gboolean
+vnr_file_info_is_image(GFileInfo *file_info, gboolean include_hidden)
+{
+    return vnr_file_is_supported(file_info) && (include_hidden || !g_file_info_get_is_hidden (file_info));
+}
+
+/* Adds the file to @files unless it is not a supported image, or is
+ * hidden and hidden files are not wanted. */
+static void
+vnr_file_list_add_info(VnrFileList *files, const gchar *dir, GFileInfo *file_info, gboolean include_hidden)
+{
+    if(!vnr_file_info_is_image(file_info, include_hidden))
+        return;
+
+    vnr_file_list_add(files, dir, g_file_info_get_name (file_info),
+                      g_file_info_get_display_name (file_info),
+                      g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+                      g_file_info_get_size (file_info));
+}
 
-static GList *
-vnr_file_dir_content_to_list(gchar *path, gboolean sort, gboolean include_hidden)
+/* Lists the images of @path, sorted by name, from its index if it has
+ * one. Returns NULL if @path cannot be read. */
+static VnrFileList *
+vnr_file_dir_read(gchar *path, gboolean include_hidden)
 {
-    GList *file_list = NULL;
     GFile *file;
     GFileEnumerator *f_enum ;
     GFileInfo *file_info;
+    VnrFileList *found;
+    gint64 stamp;
+
+    found = vnr_dir_index_load(path, include_hidden);
+    if(found != NULL)
+        return found;
 
+    stamp = vnr_dir_index_get_stamp(path);
     file = g_file_new_for_path(path);
-    f_enum = g_file_enumerate_children(file, G_FILE_ATTRIBUTE_STANDARD_NAME","
-                                       G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME","
-                                       G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE","
-                                       G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN","
-                                       G_FILE_ATTRIBUTE_TIME_MODIFIED,
+    f_enum = g_file_enumerate_children(file, VNR_FILE_ATTRIBUTES,
                                        G_FILE_QUERY_INFO_NONE,
                                        NULL, NULL);
-    file_info = g_file_enumerator_next_file(f_enum,NULL,NULL);
-
-
-    while(file_info != NULL){
-        VnrFile *vnr_file = vnr_file_new();
-
-        const char *mimetype =g_file_info_get_content_type(file_info);
+    g_object_unref (file);
 
-        if(vnr_file_is_supported_mime_type(mimetype) && (include_hidden || !g_file_info_get_is_hidden (file_info)) ){
-            vnr_file_set_display_name(vnr_file, (char*)g_file_info_get_display_name (file_info));
+    if(f_enum == NULL)
+        return NULL;
 
-            vnr_file->mtime = g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    found = vnr_file_list_new();
+    file_info = g_file_enumerator_next_file(f_enum,NULL,NULL);
 
-            vnr_file->path =g_strjoin(G_DIR_SEPARATOR_S, path,
-                                      vnr_file->display_name, NULL);
 
-            file_list = g_list_prepend(file_list, vnr_file);
-        }
+    while(file_info != NULL){
+        vnr_file_list_add_info(found, path, file_info, include_hidden);
 
         g_object_unref(file_info);
         file_info = g_file_enumerator_next_file(f_enum,NULL,NULL);
     }
 
-    g_object_unref (file);
     g_file_enumerator_close (f_enum, NULL, NULL);
     g_object_unref (f_enum);
 
-    if(sort)
-        file_list = g_list_sort_with_data(file_list,
-                                          vnr_file_list_compare, NULL);
+    vnr_file_list_sort(found);
+    vnr_dir_index_save(path, include_hidden, stamp, found);
+    return found;
+}
+
+static void
+vnr_file_dir_content_to_list(gchar *path, VnrFileList *files, gboolean include_hidden)
+{
+    VnrFileList *found;
 
-    return file_list;
+    found = vnr_file_dir_read(path, include_hidden);
+    if(found != NULL)
+        vnr_file_list_append(files, found);
 }
 
+/* Frees @files and returns NULL if there are none. */
+static VnrFileList *
+vnr_file_list_or_free(VnrFileList *files)
+{
+    if(files != NULL && vnr_file_list_get_length(files) == 0)
+    {
+        vnr_file_list_free(files);
+        return NULL;
+    }
+    return files;
+}
 
-void
-vnr_file_load_single_uri(char *p_path, GList **file_list, gboolean include_hidden, GError **error)
+/* Sorts @files, or frees them and returns NULL if there are none. */
+static VnrFileList *
+vnr_file_list_sort_or_free(VnrFileList *files)
 {
-    GFile *file;
-    GFileInfo *fileinfo;
-    GFileType filetype;
+    files = vnr_file_list_or_free(files);
+    if(files != NULL)
+        vnr_file_list_sort(files);
+    return files;
+}
 
-    file = g_file_new_for_path(p_path);
-    fileinfo = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE","
-                                  G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME,
-                                  0, NULL, error);
+static void
+vnr_file_dir_load_free(VnrFileDirLoad *load)
+{
+    g_free(load->path);
+    if(load->cancellable != NULL)
+        g_object_unref(load->cancellable);
+    vnr_file_list_free(load->index);
+    vnr_file_list_free(load->found);
+    g_free(load);
+}
 
-    if (fileinfo == NULL)
+static void
+vnr_file_dir_next_files_cb(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    VnrFileDirLoad *load = user_data;
+    GFileEnumerator *f_enum = G_FILE_ENUMERATOR(source);
+    GList *infos, *it;
+    VnrFileList *batch;
+    GError *error = NULL;
+
+    infos = g_file_enumerator_next_files_finish(f_enum, res, &error);
+
+    if(g_cancellable_is_cancelled(load->cancellable))
+    {
+        g_list_free_full(infos, g_object_unref);
+        g_clear_error(&error);
+        g_object_unref(f_enum);
+        vnr_file_dir_load_free(load);
         return;
+    }
 
-    filetype = g_file_info_get_file_type(fileinfo);
+    if(infos == NULL)
+    {
+        if(error != NULL)
+        {
+            g_warning("Error while reading directory: %s", error->message);
+            g_error_free(error);
+        }
+        else
+        {
+            vnr_file_list_sort(load->found);
+            vnr_dir_index_save(load->path, load->include_hidden,
+                               load->stamp, load->found);
+        }
+        g_file_enumerator_close(f_enum, NULL, NULL);
+        g_object_unref(f_enum);
+        load->func(NULL, TRUE, load->user_data);
+        vnr_file_dir_load_free(load);
+        return;
+    }
 
-    if (filetype == G_FILE_TYPE_DIRECTORY)
+    batch = vnr_file_list_new();
+    for(it = infos; it != NULL; it = it->next)
     {
-        *file_list = vnr_file_dir_content_to_list(p_path, TRUE, include_hidden);
+        vnr_file_list_add_info(batch, load->path, it->data, load->include_hidden);
+        g_object_unref(it->data);
     }
-    else
+    g_list_free(infos);
+
+    batch = vnr_file_list_sort_or_free(batch);
+    if(batch != NULL)
     {
-        GFile *parent;
-        GList *current_position;
+        guint i;
 
-        parent = g_file_get_parent(file);
-        *file_list = vnr_file_dir_content_to_list(g_file_get_path(parent), TRUE, include_hidden);
+        /* Kept for the index, with the keys just made */
+        for(i = 0; i < batch->entries->len; i++)
+            vnr_file_list_add_entry(load->found,
+                                    &g_array_index(batch->entries, VnrFileEntry, i));
+        load->func(batch, FALSE, load->user_data);
+    }
 
-        g_object_unref(parent);
+    g_file_enumerator_next_files_async(f_enum, VNR_FILE_BATCH_SIZE,
+                                       G_PRIORITY_LOW, load->cancellable,
+                                       vnr_file_dir_next_files_cb, load);
+}
 
-        current_position = g_list_find_custom(*file_list, p_path,
-                                  (GCompareFunc)compare_files);
+static void
+vnr_file_dir_enumerate_cb(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    VnrFileDirLoad *load = user_data;
+    GFileEnumerator *f_enum;
+    GError *error = NULL;
 
-        if(current_position != NULL)
-            *file_list = current_position;
-        else if(*file_list == NULL)
-            return;
-        else
+    f_enum = g_file_enumerate_children_finish(G_FILE(source), res, &error);
+
+    if(f_enum == NULL)
+    {
+        if(!g_cancellable_is_cancelled(load->cancellable))
         {
-            *error = g_error_new(1, 0,
-                                 _("Couldn't recognise the image file\n"
-                                 "format for file '%s'"),
-                                 g_file_info_get_display_name (fileinfo));
+            g_warning("Error while reading directory: %s", error->message);
+            load->func(NULL, TRUE, load->user_data);
         }
+        g_error_free(error);
+        vnr_file_dir_load_free(load);
+        return;
     }
-    g_object_unref (file);
-    g_object_unref(fileinfo);
+
+    g_file_enumerator_next_files_async(f_enum, VNR_FILE_BATCH_SIZE,
+                                       G_PRIORITY_LOW, load->cancellable,
+                                       vnr_file_dir_next_files_cb, load);
+}
+
+/* Hands over the listing read from the index, as if the directory had
+ * been read in one batch. */
+static gboolean
+vnr_file_dir_index_idle(gpointer user_data)
+{
+    VnrFileDirLoad *load = user_data;
+
+    if(!g_cancellable_is_cancelled(load->cancellable))
+    {
+        load->func(load->index, FALSE, load->user_data);
+        load->index = NULL;
+        load->func(NULL, TRUE, load->user_data);
+    }
+    vnr_file_dir_load_free(load);
+    return FALSE;
 }
 
+/**
+ * vnr_file_load_dir_async:
+ * @p_path: a directory
+ * @include_hidden: whether to list hidden files
+ * @cancellable: a #GCancellable, or %NULL
+ * @func: called with each batch of images found
+ * @user_data: data passed to @func
+ *
+ * Reads @p_path in batches, without blocking the main loop. @func is
+ * called for every batch containing images, and once more with @done
+ * set when the whole directory was read or reading failed. It is not
+ * called anymore once @cancellable is cancelled.
+ **/
 void
-vnr_file_load_uri_list (GSList *uri_list, GList **file_list, gboolean include_hidden, GError **error)
+vnr_file_load_dir_async(const gchar *p_path, gboolean include_hidden,
+                        GCancellable *cancellable,
+                        VnrFileBatchFunc func, gpointer user_data)
 {
-    GFileType filetype;
-    gchar *p_path;
+    VnrFileDirLoad *load;
+    GFile *file;
+
+    load = g_new0(VnrFileDirLoad, 1);
+    load->path = g_strdup(p_path);
+    load->include_hidden = include_hidden;
+    load->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+    load->func = func;
+    load->user_data = user_data;
+
+    load->index = vnr_dir_index_load(p_path, include_hidden);
+    if(load->index != NULL)
+    {
+        g_idle_add(vnr_file_dir_index_idle, load);
+        return;
+    }
+
+    load->found = vnr_file_list_new();
+    load->stamp = vnr_dir_index_get_stamp(p_path);
+
+    file = g_file_new_for_path(p_path);
+    g_file_enumerate_children_async(file, VNR_FILE_ATTRIBUTES,
+                                    G_FILE_QUERY_INFO_NONE, G_PRIORITY_LOW,
+                                    cancellable,
+                                    vnr_file_dir_enumerate_cb, load);
+    g_object_unref(file);
+}
+
+/* Tells the main loop about the images found by the crawler threads
+ * since last time. Returns FALSE once the crawl is over. */
+static gboolean
+vnr_file_crawl_deliver(VnrFileCrawl *crawl)
+{
+    VnrFileList *batch;
+    gboolean finished;
+    gint64 now = g_get_monotonic_time();
 
-    while(uri_list != NULL)
+    /* Threads hand over their images before finishing, so everything
+     * was handed over if they are all done. */
+    finished = g_atomic_int_get(&crawl->outstanding) == 0;
+
+    if(!finished && crawl->delivered != 0 &&
+       now - crawl->delivered < VNR_FILE_CRAWL_DELIVERY * 1000)
+        return TRUE;
+
+    /* The threads sorted the images already */
+    g_mutex_lock(&crawl->lock);
+    batch = crawl->found;
+    crawl->found = NULL;
+    g_mutex_unlock(&crawl->lock);
+
+    if(batch != NULL && !g_cancellable_is_cancelled(crawl->cancellable))
     {
-        p_path = uri_list->data;
-        GFile *file = g_file_new_for_path(p_path);
-        GFileInfo *fileinfo = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE","
-                                      G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME","
-                                      G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE","
-                                      G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN","
-                                       G_FILE_ATTRIBUTE_TIME_MODIFIED,
-                                      0, NULL, error);
-
-        if (fileinfo == NULL)
+        crawl->delivered = now;
+        crawl->func(batch, FALSE, crawl->user_data);
+    }
+    else if(batch != NULL)
+        vnr_file_list_free(batch);
+
+    if(!finished)
+        return TRUE;
+
+    if(!g_cancellable_is_cancelled(crawl->cancellable))
+        crawl->func(NULL, TRUE, crawl->user_data);
+
+    vnr_work_group_free(crawl->pool, FALSE, TRUE);
+    g_mutex_clear(&crawl->lock);
+    if(crawl->cancellable != NULL)
+        g_object_unref(crawl->cancellable);
+    g_free(crawl);
+    return FALSE;
+}
+
+/* Queues a job reading the NULL-terminated @paths, which it frees */
+static void
+vnr_file_crawl_push(VnrFileCrawl *crawl, gchar **paths)
+{
+    g_atomic_int_inc(&crawl->outstanding);
+    vnr_work_group_push(crawl->pool, paths);
+}
+
+/* Adds the images of the directory @path to @files, handing its
+ * subdirectories over to the other threads. */
+static void
+vnr_file_crawl_read_dir(VnrFileCrawl *crawl, const gchar *path, VnrFileList *files)
+{
+    GFile *file;
+    GFileEnumerator *f_enum;
+    GFileInfo *file_info;
+
+    file = g_file_new_for_path(path);
+    f_enum = g_file_enumerate_children(file, G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                       G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK","
+                                       VNR_FILE_ATTRIBUTES,
+                                       G_FILE_QUERY_INFO_NONE,
+                                       crawl->cancellable, NULL);
+    g_object_unref(file);
+
+    if(f_enum == NULL)
+        return;
+
+    while((file_info = g_file_enumerator_next_file(f_enum, crawl->cancellable, NULL)) != NULL)
+    {
+        GFileType type = g_file_info_get_file_type(file_info);
+
+        /* Linked directories are not followed, so the tree has no
+         * loops */
+        if(type == G_FILE_TYPE_DIRECTORY &&
+           !g_file_info_get_is_symlink(file_info) &&
+           (crawl->include_hidden || !g_file_info_get_is_hidden(file_info)))
         {
-            g_clear_error (error);
-            g_object_unref (file);
+            gchar **paths = g_new0(gchar *, 2);
 
-            uri_list = g_slist_next(uri_list);
-            continue;
+            paths[0] = g_build_filename(path, g_file_info_get_name(file_info), NULL);
+            vnr_file_crawl_push(crawl, paths);
         }
+        else if(type == G_FILE_TYPE_REGULAR)
+            vnr_file_list_add_info(files, path, file_info, crawl->include_hidden);
 
-        filetype = g_file_info_get_file_type(fileinfo);
+        g_object_unref(file_info);
+    }
+    g_file_enumerator_close(f_enum, NULL, NULL);
+    g_object_unref(f_enum);
+}
+
+/* Runs on a crawler thread: lists the images among the paths of a job,
+ * and in the directories among them. */
+static void
+vnr_file_crawl_job(gpointer data, gpointer user_data)
+{
+    VnrFileCrawl *crawl = user_data;
+    gchar **paths = data;
+    VnrFileList *files = vnr_file_list_new();
+    guint i;
 
-        if (filetype == G_FILE_TYPE_DIRECTORY)
+    for(i = 0; paths[i] != NULL && !g_cancellable_is_cancelled(crawl->cancellable); i++)
+    {
+        GFile *file = g_file_new_for_path(paths[i]);
+        GFileInfo *file_info;
+
+        file_info = g_file_query_info(file, G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                      VNR_FILE_ATTRIBUTES,
+                                      0, crawl->cancellable, NULL);
+        g_object_unref(file);
+
+        if(file_info == NULL)
+            continue;
+
+        if(g_file_info_get_file_type(file_info) == G_FILE_TYPE_DIRECTORY)
+        {
+            if(crawl->recursive)
+                vnr_file_crawl_read_dir(crawl, paths[i], files);
+            else
+                vnr_file_dir_content_to_list(paths[i], files, crawl->include_hidden);
+        }
+        else if(g_file_info_get_file_type(file_info) == G_FILE_TYPE_REGULAR)
         {
-            *file_list = g_list_concat (*file_list, vnr_file_dir_content_to_list(p_path, FALSE, include_hidden));
+            gchar *dir = g_path_get_dirname(paths[i]);
+
+            vnr_file_list_add_info(files, dir, file_info, crawl->include_hidden);
+            g_free(dir);
         }
+        g_object_unref(file_info);
+    }
+
+    /* Making the collation keys, sorting and merging here leaves the
+     * main loop only the merge into the list shown */
+    files = vnr_file_list_sort_or_free(files);
+    if(files != NULL)
+    {
+        g_mutex_lock(&crawl->lock);
+        if(crawl->found == NULL)
+            crawl->found = files;
         else
+            vnr_file_list_merge(crawl->found, files);
+        g_mutex_unlock(&crawl->lock);
+    }
+
+    g_strfreev(paths);
+    g_atomic_int_add(&crawl->outstanding, -1);
+}
+
+/**
+ * vnr_file_load_paths_async:
+ * @paths: a list of paths to files and directories
+ * @include_hidden: whether to list hidden files and directories
+ * @recursive: whether to list the subdirectories of directories too
+ * @cancellable: a #GCancellable, or %NULL
+ * @func: called with each batch of images found
+ * @user_data: data passed to @func
+ *
+ * Lists the images among @paths and in the directories among them,
+ * without blocking the main loop, like vnr_file_load_dir_async().
+ * Paths are queried in chunks, and directories read, by a bounded
+ * pool of threads. The images found are passed to @func a few times a
+ * second, the first ones as soon as they are found.
+ **/
+void
+vnr_file_load_paths_async(GSList *paths, gboolean include_hidden,
+                          gboolean recursive, GCancellable *cancellable,
+                          VnrFileBatchFunc func, gpointer user_data)
+{
+    VnrFileCrawl *crawl;
+    guint threads;
+
+    /* Filled before the threads may look at them */
+    vnr_file_init_supported_formats();
+
+    crawl = g_new0(VnrFileCrawl, 1);
+    crawl->include_hidden = include_hidden;
+    crawl->recursive = recursive;
+    crawl->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+    crawl->func = func;
+    crawl->user_data = user_data;
+    g_mutex_init(&crawl->lock);
+
+    /* Reading directories mostly waits on the disk. Half the workers
+     * are left to more urgent jobs meanwhile. */
+    threads = CLAMP(vnr_workers_get_n_threads() / 2, 2, VNR_FILE_CRAWL_THREADS);
+    crawl->pool = vnr_work_group_new(VNR_WORK_METADATA, vnr_file_crawl_job,
+                                     crawl, threads, NULL, NULL);
+
+    while(paths != NULL)
+    {
+        gchar **chunk = g_new0(gchar *, VNR_FILE_CRAWL_CHUNK + 1);
+        guint i;
+
+        for(i = 0; i < VNR_FILE_CRAWL_CHUNK && paths != NULL; i++)
         {
-            VnrFile *new_vnrfile;
-            const char *mimetype;
+            chunk[i] = g_strdup(paths->data);
+            paths = paths->next;
+        }
+        vnr_file_crawl_push(crawl, chunk);
+    }
 
-            new_vnrfile = vnr_file_new();
+    g_timeout_add(VNR_FILE_CRAWL_CHECK, (GSourceFunc)vnr_file_crawl_deliver, crawl);
+}
+
+/**
+ * vnr_file_load_single_image:
+ * @p_path: the file to load
+ * @file_list: return location for the list
+ * @include_hidden: whether hidden files are listed
+ * @returns: %TRUE if @p_path is a supported image
+ *
+ * Makes a list holding @p_path only, so that it can be shown before
+ * the rest of its directory is read with vnr_file_load_dir_async().
+ * On %FALSE, the file should be loaded with vnr_file_load_single_uri()
+ * instead, which reports why it cannot be shown.
+ **/
+gboolean
+vnr_file_load_single_image(char *p_path, VnrFileList **file_list, gboolean include_hidden)
+{
+    GFile *file;
+    GFileInfo *fileinfo;
+    gchar *dir;
 
-            mimetype = g_file_info_get_content_type(fileinfo);
+    file = g_file_new_for_path(p_path);
+    fileinfo = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                  VNR_FILE_ATTRIBUTES,
+                                  0, NULL, NULL);
+    g_object_unref (file);
 
-            if(vnr_file_is_supported_mime_type(mimetype) && (include_hidden || !g_file_info_get_is_hidden (fileinfo)) )
-            {
-                vnr_file_set_display_name(new_vnrfile, (char*)g_file_info_get_display_name (fileinfo));
+    if (fileinfo == NULL)
+        return FALSE;
 
-                new_vnrfile->mtime = g_file_info_get_attribute_uint64 (fileinfo, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    *file_list = vnr_file_list_new();
 
-                new_vnrfile->path = g_strdup(p_path);
+    if (g_file_info_get_file_type(fileinfo) == G_FILE_TYPE_REGULAR)
+    {
+        dir = g_path_get_dirname(p_path);
+        vnr_file_list_add_info(*file_list, dir, fileinfo, include_hidden);
+        g_free(dir);
+    }
+    g_object_unref (fileinfo);
 
-                *file_list = g_list_prepend(*file_list, new_vnrfile);
-            }
-        }
-        g_object_unref (file);
-        g_object_unref (fileinfo);
+    *file_list = vnr_file_list_sort_or_free(*file_list);
+    return *file_list != NULL;
+}
 
-        uri_list = g_slist_next(uri_list);
+void
+vnr_file_load_single_uri(char *p_path, VnrFileList **file_list, gboolean include_hidden, GError **error)
+{
+    GFile *file;
+    GFileInfo *fileinfo;
+    GFileType filetype;
+
+    file = g_file_new_for_path(p_path);
+    fileinfo = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                                  G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME,
+                                  0, NULL, error);
+
+    if (fileinfo == NULL)
+        return;
+
+    filetype = g_file_info_get_file_type(fileinfo);
+
+    /* A single directory comes out sorted already */
+    if (filetype == G_FILE_TYPE_DIRECTORY)
+    {
+        *file_list = vnr_file_list_or_free(vnr_file_dir_read(p_path, include_hidden));
     }
+    else
+    {
+        GFile *parent;
+        gchar *parent_path;
 
-    *file_list = g_list_sort_with_data(*file_list, vnr_file_list_compare, NULL);
+        parent = g_file_get_parent(file);
+        parent_path = g_file_get_path(parent);
+        *file_list = vnr_file_list_or_free(vnr_file_dir_read(parent_path, include_hidden));
+
+        g_free(parent_path);
+        g_object_unref(parent);
+
+        if(*file_list == NULL)
+            return;
+
+        if(!vnr_file_list_set_current_path(*file_list, p_path))
+        {
+            *error = g_error_new(1, 0,
+                                 _("Couldn't recognise the image file\n"
+                                 "format for file '%s'"),
+                                 g_file_info_get_display_name (fileinfo));
+        }
+    }
+    g_object_unref (file);
+    g_object_unref(fileinfo);
 }
@@ -21,9 +21,18 @@
 #define __VNR_FILE_H__
 
 #include <gtk/gtk.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
+/* What needs to be known about a file to list it */
+#define VNR_FILE_ATTRIBUTES G_FILE_ATTRIBUTE_STANDARD_NAME"," \
+                            G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME"," \
+                            G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE"," \
+                            G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN"," \
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE"," \
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED
+
 #define VNR_TYPE_FILE            (vnr_file_get_type ())
 #define VNR_FILE(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), VNR_TYPE_FILE, VnrFile))
 #define VNR_FILE_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), VNR_TYPE_FILE, VnrFileClass))
@@ -33,6 +42,7 @@ G_BEGIN_DECLS
 
 typedef struct _VnrFile VnrFile;
 typedef struct _VnrFileClass VnrFileClass;
+typedef struct _VnrFileList VnrFileList;
 
 struct _VnrFile {
     GObject parent;
@@ -47,14 +57,32 @@ struct _VnrFileClass {
     GObjectClass parent;
 };
 
+/**
+ * VnrFileBatchFunc:
+ * @batch: a sorted #VnrFileList of newly found files, or %NULL. Owned
+ *   by the callee.
+ * @done: whether the directory was read to the end
+ * @user_data: the data passed to vnr_file_load_dir_async()
+ **/
+typedef void (*VnrFileBatchFunc) (VnrFileList *batch, gboolean done, gpointer user_data);
+
 GType   vnr_file_get_type   (void) G_GNUC_CONST;
 
 /* Constructors */
 VnrFile *vnr_file_new ();
 
 /* Actions */
-void    vnr_file_load_uri_list      (GSList *uri_list, GList **file_list, gboolean include_hidden, GError **error);
-void    vnr_file_load_single_uri    (char *p_uri, GList **file_list, gboolean include_hidden, GError **error);
+const gchar *vnr_file_get_filter_fingerprint (void);
+gboolean vnr_file_name_is_image     (const gchar *name);
+gboolean vnr_file_info_is_image     (GFileInfo *file_info, gboolean include_hidden);
+void    vnr_file_load_single_uri    (char *p_uri, VnrFileList **file_list, gboolean include_hidden, GError **error);
+gboolean vnr_file_load_single_image (char *p_path, VnrFileList **file_list, gboolean include_hidden);
+void    vnr_file_load_dir_async     (const gchar *p_path, gboolean include_hidden,
+                                     GCancellable *cancellable,
+                                     VnrFileBatchFunc func, gpointer user_data);
+void    vnr_file_load_paths_async   (GSList *paths, gboolean include_hidden,
+                                     gboolean recursive, GCancellable *cancellable,
+                                     VnrFileBatchFunc func, gpointer user_data);
 
 
 G_END_DECLS
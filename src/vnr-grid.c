@@ -0,0 +1,884 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <gdk/gdkkeysyms.h>
+#include "vnr-grid.h"
+#include "vnr-thumbnails.h"
+#include "uni-marshal.h"
+
+/* Upper bound for the memory held by the thumbnails of the grid */
+#define VNR_GRID_CACHE_SIZE (64 * 1024 * 1024)
+
+/* Space around the thumbnail and the name of a cell */
+#define VNR_GRID_PADDING 6
+
+/* Thumbnails of the grid, and their width and height at most */
+#define VNR_GRID_THUMBNAIL_SIZE VNR_THUMBNAIL_NORMAL
+#define VNR_GRID_THUMBNAIL_PIXELS \
+    vnr_thumbnails_get_pixels (VNR_GRID_THUMBNAIL_SIZE)
+
+enum {
+    SET_SCROLL_ADJUSTMENTS,
+    ACTIVATED,
+    LAST_SIGNAL
+};
+
+static guint vnr_grid_signals[LAST_SIGNAL] = { 0 };
+
+G_DEFINE_TYPE (VnrGrid, vnr_grid, GTK_TYPE_DRAWING_AREA);
+
+typedef struct {
+    gchar *path;
+    /* Time the file was modified when the thumbnail was made */
+    time_t mtime;
+    /* NULL if no thumbnail could be made */
+    GdkPixbuf *pixbuf;
+
+    /* Link of the thumbnail in the LRU queue */
+    GList *link;
+} VnrGridThumbnail;
+
+typedef struct {
+    VnrGrid *grid;
+    gchar *path;
+    time_t mtime;
+    guint position;
+    GCancellable *cancellable;
+} VnrGridRequest;
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static gsize
+vnr_grid_thumbnail_size (VnrGridThumbnail *thumbnail)
+{
+    if (thumbnail->pixbuf == NULL)
+        return sizeof (VnrGridThumbnail);
+
+    return (gsize) gdk_pixbuf_get_rowstride (thumbnail->pixbuf) *
+        gdk_pixbuf_get_height (thumbnail->pixbuf);
+}
+
+static void
+vnr_grid_thumbnail_free (VnrGridThumbnail *thumbnail)
+{
+    if (thumbnail->pixbuf != NULL)
+        g_object_unref (thumbnail->pixbuf);
+    g_free (thumbnail->path);
+    g_slice_free (VnrGridThumbnail, thumbnail);
+}
+
+static void
+vnr_grid_cache_remove (VnrGrid *grid, VnrGridThumbnail *thumbnail)
+{
+    grid->size -= vnr_grid_thumbnail_size (thumbnail);
+    g_queue_delete_link (grid->lru, thumbnail->link);
+    g_hash_table_remove (grid->thumbnails, thumbnail->path);
+}
+
+/* Returns the thumbnail held for @path, which becomes the most
+ * recently used, or NULL if there is none or it is out of date */
+static VnrGridThumbnail *
+vnr_grid_cache_lookup (VnrGrid *grid, const gchar *path, time_t mtime)
+{
+    VnrGridThumbnail *thumbnail = g_hash_table_lookup (grid->thumbnails,
+                                                       path);
+
+    if (thumbnail == NULL)
+        return NULL;
+
+    if (thumbnail->mtime != mtime)
+    {
+        vnr_grid_cache_remove (grid, thumbnail);
+        return NULL;
+    }
+
+    g_queue_unlink (grid->lru, thumbnail->link);
+    g_queue_push_head_link (grid->lru, thumbnail->link);
+    return thumbnail;
+}
+
+static void
+vnr_grid_cache_insert (VnrGrid *grid, const gchar *path, time_t mtime,
+                       GdkPixbuf *pixbuf)
+{
+    VnrGridThumbnail *thumbnail = g_hash_table_lookup (grid->thumbnails,
+                                                       path);
+
+    if (thumbnail != NULL)
+        vnr_grid_cache_remove (grid, thumbnail);
+
+    thumbnail = g_slice_new (VnrGridThumbnail);
+    thumbnail->path = g_strdup (path);
+    thumbnail->mtime = mtime;
+    thumbnail->pixbuf = pixbuf ? g_object_ref (pixbuf) : NULL;
+    g_queue_push_head (grid->lru, thumbnail);
+    thumbnail->link = grid->lru->head;
+    g_hash_table_insert (grid->thumbnails, thumbnail->path, thumbnail);
+    grid->size += vnr_grid_thumbnail_size (thumbnail);
+
+    while (grid->size > VNR_GRID_CACHE_SIZE && grid->lru->length > 1)
+        vnr_grid_cache_remove (grid, g_queue_peek_tail (grid->lru));
+}
+
+static void
+vnr_grid_request_free (VnrGridRequest *request)
+{
+    g_cancellable_cancel (request->cancellable);
+    g_object_unref (request->cancellable);
+    g_free (request->path);
+    g_slice_free (VnrGridRequest, request);
+}
+
+/* Offset of the window in the sheet, in whole pixels so that scrolling
+ * moves the cells painted already without blurring them */
+static gdouble
+vnr_grid_get_offset (VnrGrid *grid)
+{
+    return floor (gtk_adjustment_get_value (grid->vadj));
+}
+
+/* Leftmost pixel of the cells, which are centered in the width */
+static gint
+vnr_grid_get_margin (VnrGrid *grid)
+{
+    GtkAllocation allocation;
+
+    gtk_widget_get_allocation (GTK_WIDGET (grid), &allocation);
+    return MAX (0, allocation.width - grid->columns * grid->cell_width) / 2;
+}
+
+/* Sets @rect to the area of the cell at @position, in the window */
+static void
+vnr_grid_get_cell_rect (VnrGrid *grid, guint position, GdkRectangle *rect)
+{
+    gdouble offset = vnr_grid_get_offset (grid);
+
+    rect->x = vnr_grid_get_margin (grid)
+              + (position % grid->columns) * grid->cell_width;
+    rect->y = (gint) ((gdouble) (position / grid->columns) * grid->cell_height
+                      - offset);
+    rect->width = grid->cell_width;
+    rect->height = grid->cell_height;
+}
+
+/* Sets @first and @last to the positions of the cells that rows @y to
+ * @y + @height of the window cross, @last excluded */
+static void
+vnr_grid_get_range (VnrGrid *grid, gint y, gint height,
+                    guint *first, guint *last)
+{
+    guint length = vnr_file_list_get_length (grid->list);
+    gdouble offset = vnr_grid_get_offset (grid);
+    guint64 first_row, last_row;
+
+    if (length == 0 || height <= 0)
+    {
+        *first = *last = 0;
+        return;
+    }
+
+    first_row = (guint64) MAX (0.0, (offset + y) / grid->cell_height);
+    last_row = (guint64) MAX (0.0, (offset + y + height - 1)
+                                   / grid->cell_height);
+    *first = (guint) MIN (first_row * grid->columns, length);
+    *last = (guint) MIN ((last_row + 1) * grid->columns, length);
+}
+
+static guint
+vnr_grid_get_position_at (VnrGrid *grid, gint x, gint y, gboolean *found)
+{
+    guint64 row, column, position;
+
+    x -= vnr_grid_get_margin (grid);
+    *found = FALSE;
+    if (x < 0 || y < 0 || x >= grid->columns * grid->cell_width)
+        return 0;
+
+    column = x / grid->cell_width;
+    row = (guint64) ((vnr_grid_get_offset (grid) + y) / grid->cell_height);
+    position = row * grid->columns + column;
+    *found = position < vnr_file_list_get_length (grid->list);
+    return (guint) position;
+}
+
+static void
+vnr_grid_thumbnail_cb (const gchar *path, GdkPixbuf *thumbnail,
+                       VnrGridRequest *request)
+{
+    VnrGrid *grid = request->grid;
+    GdkRectangle rect;
+
+    vnr_grid_cache_insert (grid, request->path, request->mtime, thumbnail);
+    vnr_grid_get_cell_rect (grid, request->position, &rect);
+    gtk_widget_queue_draw_area (GTK_WIDGET (grid), rect.x, rect.y,
+                                rect.width, rect.height);
+
+    g_hash_table_remove (grid->pending, request->path);
+}
+
+/* Whether the thumbnail of the cell at @position is neither held nor
+ * asked for. @path is set to the path of its file, to be freed. */
+static gboolean
+vnr_grid_is_missing (VnrGrid *grid, guint position, gchar **path)
+{
+    const VnrFileEntry *entry = vnr_file_list_get_nth_entry (grid->list,
+                                                            position);
+    VnrGridThumbnail *thumbnail;
+
+    *path = vnr_file_list_get_nth_path (grid->list, position);
+    thumbnail = g_hash_table_lookup (grid->thumbnails, *path);
+    return (thumbnail == NULL || thumbnail->mtime != entry->mtime)
+           && g_hash_table_lookup (grid->pending, *path) == NULL;
+}
+
+/* Asks for the thumbnail of the cell at @position, unless it is held
+ * or being made already */
+static void
+vnr_grid_request (VnrGrid *grid, guint position)
+{
+    VnrGridRequest *request;
+    gchar *path;
+
+    if (!vnr_grid_is_missing (grid, position, &path))
+    {
+        g_free (path);
+        return;
+    }
+
+    request = g_slice_new (VnrGridRequest);
+    request->grid = grid;
+    request->path = path;
+    request->mtime = vnr_file_list_get_nth_entry (grid->list, position)->mtime;
+    request->position = position;
+    request->cancellable = g_cancellable_new ();
+    g_hash_table_insert (grid->pending, request->path, request);
+
+    vnr_thumbnails_request (path, VNR_GRID_THUMBNAIL_SIZE,
+                            request->cancellable,
+                            (VnrThumbnailFunc) vnr_grid_thumbnail_cb,
+                            request);
+}
+
+/* Requests are served in the order they are made: the cells in view
+ * are asked for first, then the page below and the page above them.
+ * Requests for cells scrolled out of those are dropped, and so are the
+ * ones for the pages around whenever cells in view have to be asked
+ * for, so that these need not wait behind them. */
+static gboolean
+vnr_grid_update_requests (VnrGrid *grid)
+{
+    GtkAllocation allocation;
+    GHashTableIter iter;
+    VnrGridRequest *request;
+    guint first, last, page, ahead_first, ahead_last, i;
+    gboolean missing;
+    gchar *path;
+
+    grid->request_id = 0;
+    if (grid->list == NULL || !gtk_widget_get_mapped (GTK_WIDGET (grid)))
+        return FALSE;
+
+    gtk_widget_get_allocation (GTK_WIDGET (grid), &allocation);
+    vnr_grid_get_range (grid, 0, allocation.height, &first, &last);
+    page = last - first;
+    ahead_first = first - MIN (first, page);
+    ahead_last = MIN (last + page, vnr_file_list_get_length (grid->list));
+
+    missing = FALSE;
+    for (i = first; i < last && !missing; i++)
+    {
+        missing = vnr_grid_is_missing (grid, i, &path);
+        g_free (path);
+    }
+
+    g_hash_table_iter_init (&iter, grid->pending);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &request))
+    {
+        if (request->position < ahead_first || request->position >= ahead_last
+            || (missing && (request->position < first
+                            || request->position >= last)))
+            g_hash_table_iter_remove (&iter);
+    }
+
+    for (i = first; i < last; i++)
+        vnr_grid_request (grid, i);
+    for (i = last; i < ahead_last; i++)
+        vnr_grid_request (grid, i);
+    for (i = first; i > ahead_first; i--)
+        vnr_grid_request (grid, i - 1);
+
+    return FALSE;
+}
+
+static void
+vnr_grid_queue_requests (VnrGrid *grid)
+{
+    if (grid->request_id == 0)
+        grid->request_id = g_idle_add ((GSourceFunc) vnr_grid_update_requests,
+                                       grid);
+}
+
+/* Drops every request, as when the cells they were made for moved */
+static void
+vnr_grid_cancel_requests (VnrGrid *grid)
+{
+    g_hash_table_remove_all (grid->pending);
+    vnr_grid_queue_requests (grid);
+}
+
+static void
+vnr_grid_update_adjustments (VnrGrid *grid)
+{
+    GtkAllocation allocation;
+    guint length = vnr_file_list_get_length (grid->list);
+    gdouble height;
+
+    gtk_widget_get_allocation (GTK_WIDGET (grid), &allocation);
+    grid->columns = MAX (1, allocation.width / grid->cell_width);
+    height = (gdouble) ((length + grid->columns - 1) / grid->columns)
+             * grid->cell_height;
+    height = MAX (height, allocation.height);
+
+    gtk_adjustment_configure (grid->hadj, 0.0, 0.0, allocation.width,
+                              1.0, allocation.width, allocation.width);
+    gtk_adjustment_configure (grid->vadj,
+                              MIN (gtk_adjustment_get_value (grid->vadj),
+                                   height - allocation.height),
+                              0.0, height,
+                              grid->cell_height / 4,
+                              allocation.height * 0.9,
+                              allocation.height);
+}
+
+static void
+vnr_grid_draw_cell (VnrGrid *grid, cairo_t *cr, guint position)
+{
+    GtkWidget *widget = GTK_WIDGET (grid);
+    GtkStyle *style = gtk_widget_get_style (widget);
+    GtkStateType state = GTK_STATE_NORMAL;
+    const VnrFileEntry *entry;
+    VnrGridThumbnail *thumbnail;
+    GdkRectangle rect;
+    gint pixels = VNR_GRID_THUMBNAIL_PIXELS;
+    gint x, y, width, height;
+    gchar *path;
+
+    vnr_grid_get_cell_rect (grid, position, &rect);
+    x = rect.x + VNR_GRID_PADDING;
+    y = rect.y + VNR_GRID_PADDING;
+
+    if (position == grid->cursor)
+    {
+        state = gtk_widget_has_focus (widget) ? GTK_STATE_SELECTED
+                                              : GTK_STATE_ACTIVE;
+        gdk_cairo_set_source_color (cr, &style->base[state]);
+        gdk_cairo_rectangle (cr, &rect);
+        cairo_fill (cr);
+    }
+
+    entry = vnr_file_list_get_nth_entry (grid->list, position);
+    path = vnr_file_list_get_nth_path (grid->list, position);
+    thumbnail = vnr_grid_cache_lookup (grid, path, entry->mtime);
+    g_free (path);
+
+    /* Thumbnails stand on the line of the names, cells with none yet
+     * get a frame */
+    if (thumbnail != NULL && thumbnail->pixbuf != NULL)
+    {
+        width = gdk_pixbuf_get_width (thumbnail->pixbuf);
+        height = gdk_pixbuf_get_height (thumbnail->pixbuf);
+        gdk_cairo_set_source_pixbuf (cr, thumbnail->pixbuf,
+                                     x + (pixels - width) / 2,
+                                     y + pixels - height);
+        cairo_paint (cr);
+    }
+    else
+    {
+        gdk_cairo_set_source_color (cr, &style->mid[state]);
+        cairo_rectangle (cr, x + 0.5, y + 0.5, pixels - 1, pixels - 1);
+        cairo_set_line_width (cr, 1.0);
+        cairo_stroke (cr);
+    }
+
+    pango_layout_set_text (grid->layout, entry->display_name, -1);
+    gdk_cairo_set_source_color (cr, &style->text[state]);
+    cairo_move_to (cr, x, y + pixels + VNR_GRID_PADDING);
+    pango_cairo_show_layout (cr, grid->layout);
+}
+
+static void
+vnr_grid_scroll_to_cursor (VnrGrid *grid)
+{
+    GtkAllocation allocation;
+    gdouble top, offset;
+
+    gtk_widget_get_allocation (GTK_WIDGET (grid), &allocation);
+    if (allocation.height <= 1)
+    {
+        grid->scroll_to_cursor = TRUE;
+        return;
+    }
+    grid->scroll_to_cursor = FALSE;
+
+    top = (gdouble) (grid->cursor / grid->columns) * grid->cell_height;
+    offset = vnr_grid_get_offset (grid);
+    if (top < offset)
+        gtk_adjustment_set_value (grid->vadj, top);
+    else if (top + grid->cell_height > offset + allocation.height)
+        gtk_adjustment_set_value (grid->vadj,
+                                  top + grid->cell_height - allocation.height);
+}
+
+static void
+vnr_grid_queue_draw_cell (VnrGrid *grid, guint position)
+{
+    GdkRectangle rect;
+
+    vnr_grid_get_cell_rect (grid, position, &rect);
+    gtk_widget_queue_draw_area (GTK_WIDGET (grid), rect.x, rect.y,
+                                rect.width, rect.height);
+}
+
+/* Only the rows scrolled into view are painted */
+static void
+vnr_grid_value_changed_cb (GtkAdjustment *adjustment, VnrGrid *grid)
+{
+    GtkWidget *widget = GTK_WIDGET (grid);
+    gdouble offset = vnr_grid_get_offset (grid);
+    GtkAllocation allocation;
+
+    gtk_widget_get_allocation (widget, &allocation);
+    if (offset == grid->offset)
+        return;
+
+    if (gtk_widget_get_realized (widget)
+        && fabs (offset - grid->offset) < allocation.height)
+        gdk_window_scroll (gtk_widget_get_window (widget), 0,
+                           (gint) (grid->offset - offset));
+    else
+        gtk_widget_queue_draw (widget);
+
+    grid->offset = offset;
+    vnr_grid_queue_requests (grid);
+}
+
+static void
+vnr_grid_set_adjustment (VnrGrid *grid, GtkAdjustment **slot,
+                         GtkAdjustment *adjustment)
+{
+    if (adjustment == NULL)
+        adjustment = GTK_ADJUSTMENT (gtk_adjustment_new (0.0, 0.0, 0.0,
+                                                         0.0, 0.0, 0.0));
+    if (*slot == adjustment)
+        return;
+
+    if (*slot != NULL)
+    {
+        g_signal_handlers_disconnect_by_data (G_OBJECT (*slot), grid);
+        g_object_unref (*slot);
+    }
+    *slot = g_object_ref_sink (adjustment);
+    g_signal_connect (G_OBJECT (adjustment), "value_changed",
+                      G_CALLBACK (vnr_grid_value_changed_cb), grid);
+}
+
+static void
+vnr_grid_set_scroll_adjustments (VnrGrid *grid, GtkAdjustment *hadj,
+                                 GtkAdjustment *vadj)
+{
+    vnr_grid_set_adjustment (grid, &grid->hadj, hadj);
+    vnr_grid_set_adjustment (grid, &grid->vadj, vadj);
+    vnr_grid_update_adjustments (grid);
+
+    grid->offset = vnr_grid_get_offset (grid);
+    gtk_widget_queue_draw (GTK_WIDGET (grid));
+}
+
+/*************************************************************/
+/***** Stuff that deals with the widget **********************/
+/*************************************************************/
+
+static void
+vnr_grid_style_set (GtkWidget *widget, GtkStyle *previous_style)
+{
+    VnrGrid *grid = VNR_GRID (widget);
+    gint pixels = VNR_GRID_THUMBNAIL_PIXELS;
+    gint text_height;
+
+    GTK_WIDGET_CLASS (vnr_grid_parent_class)->style_set (widget,
+                                                         previous_style);
+
+    if (grid->layout != NULL)
+        g_object_unref (grid->layout);
+    grid->layout = gtk_widget_create_pango_layout (widget, "X");
+    pango_layout_get_pixel_size (grid->layout, NULL, &text_height);
+    pango_layout_set_width (grid->layout, pixels * PANGO_SCALE);
+    pango_layout_set_alignment (grid->layout, PANGO_ALIGN_CENTER);
+    pango_layout_set_ellipsize (grid->layout, PANGO_ELLIPSIZE_MIDDLE);
+
+    grid->cell_width = pixels + 2 * VNR_GRID_PADDING;
+    grid->cell_height = pixels + text_height + 3 * VNR_GRID_PADDING;
+    vnr_grid_update_adjustments (grid);
+    gtk_widget_queue_draw (widget);
+}
+
+static void
+vnr_grid_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
+{
+    VnrGrid *grid = VNR_GRID (widget);
+
+    GTK_WIDGET_CLASS (vnr_grid_parent_class)->size_allocate (widget,
+                                                             allocation);
+    vnr_grid_update_adjustments (grid);
+    if (grid->scroll_to_cursor)
+        vnr_grid_scroll_to_cursor (grid);
+    vnr_grid_queue_requests (grid);
+}
+
+static gboolean
+vnr_grid_expose (GtkWidget *widget, GdkEventExpose *ev)
+{
+    VnrGrid *grid = VNR_GRID (widget);
+    GtkStyle *style = gtk_widget_get_style (widget);
+    cairo_t *cr;
+    guint first, last, i;
+
+    cr = gdk_cairo_create (gtk_widget_get_window (widget));
+    gdk_cairo_rectangle (cr, &ev->area);
+    cairo_clip (cr);
+    gdk_cairo_set_source_color (cr, &style->base[GTK_STATE_NORMAL]);
+    cairo_paint (cr);
+
+    vnr_grid_get_range (grid, ev->area.y, ev->area.height, &first, &last);
+    for (i = first; i < last; i++)
+        vnr_grid_draw_cell (grid, cr, i);
+
+    cairo_destroy (cr);
+    return TRUE;
+}
+
+static gboolean
+vnr_grid_button_press (GtkWidget *widget, GdkEventButton *ev)
+{
+    VnrGrid *grid = VNR_GRID (widget);
+    gboolean found;
+    guint position;
+
+    gtk_widget_grab_focus (widget);
+    if (ev->button != 1)
+        return FALSE;
+
+    position = vnr_grid_get_position_at (grid, ev->x, ev->y, &found);
+    if (!found)
+        return TRUE;
+
+    if (ev->type == GDK_2BUTTON_PRESS)
+        g_signal_emit (grid, vnr_grid_signals[ACTIVATED], 0, position);
+    else
+        vnr_grid_set_cursor (grid, position);
+    return TRUE;
+}
+
+static gboolean
+vnr_grid_scroll_event (GtkWidget *widget, GdkEventScroll *ev)
+{
+    VnrGrid *grid = VNR_GRID (widget);
+    gdouble step = pow (gtk_adjustment_get_page_size (grid->vadj), 2.0 / 3.0);
+    gdouble offset = gtk_adjustment_get_value (grid->vadj);
+
+    if (ev->direction == GDK_SCROLL_UP)
+        gtk_adjustment_set_value (grid->vadj, offset - step);
+    else if (ev->direction == GDK_SCROLL_DOWN)
+        gtk_adjustment_set_value (grid->vadj, offset + step);
+    else
+        return FALSE;
+    return TRUE;
+}
+
+static gboolean
+vnr_grid_key_press (GtkWidget *widget, GdkEventKey *ev)
+{
+    VnrGrid *grid = VNR_GRID (widget);
+    GtkAllocation allocation;
+    gint64 length = vnr_file_list_get_length (grid->list);
+    gint64 cursor = grid->cursor;
+    gint64 page;
+
+    if (length == 0)
+        return GTK_WIDGET_CLASS (vnr_grid_parent_class)->key_press_event (widget,
+                                                                          ev);
+
+    gtk_widget_get_allocation (widget, &allocation);
+    page = MAX (1, allocation.height / grid->cell_height) * grid->columns;
+
+    switch (ev->keyval)
+    {
+        case GDK_KEY_Left:
+            cursor--;
+            break;
+        case GDK_KEY_Right:
+            cursor++;
+            break;
+        case GDK_KEY_Up:
+            cursor -= grid->columns;
+            break;
+        case GDK_KEY_Down:
+            cursor += grid->columns;
+            break;
+        case GDK_KEY_Page_Up:
+            cursor -= page;
+            break;
+        case GDK_KEY_Page_Down:
+            cursor += page;
+            break;
+        case GDK_KEY_Home:
+            cursor = 0;
+            break;
+        case GDK_KEY_End:
+            cursor = length - 1;
+            break;
+        case GDK_KEY_Return:
+        case GDK_KEY_KP_Enter:
+        case GDK_KEY_ISO_Enter:
+        case GDK_KEY_space:
+            g_signal_emit (grid, vnr_grid_signals[ACTIVATED], 0, grid->cursor);
+            return TRUE;
+        default:
+            return GTK_WIDGET_CLASS (vnr_grid_parent_class)->key_press_event (widget,
+                                                                              ev);
+    }
+
+    vnr_grid_set_cursor (grid, (guint) CLAMP (cursor, 0, length - 1));
+    return TRUE;
+}
+
+static gboolean
+vnr_grid_focus_changed (GtkWidget *widget, GdkEventFocus *ev)
+{
+    VnrGrid *grid = VNR_GRID (widget);
+
+    if (grid->cursor < vnr_file_list_get_length (grid->list))
+        vnr_grid_queue_draw_cell (grid, grid->cursor);
+    return FALSE;
+}
+
+static void
+vnr_grid_dispose (GObject *object)
+{
+    VnrGrid *grid = VNR_GRID (object);
+
+    if (grid->request_id != 0)
+    {
+        g_source_remove (grid->request_id);
+        grid->request_id = 0;
+    }
+    if (grid->pending != NULL)
+    {
+        g_hash_table_destroy (grid->pending);
+        grid->pending = NULL;
+    }
+    if (grid->thumbnails != NULL)
+    {
+        g_hash_table_destroy (grid->thumbnails);
+        g_queue_free (grid->lru);
+        grid->thumbnails = NULL;
+        grid->lru = NULL;
+    }
+    if (grid->hadj != NULL)
+    {
+        g_signal_handlers_disconnect_by_data (G_OBJECT (grid->hadj), grid);
+        g_object_unref (grid->hadj);
+        grid->hadj = NULL;
+    }
+    if (grid->vadj != NULL)
+    {
+        g_signal_handlers_disconnect_by_data (G_OBJECT (grid->vadj), grid);
+        g_object_unref (grid->vadj);
+        grid->vadj = NULL;
+    }
+    if (grid->layout != NULL)
+    {
+        g_object_unref (grid->layout);
+        grid->layout = NULL;
+    }
+    grid->list = NULL;
+
+    G_OBJECT_CLASS (vnr_grid_parent_class)->dispose (object);
+}
+
+static void
+vnr_grid_class_init (VnrGridClass *klass)
+{
+    GObjectClass *object_class = (GObjectClass *) klass;
+    GtkWidgetClass *widget_class = (GtkWidgetClass *) klass;
+
+    object_class->dispose = vnr_grid_dispose;
+
+    widget_class->style_set = vnr_grid_style_set;
+    widget_class->size_allocate = vnr_grid_size_allocate;
+    widget_class->expose_event = vnr_grid_expose;
+    widget_class->button_press_event = vnr_grid_button_press;
+    widget_class->scroll_event = vnr_grid_scroll_event;
+    widget_class->key_press_event = vnr_grid_key_press;
+    widget_class->focus_in_event = vnr_grid_focus_changed;
+    widget_class->focus_out_event = vnr_grid_focus_changed;
+
+    klass->set_scroll_adjustments = vnr_grid_set_scroll_adjustments;
+    klass->activated = NULL;
+
+    /* Lets a GtkScrolledWindow scroll the grid without a viewport */
+    vnr_grid_signals[SET_SCROLL_ADJUSTMENTS] =
+        widget_class->set_scroll_adjustments_signal =
+        g_signal_new ("set_scroll_adjustments",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (VnrGridClass, set_scroll_adjustments),
+                      NULL, NULL,
+                      uni_marshal_VOID__POINTER_POINTER,
+                      G_TYPE_NONE,
+                      2, GTK_TYPE_ADJUSTMENT, GTK_TYPE_ADJUSTMENT);
+
+    /**
+     * VnrGrid::activated:
+     * @grid: the grid
+     * @position: the position of the image in the list
+     *
+     * The image at @position was double-clicked, or chosen with the
+     * keyboard.
+     **/
+    vnr_grid_signals[ACTIVATED] =
+        g_signal_new ("activated",
+                      G_TYPE_FROM_CLASS (klass),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (VnrGridClass, activated),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__UINT,
+                      G_TYPE_NONE, 1, G_TYPE_UINT);
+}
+
+static void
+vnr_grid_init (VnrGrid *grid)
+{
+    gint pixels = VNR_GRID_THUMBNAIL_PIXELS;
+
+    gtk_widget_set_can_focus (GTK_WIDGET (grid), TRUE);
+    gtk_widget_add_events (GTK_WIDGET (grid), GDK_BUTTON_PRESS_MASK
+                                              | GDK_SCROLL_MASK
+                                              | GDK_KEY_PRESS_MASK);
+
+    grid->list = NULL;
+    grid->cursor = 0;
+    grid->scroll_to_cursor = FALSE;
+    grid->layout = NULL;
+    grid->cell_width = pixels + 2 * VNR_GRID_PADDING;
+    grid->cell_height = pixels + 3 * VNR_GRID_PADDING;
+    grid->columns = 1;
+    grid->offset = 0.0;
+
+    grid->thumbnails = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                              (GDestroyNotify)
+                                              vnr_grid_thumbnail_free);
+    grid->lru = g_queue_new ();
+    grid->size = 0;
+    grid->pending = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                           (GDestroyNotify)
+                                           vnr_grid_request_free);
+    grid->request_id = 0;
+
+    grid->hadj = NULL;
+    grid->vadj = NULL;
+    vnr_grid_set_adjustment (grid, &grid->hadj, NULL);
+    vnr_grid_set_adjustment (grid, &grid->vadj, NULL);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+GtkWidget *
+vnr_grid_new (void)
+{
+    return (GtkWidget *) g_object_new (VNR_TYPE_GRID, NULL);
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_grid_set_list:
+ * @grid: a #VnrGrid
+ * @list: the #VnrFileList to show, or %NULL
+ *
+ * Shows the images of @list, which must outlive @grid or be replaced
+ * before it is freed. The cursor is put on the current image of @list.
+ **/
+void
+vnr_grid_set_list (VnrGrid *grid, VnrFileList *list)
+{
+    grid->list = list;
+    grid->cursor = list ? vnr_file_list_get_position (list) : 0;
+
+    vnr_grid_cancel_requests (grid);
+    vnr_grid_update_adjustments (grid);
+    vnr_grid_scroll_to_cursor (grid);
+    gtk_widget_queue_draw (GTK_WIDGET (grid));
+}
+
+/**
+ * vnr_grid_list_changed:
+ * @grid: a #VnrGrid
+ *
+ * To be called when files were added to or removed from the list of
+ * @grid, or it was sorted in another order.
+ **/
+void
+vnr_grid_list_changed (VnrGrid *grid)
+{
+    guint length = vnr_file_list_get_length (grid->list);
+
+    if (grid->cursor >= length)
+        grid->cursor = length > 0 ? length - 1 : 0;
+
+    vnr_grid_cancel_requests (grid);
+    vnr_grid_update_adjustments (grid);
+    gtk_widget_queue_draw (GTK_WIDGET (grid));
+}
+
+/**
+ * vnr_grid_set_cursor:
+ * @grid: a #VnrGrid
+ * @position: a position in the list of @grid
+ *
+ * Moves the cursor to the image at @position, and scrolls it into view.
+ **/
+void
+vnr_grid_set_cursor (VnrGrid *grid, guint position)
+{
+    g_return_if_fail (position < vnr_file_list_get_length (grid->list));
+
+    vnr_grid_queue_draw_cell (grid, grid->cursor);
+    grid->cursor = position;
+    vnr_grid_queue_draw_cell (grid, grid->cursor);
+    vnr_grid_scroll_to_cursor (grid);
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VNR_GRID_H__
+#define __VNR_GRID_H__
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+#include "vnr-file-list.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrGrid VnrGrid;
+typedef struct _VnrGridClass VnrGridClass;
+
+#define VNR_TYPE_GRID             (vnr_grid_get_type ())
+#define VNR_GRID(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), VNR_TYPE_GRID, VnrGrid))
+#define VNR_GRID_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass),  VNR_TYPE_GRID, VnrGridClass))
+#define VNR_IS_GRID(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), VNR_TYPE_GRID))
+#define VNR_IS_GRID_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass),  VNR_TYPE_GRID))
+#define VNR_GRID_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj),  VNR_TYPE_GRID, VnrGridClass))
+
+/**
+ * VnrGrid:
+ *
+ * A contact sheet of the images of a #VnrFileList. Cells have no
+ * widget or other state of their own: only the rows in view are
+ * painted, straight from the list, so the sheet scrolls the same
+ * whatever the length of the list. Thumbnails are asked for the
+ * cells in view first, then the pages around them, and the most
+ * recently painted ones are kept in memory, up to a number of bytes.
+ **/
+struct _VnrGrid {
+    GtkDrawingArea parent;
+
+    /* Not owned, NULL if there is none */
+    VnrFileList *list;
+    guint cursor;
+    /* Whether the cursor is to be scrolled to once allocated */
+    gboolean scroll_to_cursor;
+
+    GtkAdjustment *hadj;
+    GtkAdjustment *vadj;
+    /* Offset of the window in the sheet when it was last scrolled */
+    gdouble offset;
+    PangoLayout *layout;
+
+    /* Size of a cell, and the cells in a row */
+    gint cell_width;
+    gint cell_height;
+    gint columns;
+
+    /* Path -> thumbnail, the most recently painted first in lru */
+    GHashTable *thumbnails;
+    GQueue *lru;
+    gsize size;
+
+    /* Path -> request on the workers */
+    GHashTable *pending;
+    guint request_id;
+};
+
+struct _VnrGridClass {
+    GtkDrawingAreaClass parent_class;
+
+    void (*set_scroll_adjustments) (VnrGrid *grid,
+                                    GtkAdjustment *hadj,
+                                    GtkAdjustment *vadj);
+    void (*activated)              (VnrGrid *grid, guint position);
+};
+
+GType       vnr_grid_get_type (void) G_GNUC_CONST;
+
+/* Constructors */
+GtkWidget  *vnr_grid_new          (void);
+
+/* Actions */
+void        vnr_grid_set_list     (VnrGrid *grid, VnrFileList *list);
+void        vnr_grid_list_changed (VnrGrid *grid);
+void        vnr_grid_set_cursor   (VnrGrid *grid, guint position);
+
+G_END_DECLS
+#endif /* __VNR_GRID_H__ */
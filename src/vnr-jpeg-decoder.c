@@ -0,0 +1,617 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <libintl.h>
+#include <glib/gi18n.h>
+#define _(String) gettext (String)
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <jpeglib.h>
+#include "vnr-jpeg-decoder.h"
+#include "vnr-workers.h"
+
+/* Fewest pixels worth decoding on a thread of their own */
+#define VNR_JPEG_DECODER_MIN_PIXELS (1024 * 1024)
+
+/* Most bands an image is split into */
+#define VNR_JPEG_DECODER_MAX_BANDS 32
+
+/* Rows decoded between checks for cancellation */
+#define VNR_JPEG_DECODER_ROWS 64
+
+/* A run of restart intervals covering whole rows of MCUs, the rows
+ * of the image they decode to, and the rows of the image the band
+ * fills. The rows either side of the latter are only decoded for the
+ * chroma to be upsampled across the seams. */
+typedef struct {
+    guint first;
+    guint last;
+    gint top;
+    gint rows;
+    gint y;
+    gint height;
+} VnrJpegBand;
+
+/**
+ * VnrJpegDecoder:
+ *
+ * Decodes baseline JPEG files which have restart markers on several
+ * processors at once. The entropy coded data starts afresh at each
+ * marker, so the runs of intervals covering whole rows of MCUs are
+ * JPEG images of their own, given the headers of the file with the
+ * height of the run. Each of these bands is decoded by a worker
+ * straight into its rows of the image.
+ *
+ * Bands of images with vertically subsampled chroma overlap by a few
+ * rows, which are decoded twice so that the seams do not show. Where
+ * the markers are too far apart for that, the rows either side of a
+ * seam may differ slightly from a decoding of the whole file.
+ **/
+struct _VnrJpegDecoder {
+    const guchar *data;
+    gsize length;
+    gint width;
+    gint height;
+    gint orientation;
+
+    /* Offset of the height in the frame header, of the entropy coded
+     * data and of its end */
+    gsize sof;
+    gsize scan;
+    gsize end;
+
+    /* Offset of each restart marker in the data */
+    GArray *markers;
+    guint n_intervals;
+
+    VnrJpegBand *bands;
+    guint n_bands;
+};
+
+typedef struct {
+    VnrJpegDecoder *decoder;
+    guchar *pixels;
+    gint rowstride;
+    GCancellable *cancellable;
+    GError **errors;
+    gint failed;
+} VnrJpegPass;
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+    GError **error;
+} VnrJpegError;
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static guint
+vnr_jpeg_read16 (const guchar *p, gboolean big_endian)
+{
+    return big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static guint32
+vnr_jpeg_read32 (const guchar *p, gboolean big_endian)
+{
+    return big_endian ?
+        ((guint32) vnr_jpeg_read16 (p, TRUE) << 16) | vnr_jpeg_read16 (p + 2, TRUE) :
+        ((guint32) vnr_jpeg_read16 (p + 2, FALSE) << 16) | vnr_jpeg_read16 (p, FALSE);
+}
+
+static guint
+vnr_jpeg_gcd (guint a, guint b)
+{
+    while (b != 0)
+    {
+        guint t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* Reads the headers up to the scan, and tells whether the file is one
+ * that can be split at its restart markers: baseline, a single scan of
+ * every component, and colours libjpeg turns into RGB. */
+static gboolean
+vnr_jpeg_decoder_parse_headers (VnrJpegDecoder *decoder,
+                                guint *restart, guint *mcu_width,
+                                guint *mcu_height)
+{
+    const guchar *data = decoder->data;
+    guint n_components = 0;
+    guint hmax = 1, vmax = 1;
+    gint orientation;
+    gsize pos = 2;
+
+    *restart = 0;
+    for (;;)
+    {
+        const guchar *segment;
+        guint marker, size, i;
+
+        /* Markers may be preceded by any number of fill bytes */
+        while (pos + 1 < decoder->length && data[pos] == 0xff &&
+               data[pos + 1] == 0xff)
+            pos++;
+        if (pos + 4 > decoder->length || data[pos] != 0xff)
+            return FALSE;
+
+        marker = data[pos + 1];
+        size = (data[pos + 2] << 8) | data[pos + 3];
+        if (size < 2 || pos + 2 + size > decoder->length)
+            return FALSE;
+        segment = data + pos + 4;
+        size -= 2;
+
+        switch (marker)
+        {
+        case 0xc0:
+        case 0xc1:
+            if (size < 6 || segment[0] != 8)
+                return FALSE;
+            decoder->sof = pos + 5;
+            decoder->height = (segment[1] << 8) | segment[2];
+            decoder->width = (segment[3] << 8) | segment[4];
+            n_components = segment[5];
+            if ((n_components != 1 && n_components != 3) ||
+                size < 6 + 3 * n_components)
+                return FALSE;
+            for (i = 0; i < n_components; i++)
+            {
+                hmax = MAX (hmax, segment[6 + 3 * i + 1] >> 4);
+                vmax = MAX (vmax, segment[6 + 3 * i + 1] & 0x0f);
+            }
+            break;
+        case 0xdd:
+            if (size < 2)
+                return FALSE;
+            *restart = (segment[0] << 8) | segment[1];
+            break;
+        case 0xe1:
+            orientation = vnr_jpeg_parse_orientation (segment, size);
+            if (orientation != 0)
+                decoder->orientation = orientation;
+            break;
+        case 0xda:
+            if (n_components == 0 || size < 1 || segment[0] != n_components)
+                return FALSE;
+            decoder->scan = pos + 4 + size;
+
+            /* A single component is coded one block at a time */
+            *mcu_width = n_components == 1 ? 8 : 8 * hmax;
+            *mcu_height = n_components == 1 ? 8 : 8 * vmax;
+            return decoder->width > 0 && decoder->height > 0;
+        default:
+            /* Progressive, lossless, hierarchical and arithmetic
+             * coded frames, or markers out of place */
+            if ((marker >= 0xc2 && marker <= 0xcf && marker != 0xc4 &&
+                 marker != 0xcc) || (marker >= 0xd0 && marker <= 0xd9))
+                return FALSE;
+            break;
+        }
+        pos += 4 + size;
+    }
+}
+
+/* Finds the restart markers in the entropy coded data, and its end */
+static gboolean
+vnr_jpeg_decoder_find_markers (VnrJpegDecoder *decoder)
+{
+    const guchar *data = decoder->data;
+    const guchar *found;
+    gsize pos = decoder->scan;
+
+    decoder->markers = g_array_new (FALSE, FALSE, sizeof (gsize));
+    while ((found = memchr (data + pos, 0xff, decoder->length - pos)) != NULL)
+    {
+        gsize offset = found - data;
+
+        if (offset + 1 >= decoder->length)
+            return FALSE;
+        pos = offset + 2;
+        if (data[offset + 1] == 0x00)
+            continue;
+        if (data[offset + 1] == 0xff)
+        {
+            pos = offset + 1;
+            continue;
+        }
+        if (data[offset + 1] >= 0xd0 && data[offset + 1] <= 0xd7)
+        {
+            g_array_append_val (decoder->markers, offset);
+            continue;
+        }
+
+        /* Anything after the scan but its end is left to gdk-pixbuf */
+        decoder->end = offset;
+        return data[offset + 1] == 0xd9;
+    }
+    return FALSE;
+}
+
+/* Splits the image into up to @n bands at the restart markers which
+ * start a row of MCUs, about as high as each other */
+static void
+vnr_jpeg_decoder_plan (VnrJpegDecoder *decoder, guint restart,
+                       guint mcu_width, guint mcu_height, guint n)
+{
+    guint columns = (decoder->width + mcu_width - 1) / mcu_width;
+    guint rows = (decoder->height + mcu_height - 1) / mcu_height;
+    guint gcd = vnr_jpeg_gcd (columns, restart);
+    guint row_step = restart / gcd;
+    guint interval_step = columns / gcd;
+    guint i, row = 0, top, bottom;
+
+    if (n < 2)
+        return;
+
+    decoder->bands = g_new (VnrJpegBand, n);
+    for (i = 1; i <= n; i++)
+    {
+        VnrJpegBand *band = &decoder->bands[decoder->n_bands];
+        guint next = i == n ? rows : (guint) ((guint64) rows * i / n);
+
+        /* Only rows starting an interval can start a band */
+        next = (next + row_step - 1) / row_step * row_step;
+        if (next >= rows)
+            next = rows;
+        if (next <= row)
+            continue;
+
+        /* Chroma rows are shared by rows of MCUs when it is subsampled
+         * vertically, unless decoding them twice costs too much */
+        top = row;
+        bottom = next;
+        if (mcu_height > 8 && 4 * row_step <= next - row)
+        {
+            top = row > 0 ? row - row_step : 0;
+            bottom = MIN (next + row_step, rows);
+        }
+
+        band->first = top / row_step * interval_step;
+        band->last = bottom == rows ? decoder->n_intervals :
+                                      bottom / row_step * interval_step;
+        band->top = top * mcu_height;
+        band->rows = MIN (bottom * mcu_height, (guint) decoder->height) -
+                     band->top;
+        band->y = row * mcu_height;
+        band->height = MIN (next * mcu_height, (guint) decoder->height) -
+                       band->y;
+        decoder->n_bands++;
+        row = next;
+        if (row == rows)
+            break;
+    }
+}
+
+static void
+vnr_jpeg_error_exit (j_common_ptr cinfo)
+{
+    VnrJpegError *jerr = (VnrJpegError *) cinfo->err;
+    char buffer[JMSG_LENGTH_MAX];
+
+    cinfo->err->format_message (cinfo, buffer);
+    if (jerr->error != NULL && *jerr->error == NULL)
+        g_set_error (jerr->error, GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                     _("Failed to load the image: %s"), buffer);
+    longjmp (jerr->setjmp_buffer, 1);
+}
+
+static void
+vnr_jpeg_output_message (j_common_ptr cinfo)
+{
+}
+
+/* Makes up a JPEG file of @band: the headers of the image, with the
+ * rows of the band, followed by its intervals with their restart
+ * markers numbered from the first */
+static guchar *
+vnr_jpeg_decoder_new_band (VnrJpegDecoder *decoder, VnrJpegBand *band,
+                           gsize *length)
+{
+    const gsize *markers = (const gsize *) decoder->markers->data;
+    gsize start, end;
+    guchar *buffer;
+    guint i;
+
+    start = band->first == 0 ? decoder->scan : markers[band->first - 1] + 2;
+    end = band->last == decoder->n_intervals ? decoder->end :
+                                               markers[band->last - 1];
+
+    *length = decoder->scan + (end - start) + 2;
+    buffer = g_try_malloc (*length);
+    if (buffer == NULL)
+        return NULL;
+
+    memcpy (buffer, decoder->data, decoder->scan);
+    buffer[decoder->sof] = band->rows >> 8;
+    buffer[decoder->sof + 1] = band->rows & 0xff;
+    memcpy (buffer + decoder->scan, decoder->data + start, end - start);
+    for (i = band->first; i + 1 < band->last; i++)
+        buffer[decoder->scan + markers[i] - start + 1] =
+            0xd0 + (i - band->first) % 8;
+    buffer[*length - 2] = 0xff;
+    buffer[*length - 1] = 0xd9;
+    return buffer;
+}
+
+/* Runs on a worker: decodes @band into its rows of the image */
+static void
+vnr_jpeg_decoder_run (VnrJpegBand *band, VnrJpegPass *pass)
+{
+    VnrJpegDecoder *decoder = pass->decoder;
+    GError **error = &pass->errors[band - decoder->bands];
+    struct jpeg_decompress_struct cinfo;
+    VnrJpegError jerr;
+    guchar *volatile scratch = NULL;
+    guchar *buffer;
+    gsize length;
+
+    if (g_atomic_int_get (&pass->failed))
+        return;
+
+    buffer = vnr_jpeg_decoder_new_band (decoder, band, &length);
+    if (buffer == NULL)
+    {
+        g_set_error_literal (error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+                             _("Not enough memory to load the image."));
+        g_atomic_int_set (&pass->failed, TRUE);
+        return;
+    }
+
+    cinfo.err = jpeg_std_error (&jerr.pub);
+    jerr.pub.error_exit = vnr_jpeg_error_exit;
+    jerr.pub.output_message = vnr_jpeg_output_message;
+    jerr.error = error;
+    if (!setjmp (jerr.setjmp_buffer))
+    {
+        jpeg_create_decompress (&cinfo);
+        jpeg_mem_src (&cinfo, buffer, length);
+        jpeg_read_header (&cinfo, TRUE);
+        cinfo.out_color_space = JCS_RGB;
+        jpeg_start_decompress (&cinfo);
+        scratch = g_malloc ((gsize) cinfo.output_width * 3);
+
+        while (cinfo.output_scanline < cinfo.output_height &&
+               band->top + (gint) cinfo.output_scanline <
+               band->y + band->height)
+        {
+            gint y = band->top + cinfo.output_scanline;
+            JSAMPROW row = y < band->y ? scratch :
+                           pass->pixels + (gsize) y * pass->rowstride;
+
+            if (cinfo.output_scanline % VNR_JPEG_DECODER_ROWS == 0 &&
+                (g_atomic_int_get (&pass->failed) ||
+                 g_cancellable_set_error_if_cancelled (pass->cancellable,
+                                                       error)))
+                break;
+            jpeg_read_scanlines (&cinfo, &row, 1);
+        }
+    }
+    jpeg_destroy_decompress (&cinfo);
+    g_free (scratch);
+    g_free (buffer);
+
+    if (*error != NULL)
+        g_atomic_int_set (&pass->failed, TRUE);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_jpeg_decoder_new:
+ * @data: the contents of an image file
+ * @length: the length of @data
+ * @returns: a new #VnrJpegDecoder, or %NULL if the image is not a
+ *   JPEG file with restart markers, or too small to be worth splitting
+ **/
+VnrJpegDecoder *
+vnr_jpeg_decoder_new (const guchar *data, gsize length)
+{
+    VnrJpegDecoder *decoder;
+    guint restart, mcu_width, mcu_height;
+    guint64 mcus, pixels;
+    long cpus;
+
+    if (length < 3 || memcmp (data, "\xff\xd8\xff", 3) != 0)
+        return NULL;
+
+    decoder = g_slice_new0 (VnrJpegDecoder);
+    decoder->data = data;
+    decoder->length = length;
+    decoder->orientation = 1;
+
+    if (vnr_jpeg_decoder_parse_headers (decoder, &restart,
+                                        &mcu_width, &mcu_height) &&
+        restart > 0 && vnr_jpeg_decoder_find_markers (decoder))
+    {
+        mcus = (guint64) ((decoder->width + mcu_width - 1) / mcu_width) *
+               ((decoder->height + mcu_height - 1) / mcu_height);
+        decoder->n_intervals = (mcus + restart - 1) / restart;
+
+        /* Files missing markers are left to gdk-pixbuf */
+        pixels = (guint64) decoder->width * decoder->height;
+        cpus = sysconf (_SC_NPROCESSORS_ONLN);
+        if (decoder->markers->len + 1 == decoder->n_intervals)
+            vnr_jpeg_decoder_plan (decoder, restart, mcu_width, mcu_height,
+                                   MIN (pixels / VNR_JPEG_DECODER_MIN_PIXELS,
+                                        CLAMP (cpus, 1,
+                                               VNR_JPEG_DECODER_MAX_BANDS)));
+    }
+
+    if (decoder->n_bands < 2)
+    {
+        vnr_jpeg_decoder_free (decoder);
+        return NULL;
+    }
+    return decoder;
+}
+
+void
+vnr_jpeg_decoder_free (VnrJpegDecoder *decoder)
+{
+    if (decoder == NULL)
+        return;
+
+    if (decoder->markers != NULL)
+        g_array_free (decoder->markers, TRUE);
+    g_free (decoder->bands);
+    g_slice_free (VnrJpegDecoder, decoder);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+void
+vnr_jpeg_decoder_get_size (VnrJpegDecoder *decoder,
+                           gint *width, gint *height)
+{
+    *width = decoder->width;
+    *height = decoder->height;
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_jpeg_decoder_decode:
+ * @decoder: a #VnrJpegDecoder
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: return location for a #GError
+ * @returns: the image, to be unreffed by the caller, or %NULL on error
+ *
+ * Decodes the whole image, on the workers and the calling thread. The
+ * orientation from the Exif data is set as the "orientation" option,
+ * for gdk_pixbuf_apply_embedded_orientation().
+ **/
+GdkPixbuf *
+vnr_jpeg_decoder_decode (VnrJpegDecoder *decoder, GCancellable *cancellable,
+                         GError **error)
+{
+    VnrWorkGroup *group;
+    VnrJpegPass pass;
+    GdkPixbuf *pixbuf;
+    gchar orientation[4];
+    guint i;
+
+    pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                             decoder->width, decoder->height);
+    if (pixbuf == NULL)
+    {
+        g_set_error_literal (error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+                             _("Not enough memory to load the image."));
+        return NULL;
+    }
+
+    pass.decoder = decoder;
+    pass.pixels = gdk_pixbuf_get_pixels (pixbuf);
+    pass.rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+    pass.cancellable = cancellable;
+    pass.errors = g_new0 (GError *, decoder->n_bands);
+    pass.failed = FALSE;
+
+    group = vnr_work_group_new (VNR_WORK_CURRENT,
+                                (GFunc) vnr_jpeg_decoder_run, &pass,
+                                -1, NULL, NULL);
+    for (i = 0; i < decoder->n_bands; i++)
+        vnr_work_group_push (group, &decoder->bands[i]);
+    vnr_work_group_free (group, FALSE, TRUE);
+
+    for (i = 0; i < decoder->n_bands; i++)
+    {
+        if (pass.errors[i] != NULL && pixbuf != NULL)
+        {
+            g_propagate_error (error, pass.errors[i]);
+            g_object_unref (pixbuf);
+            pixbuf = NULL;
+        }
+        else
+            g_clear_error (&pass.errors[i]);
+    }
+    g_free (pass.errors);
+
+    if (pixbuf != NULL && decoder->orientation != 1)
+    {
+        g_snprintf (orientation, sizeof orientation, "%d",
+                    decoder->orientation);
+        gdk_pixbuf_set_option (pixbuf, "orientation", orientation);
+    }
+    return pixbuf;
+}
+
+/**
+ * vnr_jpeg_parse_orientation:
+ * @segment: the contents of an APP1 segment
+ * @length: the length of @segment
+ * @returns: the orientation from the Exif data of @segment, from 1 to
+ *   8, or 0 if it has none
+ *
+ * Reads the orientation as the gdk-pixbuf loader would, for decoders
+ * which bypass it.
+ **/
+gint
+vnr_jpeg_parse_orientation (const guchar *segment, gsize length)
+{
+    const guchar *tiff = segment + 6;
+    gsize size = length - 6;
+    gboolean big_endian;
+    guint32 ifd;
+    guint n, i;
+
+    if (length < 6 + 8 || memcmp (segment, "Exif\0\0", 6) != 0)
+        return 0;
+    if (memcmp (tiff, "MM", 2) == 0)
+        big_endian = TRUE;
+    else if (memcmp (tiff, "II", 2) == 0)
+        big_endian = FALSE;
+    else
+        return 0;
+
+    ifd = vnr_jpeg_read32 (tiff + 4, big_endian);
+    if (ifd > size - 2)
+        return 0;
+    n = vnr_jpeg_read16 (tiff + ifd, big_endian);
+    for (i = 0; i < n && ifd + 2 + (i + 1) * 12 <= size; i++)
+    {
+        const guchar *entry = tiff + ifd + 2 + i * 12;
+
+        if (vnr_jpeg_read16 (entry, big_endian) == 0x0112)
+        {
+            guint orientation = vnr_jpeg_read16 (entry + 8, big_endian);
+
+            return orientation >= 1 && orientation <= 8 ? orientation : 0;
+        }
+    }
+    return 0;
+}
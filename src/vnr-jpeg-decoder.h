@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __VNR_JPEG_DECODER_H__
+#define __VNR_JPEG_DECODER_H__
+
+#include <gtk/gtk.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VnrJpegDecoder VnrJpegDecoder;
+
+/* Constructors */
+VnrJpegDecoder *vnr_jpeg_decoder_new  (const guchar *data, gsize length);
+void            vnr_jpeg_decoder_free (VnrJpegDecoder *decoder);
+
+/* Read-only properties */
+void            vnr_jpeg_decoder_get_size (VnrJpegDecoder *decoder,
+                                           gint *width, gint *height);
+
+/* Actions */
+GdkPixbuf      *vnr_jpeg_decoder_decode (VnrJpegDecoder *decoder,
+                                         GCancellable *cancellable,
+                                         GError **error);
+
+gint            vnr_jpeg_parse_orientation (const guchar *segment,
+                                            gsize length);
+
+G_END_DECLS
+#endif /* __VNR_JPEG_DECODER_H__ */
@@ -0,0 +1,588 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <libintl.h>
+#include <glib/gi18n.h>
+#define _(String) gettext (String)
+
+#include <gio/gio.h>
+#include <math.h>
+#include "vnr-load-context.h"
+#include "vnr-region-decoder.h"
+#include "vnr-jpeg-decoder.h"
+#include "vnr-pyramid.h"
+
+/* Bytes fed to the loader to tell the format of a file. Also what
+ * content type sniffing looks at. */
+#define VNR_LOAD_CONTEXT_HEADER 4096
+
+/* Bytes decoded between checks for cancellation. */
+#define VNR_LOAD_CONTEXT_CHUNK (256 * 1024)
+
+/**
+ * VnrLoadContext:
+ *
+ * The bytes of one image, read once and shared by everything that
+ * looks at them: telling the format, decoding, showing the content
+ * type and reading the metadata. The file is mapped rather than read,
+ * so pages already in the cache are not copied.
+ *
+ * Telling the format is done by the loader that then decodes the
+ * image, which carries on from the header it was fed.
+ *
+ * Images with more pixels than the budget are decoded at a reduced
+ * size. Those a #VnrRegionDecoder can read are streamed through it,
+ * which keeps its full resolution pixels out of memory altogether,
+ * and it is kept to decode parts of the image later on. If a pyramid
+ * was built for the image, the overview is read from it instead.
+ *
+ * JPEG files with restart markers are decoded on several processors
+ * by a #VnrJpegDecoder. Anything else is left to gdk-pixbuf.
+ **/
+struct _VnrLoadContext {
+    gint ref_count;
+
+    gchar *path;
+    GMappedFile *mapping;
+    const guchar *data;
+    gsize length;
+
+    gchar *content_type;
+
+    /* Loader fed the first @fed bytes, until it is taken or used up,
+     * and the error it ran into while being fed the header */
+    GdkPixbufLoader *loader;
+    gsize fed;
+    GError *error;
+    gboolean sniffed;
+
+    /* Size of the image at full resolution, once known, and the most
+     * pixels it is decoded to */
+    gint width;
+    gint height;
+    guint64 max_pixels;
+    VnrRegionDecoder *region;
+    VnrPyramid *pyramid;
+};
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static GdkPixbufLoader *
+vnr_load_context_new_loader (VnrLoadContext *context, gboolean typed)
+{
+    GdkPixbufLoader *loader = NULL;
+
+    if (typed)
+    {
+        gchar *mime_type = g_content_type_get_mime_type (
+                               vnr_load_context_get_content_type (context));
+
+        if (mime_type != NULL)
+            loader = gdk_pixbuf_loader_new_with_mime_type (mime_type, NULL);
+        g_free (mime_type);
+    }
+    if (loader == NULL)
+        loader = gdk_pixbuf_loader_new ();
+    return loader;
+}
+
+/* Reduces @width and @height to fit the pixel budget, returning
+ * %FALSE if they already do */
+static gboolean
+vnr_load_context_fit_budget (VnrLoadContext *context,
+                             gint *width, gint *height)
+{
+    gdouble scale;
+
+    if (context->max_pixels == 0 ||
+        (guint64) *width * *height <= context->max_pixels)
+        return FALSE;
+
+    scale = sqrt ((gdouble) context->max_pixels / *width / *height);
+    *width = MAX (1, (gint) (*width * scale));
+    *height = MAX (1, (gint) (*height * scale));
+    return TRUE;
+}
+
+static void
+vnr_load_context_size_prepared_cb (GdkPixbufLoader *loader,
+                                   gint width, gint height,
+                                   VnrLoadContext *context)
+{
+    context->width = width;
+    context->height = height;
+    if (vnr_load_context_fit_budget (context, &width, &height))
+        gdk_pixbuf_loader_set_size (loader, width, height);
+}
+
+/* Feeds the header to a loader picked from the content type, which
+ * also knows the formats without a signature, or failing that to one
+ * which recognizes the format from the header alone. */
+static void
+vnr_load_context_sniff (VnrLoadContext *context)
+{
+    gsize count = MIN (context->length, VNR_LOAD_CONTEXT_HEADER);
+    gboolean typed;
+
+    if (context->sniffed)
+        return;
+    context->sniffed = TRUE;
+
+    /* An empty file is mapped to no data at all */
+    if (context->length == 0)
+    {
+        g_set_error_literal (&context->error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                             _("The file is empty."));
+        return;
+    }
+
+    for (typed = TRUE; ; typed = FALSE)
+    {
+        context->loader = vnr_load_context_new_loader (context, typed);
+        g_signal_connect (context->loader, "size-prepared",
+                          G_CALLBACK (vnr_load_context_size_prepared_cb),
+                          context);
+        if (gdk_pixbuf_loader_write (context->loader, context->data, count,
+                                     &context->error))
+            break;
+
+        gdk_pixbuf_loader_close (context->loader, NULL);
+        g_object_unref (context->loader);
+        context->loader = NULL;
+        if (!typed)
+            return;
+        g_clear_error (&context->error);
+    }
+    context->fed = count;
+}
+
+static GdkPixbufAnimation *
+vnr_load_context_new_static (GdkPixbuf *pixbuf)
+{
+    GdkPixbufSimpleAnim *anim;
+
+    anim = gdk_pixbuf_simple_anim_new (gdk_pixbuf_get_width (pixbuf),
+                                       gdk_pixbuf_get_height (pixbuf), -1);
+    gdk_pixbuf_simple_anim_add_frame (anim, pixbuf);
+    g_object_unref (pixbuf);
+    return GDK_PIXBUF_ANIMATION (anim);
+}
+
+/* Decodes an image over the budget through a region decoder, which
+ * reduces it row by row, or reads it from its pyramid. Returns %NULL
+ * without setting @error if the image is within the budget or the
+ * decoder cannot read it. */
+static GdkPixbufAnimation *
+vnr_load_context_load_overview (VnrLoadContext *context,
+                                GCancellable *cancellable, GError **error)
+{
+    GdkPixbuf *overview;
+    GError *tmp_error = NULL;
+    gint width, height, pyramid_width, pyramid_height;
+
+    if (context->max_pixels == 0)
+        return NULL;
+
+    context->region = vnr_region_decoder_new (context->data, context->length);
+    if (context->region == NULL)
+        return NULL;
+
+    vnr_region_decoder_get_size (context->region, &width, &height);
+    if (!vnr_load_context_fit_budget (context, &width, &height))
+    {
+        vnr_region_decoder_free (context->region);
+        context->region = NULL;
+        return NULL;
+    }
+    vnr_region_decoder_get_size (context->region,
+                                 &context->width, &context->height);
+
+    /* A pyramid built earlier spares decoding the image at all */
+    context->pyramid = vnr_pyramid_open (context->path);
+    if (context->pyramid != NULL)
+    {
+        overview = NULL;
+        vnr_pyramid_get_size (context->pyramid, &pyramid_width, &pyramid_height);
+        if (pyramid_width == context->width && pyramid_height == context->height)
+            overview = vnr_pyramid_get_overview (context->pyramid,
+                                                 context->max_pixels);
+        if (overview != NULL)
+            return vnr_load_context_new_static (overview);
+
+        vnr_pyramid_free (context->pyramid);
+        context->pyramid = NULL;
+    }
+
+    overview = vnr_region_decoder_decode (context->region, NULL,
+                                          width, height,
+                                          cancellable, &tmp_error);
+    if (overview != NULL)
+        return vnr_load_context_new_static (overview);
+
+    /* Left to gdk-pixbuf, which copes better with broken files */
+    vnr_region_decoder_free (context->region);
+    context->region = NULL;
+    if (g_error_matches (tmp_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_propagate_error (error, tmp_error);
+    else
+        g_clear_error (&tmp_error);
+    return NULL;
+}
+
+/* Decodes a JPEG file with restart markers on several processors.
+ * Returns %NULL without setting @error if the file has none, if it is
+ * over the budget, or if it turns out to be broken. */
+static GdkPixbufAnimation *
+vnr_load_context_load_parallel (VnrLoadContext *context,
+                                GCancellable *cancellable, GError **error)
+{
+    VnrJpegDecoder *decoder;
+    GdkPixbuf *pixbuf;
+    GError *tmp_error = NULL;
+    gint width, height;
+
+    decoder = vnr_jpeg_decoder_new (context->data, context->length);
+    if (decoder == NULL)
+        return NULL;
+
+    vnr_jpeg_decoder_get_size (decoder, &width, &height);
+    if (vnr_load_context_fit_budget (context, &width, &height))
+    {
+        vnr_jpeg_decoder_free (decoder);
+        return NULL;
+    }
+
+    pixbuf = vnr_jpeg_decoder_decode (decoder, cancellable, &tmp_error);
+    vnr_jpeg_decoder_free (decoder);
+    if (pixbuf != NULL)
+    {
+        context->width = gdk_pixbuf_get_width (pixbuf);
+        context->height = gdk_pixbuf_get_height (pixbuf);
+        return vnr_load_context_new_static (pixbuf);
+    }
+
+    if (g_error_matches (tmp_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_propagate_error (error, tmp_error);
+    else
+        g_clear_error (&tmp_error);
+    return NULL;
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_load_context_new:
+ * @path: the file to read
+ * @error: return location for a #GError
+ * @returns: a new #VnrLoadContext, or %NULL on error
+ **/
+VnrLoadContext *
+vnr_load_context_new (const gchar *path, GError **error)
+{
+    VnrLoadContext *context;
+    GMappedFile *mapping;
+
+    mapping = g_mapped_file_new (path, FALSE, error);
+    if (mapping == NULL)
+        return NULL;
+
+    context = g_slice_new0 (VnrLoadContext);
+    context->ref_count = 1;
+    context->path = g_strdup (path);
+    context->mapping = mapping;
+    context->data = (const guchar *) g_mapped_file_get_contents (mapping);
+    context->length = g_mapped_file_get_length (mapping);
+    return context;
+}
+
+VnrLoadContext *
+vnr_load_context_ref (VnrLoadContext *context)
+{
+    g_atomic_int_inc (&context->ref_count);
+    return context;
+}
+
+void
+vnr_load_context_unref (VnrLoadContext *context)
+{
+    if (context == NULL || !g_atomic_int_dec_and_test (&context->ref_count))
+        return;
+
+    if (context->loader != NULL)
+    {
+        gdk_pixbuf_loader_close (context->loader, NULL);
+        g_object_unref (context->loader);
+    }
+    vnr_region_decoder_free (context->region);
+    vnr_pyramid_free (context->pyramid);
+    g_clear_error (&context->error);
+    g_free (context->content_type);
+    g_mapped_file_unref (context->mapping);
+    g_free (context->path);
+    g_slice_free (VnrLoadContext, context);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+const gchar *
+vnr_load_context_get_path (VnrLoadContext *context)
+{
+    return context->path;
+}
+
+/**
+ * vnr_load_context_get_data:
+ * @context: a #VnrLoadContext
+ * @length: return location for the length of the data
+ * @returns: the contents of the file, owned by @context
+ **/
+const guchar *
+vnr_load_context_get_data (VnrLoadContext *context, gsize *length)
+{
+    *length = context->length;
+    return context->data;
+}
+
+/**
+ * vnr_load_context_get_content_type:
+ * @context: a #VnrLoadContext
+ * @returns: the content type guessed from the name and the header of
+ *   the file, owned by @context
+ **/
+const gchar *
+vnr_load_context_get_content_type (VnrLoadContext *context)
+{
+    if (context->content_type == NULL)
+        context->content_type = g_content_type_guess (context->path,
+                                    context->data,
+                                    MIN (context->length,
+                                         VNR_LOAD_CONTEXT_HEADER),
+                                    NULL);
+    return context->content_type;
+}
+
+/**
+ * vnr_load_context_get_format:
+ * @context: a #VnrLoadContext
+ * @returns: the format of the image, or %NULL if it has none known
+ **/
+GdkPixbufFormat *
+vnr_load_context_get_format (VnrLoadContext *context)
+{
+    vnr_load_context_sniff (context);
+    if (context->loader == NULL)
+        return NULL;
+    return gdk_pixbuf_loader_get_format (context->loader);
+}
+
+/**
+ * vnr_load_context_get_size:
+ * @context: a #VnrLoadContext
+ * @width: return location for the width of the image
+ * @height: return location for the height of the image
+ * @returns: %TRUE if the size is known, which it is once the image
+ *   was decoded
+ *
+ * Gets the size of the image at full resolution, which the decoded
+ * image is smaller than if it went over the pixel budget.
+ **/
+gboolean
+vnr_load_context_get_size (VnrLoadContext *context,
+                           gint *width, gint *height)
+{
+    *width = context->width;
+    *height = context->height;
+    return context->width > 0 && context->height > 0;
+}
+
+/**
+ * vnr_load_context_get_region_decoder:
+ * @context: a #VnrLoadContext
+ * @returns: the decoder the image was reduced with, owned by
+ *   @context, or %NULL if it was decoded some other way
+ *
+ * The decoder can be used from any thread for as long as a reference
+ * to @context is held.
+ **/
+VnrRegionDecoder *
+vnr_load_context_get_region_decoder (VnrLoadContext *context)
+{
+    return context->region;
+}
+
+/**
+ * vnr_load_context_get_pyramid:
+ * @context: a #VnrLoadContext
+ * @returns: the pyramid the overview was read from, or %NULL
+ *
+ * Like the region decoder, the pyramid can be used from any thread for
+ * as long as a reference to @context is held.
+ **/
+VnrPyramid *
+vnr_load_context_get_pyramid (VnrLoadContext *context)
+{
+    return context->pyramid;
+}
+
+/*************************************************************/
+/***** Write-only properties *********************************/
+/*************************************************************/
+
+/**
+ * vnr_load_context_set_max_pixels:
+ * @context: a #VnrLoadContext
+ * @max_pixels: the most pixels to decode the image to, or 0 for no
+ *   limit
+ *
+ * Sets the pixel budget of the image. Has to be called before anything
+ * else is asked of @context.
+ **/
+void
+vnr_load_context_set_max_pixels (VnrLoadContext *context, guint64 max_pixels)
+{
+    context->max_pixels = max_pixels;
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_load_context_take_loader:
+ * @context: a #VnrLoadContext
+ * @fed: return location for the number of bytes already written
+ * @error: return location for a #GError
+ * @returns: the loader that was fed the start of the file, to be
+ *   unreffed by the caller, or %NULL on error
+ *
+ * Hands the loader over to decode the rest of the file, as the caller
+ * sees fit. The loader can only be taken once.
+ **/
+GdkPixbufLoader *
+vnr_load_context_take_loader (VnrLoadContext *context, gsize *fed,
+                              GError **error)
+{
+    GdkPixbufLoader *loader;
+
+    vnr_load_context_sniff (context);
+    if (context->error != NULL)
+    {
+        g_propagate_error (error, g_error_copy (context->error));
+        return NULL;
+    }
+    g_return_val_if_fail (context->loader != NULL, NULL);
+
+    loader = context->loader;
+    context->loader = NULL;
+    *fed = context->fed;
+    return loader;
+}
+
+/**
+ * vnr_load_context_load:
+ * @context: a #VnrLoadContext
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: return location for a #GError
+ * @returns: the image, to be unreffed by the caller, or %NULL on error
+ *
+ * Decodes the whole file. May be called from any thread, as long as
+ * @context is not used by another one meanwhile.
+ **/
+GdkPixbufAnimation *
+vnr_load_context_load (VnrLoadContext *context, GCancellable *cancellable,
+                       GError **error)
+{
+    GdkPixbufLoader *loader;
+    GdkPixbufAnimation *anim = NULL;
+    GError *tmp_error = NULL;
+    gboolean written = TRUE;
+    gsize fed = 0;
+    gint width, height;
+
+    anim = vnr_load_context_load_overview (context, cancellable, &tmp_error);
+    if (anim == NULL && tmp_error == NULL)
+        anim = vnr_load_context_load_parallel (context, cancellable,
+                                               &tmp_error);
+    if (anim != NULL || tmp_error != NULL)
+        loader = NULL;
+    else
+        loader = vnr_load_context_take_loader (context, &fed, &tmp_error);
+
+    /* Written in chunks, so that decoding can stop half way */
+    while (loader != NULL && written && fed < context->length)
+    {
+        gsize count = MIN (context->length - fed, VNR_LOAD_CONTEXT_CHUNK);
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, &tmp_error))
+            written = FALSE;
+        else
+            written = gdk_pixbuf_loader_write (loader, context->data + fed,
+                                               count, &tmp_error);
+        fed += count;
+    }
+
+    if (loader != NULL && written &&
+        gdk_pixbuf_loader_close (loader, &tmp_error))
+    {
+        anim = gdk_pixbuf_loader_get_animation (loader);
+        if (anim != NULL)
+            g_object_ref (anim);
+    }
+    if (loader != NULL)
+    {
+        /* Closing twice is harmless, and needed after an error */
+        gdk_pixbuf_loader_close (loader, NULL);
+        g_object_unref (loader);
+    }
+
+    /* Some modules can only load whole files */
+    if (anim == NULL && g_error_matches (tmp_error, GDK_PIXBUF_ERROR,
+                                GDK_PIXBUF_ERROR_UNSUPPORTED_OPERATION))
+    {
+        g_clear_error (&tmp_error);
+        width = context->width;
+        height = context->height;
+        if (vnr_load_context_fit_budget (context, &width, &height))
+        {
+            GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_size (
+                                    context->path, width, height, &tmp_error);
+            if (pixbuf != NULL)
+                anim = vnr_load_context_new_static (pixbuf);
+        }
+        else
+            anim = gdk_pixbuf_animation_new_from_file (context->path,
+                                                       &tmp_error);
+    }
+
+    if (anim == NULL && tmp_error == NULL)
+        g_set_error_literal (&tmp_error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                             _("The image contains no frames."));
+    if (tmp_error != NULL)
+        g_propagate_error (error, tmp_error);
+    return anim;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __VNR_LOAD_CONTEXT_H__
+#define __VNR_LOAD_CONTEXT_H__
+
+#include <gtk/gtk.h>
+#include "vnr-region-decoder.h"
+#include "vnr-pyramid.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrLoadContext VnrLoadContext;
+
+/* Constructors */
+VnrLoadContext     *vnr_load_context_new   (const gchar *path, GError **error);
+VnrLoadContext     *vnr_load_context_ref   (VnrLoadContext *context);
+void                vnr_load_context_unref (VnrLoadContext *context);
+
+/* Read-only properties */
+const gchar        *vnr_load_context_get_path   (VnrLoadContext *context);
+const guchar       *vnr_load_context_get_data   (VnrLoadContext *context,
+                                                 gsize *length);
+const gchar        *vnr_load_context_get_content_type (VnrLoadContext *context);
+GdkPixbufFormat    *vnr_load_context_get_format (VnrLoadContext *context);
+gboolean            vnr_load_context_get_size   (VnrLoadContext *context,
+                                                 gint *width, gint *height);
+VnrRegionDecoder   *vnr_load_context_get_region_decoder (VnrLoadContext *context);
+VnrPyramid         *vnr_load_context_get_pyramid (VnrLoadContext *context);
+
+/* Write-only properties */
+void                vnr_load_context_set_max_pixels (VnrLoadContext *context,
+                                                     guint64 max_pixels);
+
+/* Actions */
+GdkPixbufLoader    *vnr_load_context_take_loader (VnrLoadContext *context,
+                                                  gsize *fed,
+                                                  GError **error);
+GdkPixbufAnimation *vnr_load_context_load   (VnrLoadContext *context,
+                                             GCancellable *cancellable,
+                                             GError **error);
+
+G_END_DECLS
+#endif /* __VNR_LOAD_CONTEXT_H__ */
@@ -49,6 +49,13 @@ toggle_show_hidden_cb (GtkToggleButton *togglebutton, gpointer user_data)
     vnr_prefs_save(VNR_PREFS(user_data));
 }
 
+static void
+toggle_recursive_cb (GtkToggleButton *togglebutton, gpointer user_data)
+{
+    VNR_PREFS(user_data)->recursive = gtk_toggle_button_get_active(togglebutton);
+    vnr_prefs_save(VNR_PREFS(user_data));
+}
+
 static void
 toggle_dark_background_cb (GtkToggleButton *togglebutton, gpointer user_data)
 {
@@ -168,16 +175,21 @@ vnr_prefs_set_default(VnrPrefs *prefs)
 {
     prefs->zoom = VNR_PREFS_ZOOM_SMART;
     prefs->show_hidden = FALSE;
+    prefs->recursive = FALSE;
     prefs->dark_background = FALSE;
     prefs->fit_on_fullscreen = TRUE;
     prefs->smooth_images = TRUE;
     prefs->confirm_delete = TRUE;
     prefs->slideshow_timeout = 5;
+    prefs->sequence_fps = 24;
+    prefs->sort_order = 0;
     prefs->behavior_wheel = VNR_PREFS_WHEEL_ZOOM;
     prefs->behavior_click = VNR_PREFS_CLICK_ZOOM;
     prefs->behavior_modify = VNR_PREFS_MODIFY_ASK;
     prefs->jpeg_quality = 90;
     prefs->png_compression = 9;
+    prefs->max_megapixels = 100;
+    prefs->pyramid_cache_size = 4096;
     prefs->reload_on_save = FALSE;
     prefs->show_menu_bar = FALSE;
     prefs->show_toolbar = TRUE;
@@ -199,6 +211,7 @@ build_dialog (VnrPrefs *prefs)
 
     GObject *close_button;
     GtkToggleButton *show_hidden;
+    GtkToggleButton *recursive;
     GtkToggleButton *dark_background;
     GtkToggleButton *fit_on_fullscreen;
     GtkBox *zoom_mode_box;
@@ -239,6 +252,11 @@ build_dialog (VnrPrefs *prefs)
     gtk_toggle_button_set_active( show_hidden, prefs->show_hidden );
     g_signal_connect(G_OBJECT(show_hidden), "toggled", G_CALLBACK(toggle_show_hidden_cb), prefs);
 
+    /* Include subfolders checkbox */
+    recursive = GTK_TOGGLE_BUTTON (gtk_builder_get_object (builder, "recursive"));
+    gtk_toggle_button_set_active( recursive, prefs->recursive );
+    g_signal_connect(G_OBJECT(recursive), "toggled", G_CALLBACK(toggle_recursive_cb), prefs);
+
     /* Show dark background checkbox */
     dark_background = GTK_TOGGLE_BUTTON (gtk_builder_get_object (builder, "dark_background"));
     gtk_toggle_button_set_active( dark_background, prefs->dark_background );
@@ -383,6 +401,7 @@ vnr_prefs_load (VnrPrefs *prefs, GError **error)
     VNR_PREF_LOAD_KEY (zoom, integer, "zoom-mode", VNR_PREFS_ZOOM_SMART);
     VNR_PREF_LOAD_KEY (fit_on_fullscreen, boolean, "fit-on-fullscreen", TRUE);
     VNR_PREF_LOAD_KEY (show_hidden, boolean, "show-hidden", FALSE);
+    VNR_PREF_LOAD_KEY (recursive, boolean, "recursive", FALSE);
     VNR_PREF_LOAD_KEY (dark_background, boolean, "dark-background", FALSE);
     VNR_PREF_LOAD_KEY (smooth_images, boolean, "smooth-images", TRUE);
     VNR_PREF_LOAD_KEY (confirm_delete, boolean, "confirm-delete", TRUE);
@@ -393,12 +412,16 @@ vnr_prefs_load (VnrPrefs *prefs, GError **error)
     VNR_PREF_LOAD_KEY (show_statusbar, boolean, "show-statusbar", FALSE);
     VNR_PREF_LOAD_KEY (start_maximized, boolean, "start-maximized", FALSE);
     VNR_PREF_LOAD_KEY (slideshow_timeout, integer, "slideshow-timeout", 5);
+    VNR_PREF_LOAD_KEY (sequence_fps, integer, "sequence-fps", 24);
+    VNR_PREF_LOAD_KEY (sort_order, integer, "sort-order", 0);
     VNR_PREF_LOAD_KEY (auto_resize, boolean, "auto-resize", FALSE);
     VNR_PREF_LOAD_KEY (behavior_wheel, integer, "behavior-wheel", VNR_PREFS_WHEEL_ZOOM);
     VNR_PREF_LOAD_KEY (behavior_click, integer, "behavior-click", VNR_PREFS_CLICK_ZOOM);
     VNR_PREF_LOAD_KEY (behavior_modify, integer, "behavior-modify", VNR_PREFS_MODIFY_ASK);
     VNR_PREF_LOAD_KEY (jpeg_quality, integer, "jpeg-quality", 90);
     VNR_PREF_LOAD_KEY (png_compression, integer, "png-compression", 9);
+    VNR_PREF_LOAD_KEY (max_megapixels, integer, "max-megapixels", 100);
+    VNR_PREF_LOAD_KEY (pyramid_cache_size, integer, "pyramid-cache-size", 4096);
     VNR_PREF_LOAD_KEY (desktop, integer, "desktop", VNR_PREFS_DESKTOP_AUTO);
 
     g_key_file_free (conf);
@@ -471,6 +494,7 @@ vnr_prefs_save (VnrPrefs *prefs)
     g_key_file_set_integer (conf, "prefs", "zoom-mode", prefs->zoom);
     g_key_file_set_boolean (conf, "prefs", "fit-on-fullscreen", prefs->fit_on_fullscreen);
     g_key_file_set_boolean (conf, "prefs", "show-hidden", prefs->show_hidden);
+    g_key_file_set_boolean (conf, "prefs", "recursive", prefs->recursive);
     g_key_file_set_boolean (conf, "prefs", "dark-background", prefs->dark_background);
     g_key_file_set_boolean (conf, "prefs", "smooth-images", prefs->smooth_images);
     g_key_file_set_boolean (conf, "prefs", "confirm-delete", prefs->confirm_delete);
@@ -481,12 +505,16 @@ vnr_prefs_save (VnrPrefs *prefs)
     g_key_file_set_boolean (conf, "prefs", "show-statusbar", prefs->show_statusbar);
     g_key_file_set_boolean (conf, "prefs", "start-maximized", prefs->start_maximized);
     g_key_file_set_integer (conf, "prefs", "slideshow-timeout", prefs->slideshow_timeout);
+    g_key_file_set_integer (conf, "prefs", "sequence-fps", prefs->sequence_fps);
+    g_key_file_set_integer (conf, "prefs", "sort-order", prefs->sort_order);
     g_key_file_set_boolean (conf, "prefs", "auto-resize", prefs->auto_resize);
     g_key_file_set_integer (conf, "prefs", "behavior-wheel", prefs->behavior_wheel);
     g_key_file_set_integer (conf, "prefs", "behavior-click", prefs->behavior_click);
     g_key_file_set_integer (conf, "prefs", "behavior-modify", prefs->behavior_modify);
     g_key_file_set_integer (conf, "prefs", "jpeg-quality", prefs->jpeg_quality);
     g_key_file_set_integer (conf, "prefs", "png-compression", prefs->png_compression);
+    g_key_file_set_integer (conf, "prefs", "max-megapixels", prefs->max_megapixels);
+    g_key_file_set_integer (conf, "prefs", "pyramid-cache-size", prefs->pyramid_cache_size);
     g_key_file_set_integer (conf, "prefs", "desktop", prefs->desktop);
 
     if(g_mkdir_with_parents (dir, 0700) != 0)
@@ -557,3 +585,13 @@ vnr_prefs_set_show_menu_bar (VnrPrefs *prefs, gboolean show_menu_bar)
         vnr_prefs_save(prefs);
     }
 }
+
+void
+vnr_prefs_set_sort_order (VnrPrefs *prefs, int sort_order)
+{
+    if(prefs->sort_order != sort_order)
+    {
+        prefs->sort_order = sort_order;
+        vnr_prefs_save(prefs);
+    }
+}
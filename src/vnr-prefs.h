@@ -89,6 +89,7 @@ struct _VnrPrefs {
     VnrPrefsModify behavior_modify;
     gboolean fit_on_fullscreen;
     gboolean show_hidden;
+    gboolean recursive;
     gboolean smooth_images;
     gboolean confirm_delete;
     gboolean reload_on_save;
@@ -102,8 +103,12 @@ struct _VnrPrefs {
     gboolean auto_resize;
     gboolean dark_background;
     int slideshow_timeout;
+    int sequence_fps;
+    int sort_order;
     int jpeg_quality;
     int png_compression;
+    int max_megapixels;
+    int pyramid_cache_size;
 
     GtkWidget *dialog;
     GtkWidget *vnr_win;
@@ -124,6 +129,7 @@ void      vnr_prefs_set_show_menu_bar     (VnrPrefs *prefs, gboolean show_menu_b
 void      vnr_prefs_set_show_toolbar      (VnrPrefs *prefs, gboolean show_toolbar);
 void      vnr_prefs_set_show_scrollbar    (VnrPrefs *prefs, gboolean show_scollbar);
 void      vnr_prefs_set_show_statusbar    (VnrPrefs *prefs, gboolean show_statusbar);
+void      vnr_prefs_set_sort_order        (VnrPrefs *prefs, int sort_order);
 gboolean  vnr_prefs_save (VnrPrefs *prefs);
 
 G_END_DECLS
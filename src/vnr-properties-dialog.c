@@ -26,7 +26,9 @@
 #include <locale.h>
 #include "vnr-properties-dialog.h"
 #include "vnr-file.h"
+#include "vnr-file-list.h"
 #include "vnr-tools.h"
+#include "vnr-thumbnails.h"
 #include "uni-exiv2.hpp"
 
 G_DEFINE_TYPE (VnrPropertiesDialog, vnr_properties_dialog, GTK_TYPE_DIALOG);
@@ -46,30 +48,8 @@ key_press_cb (GtkWidget *widget, GdkEventKey *event, gpointer user_data)
 }
 
 static void
-get_file_info(gchar *filename, goffset *size, const gchar **type)
-{
-    GFile *file;
-    GFileInfo *fileinfo;
-
-    file = g_file_new_for_path(filename);
-    fileinfo = g_file_query_info (file, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE","
-                                  G_FILE_ATTRIBUTE_STANDARD_SIZE,
-                                  0, NULL, NULL);
-
-    if (fileinfo == NULL)
-    {
-        return;
-    }
-
-    *size = g_file_info_get_size(fileinfo);
-    *type = g_strdup(g_file_info_get_content_type(fileinfo));
-
-    g_object_unref(file);
-    g_object_unref(fileinfo);
-}
-
-static void
-set_new_pixbuf(VnrPropertiesDialog *dialog, GdkPixbuf* original)
+set_new_pixbuf(VnrPropertiesDialog *dialog, GdkPixbuf* original,
+               GdkInterpType interp_type)
 {
     if(dialog->thumbnail != NULL)
     {
@@ -91,7 +71,28 @@ set_new_pixbuf(VnrPropertiesDialog *dialog, GdkPixbuf* original)
     vnr_tools_fit_to_size(&height, &width, 100,100);
 
     dialog->thumbnail = gdk_pixbuf_scale_simple (original, width, height,
-                                                 GDK_INTERP_NEAREST);
+                                                 interp_type);
+}
+
+static void
+thumbnail_ready_cb (const gchar *path, GdkPixbuf *thumbnail, gpointer user_data)
+{
+    VnrPropertiesDialog *dialog = VNR_PROPERTIES_DIALOG(user_data);
+
+    set_new_pixbuf(dialog, thumbnail, GDK_INTERP_BILINEAR);
+    if(dialog->thumbnail != NULL)
+        gtk_image_set_from_pixbuf (GTK_IMAGE(dialog->image), dialog->thumbnail);
+}
+
+static void
+cancel_thumbnail (VnrPropertiesDialog *dialog)
+{
+    if(dialog->thumbnail_cancellable == NULL)
+        return;
+
+    g_cancellable_cancel(dialog->thumbnail_cancellable);
+    g_object_unref(dialog->thumbnail_cancellable);
+    dialog->thumbnail_cancellable = NULL;
 }
 
 static void
@@ -105,6 +106,7 @@ vnr_properties_dialog_new (VnrWindow *vnr_win, GtkAction *next_action, GtkAction
     dialog = g_object_new (VNR_TYPE_PROPERTIES_DIALOG, NULL);
 
     dialog->thumbnail = NULL;
+    dialog->thumbnail_cancellable = NULL;
     dialog->vnr_win = vnr_win;
 
     gtk_activatable_set_related_action (GTK_ACTIVATABLE(dialog->next_button), next_action);
@@ -264,19 +266,20 @@ void
 vnr_properties_dialog_update(VnrPropertiesDialog *dialog)
 {
     const gchar *filetype = NULL;
-    goffset filesize = 0;
+    gsize filesize = 0;
     gchar *filetype_desc = NULL;
     gchar *filesize_str = NULL;
 
-    get_file_info ((gchar*)VNR_FILE(dialog->vnr_win->file_list->data)->path,
-                   &filesize, &filetype);
-
-    if(filetype == NULL && filesize == 0)
+    /* Only the bytes read to show the image are looked at */
+    if(dialog->vnr_win->load_context == NULL)
     {
         vnr_properties_dialog_clear(dialog);
         return;
     }
 
+    vnr_load_context_get_data(dialog->vnr_win->load_context, &filesize);
+    filetype = vnr_load_context_get_content_type(dialog->vnr_win->load_context);
+
     vnr_properties_dialog_update_image(dialog);
     vnr_properties_dialog_update_metadata(dialog);
 
@@ -285,16 +288,15 @@ vnr_properties_dialog_update(VnrPropertiesDialog *dialog)
     filetype_desc = g_content_type_get_description (filetype);
 
     gtk_label_set_text(GTK_LABEL(dialog->name_label),
-                       (gchar*)VNR_FILE(dialog->vnr_win->file_list->data)->display_name);
+                       (gchar*)vnr_file_list_get_current(dialog->vnr_win->file_list)->display_name);
 
     gtk_label_set_text(GTK_LABEL(dialog->location_label),
-                       (gchar*)VNR_FILE(dialog->vnr_win->file_list->data)->path);
+                       (gchar*)vnr_file_list_get_current(dialog->vnr_win->file_list)->path);
 
     gtk_label_set_text(GTK_LABEL(dialog->type_label), filetype_desc);
     gtk_label_set_text(GTK_LABEL(dialog->size_label), filesize_str);
 
     g_free(filesize_str);
-    g_free((gchar*)filetype);
     g_free(filetype_desc);
 }
 
@@ -347,12 +349,13 @@ vnr_cb_add_metadata(const char *label, const char *value, void *user_data) {
 static void
 vnr_properties_dialog_update_metadata(VnrPropertiesDialog *dialog)
 {
+    const guchar *data;
+    gsize length;
+
     vnr_properties_dialog_clear_metadata(dialog);
 
-    uni_read_exiv2_map(
-        VNR_FILE(dialog->vnr_win->file_list->data)->path,
-        vnr_cb_add_metadata,
-        (void*)dialog);
+    data = vnr_load_context_get_data(dialog->vnr_win->load_context, &length);
+    uni_read_exiv2_map(data, length, vnr_cb_add_metadata, (void*)dialog);
 }
 
 void
@@ -365,11 +368,24 @@ vnr_properties_dialog_update_image(VnrPropertiesDialog *dialog)
     strftime(date_modified,
              date_modified_buf_size * sizeof(gchar),
              "%Ec",
-             localtime(&VNR_FILE(dialog->vnr_win->file_list->data)->mtime));
+             localtime(&vnr_file_list_get_current(dialog->vnr_win->file_list)->mtime));
     gtk_label_set_text(GTK_LABEL(dialog->modified_label), date_modified);
 
-    set_new_pixbuf(dialog, uni_image_view_get_pixbuf(UNI_IMAGE_VIEW(dialog->vnr_win->view)));
-    gtk_image_set_from_pixbuf (GTK_IMAGE(dialog->image), dialog->thumbnail);
+    /* Edits are only in the view until they are saved */
+    cancel_thumbnail(dialog);
+    if(dialog->vnr_win->modifications != 0)
+    {
+        set_new_pixbuf(dialog, uni_image_view_get_pixbuf(UNI_IMAGE_VIEW(dialog->vnr_win->view)),
+                       GDK_INTERP_NEAREST);
+        gtk_image_set_from_pixbuf (GTK_IMAGE(dialog->image), dialog->thumbnail);
+    }
+    else
+    {
+        dialog->thumbnail_cancellable = g_cancellable_new();
+        vnr_thumbnails_request(vnr_file_list_get_current(dialog->vnr_win->file_list)->path,
+                               VNR_THUMBNAIL_NORMAL, dialog->thumbnail_cancellable,
+                               thumbnail_ready_cb, dialog);
+    }
 
     width_str = g_strdup_printf("%i px", dialog->vnr_win->current_image_width);
     height_str = g_strdup_printf("%i px", dialog->vnr_win->current_image_height);
@@ -384,7 +400,8 @@ vnr_properties_dialog_update_image(VnrPropertiesDialog *dialog)
 void
 vnr_properties_dialog_clear(VnrPropertiesDialog *dialog)
 {
-    set_new_pixbuf(dialog, NULL);
+    cancel_thumbnail(dialog);
+    set_new_pixbuf(dialog, NULL, GDK_INTERP_NEAREST);
     vnr_properties_dialog_clear_metadata(dialog);
 
     gtk_label_set_text(GTK_LABEL(dialog->location_label), _("None"));
@@ -63,6 +63,7 @@ struct _VnrPropertiesDialog {
     GtkWidget* modified_label;
 
     GdkPixbuf *thumbnail;
+    GCancellable *thumbnail_cancellable;
 
     VnrWindow *vnr_win;
 };
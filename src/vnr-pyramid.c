@@ -0,0 +1,996 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <libintl.h>
+#include <glib/gi18n.h>
+#define _(String) gettext (String)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "vnr-pyramid.h"
+#include "vnr-region-decoder.h"
+#include "vnr-workers.h"
+
+/* Pyramids of the first version kept JPEG images as stored, rather
+ * than turned upright */
+#define VNR_PYRAMID_MAGIC "VNRPYR\0\2"
+
+/* Tiles start at a page boundary */
+#define VNR_PYRAMID_ALIGN 4096
+
+#define VNR_PYRAMID_MAX_LEVELS 32
+
+/* Seconds after which a temporary file no build of this process is
+ * writing is taken as left over, since builds write as they go */
+#define VNR_PYRAMID_TMP_AGE 3600
+
+/*
+ * A pyramid file holds an image at full resolution, as it is shown,
+ * and at every halving of it down to a single tile, cut into the tiles
+ * UniImageView draws. It is mapped into memory and its tiles are shown
+ * in place, so an image opened again is not decoded at all:
+ *
+ *   VnrPyramidHeader
+ *   the path of the image, NUL-terminated
+ *   padding up to VNR_PYRAMID_ALIGN
+ *   the tiles of level 0, row by row, then those of level 1 and so on
+ *
+ * Every tile takes UNI_TILE_SIZE rows of UNI_TILE_SIZE pixels, those
+ * at the right and bottom edges being padded, of 8 bit RGB or RGBA.
+ * Numbers are in the byte order of the machine, as the cache is not
+ * shared between machines. A pyramid is only used if the image still
+ * has the size and modification time it was built from, and is deleted
+ * once it has not.
+ *
+ * The modification time of a pyramid file is the last time it was
+ * opened. Before a pyramid is built in the background, the least
+ * recently opened ones are deleted until the cache fits in the size
+ * the preferences give it. Pyramids built from the command line are
+ * not limited. Temporary files left by builds that did not finish are
+ * deleted as well.
+ */
+typedef struct {
+    gchar magic[8];
+    guint32 tile_size;
+    guint32 channels;
+    guint32 width;
+    guint32 height;
+    guint32 n_levels;
+    guint32 path_length;
+    gint64 stamp;
+    guint64 source_size;
+} VnrPyramidHeader;
+
+typedef struct {
+    gint width;
+    gint height;
+    gint cols;
+    gint rows;
+    guint64 offset;
+} VnrPyramidLevel;
+
+/* A pyramid file of the cache, when making room in it */
+typedef struct {
+    gchar *file;
+    gint64 used;
+    guint64 size;
+} VnrPyramidCacheEntry;
+
+struct _VnrPyramid {
+    GMappedFile *mapping;
+    const guchar *data;
+
+    gint width;
+    gint height;
+    gint channels;
+    gsize tile_bytes;
+    guint n_levels;
+    VnrPyramidLevel levels[VNR_PYRAMID_MAX_LEVELS];
+};
+
+/* A pyramid being written */
+typedef struct {
+    VnrPyramid layout;
+    int fd;
+    guchar *buffer;
+    GError *error;
+} VnrPyramidWriter;
+
+/* Pyramids being built in the background, by path, the most bytes
+ * their cache may take and the cancellable stopping them. The lock
+ * also protects the times, in seconds, the running builds started. */
+static GHashTable *building = NULL;
+static guint64 build_cache_size = 0;
+static GCancellable *build_cancellable = NULL;
+static VnrWorkGroup *build_group = NULL;
+static GArray *build_starts = NULL;
+G_LOCK_DEFINE_STATIC (building);
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static gchar *
+vnr_pyramid_get_file (const gchar *path)
+{
+    gchar *checksum, *name, *file;
+
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, path, -1);
+    name = g_strconcat (checksum, ".pyramid", NULL);
+    file = g_build_filename (g_get_user_cache_dir (), "viewnior", "pyramids",
+                             name, NULL);
+
+    g_free (name);
+    g_free (checksum);
+    return file;
+}
+
+/* The modification time of @path, in microseconds, and its size */
+static gboolean
+vnr_pyramid_get_source_info (const gchar *path, gint64 *stamp, guint64 *size)
+{
+    GFile *file = g_file_new_for_path (path);
+    GFileInfo *info;
+
+    info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC","
+                              G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                              0, NULL, NULL);
+    g_object_unref (file);
+    if (info == NULL)
+        return FALSE;
+
+    *stamp = g_file_info_get_attribute_uint64 (info,
+                 G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+             + g_file_info_get_attribute_uint32 (info,
+                 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+    *size = g_file_info_get_size (info);
+    g_object_unref (info);
+    return TRUE;
+}
+
+/* Lays the levels of an image of @width by @height out after a header
+ * naming a path of @path_length bytes. Returns the size of the file. */
+static guint64
+vnr_pyramid_layout (VnrPyramid *pyramid, gint width, gint height,
+                    gint channels, gsize path_length)
+{
+    guint64 offset;
+    guint i;
+
+    pyramid->width = width;
+    pyramid->height = height;
+    pyramid->channels = channels;
+    pyramid->tile_bytes = (gsize) UNI_TILE_SIZE * UNI_TILE_SIZE * channels;
+
+    offset = sizeof (VnrPyramidHeader) + path_length + 1;
+    offset = (offset + VNR_PYRAMID_ALIGN - 1) / VNR_PYRAMID_ALIGN
+             * VNR_PYRAMID_ALIGN;
+
+    for (i = 0; i < VNR_PYRAMID_MAX_LEVELS; i++)
+    {
+        VnrPyramidLevel *level = &pyramid->levels[i];
+
+        level->width = ((gint64) width + (1 << i) - 1) >> i;
+        level->height = ((gint64) height + (1 << i) - 1) >> i;
+        level->cols = (level->width + UNI_TILE_SIZE - 1) / UNI_TILE_SIZE;
+        level->rows = (level->height + UNI_TILE_SIZE - 1) / UNI_TILE_SIZE;
+        level->offset = offset;
+        offset += (guint64) level->cols * level->rows * pyramid->tile_bytes;
+
+        if (level->cols == 1 && level->rows == 1)
+            break;
+    }
+    pyramid->n_levels = i + 1;
+    return offset;
+}
+
+static guint64
+vnr_pyramid_get_tile_offset (VnrPyramid *pyramid, gint level,
+                             gint col, gint row)
+{
+    VnrPyramidLevel *l = &pyramid->levels[level];
+
+    return l->offset + ((guint64) row * l->cols + col) * pyramid->tile_bytes;
+}
+
+static void
+vnr_pyramid_release (guchar *pixels, gpointer data)
+{
+    g_mapped_file_unref (data);
+}
+
+static void
+vnr_pyramid_set_io_error (GError **error, int saved_errno)
+{
+    if (error != NULL && *error == NULL)
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     _("Failed to write the pyramid: %s"),
+                     g_strerror (saved_errno));
+}
+
+static gboolean
+vnr_pyramid_write (VnrPyramidWriter *writer, const guchar *buffer,
+                   gsize count, guint64 offset)
+{
+    while (count > 0)
+    {
+        gssize written = pwrite (writer->fd, buffer, count, offset);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+        {
+            vnr_pyramid_set_io_error (&writer->error,
+                                      written < 0 ? errno : ENOSPC);
+            return FALSE;
+        }
+        buffer += written;
+        count -= written;
+        offset += written;
+    }
+    return TRUE;
+}
+
+static gboolean
+vnr_pyramid_read (VnrPyramidWriter *writer, guchar *buffer,
+                  gsize count, guint64 offset)
+{
+    while (count > 0)
+    {
+        gssize done = pread (writer->fd, buffer, count, offset);
+
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+        {
+            vnr_pyramid_set_io_error (&writer->error,
+                                      done < 0 ? errno : EIO);
+            return FALSE;
+        }
+        buffer += done;
+        count -= done;
+        offset += done;
+    }
+    return TRUE;
+}
+
+/* Runs as each tile of level 0 is decoded */
+static void
+vnr_pyramid_write_decoded (guint index, GdkPixbuf *pixbuf, gpointer user_data)
+{
+    VnrPyramidWriter *writer = user_data;
+    VnrPyramid *layout = &writer->layout;
+    gint cols = layout->levels[0].cols;
+    gint rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+    gsize length = gdk_pixbuf_get_width (pixbuf) * layout->channels;
+    const guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    gint y;
+
+    if (writer->error != NULL)
+        return;
+
+    for (y = 0; y < gdk_pixbuf_get_height (pixbuf); y++)
+        memcpy (writer->buffer + y * UNI_TILE_SIZE * layout->channels,
+                pixels + y * rowstride, length);
+
+    vnr_pyramid_write (writer, writer->buffer, layout->tile_bytes,
+                       vnr_pyramid_get_tile_offset (layout, 0, index % cols,
+                                                    index / cols));
+}
+
+/* The pixel at @x, @y of the 2 by 2 tiles in @children */
+static inline const guchar *
+vnr_pyramid_get_pixel (guchar **children, gint x, gint y, gint channels)
+{
+    return children[(y / UNI_TILE_SIZE) * 2 + x / UNI_TILE_SIZE] +
+           ((y % UNI_TILE_SIZE) * UNI_TILE_SIZE + x % UNI_TILE_SIZE) * channels;
+}
+
+/* Makes the tiles of @level by halving those of the level below */
+static gboolean
+vnr_pyramid_reduce (VnrPyramidWriter *writer, guint level,
+                    GCancellable *cancellable)
+{
+    VnrPyramid *layout = &writer->layout;
+    VnrPyramidLevel *below = &layout->levels[level - 1];
+    VnrPyramidLevel *l = &layout->levels[level];
+    gint channels = layout->channels;
+    guchar *children[4];
+    gboolean ok = TRUE;
+    gint col, row, i, x, y, c, width, height, block_width, block_height;
+
+    children[0] = g_malloc (4 * layout->tile_bytes);
+    for (i = 1; i < 4; i++)
+        children[i] = children[0] + i * layout->tile_bytes;
+
+    for (row = 0; ok && row < l->rows; row++)
+    {
+        if (g_cancellable_set_error_if_cancelled (cancellable, &writer->error))
+        {
+            ok = FALSE;
+            break;
+        }
+
+        for (col = 0; ok && col < l->cols; col++)
+        {
+            for (i = 0; ok && i < 4; i++)
+                if (2 * col + i % 2 < below->cols && 2 * row + i / 2 < below->rows)
+                    ok = vnr_pyramid_read (writer, children[i],
+                                           layout->tile_bytes,
+                                           vnr_pyramid_get_tile_offset (
+                                               layout, level - 1,
+                                               2 * col + i % 2,
+                                               2 * row + i / 2));
+            if (!ok)
+                break;
+
+            /* Odd edges repeat their last pixel */
+            block_width = MIN (2 * UNI_TILE_SIZE,
+                               below->width - 2 * col * UNI_TILE_SIZE);
+            block_height = MIN (2 * UNI_TILE_SIZE,
+                                below->height - 2 * row * UNI_TILE_SIZE);
+            width = MIN (UNI_TILE_SIZE, l->width - col * UNI_TILE_SIZE);
+            height = MIN (UNI_TILE_SIZE, l->height - row * UNI_TILE_SIZE);
+
+            for (y = 0; y < height; y++)
+            {
+                gint y0 = 2 * y, y1 = MIN (2 * y + 1, block_height - 1);
+                guchar *dst = writer->buffer + y * UNI_TILE_SIZE * channels;
+
+                for (x = 0; x < width; x++)
+                {
+                    gint x0 = 2 * x, x1 = MIN (2 * x + 1, block_width - 1);
+                    const guchar *p00 = vnr_pyramid_get_pixel (children, x0, y0, channels);
+                    const guchar *p01 = vnr_pyramid_get_pixel (children, x1, y0, channels);
+                    const guchar *p10 = vnr_pyramid_get_pixel (children, x0, y1, channels);
+                    const guchar *p11 = vnr_pyramid_get_pixel (children, x1, y1, channels);
+
+                    for (c = 0; c < channels; c++)
+                        dst[c] = (p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4;
+                    dst += channels;
+                }
+            }
+
+            ok = vnr_pyramid_write (writer, writer->buffer, layout->tile_bytes,
+                                    vnr_pyramid_get_tile_offset (layout, level,
+                                                                 col, row));
+        }
+    }
+    g_free (children[0]);
+    return ok;
+}
+
+/* Whether the pyramid in @file was built from the image it names as
+ * it is now */
+static gboolean
+vnr_pyramid_is_fresh (const gchar *file)
+{
+    VnrPyramidHeader header;
+    gchar *path;
+    gint64 stamp;
+    guint64 size;
+    gboolean fresh = FALSE;
+    int fd;
+
+    fd = g_open (file, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return FALSE;
+
+    if (read (fd, &header, sizeof (header)) == sizeof (header) &&
+        memcmp (header.magic, VNR_PYRAMID_MAGIC, 8) == 0 &&
+        header.path_length < G_MAXUINT16)
+    {
+        path = g_malloc (header.path_length + 1);
+        if (read (fd, path, header.path_length + 1) ==
+                (gssize) header.path_length + 1 &&
+            path[header.path_length] == '\0' &&
+            vnr_pyramid_get_source_info (path, &stamp, &size))
+            fresh = header.stamp == stamp && header.source_size == size;
+        g_free (path);
+    }
+    close (fd);
+    return fresh;
+}
+
+static gint
+vnr_pyramid_cache_entry_compare (gconstpointer a, gconstpointer b)
+{
+    const VnrPyramidCacheEntry *x = a, *y = b;
+
+    return x->used < y->used ? -1 : x->used > y->used;
+}
+
+/* Records that a build starts, or ends with @start being when it
+ * started */
+static gint64
+vnr_pyramid_track_build (gboolean starting, gint64 start)
+{
+    guint i;
+
+    G_LOCK (building);
+    if (build_starts == NULL)
+        build_starts = g_array_new (FALSE, FALSE, sizeof (gint64));
+    if (starting)
+    {
+        start = g_get_real_time () / G_USEC_PER_SEC;
+        g_array_append_val (build_starts, start);
+    }
+    else
+    {
+        for (i = 0; i < build_starts->len; i++)
+            if (g_array_index (build_starts, gint64, i) == start)
+                break;
+        if (i < build_starts->len)
+            g_array_remove_index_fast (build_starts, i);
+    }
+    G_UNLOCK (building);
+    return start;
+}
+
+/* Temporary files last written before this time are left over: no
+ * build of this process was running yet, and one of another process
+ * would have written since */
+static gint64
+vnr_pyramid_get_tmp_cutoff (void)
+{
+    gint64 cutoff = g_get_real_time () / G_USEC_PER_SEC - VNR_PYRAMID_TMP_AGE;
+    guint i;
+
+    G_LOCK (building);
+    for (i = 0; build_starts != NULL && i < build_starts->len; i++)
+        cutoff = MIN (cutoff, g_array_index (build_starts, gint64, i));
+    G_UNLOCK (building);
+    return cutoff;
+}
+
+/* Deletes the left over temporary files and the pyramids in @dir of
+ * images which changed or are gone, then, unless @cache_size is 0, the
+ * least recently opened ones until @size more bytes fit in
+ * @cache_size */
+static gboolean
+vnr_pyramid_make_room (const gchar *dir, guint64 size, guint64 cache_size,
+                       GError **error)
+{
+    VnrPyramidCacheEntry entry;
+    GArray *entries;
+    GDir *d;
+    const gchar *name;
+    guint64 total = 0;
+    gint64 cutoff;
+    guint i;
+
+    if (cache_size > 0 && size > cache_size)
+    {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                             _("The pyramid is larger than the cache."));
+        return FALSE;
+    }
+
+    d = g_dir_open (dir, 0, NULL);
+    if (d == NULL)
+        return TRUE;
+
+    cutoff = vnr_pyramid_get_tmp_cutoff ();
+    entries = g_array_new (FALSE, FALSE, sizeof (VnrPyramidCacheEntry));
+    while ((name = g_dir_read_name (d)) != NULL)
+    {
+        GStatBuf st;
+
+        /* Pyramids being written have a suffix of their own */
+        if (!g_str_has_suffix (name, ".pyramid"))
+        {
+            if (strstr (name, ".pyramid.") == NULL)
+                continue;
+            entry.file = g_build_filename (dir, name, NULL);
+            if (g_stat (entry.file, &st) == 0 && st.st_mtime < cutoff)
+                g_unlink (entry.file);
+            g_free (entry.file);
+            continue;
+        }
+
+        entry.file = g_build_filename (dir, name, NULL);
+        if (g_stat (entry.file, &st) != 0 || !vnr_pyramid_is_fresh (entry.file))
+        {
+            g_unlink (entry.file);
+            g_free (entry.file);
+            continue;
+        }
+        entry.used = st.st_mtime;
+        entry.size = st.st_size;
+        total += entry.size;
+        g_array_append_val (entries, entry);
+    }
+    g_dir_close (d);
+
+    g_array_sort (entries, vnr_pyramid_cache_entry_compare);
+    for (i = 0; i < entries->len; i++)
+    {
+        VnrPyramidCacheEntry *e = &g_array_index (entries, VnrPyramidCacheEntry, i);
+
+        if (cache_size > 0 && total + size > cache_size &&
+            g_unlink (e->file) == 0)
+            total -= e->size;
+        g_free (e->file);
+    }
+    g_array_free (entries, TRUE);
+    return TRUE;
+}
+
+/* Refuses pyramids taking more than half of the space left */
+static gboolean
+vnr_pyramid_check_space (const gchar *dir, guint64 size, GError **error)
+{
+    GFile *file = g_file_new_for_path (dir);
+    GFileInfo *info;
+    guint64 free_space = G_MAXUINT64;
+
+    info = g_file_query_filesystem_info (file, G_FILE_ATTRIBUTE_FILESYSTEM_FREE,
+                                         NULL, NULL);
+    if (info != NULL)
+    {
+        free_space = g_file_info_get_attribute_uint64 (info,
+                         G_FILE_ATTRIBUTE_FILESYSTEM_FREE);
+        g_object_unref (info);
+    }
+    g_object_unref (file);
+
+    if (size <= free_space / 2)
+        return TRUE;
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                         _("Not enough free space to keep the pyramid."));
+    return FALSE;
+}
+
+static void
+vnr_pyramid_build_job (gchar *path, gpointer user_data)
+{
+    guint64 cache_size;
+
+    G_LOCK (building);
+    cache_size = build_cache_size;
+    G_UNLOCK (building);
+
+    vnr_pyramid_build (path, cache_size, build_cancellable, NULL);
+
+    G_LOCK (building);
+    g_hash_table_remove (building, path);
+    G_UNLOCK (building);
+}
+
+static void
+vnr_pyramid_build_file_job (gchar *path, gint *failed)
+{
+    GError *error = NULL;
+
+    if (vnr_pyramid_build (path, 0, NULL, &error))
+        g_print ("%s\n", path);
+    else
+    {
+        g_printerr ("%s: %s\n", path, error->message);
+        g_error_free (error);
+        g_atomic_int_inc (failed);
+    }
+    g_free (path);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_pyramid_open:
+ * @path: an image
+ * @returns: the pyramid built for @path, or %NULL if there is none or
+ *   it is stale, in which case it is deleted
+ **/
+VnrPyramid *
+vnr_pyramid_open (const gchar *path)
+{
+    VnrPyramid *pyramid;
+    GMappedFile *mapping;
+    const VnrPyramidHeader *header;
+    gchar *file;
+    gsize length, path_length = strlen (path);
+    gint64 stamp;
+    guint64 size;
+
+    file = vnr_pyramid_get_file (path);
+    mapping = g_mapped_file_new (file, FALSE, NULL);
+
+    if (mapping == NULL)
+    {
+        g_free (file);
+        return NULL;
+    }
+
+    pyramid = g_slice_new0 (VnrPyramid);
+    pyramid->mapping = mapping;
+    pyramid->data = (const guchar *) g_mapped_file_get_contents (mapping);
+    length = g_mapped_file_get_length (mapping);
+    header = (const VnrPyramidHeader *) pyramid->data;
+
+    if (length < sizeof (VnrPyramidHeader) + path_length + 1 ||
+        memcmp (header->magic, VNR_PYRAMID_MAGIC, 8) != 0 ||
+        header->tile_size != UNI_TILE_SIZE ||
+        (header->channels != 3 && header->channels != 4) ||
+        header->width == 0 || header->width > G_MAXINT ||
+        header->height == 0 || header->height > G_MAXINT ||
+        header->path_length != path_length ||
+        memcmp (header + 1, path, path_length + 1) != 0 ||
+        !vnr_pyramid_get_source_info (path, &stamp, &size) ||
+        header->stamp != stamp || header->source_size != size ||
+        vnr_pyramid_layout (pyramid, header->width, header->height,
+                            header->channels, path_length) != length ||
+        header->n_levels != pyramid->n_levels)
+    {
+        /* It would never be used again */
+        g_unlink (file);
+        g_free (file);
+        vnr_pyramid_free (pyramid);
+        return NULL;
+    }
+
+    /* Kept the longest in the cache, as the most recently opened */
+    g_utime (file, NULL);
+    g_free (file);
+    return pyramid;
+}
+
+void
+vnr_pyramid_free (VnrPyramid *pyramid)
+{
+    if (pyramid == NULL)
+        return;
+
+    g_mapped_file_unref (pyramid->mapping);
+    g_slice_free (VnrPyramid, pyramid);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+void
+vnr_pyramid_get_size (VnrPyramid *pyramid, gint *width, gint *height)
+{
+    *width = pyramid->width;
+    *height = pyramid->height;
+}
+
+/**
+ * vnr_pyramid_get_tile:
+ * @pyramid: a #VnrPyramid
+ * @key: the tile wanted
+ * @returns: the pixels of the tile, to be unreffed by the caller, or
+ *   %NULL if the pyramid does not have it
+ *
+ * The pixels are read from the pyramid file in place, from any thread.
+ **/
+GdkPixbuf *
+vnr_pyramid_get_tile (VnrPyramid *pyramid, const UniTileKey *key)
+{
+    VnrPyramidLevel *level;
+
+    if (key->level < 0 || (guint) key->level >= pyramid->n_levels)
+        return NULL;
+
+    level = &pyramid->levels[key->level];
+    if (key->col < 0 || key->col >= level->cols ||
+        key->row < 0 || key->row >= level->rows)
+        return NULL;
+
+    return gdk_pixbuf_new_from_data (
+               pyramid->data + vnr_pyramid_get_tile_offset (pyramid, key->level,
+                                                            key->col, key->row),
+               GDK_COLORSPACE_RGB, pyramid->channels == 4, 8,
+               MIN (UNI_TILE_SIZE, level->width - key->col * UNI_TILE_SIZE),
+               MIN (UNI_TILE_SIZE, level->height - key->row * UNI_TILE_SIZE),
+               UNI_TILE_SIZE * pyramid->channels,
+               vnr_pyramid_release, g_mapped_file_ref (pyramid->mapping));
+}
+
+/**
+ * vnr_pyramid_get_overview:
+ * @pyramid: a #VnrPyramid
+ * @max_pixels: the most pixels the overview may have
+ * @returns: the largest level of the pyramid within @max_pixels, or the
+ *   smallest one, to be unreffed by the caller, or %NULL if there is
+ *   not enough memory for it
+ **/
+GdkPixbuf *
+vnr_pyramid_get_overview (VnrPyramid *pyramid, guint64 max_pixels)
+{
+    VnrPyramidLevel *level;
+    GdkPixbuf *pixbuf;
+    guchar *pixels;
+    gint rowstride, channels = pyramid->channels;
+    gint col, row, y, width, height;
+    guint i;
+
+    for (i = 0; i + 1 < pyramid->n_levels; i++)
+        if ((guint64) pyramid->levels[i].width *
+            pyramid->levels[i].height <= max_pixels)
+            break;
+    level = &pyramid->levels[i];
+
+    pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, channels == 4, 8,
+                             level->width, level->height);
+    if (pixbuf == NULL)
+        return NULL;
+
+    pixels = gdk_pixbuf_get_pixels (pixbuf);
+    rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+    for (row = 0; row < level->rows; row++)
+        for (col = 0; col < level->cols; col++)
+        {
+            const guchar *tile = pyramid->data +
+                vnr_pyramid_get_tile_offset (pyramid, i, col, row);
+
+            width = MIN (UNI_TILE_SIZE, level->width - col * UNI_TILE_SIZE);
+            height = MIN (UNI_TILE_SIZE, level->height - row * UNI_TILE_SIZE);
+            for (y = 0; y < height; y++)
+                memcpy (pixels + (gsize) (row * UNI_TILE_SIZE + y) * rowstride
+                        + col * UNI_TILE_SIZE * channels,
+                        tile + y * UNI_TILE_SIZE * channels,
+                        width * channels);
+        }
+    return pixbuf;
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_pyramid_build:
+ * @path: an image a #VnrRegionDecoder can read
+ * @cache_size: the most bytes the pyramids may take altogether, or 0
+ *   for no limit
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: return location for a #GError
+ * @returns: %TRUE if the pyramid of @path was written
+ *
+ * Decodes the image once, cutting it into tiles as it goes, and makes
+ * the smaller levels from those tiles. The pyramid is written to a
+ * temporary file and renamed, so a reader never maps half of one.
+ **/
+gboolean
+vnr_pyramid_build (const gchar *path, guint64 cache_size,
+                   GCancellable *cancellable, GError **error)
+{
+    VnrPyramidWriter writer;
+    VnrPyramidHeader header;
+    VnrRegionDecoder *decoder = NULL;
+    GMappedFile *mapping;
+    GdkRectangle *rects;
+    GError *tmp_error = NULL;
+    UniTileKey key = { 0, 0, 0 };
+    gchar *file = NULL, *dir = NULL, *tmp = NULL;
+    gsize path_length = strlen (path);
+    guint64 total;
+    gint64 start;
+    gint width, height, n_tiles, i;
+    guint level;
+
+    memset (&writer, 0, sizeof (writer));
+    writer.fd = -1;
+    start = vnr_pyramid_track_build (TRUE, 0);
+
+    mapping = g_mapped_file_new (path, FALSE, &writer.error);
+    if (mapping != NULL)
+        decoder = vnr_region_decoder_new (
+                      (const guchar *) g_mapped_file_get_contents (mapping),
+                      g_mapped_file_get_length (mapping));
+    if (mapping != NULL && decoder == NULL)
+        g_set_error_literal (&writer.error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_UNKNOWN_TYPE,
+                             _("The image cannot be decoded by parts."));
+    if (writer.error != NULL)
+        goto out;
+
+    memset (&header, 0, sizeof (header));
+    if (!vnr_pyramid_get_source_info (path, &header.stamp,
+                                      &header.source_size))
+    {
+        vnr_pyramid_set_io_error (&writer.error, ENOENT);
+        goto out;
+    }
+
+    vnr_region_decoder_get_size (decoder, &width, &height);
+    total = vnr_pyramid_layout (&writer.layout, width, height,
+                                vnr_region_decoder_get_n_channels (decoder),
+                                path_length);
+    memcpy (header.magic, VNR_PYRAMID_MAGIC, 8);
+    header.tile_size = UNI_TILE_SIZE;
+    header.channels = writer.layout.channels;
+    header.width = width;
+    header.height = height;
+    header.n_levels = writer.layout.n_levels;
+    header.path_length = path_length;
+
+    file = vnr_pyramid_get_file (path);
+    dir = g_path_get_dirname (file);
+    tmp = g_strconcat (file, ".XXXXXX", NULL);
+    if (g_mkdir_with_parents (dir, 0700) != 0 ||
+        (writer.fd = g_mkstemp (tmp)) < 0)
+    {
+        vnr_pyramid_set_io_error (&writer.error, errno);
+        goto out;
+    }
+    if (!vnr_pyramid_make_room (dir, total, cache_size, &writer.error) ||
+        !vnr_pyramid_check_space (dir, total, &writer.error))
+        goto out;
+
+    /* Padding is left as holes */
+    if (ftruncate (writer.fd, total) != 0)
+    {
+        vnr_pyramid_set_io_error (&writer.error, errno);
+        goto out;
+    }
+    writer.buffer = g_malloc0 (writer.layout.tile_bytes);
+    if (!vnr_pyramid_write (&writer, (guchar *) &header, sizeof (header), 0) ||
+        !vnr_pyramid_write (&writer, (const guchar *) path, path_length + 1,
+                            sizeof (header)))
+        goto out;
+
+    /* Level 0 in a single pass over the image */
+    n_tiles = writer.layout.levels[0].cols * writer.layout.levels[0].rows;
+    rects = g_new (GdkRectangle, n_tiles);
+    for (i = 0; i < n_tiles; i++)
+    {
+        key.col = i % writer.layout.levels[0].cols;
+        key.row = i / writer.layout.levels[0].cols;
+        uni_tile_get_rect (&key, &rects[i]);
+    }
+    vnr_region_decoder_decode_areas (decoder, rects, n_tiles, 1.0,
+                                     vnr_pyramid_write_decoded, NULL,
+                                     &writer, cancellable, &tmp_error);
+    g_free (rects);
+    if (writer.error == NULL)
+        writer.error = tmp_error;
+    else
+        g_clear_error (&tmp_error);
+
+    for (level = 1; writer.error == NULL && level < writer.layout.n_levels;
+         level++)
+        vnr_pyramid_reduce (&writer, level, cancellable);
+
+    if (writer.error == NULL && g_rename (tmp, file) != 0)
+        vnr_pyramid_set_io_error (&writer.error, errno);
+
+out:
+    if (writer.fd >= 0)
+    {
+        close (writer.fd);
+        if (writer.error != NULL)
+            g_unlink (tmp);
+    }
+    g_free (writer.buffer);
+    g_free (tmp);
+    g_free (dir);
+    g_free (file);
+    vnr_region_decoder_free (decoder);
+    if (mapping != NULL)
+        g_mapped_file_unref (mapping);
+    vnr_pyramid_track_build (FALSE, start);
+
+    if (writer.error == NULL)
+        return TRUE;
+    g_propagate_error (error, writer.error);
+    return FALSE;
+}
+
+/**
+ * vnr_pyramid_build_async:
+ * @path: an image a #VnrRegionDecoder can read
+ * @cache_size: the most bytes the pyramids may take altogether
+ *
+ * Builds the pyramid of @path in the background, unless it is being
+ * built already. Pyramids are built one after the other, until
+ * vnr_pyramid_stop_builds() is called.
+ **/
+void
+vnr_pyramid_build_async (const gchar *path, guint64 cache_size)
+{
+    gchar *job;
+
+    G_LOCK (building);
+    if (building == NULL)
+        building = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, NULL);
+    build_cache_size = cache_size;
+    if (g_hash_table_contains (building, path))
+    {
+        G_UNLOCK (building);
+        return;
+    }
+    job = g_strdup (path);
+    g_hash_table_add (building, job);
+    G_UNLOCK (building);
+
+    if (build_group == NULL)
+    {
+        build_cancellable = g_cancellable_new ();
+        build_group = vnr_work_group_new (VNR_WORK_WARMING,
+                                          (GFunc) vnr_pyramid_build_job,
+                                          NULL, 1, NULL, build_cancellable);
+    }
+    vnr_work_group_push (build_group, job);
+}
+
+/**
+ * vnr_pyramid_stop_builds:
+ *
+ * Stops the pyramids being built in the background and drops the
+ * queued ones, waiting for the temporary files to be deleted. Called
+ * on shutdown.
+ **/
+void
+vnr_pyramid_stop_builds (void)
+{
+    if (build_group == NULL)
+        return;
+
+    g_cancellable_cancel (build_cancellable);
+    vnr_work_group_free (build_group, TRUE, TRUE);
+    g_clear_object (&build_cancellable);
+    build_group = NULL;
+}
+
+/**
+ * vnr_pyramid_build_files:
+ * @paths: the images to build the pyramids of, %NULL-terminated
+ * @returns: the exit status of viewnior --build-pyramid
+ *
+ * Builds the pyramids of @paths, as many at once as there are
+ * processors, printing each path as it is done.
+ **/
+int
+vnr_pyramid_build_files (gchar **paths)
+{
+    VnrWorkGroup *group;
+    gint failed = 0;
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+    group = vnr_work_group_new (VNR_WORK_CURRENT,
+                                (GFunc) vnr_pyramid_build_file_job, &failed,
+                                MAX (cpus, 1), NULL, NULL);
+    for (; paths != NULL && *paths != NULL; paths++)
+    {
+        GFile *file = g_file_new_for_commandline_arg (*paths);
+        gchar *path = g_file_get_path (file);
+
+        if (path != NULL)
+            vnr_work_group_push (group, path);
+        else
+        {
+            g_printerr ("%s: %s\n", *paths, _("Not a local file."));
+            g_atomic_int_inc (&failed);
+        }
+        g_object_unref (file);
+    }
+    vnr_work_group_free (group, FALSE, TRUE);
+    return failed > 0 ? 1 : 0;
+}
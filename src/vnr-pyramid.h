@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __VNR_PYRAMID_H__
+#define __VNR_PYRAMID_H__
+
+#include <gtk/gtk.h>
+#include <gio/gio.h>
+#include "uni-tile-cache.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrPyramid VnrPyramid;
+
+/* Constructors */
+VnrPyramid *vnr_pyramid_open (const gchar *path);
+void        vnr_pyramid_free (VnrPyramid *pyramid);
+
+/* Read-only properties */
+void        vnr_pyramid_get_size     (VnrPyramid *pyramid,
+                                      gint *width, gint *height);
+GdkPixbuf  *vnr_pyramid_get_tile     (VnrPyramid *pyramid,
+                                      const UniTileKey *key);
+GdkPixbuf  *vnr_pyramid_get_overview (VnrPyramid *pyramid,
+                                      guint64 max_pixels);
+
+/* Actions */
+gboolean    vnr_pyramid_build        (const gchar *path,
+                                      guint64 cache_size,
+                                      GCancellable *cancellable,
+                                      GError **error);
+void        vnr_pyramid_build_async  (const gchar *path,
+                                      guint64 cache_size);
+void        vnr_pyramid_stop_builds  (void);
+int         vnr_pyramid_build_files  (gchar **paths);
+
+G_END_DECLS
+#endif /* __VNR_PYRAMID_H__ */
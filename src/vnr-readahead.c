@@ -0,0 +1,201 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "vnr-readahead.h"
+#include "vnr-workers.h"
+
+/* Most files and bytes asked for ahead of the current one. The byte
+ * budget bounds the page cache taken from other programs, and the
+ * reads a change of direction wastes. */
+#define VNR_READAHEAD_FILES 8
+#define VNR_READAHEAD_BUDGET (64 * 1024 * 1024)
+
+/**
+ * VnrReadahead:
+ *
+ * Asks the kernel to start reading the next few files of a list, in
+ * the direction it is walked, while the current one is looked at.
+ * Only the page cache is filled; nothing is decoded or kept in memory
+ * by the application.
+ *
+ * Every file is only asked for once while the list is walked in the
+ * same direction. Turning back, or jumping, bumps the generation, and
+ * the requests still queued for the old one are dropped unread.
+ **/
+struct _VnrReadahead {
+    VnrWorkGroup *pool;
+    volatile gint generation;
+
+    gint direction;
+    /* Position of the furthest file asked for, and how far it was from
+     * the current one then */
+    guint last;
+    guint ahead;
+};
+
+typedef struct {
+    gchar *path;
+    goffset length;
+    gint generation;
+} VnrReadaheadJob;
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static void
+vnr_readahead_job_free (VnrReadaheadJob *job)
+{
+    g_free (job->path);
+    g_slice_free (VnrReadaheadJob, job);
+}
+
+static void
+vnr_readahead_job (VnrReadaheadJob *job, VnrReadahead *readahead)
+{
+    int fd;
+
+    if (job->generation != g_atomic_int_get (&readahead->generation))
+        goto out;
+
+    fd = open (job->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        goto out;
+
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise (fd, 0, job->length, POSIX_FADV_WILLNEED);
+#endif
+    close (fd);
+
+out:
+    vnr_readahead_job_free (job);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+VnrReadahead *
+vnr_readahead_new (void)
+{
+    VnrReadahead *readahead = g_slice_new0 (VnrReadahead);
+
+    /* One worker at a time is enough to keep the disk busy, and keeps
+     * the files being read in the order they will be shown. */
+    readahead->pool = vnr_work_group_new (VNR_WORK_WARMING,
+                                          (GFunc) vnr_readahead_job,
+                                          readahead, 1,
+                                          (GDestroyNotify) vnr_readahead_job_free,
+                                          NULL);
+    return readahead;
+}
+
+void
+vnr_readahead_free (VnrReadahead *readahead)
+{
+    if (readahead == NULL)
+        return;
+
+    vnr_readahead_cancel (readahead);
+    vnr_work_group_free (readahead->pool, TRUE, TRUE);
+    g_slice_free (VnrReadahead, readahead);
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_readahead_cancel:
+ * @readahead: a #VnrReadahead
+ *
+ * Drops the requests not yet sent to the kernel. The next update
+ * starts afresh from the current file.
+ **/
+void
+vnr_readahead_cancel (VnrReadahead *readahead)
+{
+    g_atomic_int_inc (&readahead->generation);
+    readahead->direction = 0;
+}
+
+/**
+ * vnr_readahead_update:
+ * @readahead: a #VnrReadahead
+ * @list: the list being walked
+ * @direction: 1 when moving forward, -1 when moving back
+ *
+ * Asks for the files following the current one of @list in
+ * @direction that were not asked for yet, within the budget.
+ **/
+void
+vnr_readahead_update (VnrReadahead *readahead, VnrFileList *list,
+                      gint direction)
+{
+    guint length = vnr_file_list_get_length (list);
+    guint current = vnr_file_list_get_position (list);
+    guint done = 0, k, n_files;
+    goffset budget = VNR_READAHEAD_BUDGET;
+
+    if (length < 2)
+        return;
+
+    if (direction != readahead->direction)
+    {
+        vnr_readahead_cancel (readahead);
+        readahead->direction = direction;
+    }
+    else
+    {
+        /* Files up to the last one asked for are already on their way,
+         * if the list was walked less than that far since then. */
+        guint d = direction > 0
+                  ? (readahead->last + length - current) % length
+                  : (current + length - readahead->last) % length;
+
+        if (d < readahead->ahead)
+            done = d;
+    }
+
+    n_files = MIN (VNR_READAHEAD_FILES, length - 1);
+    for (k = 1; k <= n_files && budget > 0; k++)
+    {
+        guint n = direction > 0 ? (current + k) % length
+                                : (current + length - k) % length;
+        const VnrFileEntry *entry = vnr_file_list_get_nth_entry (list, n);
+        goffset size = MIN (entry->size, budget);
+
+        budget -= size;
+        readahead->last = n;
+        readahead->ahead = k;
+
+        if (k > done && size > 0)
+        {
+            VnrReadaheadJob *job = g_slice_new (VnrReadaheadJob);
+
+            job->path = g_build_filename (entry->dir, entry->name, NULL);
+            job->length = size;
+            job->generation = g_atomic_int_get (&readahead->generation);
+            vnr_work_group_push (readahead->pool, job);
+        }
+    }
+}
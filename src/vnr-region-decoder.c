@@ -0,0 +1,1447 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <libintl.h>
+#include <glib/gi18n.h>
+#define _(String) gettext (String)
+
+#include <math.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <png.h>
+#include <jpeglib.h>
+#include <tiffio.h>
+#include "vnr-region-decoder.h"
+#include "vnr-jpeg-decoder.h"
+
+/* Rows decoded between checks for cancellation and other areas */
+#define VNR_REGION_DECODER_ROWS 64
+
+/* Largest strip of a TIFF file that is decoded at once, in bytes */
+#define VNR_REGION_DECODER_MAX_STRIP (64 * 1024 * 1024)
+
+typedef enum {
+    VNR_REGION_DECODER_PNG,
+    VNR_REGION_DECODER_JPEG,
+    VNR_REGION_DECODER_TIFF,
+} VnrRegionDecoderFormat;
+
+/**
+ * VnrRegionDecoder:
+ *
+ * Decodes any part of a PNG, baseline JPEG or TIFF image, at full or
+ * reduced resolution, without ever holding the whole of it. Rows are
+ * streamed from the top of the file and averaged down into the results
+ * as they come, so only the results and a band of rows are in memory at
+ * a time. Tiled TIFF files only have the tiles under the areas decoded.
+ *
+ * JPEG images are turned upright by their Exif orientation, like
+ * gdk-pixbuf does it: sizes and areas are those of the image as shown,
+ * and each area is turned around once decoded.
+ *
+ * The decoder keeps no state between calls and only reads the data it
+ * was given, which must outlive it. Regions can thus be decoded from
+ * several threads at once.
+ *
+ * A pass over the image can take on more areas while it runs, as long
+ * as it has not read past their first row yet, and drop the ones that
+ * are no longer wanted. Moving around a large PNG image thus goes on
+ * from the rows read so far rather than from the top of the file.
+ **/
+struct _VnrRegionDecoder {
+    const guchar *data;
+    gsize length;
+    VnrRegionDecoderFormat format;
+    /* Size of the image as stored */
+    gint width;
+    gint height;
+    gint channels;
+    gint orientation;
+};
+
+/* Whether the image is shown with its rows as columns */
+#define vnr_region_decoder_is_transposed(decoder) ((decoder)->orientation >= 5)
+
+/* Averages the rows of an area down to the size of a pixbuf */
+typedef struct {
+    GdkPixbuf *pixbuf;
+    gint channels;
+    gint src_width;
+    gint src_height;
+    gboolean identity;
+
+    /* Column of the pixbuf each source column is summed into, and
+     * the number of source columns summed into each column */
+    gint *columns;
+    guint *counts;
+    guint64 *sums;
+
+    gint row;
+    gint rows;
+} VnrRegionScaler;
+
+/* One of the areas decoded by a pass */
+typedef struct {
+    GdkRectangle rect;
+    gint width;
+    gint height;
+
+    /* @rect in the rows the pass reads, which are smaller than the
+     * image when the format can reduce while decoding */
+    GdkRectangle area;
+    VnrRegionScaler *scaler;
+    gboolean done;
+} VnrRegionTarget;
+
+/* Hands the areas decoded to the caller, turned upright */
+typedef struct {
+    gint orientation;
+    VnrRegionDecoderFunc func;
+    gpointer user_data;
+} VnrRegionOrient;
+
+/* Decodes several areas while reading the image once */
+struct _VnrRegionPass {
+    VnrRegionDecoder *decoder;
+    VnrRegionTarget *targets;
+    guint n_targets;
+    guint allocated;
+    guint remaining;
+    gint channels;
+    VnrRegionDecoderFunc func;
+    gpointer user_data;
+    GError **error;
+
+    /* Areas added while the pass runs are reduced by @scale, and the
+     * format reduces them by @denom while decoding */
+    gdouble scale;
+    gint denom;
+    VnrRegionDecoderUpdateFunc update;
+    gpointer update_data;
+
+    /* Size of the rows read, the columns kept of them and the first
+     * row not read yet */
+    gint rows_width;
+    gint rows_height;
+    gint span_x;
+    gint span_width;
+    gint next_row;
+};
+
+typedef struct {
+    const guchar *data;
+    gsize length;
+    gsize offset;
+} VnrRegionReader;
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+    GError **error;
+} VnrRegionJpegError;
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static VnrRegionScaler *
+vnr_region_scaler_new (gint src_width, gint src_height,
+                       gint width, gint height, gint channels,
+                       GError **error)
+{
+    VnrRegionScaler *scaler;
+    GdkPixbuf *pixbuf;
+    gint x;
+
+    pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, channels == 4, 8,
+                             width, height);
+    if (pixbuf == NULL)
+    {
+        g_set_error_literal (error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+                             _("Not enough memory to load the image."));
+        return NULL;
+    }
+
+    scaler = g_slice_new0 (VnrRegionScaler);
+    scaler->pixbuf = pixbuf;
+    scaler->channels = channels;
+    scaler->src_width = src_width;
+    scaler->src_height = src_height;
+    scaler->identity = (src_width == width && src_height == height);
+    if (scaler->identity)
+        return scaler;
+
+    scaler->columns = g_new (gint, src_width);
+    scaler->counts = g_new0 (guint, width);
+    scaler->sums = g_new0 (guint64, width * channels);
+    for (x = 0; x < src_width; x++)
+    {
+        scaler->columns[x] = (gint64) x * width / src_width;
+        scaler->counts[scaler->columns[x]]++;
+    }
+    return scaler;
+}
+
+/* Frees @scaler, handing over the pixbuf if every row was pushed */
+static GdkPixbuf *
+vnr_region_scaler_free (VnrRegionScaler *scaler, gboolean complete)
+{
+    GdkPixbuf *pixbuf;
+
+    if (scaler == NULL)
+        return NULL;
+
+    pixbuf = scaler->pixbuf;
+    if (!complete)
+    {
+        g_object_unref (pixbuf);
+        pixbuf = NULL;
+    }
+    g_free (scaler->columns);
+    g_free (scaler->counts);
+    g_free (scaler->sums);
+    g_slice_free (VnrRegionScaler, scaler);
+    return pixbuf;
+}
+
+static void
+vnr_region_scaler_flush (VnrRegionScaler *scaler, gint y)
+{
+    gint width = gdk_pixbuf_get_width (scaler->pixbuf);
+    gint channels = scaler->channels;
+    guchar *dst = gdk_pixbuf_get_pixels (scaler->pixbuf) +
+                  y * gdk_pixbuf_get_rowstride (scaler->pixbuf);
+    gint x, c;
+
+    for (x = 0; x < width; x++)
+    {
+        guint64 count = (guint64) scaler->counts[x] * scaler->rows;
+        guint64 *sum = scaler->sums + x * channels;
+
+        for (c = 0; c < channels; c++)
+        {
+            dst[c] = (sum[c] + count / 2) / count;
+            sum[c] = 0;
+        }
+        dst += channels;
+    }
+    scaler->rows = 0;
+}
+
+/* Adds the next row of the area, which starts at @src */
+static void
+vnr_region_scaler_push (VnrRegionScaler *scaler, const guchar *src)
+{
+    gint height = gdk_pixbuf_get_height (scaler->pixbuf);
+    gint channels = scaler->channels;
+    gint x, c, y;
+
+    if (scaler->identity)
+    {
+        memcpy (gdk_pixbuf_get_pixels (scaler->pixbuf) +
+                scaler->row * gdk_pixbuf_get_rowstride (scaler->pixbuf),
+                src, scaler->src_width * channels);
+        scaler->row++;
+        return;
+    }
+
+    for (x = 0; x < scaler->src_width; x++)
+    {
+        guint64 *sum = scaler->sums + scaler->columns[x] * channels;
+
+        for (c = 0; c < channels; c++)
+            sum[c] += src[c];
+        src += channels;
+    }
+    scaler->rows++;
+
+    y = (gint64) scaler->row * height / scaler->src_height;
+    scaler->row++;
+    if (scaler->row == scaler->src_height ||
+        (gint64) scaler->row * height / scaler->src_height != y)
+        vnr_region_scaler_flush (scaler, y);
+}
+
+/* Places @target in the rows @pass reads */
+static void
+vnr_region_pass_map_target (VnrRegionPass *pass, VnrRegionTarget *target)
+{
+    VnrRegionDecoder *decoder = pass->decoder;
+    GdkRectangle *rect = &target->rect;
+    gint width = pass->rows_width, height = pass->rows_height;
+    gint x0, y0, x1, y1;
+
+    x0 = (gint64) rect->x * width / decoder->width;
+    y0 = (gint64) rect->y * height / decoder->height;
+    x1 = ((gint64) (rect->x + rect->width) * width +
+          decoder->width - 1) / decoder->width;
+    y1 = ((gint64) (rect->y + rect->height) * height +
+          decoder->height - 1) / decoder->height;
+
+    target->area.x = x0;
+    target->area.y = y0;
+    target->area.width = MIN (x1, width) - x0;
+    target->area.height = MIN (y1, height) - y0;
+}
+
+/* Places the targets of @pass in rows of @width by @height pixels, to
+ * which the image is reduced while reading it. The rows are kept whole
+ * unless the format says otherwise. */
+static void
+vnr_region_pass_map (VnrRegionPass *pass, gint width, gint height)
+{
+    guint i;
+
+    pass->rows_width = width;
+    pass->rows_height = height;
+    pass->span_x = 0;
+    pass->span_width = width;
+    for (i = 0; i < pass->n_targets; i++)
+        vnr_region_pass_map_target (pass, &pass->targets[i]);
+}
+
+/* The rows and columns the targets still to decode span */
+static void
+vnr_region_pass_get_bounds (VnrRegionPass *pass, GdkRectangle *bounds)
+{
+    gboolean empty = TRUE;
+    guint i;
+
+    bounds->x = bounds->y = bounds->width = bounds->height = 0;
+    for (i = 0; i < pass->n_targets; i++)
+    {
+        if (pass->targets[i].done)
+            continue;
+        if (empty)
+            *bounds = pass->targets[i].area;
+        else
+            gdk_rectangle_union (bounds, &pass->targets[i].area, bounds);
+        empty = FALSE;
+    }
+}
+
+/* Whether a target still to decode covers part of @rect */
+static gboolean
+vnr_region_pass_wants (VnrRegionPass *pass, GdkRectangle *rect)
+{
+    guint i;
+
+    for (i = 0; i < pass->n_targets; i++)
+        if (!pass->targets[i].done &&
+            gdk_rectangle_intersect (&pass->targets[i].area, rect, NULL))
+            return TRUE;
+    return FALSE;
+}
+
+/* Checks for cancellation before row @y is read, and lets the caller
+ * change the areas of @pass, updating @bounds if not %NULL. Returns
+ * %FALSE once the pass is cancelled or has nothing left to do. */
+static gboolean
+vnr_region_pass_checkpoint (VnrRegionPass *pass, gint y,
+                            GdkRectangle *bounds, GCancellable *cancellable)
+{
+    if (g_cancellable_set_error_if_cancelled (cancellable, pass->error))
+        return FALSE;
+    if (pass->update != NULL)
+    {
+        pass->next_row = y;
+        pass->update (pass, pass->update_data);
+        if (bounds != NULL)
+            vnr_region_pass_get_bounds (pass, bounds);
+    }
+    return pass->remaining > 0;
+}
+
+/* Adds row @y, of which @row holds the pixels from column @row_x on, to
+ * the targets crossing it. Targets are handed over as they complete. */
+static gboolean
+vnr_region_pass_push (VnrRegionPass *pass, gint y,
+                      const guchar *row, gint row_x)
+{
+    guint i;
+
+    for (i = 0; i < pass->n_targets; i++)
+    {
+        VnrRegionTarget *target = &pass->targets[i];
+        GdkPixbuf *pixbuf;
+
+        if (target->done || y < target->area.y ||
+            y >= target->area.y + target->area.height)
+            continue;
+
+        if (target->scaler == NULL)
+        {
+            target->scaler = vnr_region_scaler_new (
+                                 target->area.width, target->area.height,
+                                 MIN (target->width, target->area.width),
+                                 MIN (target->height, target->area.height),
+                                 pass->channels, pass->error);
+            if (target->scaler == NULL)
+                return FALSE;
+        }
+        vnr_region_scaler_push (target->scaler,
+                                row + (target->area.x - row_x) * pass->channels);
+        if (target->scaler->row < target->area.height)
+            continue;
+
+        pixbuf = vnr_region_scaler_free (target->scaler, TRUE);
+        target->scaler = NULL;
+        target->done = TRUE;
+        pass->remaining--;
+        pass->func (i, pixbuf, pass->user_data);
+        g_object_unref (pixbuf);
+    }
+    return TRUE;
+}
+
+static void
+vnr_region_read (VnrRegionReader *reader, guchar *buffer, gsize count)
+{
+    memcpy (buffer, reader->data + reader->offset, count);
+    reader->offset += count;
+}
+
+static void
+vnr_region_png_read (png_structp png, png_bytep buffer, png_size_t count)
+{
+    VnrRegionReader *reader = png_get_io_ptr (png);
+
+    if (count > reader->length - reader->offset)
+        png_error (png, "Premature end of file");
+    vnr_region_read (reader, buffer, count);
+}
+
+static void
+vnr_region_png_error (png_structp png, png_const_charp message)
+{
+    GError **error = png_get_error_ptr (png);
+
+    if (error != NULL && *error == NULL)
+        g_set_error (error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                     _("Failed to load the image: %s"), message);
+    png_longjmp (png, 1);
+}
+
+static void
+vnr_region_png_warning (png_structp png, png_const_charp message)
+{
+}
+
+/* Has @png read the header, and turn every row into 8 bit RGB(A) */
+static void
+vnr_region_png_setup (png_structp png, png_infop info,
+                      VnrRegionReader *reader)
+{
+    png_set_read_fn (png, reader, vnr_region_png_read);
+    png_read_info (png, info);
+    png_set_expand (png);
+    png_set_strip_16 (png);
+    png_set_gray_to_rgb (png);
+    png_read_update_info (png, info);
+}
+
+static gboolean
+vnr_region_decoder_probe_png (VnrRegionDecoder *decoder)
+{
+    VnrRegionReader reader = { decoder->data, decoder->length, 0 };
+    volatile gboolean supported = FALSE;
+    png_structp png;
+    png_infop info = NULL;
+
+    if (decoder->length < 8 ||
+        png_sig_cmp ((png_const_bytep) decoder->data, 0, 8) != 0)
+        return FALSE;
+
+    png = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL,
+                                  vnr_region_png_error,
+                                  vnr_region_png_warning);
+    if (png == NULL)
+        return FALSE;
+
+    info = png_create_info_struct (png);
+    if (info != NULL && !setjmp (png_jmpbuf (png)))
+    {
+        vnr_region_png_setup (png, info, &reader);
+        decoder->width = png_get_image_width (png, info);
+        decoder->height = png_get_image_height (png, info);
+        decoder->channels = png_get_channels (png, info);
+
+        /* Interlaced images only have whole rows after the last pass */
+        supported = (png_get_interlace_type (png, info) == PNG_INTERLACE_NONE);
+    }
+    png_destroy_read_struct (&png, &info, NULL);
+    return supported;
+}
+
+static void
+vnr_region_decoder_run_png (VnrRegionDecoder *decoder, VnrRegionPass *pass,
+                            GCancellable *cancellable)
+{
+    VnrRegionReader reader = { decoder->data, decoder->length, 0 };
+    guchar *volatile row = NULL;
+    GdkRectangle bounds;
+    png_structp png;
+    png_infop info = NULL;
+    gint y;
+
+    png = png_create_read_struct (PNG_LIBPNG_VER_STRING, pass->error,
+                                  vnr_region_png_error,
+                                  vnr_region_png_warning);
+    if (png != NULL)
+        info = png_create_info_struct (png);
+    if (info == NULL)
+    {
+        png_destroy_read_struct (&png, NULL, NULL);
+        g_set_error_literal (pass->error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+                             _("Not enough memory to load the image."));
+        return;
+    }
+
+    if (!setjmp (png_jmpbuf (png)))
+    {
+        vnr_region_png_setup (png, info, &reader);
+        pass->channels = png_get_channels (png, info);
+        vnr_region_pass_map (pass, decoder->width, decoder->height);
+        vnr_region_pass_get_bounds (pass, &bounds);
+        row = g_malloc (png_get_rowbytes (png, info));
+
+        /* Rows above the areas have to be read to get to them */
+        for (y = 0; pass->remaining > 0; y++)
+        {
+            if (y % VNR_REGION_DECODER_ROWS == 0 &&
+                !vnr_region_pass_checkpoint (pass, y, &bounds, cancellable))
+                break;
+            png_read_row (png, row, NULL);
+            if (y >= bounds.y && !vnr_region_pass_push (pass, y, row, 0))
+                break;
+        }
+    }
+    png_destroy_read_struct (&png, &info, NULL);
+    g_free (row);
+}
+
+static void
+vnr_region_jpeg_error_exit (j_common_ptr cinfo)
+{
+    VnrRegionJpegError *jerr = (VnrRegionJpegError *) cinfo->err;
+    char buffer[JMSG_LENGTH_MAX];
+
+    cinfo->err->format_message (cinfo, buffer);
+    if (jerr->error != NULL && *jerr->error == NULL)
+        g_set_error (jerr->error, GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                     _("Failed to load the image: %s"), buffer);
+    longjmp (jerr->setjmp_buffer, 1);
+}
+
+static void
+vnr_region_jpeg_output_message (j_common_ptr cinfo)
+{
+}
+
+static void
+vnr_region_jpeg_init (struct jpeg_decompress_struct *cinfo,
+                      VnrRegionJpegError *jerr, GError **error)
+{
+    cinfo->err = jpeg_std_error (&jerr->pub);
+    jerr->pub.error_exit = vnr_region_jpeg_error_exit;
+    jerr->pub.output_message = vnr_region_jpeg_output_message;
+    jerr->error = error;
+}
+
+static gboolean
+vnr_region_decoder_probe_jpeg (VnrRegionDecoder *decoder)
+{
+    struct jpeg_decompress_struct cinfo;
+    VnrRegionJpegError jerr;
+    volatile gboolean supported = FALSE;
+
+    if (decoder->length < 3 || memcmp (decoder->data, "\xff\xd8\xff", 3) != 0)
+        return FALSE;
+
+    vnr_region_jpeg_init (&cinfo, &jerr, NULL);
+    if (!setjmp (jerr.setjmp_buffer))
+    {
+        jpeg_saved_marker_ptr marker;
+
+        jpeg_create_decompress (&cinfo);
+        jpeg_mem_src (&cinfo, decoder->data, decoder->length);
+        jpeg_save_markers (&cinfo, JPEG_APP0 + 1, 0xffff);
+        jpeg_read_header (&cinfo, TRUE);
+        for (marker = cinfo.marker_list; marker != NULL; marker = marker->next)
+        {
+            gint orientation = vnr_jpeg_parse_orientation (marker->data,
+                                                           marker->data_length);
+
+            if (orientation != 0)
+                decoder->orientation = orientation;
+        }
+        decoder->width = cinfo.image_width;
+        decoder->height = cinfo.image_height;
+        decoder->channels = 3;
+
+        /* Progressive images keep the coefficients of the whole image
+         * in memory, and CMYK ones cannot be read as RGB */
+        supported = !cinfo.progressive_mode &&
+                    (cinfo.jpeg_color_space == JCS_YCbCr ||
+                     cinfo.jpeg_color_space == JCS_GRAYSCALE ||
+                     cinfo.jpeg_color_space == JCS_RGB);
+    }
+    jpeg_destroy_decompress (&cinfo);
+    return supported;
+}
+
+static void
+vnr_region_decoder_run_jpeg (VnrRegionDecoder *decoder, VnrRegionPass *pass,
+                             GCancellable *cancellable)
+{
+    struct jpeg_decompress_struct cinfo;
+    VnrRegionJpegError jerr;
+    guchar *volatile row = NULL;
+    JDIMENSION xoffset, columns;
+    GdkRectangle bounds;
+    JSAMPROW rowp;
+    gint denom;
+    guint i;
+
+    vnr_region_jpeg_init (&cinfo, &jerr, pass->error);
+    if (!setjmp (jerr.setjmp_buffer))
+    {
+        jpeg_create_decompress (&cinfo);
+        jpeg_mem_src (&cinfo, decoder->data, decoder->length);
+        jpeg_read_header (&cinfo, TRUE);
+        cinfo.out_color_space = JCS_RGB;
+
+        /* The decoder reduces by powers of two for next to nothing, as
+         * far as every area allows */
+        for (denom = 8; denom > 1; denom /= 2)
+        {
+            for (i = 0; i < pass->n_targets; i++)
+                if (pass->targets[i].rect.width / denom < pass->targets[i].width ||
+                    pass->targets[i].rect.height / denom < pass->targets[i].height)
+                    break;
+            if (i == pass->n_targets)
+                break;
+        }
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = denom;
+        jpeg_start_decompress (&cinfo);
+
+        pass->channels = 3;
+        pass->denom = denom;
+        vnr_region_pass_map (pass, cinfo.output_width, cinfo.output_height);
+        vnr_region_pass_get_bounds (pass, &bounds);
+
+        xoffset = bounds.x;
+        columns = bounds.width;
+#if LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+        /* Only the blocks of the areas are decoded, from their left */
+        jpeg_crop_scanline (&cinfo, &xoffset, &columns);
+        if (bounds.y > 0)
+            jpeg_skip_scanlines (&cinfo, bounds.y);
+#else
+        xoffset = 0;
+#endif
+        /* Cropping leaves output_width to the columns decoded */
+        pass->span_x = xoffset;
+        pass->span_width = cinfo.output_width;
+
+        row = g_malloc ((gsize) cinfo.output_width * 3);
+        rowp = row;
+        while (pass->remaining > 0 &&
+               cinfo.output_scanline < cinfo.output_height)
+        {
+            JDIMENSION y = cinfo.output_scanline;
+
+            if (y % VNR_REGION_DECODER_ROWS == 0 &&
+                !vnr_region_pass_checkpoint (pass, y, &bounds, cancellable))
+                break;
+            jpeg_read_scanlines (&cinfo, &rowp, 1);
+            if ((gint) y >= bounds.y &&
+                !vnr_region_pass_push (pass, y, row, xoffset))
+                break;
+        }
+    }
+    jpeg_destroy_decompress (&cinfo);
+    g_free (row);
+}
+
+static tmsize_t
+vnr_region_tiff_read (thandle_t handle, void *buffer, tmsize_t size)
+{
+    VnrRegionReader *reader = handle;
+
+    size = MIN ((gsize) size, reader->length - reader->offset);
+    vnr_region_read (reader, buffer, size);
+    return size;
+}
+
+static tmsize_t
+vnr_region_tiff_write (thandle_t handle, void *buffer, tmsize_t size)
+{
+    return -1;
+}
+
+static toff_t
+vnr_region_tiff_seek (thandle_t handle, toff_t offset, int whence)
+{
+    VnrRegionReader *reader = handle;
+    gint64 position;
+
+    switch (whence)
+    {
+        case SEEK_CUR:
+            position = reader->offset + (gint64) offset;
+            break;
+        case SEEK_END:
+            position = reader->length + (gint64) offset;
+            break;
+        default:
+            position = offset;
+            break;
+    }
+    if (position < 0 || (guint64) position > reader->length)
+        return (toff_t) -1;
+    reader->offset = position;
+    return position;
+}
+
+static int
+vnr_region_tiff_close (thandle_t handle)
+{
+    return 0;
+}
+
+static toff_t
+vnr_region_tiff_size (thandle_t handle)
+{
+    return ((VnrRegionReader *) handle)->length;
+}
+
+static int
+vnr_region_tiff_map (thandle_t handle, void **base, toff_t *size)
+{
+    VnrRegionReader *reader = handle;
+
+    *base = (void *) reader->data;
+    *size = reader->length;
+    return 1;
+}
+
+static void
+vnr_region_tiff_unmap (thandle_t handle, void *base, toff_t size)
+{
+}
+
+static TIFF *
+vnr_region_tiff_open (VnrRegionReader *reader)
+{
+    return TIFFClientOpen ("viewnior", "rm", reader,
+                           vnr_region_tiff_read, vnr_region_tiff_write,
+                           vnr_region_tiff_seek, vnr_region_tiff_close,
+                           vnr_region_tiff_size, vnr_region_tiff_map,
+                           vnr_region_tiff_unmap);
+}
+
+/* Copies @width pixels of a raster filled by libtiff into 8 bit RGBA */
+static void
+vnr_region_tiff_convert (const uint32 *src, guchar *dst, gint width)
+{
+    gint x;
+
+    for (x = 0; x < width; x++)
+    {
+        dst[0] = TIFFGetR (src[x]);
+        dst[1] = TIFFGetG (src[x]);
+        dst[2] = TIFFGetB (src[x]);
+        dst[3] = TIFFGetA (src[x]);
+        dst += 4;
+    }
+}
+
+static gboolean
+vnr_region_decoder_probe_tiff (VnrRegionDecoder *decoder)
+{
+    VnrRegionReader reader = { decoder->data, decoder->length, 0 };
+    char message[1024];
+    gboolean supported;
+    uint32 width = 0, height = 0, rows;
+    TIFF *tiff;
+
+    if (decoder->length < 4 ||
+        (memcmp (decoder->data, "II*\0", 4) != 0 &&
+         memcmp (decoder->data, "MM\0*", 4) != 0))
+        return FALSE;
+
+    tiff = vnr_region_tiff_open (&reader);
+    if (tiff == NULL)
+        return FALSE;
+
+    TIFFGetField (tiff, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &height);
+    decoder->width = MIN (width, G_MAXINT);
+    decoder->height = MIN (height, G_MAXINT);
+    decoder->channels = 4;
+
+    supported = TIFFRGBAImageOK (tiff, message);
+    if (supported && !TIFFIsTiled (tiff))
+    {
+        /* Each strip is decoded whole */
+        TIFFGetFieldDefaulted (tiff, TIFFTAG_ROWSPERSTRIP, &rows);
+        supported = ((guint64) width * MIN (rows, height) * 4 <=
+                     VNR_REGION_DECODER_MAX_STRIP);
+    }
+    TIFFClose (tiff);
+    return supported;
+}
+
+static gboolean
+vnr_region_decoder_run_tiff_tiled (VnrRegionDecoder *decoder,
+                                   VnrRegionPass *pass, TIFF *tiff,
+                                   GCancellable *cancellable)
+{
+    uint32 tile_width = 0, tile_height = 0;
+    uint32 *raster;
+    guchar *band;
+    GdkRectangle bounds, tile;
+    gint col0, col1, stride, y, x, r, rows;
+    gboolean ok = TRUE;
+
+    TIFFGetField (tiff, TIFFTAG_TILEWIDTH, &tile_width);
+    TIFFGetField (tiff, TIFFTAG_TILELENGTH, &tile_height);
+    if (tile_width == 0 || tile_height == 0)
+    {
+        g_set_error (pass->error, GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                     _("Failed to load the image: %s"), "Invalid tile size");
+        return FALSE;
+    }
+
+    /* The columns of tiles under the areas are decoded into a band, a
+     * row of tiles at a time */
+    vnr_region_pass_get_bounds (pass, &bounds);
+    col0 = bounds.x / tile_width;
+    col1 = (bounds.x + bounds.width - 1) / tile_width;
+    stride = (col1 - col0 + 1) * tile_width * 4;
+    pass->span_x = col0 * tile_width;
+    pass->span_width = MIN ((gint) ((col1 + 1) * tile_width),
+                            decoder->width) - pass->span_x;
+
+    raster = g_try_new (uint32, (gsize) tile_width * tile_height);
+    band = g_try_malloc ((gsize) stride * tile_height);
+    if (raster == NULL || band == NULL)
+    {
+        g_free (raster);
+        g_free (band);
+        g_set_error_literal (pass->error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+                             _("Not enough memory to load the image."));
+        return FALSE;
+    }
+
+    for (y = bounds.y - bounds.y % tile_height;
+         ok && pass->remaining > 0 && y < decoder->height;
+         y += tile_height)
+    {
+        if (!vnr_region_pass_checkpoint (pass, y, NULL, cancellable))
+        {
+            ok = FALSE;
+            break;
+        }
+
+        rows = MIN ((gint) tile_height, decoder->height - y);
+        tile.y = y;
+        tile.width = tile_width;
+        tile.height = rows;
+        for (x = col0 * tile_width; ok && x <= (gint) (col1 * tile_width);
+             x += tile_width)
+        {
+            /* Tiles no area covers are left as they are */
+            tile.x = x;
+            if (!vnr_region_pass_wants (pass, &tile))
+                continue;
+            if (!TIFFReadRGBATile (tiff, x, y, raster))
+            {
+                g_set_error (pass->error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                             _("Failed to load the image: %s"),
+                             "Cannot read a tile");
+                ok = FALSE;
+                break;
+            }
+
+            /* The raster has the tile upside down */
+            for (r = 0; r < rows; r++)
+                vnr_region_tiff_convert (raster + (tile_height - 1 - r) *
+                                                  tile_width,
+                                         band + r * stride +
+                                         (x / tile_width - col0) *
+                                         tile_width * 4,
+                                         MIN ((gint) tile_width,
+                                              decoder->width - x));
+        }
+
+        for (r = 0; ok && r < rows; r++)
+            ok = vnr_region_pass_push (pass, y + r, band + r * stride,
+                                       col0 * tile_width);
+    }
+    g_free (raster);
+    g_free (band);
+    return ok;
+}
+
+static gboolean
+vnr_region_decoder_run_tiff_stripped (VnrRegionDecoder *decoder,
+                                      VnrRegionPass *pass, TIFF *tiff,
+                                      GCancellable *cancellable)
+{
+    uint32 rows_per_strip = 0;
+    uint32 *raster;
+    guchar *row;
+    GdkRectangle bounds;
+    gint y, r, rows;
+    gboolean ok = TRUE;
+
+    TIFFGetFieldDefaulted (tiff, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+    rows_per_strip = CLAMP (rows_per_strip, 1, (uint32) decoder->height);
+
+    /* Only the columns of the areas are converted */
+    vnr_region_pass_get_bounds (pass, &bounds);
+    pass->span_x = bounds.x;
+    pass->span_width = bounds.width;
+    raster = g_try_new (uint32, (gsize) decoder->width * rows_per_strip);
+    row = g_try_malloc ((gsize) bounds.width * 4);
+    if (raster == NULL || row == NULL)
+    {
+        g_free (raster);
+        g_free (row);
+        g_set_error_literal (pass->error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_INSUFFICIENT_MEMORY,
+                             _("Not enough memory to load the image."));
+        return FALSE;
+    }
+
+    for (y = bounds.y - bounds.y % rows_per_strip;
+         ok && pass->remaining > 0 && y < decoder->height;
+         y += rows_per_strip)
+    {
+        if (!vnr_region_pass_checkpoint (pass, y, &bounds, cancellable))
+        {
+            ok = FALSE;
+            break;
+        }
+        if (!TIFFReadRGBAStrip (tiff, y, raster))
+        {
+            g_set_error (pass->error, GDK_PIXBUF_ERROR,
+                         GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                         _("Failed to load the image: %s"),
+                         "Cannot read a strip");
+            ok = FALSE;
+            break;
+        }
+
+        /* The raster has the strip upside down */
+        rows = MIN ((gint) rows_per_strip, decoder->height - y);
+        for (r = 0; ok && r < rows; r++)
+        {
+            if (y + r < bounds.y)
+                continue;
+            vnr_region_tiff_convert (raster + (gsize) (rows - 1 - r) *
+                                              decoder->width + pass->span_x,
+                                     row, pass->span_width);
+            ok = vnr_region_pass_push (pass, y + r, row, pass->span_x);
+        }
+    }
+    g_free (raster);
+    g_free (row);
+    return ok;
+}
+
+static void
+vnr_region_decoder_run_tiff (VnrRegionDecoder *decoder, VnrRegionPass *pass,
+                             GCancellable *cancellable)
+{
+    VnrRegionReader reader = { decoder->data, decoder->length, 0 };
+    TIFF *tiff;
+
+    tiff = vnr_region_tiff_open (&reader);
+    if (tiff == NULL)
+    {
+        g_set_error (pass->error, GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                     _("Failed to load the image: %s"), "Cannot open");
+        return;
+    }
+
+    pass->channels = 4;
+    vnr_region_pass_map (pass, decoder->width, decoder->height);
+    if (TIFFIsTiled (tiff))
+        vnr_region_decoder_run_tiff_tiled (decoder, pass, tiff, cancellable);
+    else
+        vnr_region_decoder_run_tiff_stripped (decoder, pass, tiff,
+                                              cancellable);
+    TIFFClose (tiff);
+}
+
+/* Maps @rect, within the image as shown, to the image as stored */
+static void
+vnr_region_decoder_unorient_rect (VnrRegionDecoder *decoder,
+                                  const GdkRectangle *rect,
+                                  GdkRectangle *result)
+{
+    gint x = rect->x, y = rect->y, width = rect->width, height = rect->height;
+
+    /* Rows and columns swap places first, then flip */
+    if (vnr_region_decoder_is_transposed (decoder))
+    {
+        x = rect->y;
+        y = rect->x;
+        width = rect->height;
+        height = rect->width;
+    }
+
+    switch (decoder->orientation)
+    {
+        case 2:
+        case 3:
+        case 7:
+        case 8:
+            x = decoder->width - x - width;
+            break;
+    }
+    switch (decoder->orientation)
+    {
+        case 3:
+        case 4:
+        case 6:
+        case 7:
+            y = decoder->height - y - height;
+            break;
+    }
+
+    result->x = x;
+    result->y = y;
+    result->width = width;
+    result->height = height;
+}
+
+/* Turns an area decoded from the image as stored the way it is shown,
+ * as gdk_pixbuf_apply_embedded_orientation() would */
+static void
+vnr_region_decoder_orient (guint index, GdkPixbuf *pixbuf, gpointer user_data)
+{
+    VnrRegionOrient *orient = user_data;
+    GdkPixbuf *temp, *result;
+
+    switch (orient->orientation)
+    {
+        case 2:
+            result = gdk_pixbuf_flip (pixbuf, TRUE);
+            break;
+        case 3:
+            result = gdk_pixbuf_rotate_simple (pixbuf,
+                                               GDK_PIXBUF_ROTATE_UPSIDEDOWN);
+            break;
+        case 4:
+            result = gdk_pixbuf_flip (pixbuf, FALSE);
+            break;
+        case 5:
+        case 7:
+            temp = gdk_pixbuf_rotate_simple (pixbuf,
+                                             GDK_PIXBUF_ROTATE_CLOCKWISE);
+            result = temp ? gdk_pixbuf_flip (temp, orient->orientation == 5)
+                          : NULL;
+            if (temp != NULL)
+                g_object_unref (temp);
+            break;
+        case 6:
+            result = gdk_pixbuf_rotate_simple (pixbuf,
+                                               GDK_PIXBUF_ROTATE_CLOCKWISE);
+            break;
+        case 8:
+            result = gdk_pixbuf_rotate_simple (pixbuf,
+                                               GDK_PIXBUF_ROTATE_COUNTERCLOCKWISE);
+            break;
+        default:
+            result = g_object_ref (pixbuf);
+            break;
+    }
+
+    /* Out of memory, the area is left out like a cancelled one */
+    if (result == NULL)
+        return;
+    orient->func (index, result, orient->user_data);
+    g_object_unref (result);
+}
+
+/* Decodes the @n_targets areas of @targets, whose rectangle and size
+ * are set, in one pass over the image. Areas @update adds are reduced
+ * by @scale. */
+static gboolean
+vnr_region_decoder_run (VnrRegionDecoder *decoder,
+                        const VnrRegionTarget *targets, guint n_targets,
+                        gdouble scale, VnrRegionDecoderFunc func,
+                        VnrRegionDecoderUpdateFunc update,
+                        gpointer user_data,
+                        GCancellable *cancellable, GError **error)
+{
+    VnrRegionPass pass = { 0 };
+    VnrRegionOrient orient = { decoder->orientation, func, user_data };
+    GError *tmp_error = NULL;
+    guint i;
+
+    pass.decoder = decoder;
+    pass.func = func;
+    pass.user_data = user_data;
+    pass.scale = scale;
+    pass.denom = 1;
+    pass.update = update;
+    pass.update_data = user_data;
+    if (decoder->orientation != 1)
+    {
+        pass.func = vnr_region_decoder_orient;
+        pass.user_data = &orient;
+    }
+
+    pass.error = &tmp_error;
+    for (i = 0; i < n_targets; i++)
+        if (!targets[i].done)
+            pass.remaining++;
+    if (pass.remaining == 0)
+        return TRUE;
+
+    /* The pass has targets of its own, as more may be added */
+    pass.allocated = MAX (n_targets, 16);
+    pass.targets = g_new (VnrRegionTarget, pass.allocated);
+    memcpy (pass.targets, targets, n_targets * sizeof (VnrRegionTarget));
+    pass.n_targets = n_targets;
+
+    switch (decoder->format)
+    {
+        case VNR_REGION_DECODER_PNG:
+            vnr_region_decoder_run_png (decoder, &pass, cancellable);
+            break;
+        case VNR_REGION_DECODER_JPEG:
+            vnr_region_decoder_run_jpeg (decoder, &pass, cancellable);
+            break;
+        case VNR_REGION_DECODER_TIFF:
+            vnr_region_decoder_run_tiff (decoder, &pass, cancellable);
+            break;
+    }
+
+    for (i = 0; i < pass.n_targets; i++)
+        vnr_region_scaler_free (pass.targets[i].scaler, FALSE);
+    g_free (pass.targets);
+
+    if (pass.remaining == 0)
+    {
+        g_clear_error (&tmp_error);
+        return TRUE;
+    }
+    if (tmp_error == NULL)
+        g_set_error (&tmp_error, GDK_PIXBUF_ERROR,
+                     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+                     _("Failed to load the image: %s"),
+                     "Premature end of file");
+    g_propagate_error (error, tmp_error);
+    return FALSE;
+}
+
+/* Clips @target to the image and sets the size of its result, @width
+ * by @height for the whole of @rect, which are as the image is shown.
+ * The target itself is set in the image as stored. */
+static gboolean
+vnr_region_decoder_set_target (VnrRegionDecoder *decoder,
+                               VnrRegionTarget *target,
+                               const GdkRectangle *rect,
+                               gint width, gint height)
+{
+    GdkRectangle whole = { 0, 0, 0, 0 }, shown;
+
+    vnr_region_decoder_get_size (decoder, &whole.width, &whole.height);
+    memset (target, 0, sizeof (VnrRegionTarget));
+    if (!gdk_rectangle_intersect (&whole, (GdkRectangle *) rect, &shown))
+    {
+        target->done = TRUE;
+        return FALSE;
+    }
+
+    target->width = CLAMP ((gint64) width * shown.width / rect->width,
+                           1, shown.width);
+    target->height = CLAMP ((gint64) height * shown.height / rect->height,
+                            1, shown.height);
+
+    vnr_region_decoder_unorient_rect (decoder, &shown, &target->rect);
+    if (vnr_region_decoder_is_transposed (decoder))
+    {
+        gint swap = target->width;
+
+        target->width = target->height;
+        target->height = swap;
+    }
+    return TRUE;
+}
+
+static void
+vnr_region_decoder_keep (guint index, GdkPixbuf *pixbuf, gpointer user_data)
+{
+    *(GdkPixbuf **) user_data = g_object_ref (pixbuf);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_region_decoder_new:
+ * @data: the contents of an image file
+ * @length: the length of @data
+ * @returns: a new #VnrRegionDecoder, or %NULL if the image is not one
+ *   that can be decoded by regions
+ **/
+VnrRegionDecoder *
+vnr_region_decoder_new (const guchar *data, gsize length)
+{
+    VnrRegionDecoder *decoder = g_slice_new0 (VnrRegionDecoder);
+
+    decoder->data = data;
+    decoder->length = length;
+    decoder->orientation = 1;
+    if (vnr_region_decoder_probe_png (decoder))
+        decoder->format = VNR_REGION_DECODER_PNG;
+    else if (vnr_region_decoder_probe_jpeg (decoder))
+        decoder->format = VNR_REGION_DECODER_JPEG;
+    else if (vnr_region_decoder_probe_tiff (decoder))
+        decoder->format = VNR_REGION_DECODER_TIFF;
+    else
+        decoder->width = 0;
+
+    if (decoder->width <= 0 || decoder->height <= 0)
+    {
+        g_slice_free (VnrRegionDecoder, decoder);
+        return NULL;
+    }
+    return decoder;
+}
+
+void
+vnr_region_decoder_free (VnrRegionDecoder *decoder)
+{
+    if (decoder != NULL)
+        g_slice_free (VnrRegionDecoder, decoder);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+/**
+ * vnr_region_decoder_get_size:
+ * @decoder: a #VnrRegionDecoder
+ * @width: return location for the width of the image
+ * @height: return location for the height of the image
+ *
+ * Gets the size of the image as shown, turned by its orientation.
+ **/
+void
+vnr_region_decoder_get_size (VnrRegionDecoder *decoder,
+                             gint *width, gint *height)
+{
+    gboolean transposed = vnr_region_decoder_is_transposed (decoder);
+
+    *width = transposed ? decoder->height : decoder->width;
+    *height = transposed ? decoder->width : decoder->height;
+}
+
+/**
+ * vnr_region_decoder_get_n_channels:
+ * @decoder: a #VnrRegionDecoder
+ * @returns: 4 if the pixbufs decoded have an alpha channel, else 3
+ **/
+gint
+vnr_region_decoder_get_n_channels (VnrRegionDecoder *decoder)
+{
+    return decoder->channels;
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_region_decoder_decode:
+ * @decoder: a #VnrRegionDecoder
+ * @rect: the area of the image to decode, or %NULL for all of it
+ * @width: the width to reduce the area to
+ * @height: the height to reduce the area to
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: return location for a #GError
+ * @returns: the pixels of @rect, to be unreffed by the caller, or
+ *   %NULL on error
+ *
+ * Decodes part of the image. Areas are only ever reduced, a size
+ * larger than the one of @rect decodes it at full resolution.
+ **/
+GdkPixbuf *
+vnr_region_decoder_decode (VnrRegionDecoder *decoder,
+                           const GdkRectangle *rect,
+                           gint width, gint height,
+                           GCancellable *cancellable, GError **error)
+{
+    GdkRectangle whole = { 0, 0, 0, 0 };
+    VnrRegionTarget target;
+    GdkPixbuf *pixbuf = NULL;
+
+    vnr_region_decoder_get_size (decoder, &whole.width, &whole.height);
+    if (rect == NULL)
+        rect = &whole;
+    if (!vnr_region_decoder_set_target (decoder, &target, rect,
+                                        width, height))
+    {
+        g_set_error_literal (error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_FAILED,
+                             _("The area is outside of the image."));
+        return NULL;
+    }
+
+    vnr_region_decoder_run (decoder, &target, 1, 1.0,
+                            vnr_region_decoder_keep, NULL, &pixbuf,
+                            cancellable, error);
+    return pixbuf;
+}
+
+/**
+ * vnr_region_decoder_decode_areas:
+ * @decoder: a #VnrRegionDecoder
+ * @rects: the areas of the image to decode
+ * @n_rects: the number of @rects
+ * @scale: the factor, at most 1, to reduce every area by
+ * @func: called with each area as soon as it is decoded
+ * @update: called every few rows to change the areas, or %NULL
+ * @user_data: data to pass to @func and @update
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: return location for a #GError
+ * @returns: %TRUE if every area was decoded or dropped
+ *
+ * Decodes several areas while reading the image only once, which is
+ * how the tiles of a view are filled. @func is called from the calling
+ * thread, with the index of the area in @rects and a pixbuf it has to
+ * reference to keep. Areas outside of the image are skipped.
+ *
+ * @update is called from the calling thread as well, and may add
+ * areas with vnr_region_pass_add() or drop them with
+ * vnr_region_pass_drop().
+ **/
+gboolean
+vnr_region_decoder_decode_areas (VnrRegionDecoder *decoder,
+                                 const GdkRectangle *rects, guint n_rects,
+                                 gdouble scale,
+                                 VnrRegionDecoderFunc func,
+                                 VnrRegionDecoderUpdateFunc update,
+                                 gpointer user_data,
+                                 GCancellable *cancellable, GError **error)
+{
+    VnrRegionTarget *targets;
+    gboolean result;
+    guint i;
+
+    scale = CLAMP (scale, 0, 1);
+    targets = g_new (VnrRegionTarget, n_rects);
+    for (i = 0; i < n_rects; i++)
+        vnr_region_decoder_set_target (decoder, &targets[i], &rects[i],
+                                       ceil (rects[i].width * scale),
+                                       ceil (rects[i].height * scale));
+
+    result = vnr_region_decoder_run (decoder, targets, n_rects, scale,
+                                     func, update, user_data,
+                                     cancellable, error);
+    g_free (targets);
+    return result;
+}
+
+/**
+ * vnr_region_pass_add:
+ * @pass: the pass an update function was called with
+ * @rect: another area of the image to decode
+ * @returns: %TRUE if the pass took the area on
+ *
+ * Adds an area to a running pass, reduced by the scale of the pass. It
+ * comes after the areas given before, and is handed over with the next
+ * index. The pass only takes areas it has not read past yet, in the
+ * columns it decodes, and not smaller than what the format reduced the
+ * image to; others have to go to a pass of their own.
+ **/
+gboolean
+vnr_region_pass_add (VnrRegionPass *pass, const GdkRectangle *rect)
+{
+    VnrRegionTarget target;
+
+    /* Areas outside of the image are skipped, as they are at first */
+    if (vnr_region_decoder_set_target (pass->decoder, &target, rect,
+                                       ceil (rect->width * pass->scale),
+                                       ceil (rect->height * pass->scale)))
+    {
+        if (target.rect.width / pass->denom < target.width ||
+            target.rect.height / pass->denom < target.height)
+            return FALSE;
+
+        vnr_region_pass_map_target (pass, &target);
+        if (target.area.y < pass->next_row ||
+            target.area.x < pass->span_x ||
+            target.area.x + target.area.width >
+            pass->span_x + pass->span_width)
+            return FALSE;
+        pass->remaining++;
+    }
+
+    if (pass->n_targets == pass->allocated)
+    {
+        pass->allocated *= 2;
+        pass->targets = g_renew (VnrRegionTarget, pass->targets,
+                                 pass->allocated);
+    }
+    pass->targets[pass->n_targets++] = target;
+    return TRUE;
+}
+
+/**
+ * vnr_region_pass_drop:
+ * @pass: the pass an update function was called with
+ * @index: the index of an area of @pass
+ *
+ * Stops decoding an area that is no longer wanted. Once no area is
+ * left, the pass ends. Areas already handed over are left as they are.
+ **/
+void
+vnr_region_pass_drop (VnrRegionPass *pass, guint index)
+{
+    VnrRegionTarget *target = &pass->targets[index];
+
+    if (target->done)
+        return;
+
+    vnr_region_scaler_free (target->scaler, FALSE);
+    target->scaler = NULL;
+    target->done = TRUE;
+    pass->remaining--;
+}
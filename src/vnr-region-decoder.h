@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __VNR_REGION_DECODER_H__
+#define __VNR_REGION_DECODER_H__
+
+#include <gtk/gtk.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VnrRegionDecoder VnrRegionDecoder;
+typedef struct _VnrRegionPass VnrRegionPass;
+
+typedef void (*VnrRegionDecoderFunc) (guint index, GdkPixbuf *pixbuf,
+                                      gpointer user_data);
+typedef void (*VnrRegionDecoderUpdateFunc) (VnrRegionPass *pass,
+                                            gpointer user_data);
+
+/* Constructors */
+VnrRegionDecoder *vnr_region_decoder_new  (const guchar *data, gsize length);
+void              vnr_region_decoder_free (VnrRegionDecoder *decoder);
+
+/* Read-only properties */
+void              vnr_region_decoder_get_size (VnrRegionDecoder *decoder,
+                                               gint *width, gint *height);
+gint              vnr_region_decoder_get_n_channels (VnrRegionDecoder *decoder);
+
+/* Actions */
+GdkPixbuf        *vnr_region_decoder_decode (VnrRegionDecoder *decoder,
+                                             const GdkRectangle *rect,
+                                             gint width, gint height,
+                                             GCancellable *cancellable,
+                                             GError **error);
+gboolean          vnr_region_decoder_decode_areas (VnrRegionDecoder *decoder,
+                                                   const GdkRectangle *rects,
+                                                   guint n_rects,
+                                                   gdouble scale,
+                                                   VnrRegionDecoderFunc func,
+                                                   VnrRegionDecoderUpdateFunc update,
+                                                   gpointer user_data,
+                                                   GCancellable *cancellable,
+                                                   GError **error);
+gboolean          vnr_region_pass_add  (VnrRegionPass *pass,
+                                        const GdkRectangle *rect);
+void              vnr_region_pass_drop (VnrRegionPass *pass, guint index);
+
+G_END_DECLS
+#endif /* __VNR_REGION_DECODER_H__ */
@@ -0,0 +1,335 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h>
+#include <gtk/gtk.h>
+#include <gdk/gdkpixbuf.h>
+#include "vnr-sequence.h"
+#include "vnr-file-list.h"
+#include "vnr-workers.h"
+
+/* Memory the frames decoded ahead of playback may take up. */
+#define VNR_SEQUENCE_BUDGET (512 * 1024 * 1024)
+
+/* Interval over which the sustained frame rate is measured, in
+ * microseconds. */
+#define VNR_SEQUENCE_STATS_INTERVAL G_USEC_PER_SEC
+
+/**
+ * VnrSequence:
+ *
+ * Plays a file list as the frames of a video. Frames are numbered
+ * from the time playback started, frame 0 being the image shown at
+ * that time, and wrap around at the end of the list. A pool of worker
+ * threads decodes the frames following the one on screen. When a
+ * frame is due and not decoded yet, the newest decoded frame that is
+ * not early is shown instead and the frames in between are dropped.
+ * The statistics follow the frames as they are decoded, so they are
+ * kept up to date while none can be shown.
+ **/
+struct _VnrSequence {
+    gchar **paths;
+    guint n_files;
+    guint first;
+
+    int fps;
+    VnrSequenceFrameFunc func;
+    VnrSequenceStatsFunc stats_func;
+    gpointer user_data;
+
+    VnrWorkGroup *pool;
+    guint threads;
+    guint ahead;
+
+    /* Protects ready, shown and decoded, which the workers use. */
+    GMutex lock;
+    /* Decoded frames by number, NULL for those which failed. */
+    GHashTable *ready;
+    guint shown;
+    guint queued;
+    guint decoded;
+
+    gint64 start;
+    guint source_id;
+
+    guint dropped;
+    gint64 stats_time;
+    guint stats_decoded;
+    gdouble sustained;
+    /* Statistics last passed to stats_func */
+    guint reported_decoded;
+    guint reported_dropped;
+};
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static void
+vnr_sequence_free_frame (gpointer data)
+{
+    if (data != NULL)
+        g_object_unref (data);
+}
+
+static void
+vnr_sequence_decode (gpointer data, gpointer user_data)
+{
+    VnrSequence *sequence = user_data;
+    guint frame = GPOINTER_TO_UINT (data);
+    GdkPixbuf *pixbuf;
+    gboolean late;
+
+    g_mutex_lock (&sequence->lock);
+    late = frame <= sequence->shown;
+    g_mutex_unlock (&sequence->lock);
+
+    /* Playback moved past the frame while it was queued. */
+    if (late)
+        return;
+
+    pixbuf = gdk_pixbuf_new_from_file (
+        sequence->paths[(sequence->first + frame) % sequence->n_files], NULL);
+
+    g_mutex_lock (&sequence->lock);
+    if (pixbuf != NULL)
+        sequence->decoded++;
+    if (frame > sequence->shown)
+    {
+        g_hash_table_insert (sequence->ready, GUINT_TO_POINTER (frame),
+                             pixbuf);
+        pixbuf = NULL;
+    }
+    g_mutex_unlock (&sequence->lock);
+
+    if (pixbuf != NULL)
+        g_object_unref (pixbuf);
+}
+
+/* Keeps the workers busy with the frames following the one shown. If
+ * playback is lagging behind, decoding restarts at the frame that is
+ * due, as the ones before it would be dropped anyway, and runs ahead
+ * of that frame rather than the one shown. */
+static void
+vnr_sequence_queue (VnrSequence *sequence, guint due)
+{
+    if (sequence->queued < due)
+        sequence->queued = due;
+
+    while (sequence->queued < MAX (sequence->shown, due) + sequence->ahead)
+    {
+        sequence->queued++;
+        vnr_work_group_push (sequence->pool,
+                             GUINT_TO_POINTER (sequence->queued));
+    }
+}
+
+/* Decodes ahead as many frames as fit in the budget, but at least one
+ * per worker. */
+static void
+vnr_sequence_set_ahead (VnrSequence *sequence, GdkPixbuf *pixbuf)
+{
+    gsize size;
+
+    size = (gsize) gdk_pixbuf_get_rowstride (pixbuf)
+           * gdk_pixbuf_get_height (pixbuf);
+    sequence->ahead = CLAMP (VNR_SEQUENCE_BUDGET / MAX (size, 1),
+                             sequence->threads, 2 * sequence->threads);
+}
+
+static gboolean
+vnr_sequence_tick (gpointer user_data)
+{
+    VnrSequence *sequence = user_data;
+    GdkPixbuf *pixbuf = NULL;
+    gpointer value;
+    gboolean found = FALSE, report = FALSE;
+    gint64 now;
+    guint due, frame, decoded;
+
+    now = g_get_monotonic_time ();
+    due = (now - sequence->start) * sequence->fps / G_USEC_PER_SEC;
+
+    g_mutex_lock (&sequence->lock);
+    for (frame = due; frame > sequence->shown; frame--)
+    {
+        if (g_hash_table_lookup_extended (sequence->ready,
+                                          GUINT_TO_POINTER (frame),
+                                          NULL, &value))
+        {
+            found = TRUE;
+            break;
+        }
+    }
+    if (found)
+    {
+        guint old;
+
+        g_hash_table_steal (sequence->ready, GUINT_TO_POINTER (frame));
+        pixbuf = value;
+
+        /* Frames which were skipped, or could not be decoded. */
+        sequence->dropped += frame - sequence->shown - (pixbuf ? 1 : 0);
+
+        for (old = sequence->shown + 1; old < frame; old++)
+            g_hash_table_remove (sequence->ready, GUINT_TO_POINTER (old));
+        sequence->shown = frame;
+    }
+    decoded = sequence->decoded;
+    g_mutex_unlock (&sequence->lock);
+
+    if (pixbuf != NULL)
+    {
+        vnr_sequence_set_ahead (sequence, pixbuf);
+        sequence->func (sequence->paths[(sequence->first + frame)
+                                        % sequence->n_files],
+                        pixbuf, sequence->user_data);
+        g_object_unref (pixbuf);
+    }
+
+    /* The rate counts the frames decoded rather than those shown, as
+     * the workers never run more than a few frames ahead. */
+    if (now - sequence->stats_time >= VNR_SEQUENCE_STATS_INTERVAL)
+    {
+        sequence->sustained = (gdouble) (decoded - sequence->stats_decoded)
+                              * G_USEC_PER_SEC / (now - sequence->stats_time);
+        sequence->stats_decoded = decoded;
+        sequence->stats_time = now;
+        report = TRUE;
+    }
+
+    if (report || decoded != sequence->reported_decoded
+        || sequence->dropped != sequence->reported_dropped)
+    {
+        sequence->reported_decoded = decoded;
+        sequence->reported_dropped = sequence->dropped;
+        sequence->stats_func (sequence->sustained, sequence->dropped,
+                              sequence->user_data);
+    }
+
+    vnr_sequence_queue (sequence, due);
+    return TRUE;
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_sequence_new:
+ * @file_list: the file list, positioned at the image on screen
+ * @fps: the frame rate to play at
+ * @func: the function showing the frames
+ * @stats_func: the function showing the statistics
+ * @user_data: data passed to @func and @stats_func
+ * @returns: a new #VnrSequence
+ *
+ * Starts playing @file_list, beginning with the file after the current
+ * one. Files added to the list later on are not played.
+ **/
+VnrSequence *
+vnr_sequence_new (VnrFileList *file_list, int fps,
+                  VnrSequenceFrameFunc func, VnrSequenceStatsFunc stats_func,
+                  gpointer user_data)
+{
+    VnrSequence *sequence;
+    long cpus;
+    guint i;
+
+    sequence = g_new0 (VnrSequence, 1);
+    sequence->fps = MAX (fps, 1);
+    sequence->func = func;
+    sequence->stats_func = stats_func;
+    sequence->user_data = user_data;
+
+    sequence->n_files = vnr_file_list_get_length (file_list);
+    sequence->first = vnr_file_list_get_position (file_list);
+    sequence->paths = g_new0 (gchar *, sequence->n_files + 1);
+
+    /* The workers only see copies of the paths, so the list itself is
+     * never touched outside the main loop. */
+    for (i = 0; i < sequence->n_files; i++)
+        sequence->paths[i] = vnr_file_list_get_nth_path (file_list, i);
+
+    cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    sequence->threads = CLAMP (cpus, 1, 32);
+    sequence->ahead = 2 * sequence->threads;
+
+    g_mutex_init (&sequence->lock);
+    sequence->ready = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                             NULL, vnr_sequence_free_frame);
+    sequence->pool = vnr_work_group_new (VNR_WORK_NEIGHBOUR,
+                                         vnr_sequence_decode, sequence,
+                                         sequence->threads, NULL, NULL);
+
+    sequence->start = g_get_monotonic_time ();
+    sequence->stats_time = sequence->start;
+    vnr_sequence_queue (sequence, 0);
+
+    /* Tick twice per frame, so frames are shown at most half a frame
+     * late. */
+    sequence->source_id = g_timeout_add (MAX (500 / sequence->fps, 1),
+                                         vnr_sequence_tick, sequence);
+    return sequence;
+}
+
+/**
+ * vnr_sequence_free:
+ * @sequence: a #VnrSequence, or %NULL
+ *
+ * Stops playback, waiting for the frames being decoded.
+ **/
+void
+vnr_sequence_free (VnrSequence *sequence)
+{
+    if (sequence == NULL)
+        return;
+
+    g_source_remove (sequence->source_id);
+    vnr_work_group_free (sequence->pool, TRUE, TRUE);
+
+    g_hash_table_destroy (sequence->ready);
+    g_mutex_clear (&sequence->lock);
+    g_strfreev (sequence->paths);
+    g_free (sequence);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+/**
+ * vnr_sequence_get_stats:
+ * @sequence: a #VnrSequence
+ * @fps: return location for the frame rate sustained over the last
+ *   second, or %NULL
+ * @dropped: return location for the number of frames dropped since
+ *   playback started, or %NULL
+ *
+ * A sustained frame rate below the requested one means the frames
+ * cannot be read and decoded fast enough.
+ **/
+void
+vnr_sequence_get_stats (VnrSequence *sequence, gdouble *fps, guint *dropped)
+{
+    if (fps != NULL)
+        *fps = sequence->sustained;
+    if (dropped != NULL)
+        *dropped = sequence->dropped;
+}
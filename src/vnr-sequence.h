@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VNR_SEQUENCE_H__
+#define __VNR_SEQUENCE_H__
+
+#include <gtk/gtk.h>
+#include "vnr-file.h"
+
+G_BEGIN_DECLS
+
+typedef struct _VnrSequence VnrSequence;
+
+/**
+ * VnrSequenceFrameFunc:
+ * @path: The path of the file the frame was decoded from.
+ * @frame: The decoded frame. The callback must take a reference to
+ *   it to keep it around.
+ * @user_data: The data passed to vnr_sequence_new().
+ *
+ * Called from the main loop whenever a frame is due.
+ **/
+typedef void (*VnrSequenceFrameFunc) (const gchar *path, GdkPixbuf *frame,
+                                      gpointer user_data);
+
+/**
+ * VnrSequenceStatsFunc:
+ * @fps: The frame rate sustained over the last second.
+ * @dropped: The number of frames dropped since playback started.
+ * @user_data: The data passed to vnr_sequence_new().
+ *
+ * Called from the main loop whenever frames were decoded or dropped
+ * since the last call, and at least once a second.
+ **/
+typedef void (*VnrSequenceStatsFunc) (gdouble fps, guint dropped,
+                                      gpointer user_data);
+
+/* Constructors */
+VnrSequence *vnr_sequence_new       (VnrFileList *file_list, int fps,
+                                     VnrSequenceFrameFunc func,
+                                     VnrSequenceStatsFunc stats_func,
+                                     gpointer user_data);
+void         vnr_sequence_free      (VnrSequence *sequence);
+
+/* Read-only properties */
+void         vnr_sequence_get_stats (VnrSequence *sequence,
+                                     gdouble *fps, guint *dropped);
+
+G_END_DECLS
+#endif /* __VNR_SEQUENCE_H__ */
@@ -0,0 +1,482 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <libintl.h>
+#include <glib/gi18n.h>
+#define _(String) gettext (String)
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "config.h"
+#include "vnr-thumbnails.h"
+#include "vnr-load-context.h"
+#include "vnr-workers.h"
+#include "vnr-tools.h"
+#include "uni-exiv2.hpp"
+
+/* Where the files no thumbnail could be made of are remembered, so
+ * that they are not tried again until they change */
+#define VNR_THUMBNAILS_FAIL_DIR "fail" G_DIR_SEPARATOR_S "viewnior-" PACKAGE_VERSION
+
+/**
+ * VnrThumbnails:
+ *
+ * Thumbnails of images, kept in the cache shared by the desktop as
+ * the freedesktop.org thumbnail specification lays out: PNG files
+ * named after the MD5 of the URI of the image, which they record
+ * along with its modification time to tell when they are stale.
+ *
+ * Missing thumbnails are made by the workers, several at once. The
+ * previews cameras embed in their files are used when one is large
+ * enough, which spares decoding the image at all. Other images are
+ * decoded to a pixel budget the size of the thumbnail, so large ones
+ * are reduced while being read.
+ **/
+
+static const gchar *vnr_thumbnails_dirs[] = { "normal", "large" };
+static const gint vnr_thumbnails_pixels[] = { 128, 256 };
+
+/* What a thumbnail records about its image */
+typedef struct {
+    gchar *uri;
+    gchar *mtime;
+    gchar *length;
+} VnrThumbnailInfo;
+
+typedef struct {
+    gchar *path;
+    VnrThumbnailSize size;
+    GCancellable *cancellable;
+    VnrThumbnailFunc func;
+    gpointer user_data;
+    GdkPixbuf *thumbnail;
+} VnrThumbnailJob;
+
+/* Created on first use, from the main thread */
+static VnrWorkGroup *thumbnail_group = NULL;
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static gboolean
+vnr_thumbnails_info_init (VnrThumbnailInfo *info, const gchar *path,
+                          GError **error)
+{
+    GStatBuf st;
+    int saved_errno;
+
+    if (g_stat (path, &st) != 0)
+    {
+        saved_errno = errno;
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (saved_errno),
+                     "%s", g_strerror (saved_errno));
+        return FALSE;
+    }
+
+    info->uri = g_filename_to_uri (path, NULL, error);
+    if (info->uri == NULL)
+        return FALSE;
+    info->mtime = g_strdup_printf ("%" G_GINT64_FORMAT, (gint64) st.st_mtime);
+    info->length = g_strdup_printf ("%" G_GINT64_FORMAT, (gint64) st.st_size);
+    return TRUE;
+}
+
+static void
+vnr_thumbnails_info_clear (VnrThumbnailInfo *info)
+{
+    g_free (info->uri);
+    g_free (info->mtime);
+    g_free (info->length);
+}
+
+static gchar *
+vnr_thumbnails_get_file (const VnrThumbnailInfo *info, const gchar *dir)
+{
+    gchar *checksum, *name, *file;
+
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, info->uri, -1);
+    name = g_strconcat (checksum, ".png", NULL);
+    file = g_build_filename (g_get_user_cache_dir (), "thumbnails", dir,
+                             name, NULL);
+
+    g_free (name);
+    g_free (checksum);
+    return file;
+}
+
+/* Reads the thumbnail @file, if it is one of the image as it is now */
+static GdkPixbuf *
+vnr_thumbnails_load (const gchar *file, const VnrThumbnailInfo *info)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file (file, NULL);
+
+    if (pixbuf == NULL)
+        return NULL;
+
+    if (g_strcmp0 (gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::URI"),
+                   info->uri) != 0 ||
+        g_strcmp0 (gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::MTime"),
+                   info->mtime) != 0)
+    {
+        g_object_unref (pixbuf);
+        return NULL;
+    }
+    return pixbuf;
+}
+
+/* Writes @pixbuf as the thumbnail @file. Other programs read the
+ * cache too, so it is written to a temporary file and renamed. */
+static void
+vnr_thumbnails_save (GdkPixbuf *pixbuf, const gchar *file,
+                     const VnrThumbnailInfo *info, gint width, gint height)
+{
+    gchar *keys[7], *values[7];
+    gchar *dir, *tmp, *width_str, *height_str;
+    gint n = 0;
+    int fd;
+
+    width_str = g_strdup_printf ("%d", width);
+    height_str = g_strdup_printf ("%d", height);
+
+    keys[n] = (gchar *) "tEXt::Thumb::URI";
+    values[n++] = info->uri;
+    keys[n] = (gchar *) "tEXt::Thumb::MTime";
+    values[n++] = info->mtime;
+    keys[n] = (gchar *) "tEXt::Thumb::Size";
+    values[n++] = info->length;
+    if (width > 0 && height > 0)
+    {
+        keys[n] = (gchar *) "tEXt::Thumb::Image::Width";
+        values[n++] = width_str;
+        keys[n] = (gchar *) "tEXt::Thumb::Image::Height";
+        values[n++] = height_str;
+    }
+    keys[n] = (gchar *) "tEXt::Software";
+    values[n++] = (gchar *) "Viewnior";
+    keys[n] = values[n] = NULL;
+
+    dir = g_path_get_dirname (file);
+    tmp = g_strconcat (file, ".XXXXXX", NULL);
+    if (g_mkdir_with_parents (dir, 0700) == 0 && (fd = g_mkstemp (tmp)) >= 0)
+    {
+        close (fd);
+        if (!gdk_pixbuf_savev (pixbuf, tmp, "png", keys, values, NULL) ||
+            g_rename (tmp, file) != 0)
+            g_unlink (tmp);
+    }
+
+    g_free (tmp);
+    g_free (dir);
+    g_free (height_str);
+    g_free (width_str);
+}
+
+static void
+vnr_thumbnails_size_prepared_cb (GdkPixbufLoader *loader,
+                                 gint width, gint height, gpointer data)
+{
+    gint pixels = GPOINTER_TO_INT (data);
+
+    vnr_tools_fit_to_size (&width, &height, pixels, pixels);
+    gdk_pixbuf_loader_set_size (loader, MAX (width, 1), MAX (height, 1));
+}
+
+/* Decodes an embedded preview, reduced to fit @pixels while decoding */
+static GdkPixbuf *
+vnr_thumbnails_decode_preview (const guchar *data, gsize length,
+                               gint pixels)
+{
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+    GdkPixbuf *pixbuf = NULL;
+
+    g_signal_connect (loader, "size-prepared",
+                      G_CALLBACK (vnr_thumbnails_size_prepared_cb),
+                      GINT_TO_POINTER (pixels));
+    if (gdk_pixbuf_loader_write (loader, data, length, NULL) &&
+        gdk_pixbuf_loader_close (loader, NULL))
+    {
+        pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+        if (pixbuf != NULL)
+            g_object_ref (pixbuf);
+    }
+    gdk_pixbuf_loader_close (loader, NULL);
+    g_object_unref (loader);
+    return pixbuf;
+}
+
+/* Makes a thumbnail of @path fitting @pixels, turned upright. Sets
+ * @width and @height to the size of the image, or 0 if the thumbnail
+ * came from a preview. */
+static GdkPixbuf *
+vnr_thumbnails_generate (const gchar *path, gint pixels,
+                         GCancellable *cancellable,
+                         gint *width, gint *height, GError **error)
+{
+    VnrLoadContext *context;
+    GdkPixbufAnimation *anim;
+    GdkPixbuf *pixbuf = NULL, *upright, *thumbnail;
+    const guchar *data;
+    guchar *preview;
+    long preview_length;
+    gchar orientation_str[4];
+    gint orientation, w, h;
+    gsize length;
+
+    *width = *height = 0;
+    context = vnr_load_context_new (path, error);
+    if (context == NULL)
+        return NULL;
+    data = vnr_load_context_get_data (context, &length);
+
+    orientation = uni_read_exiv2_preview (data, length, pixels,
+                                          &preview, &preview_length);
+    if (preview != NULL)
+    {
+        pixbuf = vnr_thumbnails_decode_preview (preview, preview_length,
+                                                pixels);
+        g_free (preview);
+    }
+
+    if (pixbuf == NULL)
+    {
+        vnr_load_context_set_max_pixels (context, (guint64) pixels * pixels);
+        anim = vnr_load_context_load (context, cancellable, error);
+        if (anim != NULL)
+        {
+            pixbuf = gdk_pixbuf_animation_get_static_image (anim);
+            if (pixbuf != NULL)
+                g_object_ref (pixbuf);
+            g_object_unref (anim);
+            vnr_load_context_get_size (context, width, height);
+        }
+    }
+    vnr_load_context_unref (context);
+    if (pixbuf == NULL)
+        return NULL;
+
+    /* Only gdk-pixbuf sets the orientation; previews and images read
+     * by regions get it from the Exif data */
+    if (gdk_pixbuf_get_option (pixbuf, "orientation") == NULL &&
+        orientation > 1 && orientation <= 8)
+    {
+        g_snprintf (orientation_str, sizeof orientation_str, "%d",
+                    orientation);
+        gdk_pixbuf_set_option (pixbuf, "orientation", orientation_str);
+    }
+    upright = gdk_pixbuf_apply_embedded_orientation (pixbuf);
+    g_object_unref (pixbuf);
+
+    w = gdk_pixbuf_get_width (upright);
+    h = gdk_pixbuf_get_height (upright);
+    vnr_tools_fit_to_size (&w, &h, pixels, pixels);
+    if (w == gdk_pixbuf_get_width (upright) &&
+        h == gdk_pixbuf_get_height (upright))
+        return upright;
+
+    thumbnail = gdk_pixbuf_scale_simple (upright, MAX (w, 1), MAX (h, 1),
+                                         GDK_INTERP_BILINEAR);
+    g_object_unref (upright);
+    return thumbnail;
+}
+
+static void
+vnr_thumbnails_job_free (VnrThumbnailJob *job)
+{
+    if (job->thumbnail != NULL)
+        g_object_unref (job->thumbnail);
+    if (job->cancellable != NULL)
+        g_object_unref (job->cancellable);
+    g_free (job->path);
+    g_slice_free (VnrThumbnailJob, job);
+}
+
+static gboolean
+vnr_thumbnails_deliver (VnrThumbnailJob *job)
+{
+    if (!g_cancellable_is_cancelled (job->cancellable))
+        job->func (job->path, job->thumbnail, job->user_data);
+
+    vnr_thumbnails_job_free (job);
+    return FALSE;
+}
+
+/* Runs on a worker */
+static void
+vnr_thumbnails_job (VnrThumbnailJob *job, gpointer user_data)
+{
+    if (!g_cancellable_is_cancelled (job->cancellable))
+        job->thumbnail = vnr_thumbnails_get (job->path, job->size,
+                                             job->cancellable, NULL);
+    g_idle_add ((GSourceFunc) vnr_thumbnails_deliver, job);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+/**
+ * vnr_thumbnails_get_pixels:
+ * @size: a #VnrThumbnailSize
+ * @returns: the most pixels thumbnails of @size are wide or high
+ **/
+gint
+vnr_thumbnails_get_pixels (VnrThumbnailSize size)
+{
+    return vnr_thumbnails_pixels[size];
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_thumbnails_lookup:
+ * @path: an image file
+ * @size: the size of the thumbnail
+ * @returns: the thumbnail of @path in the cache, to be unreffed by the
+ *   caller, or %NULL if there is none, or it is stale
+ *
+ * Only reads the cache, which is quick enough for the main thread.
+ **/
+GdkPixbuf *
+vnr_thumbnails_lookup (const gchar *path, VnrThumbnailSize size)
+{
+    VnrThumbnailInfo info;
+    GdkPixbuf *thumbnail;
+    gchar *file;
+
+    if (!vnr_thumbnails_info_init (&info, path, NULL))
+        return NULL;
+
+    file = vnr_thumbnails_get_file (&info, vnr_thumbnails_dirs[size]);
+    thumbnail = vnr_thumbnails_load (file, &info);
+
+    g_free (file);
+    vnr_thumbnails_info_clear (&info);
+    return thumbnail;
+}
+
+/**
+ * vnr_thumbnails_get:
+ * @path: an image file
+ * @size: the size of the thumbnail
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: return location for a #GError
+ * @returns: the thumbnail of @path, to be unreffed by the caller, or
+ *   %NULL on error
+ *
+ * Reads the thumbnail from the cache, or makes it and adds it there.
+ * Files no thumbnail could be made of are not tried again until they
+ * change. May be called from any thread.
+ **/
+GdkPixbuf *
+vnr_thumbnails_get (const gchar *path, VnrThumbnailSize size,
+                    GCancellable *cancellable, GError **error)
+{
+    VnrThumbnailInfo info;
+    GdkPixbuf *thumbnail, *failure;
+    GError *tmp_error = NULL;
+    gchar *file, *fail_file, *root;
+    gint width, height;
+
+    if (!vnr_thumbnails_info_init (&info, path, error))
+        return NULL;
+
+    file = vnr_thumbnails_get_file (&info, vnr_thumbnails_dirs[size]);
+    fail_file = vnr_thumbnails_get_file (&info, VNR_THUMBNAILS_FAIL_DIR);
+
+    thumbnail = vnr_thumbnails_load (file, &info);
+    failure = thumbnail == NULL ? vnr_thumbnails_load (fail_file, &info) : NULL;
+    if (failure != NULL)
+    {
+        g_object_unref (failure);
+        g_set_error_literal (&tmp_error, GDK_PIXBUF_ERROR,
+                             GDK_PIXBUF_ERROR_FAILED,
+                             _("No thumbnail can be made of the image."));
+    }
+    else if (thumbnail == NULL)
+    {
+        thumbnail = vnr_thumbnails_generate (path, vnr_thumbnails_pixels[size],
+                                             cancellable, &width, &height,
+                                             &tmp_error);
+
+        /* Thumbnails of the thumbnails themselves are not kept */
+        root = g_build_filename (g_get_user_cache_dir (), "thumbnails",
+                                 NULL);
+        if (thumbnail != NULL && !g_str_has_prefix (path, root))
+            vnr_thumbnails_save (thumbnail, file, &info, width, height);
+        else if (thumbnail == NULL &&
+                 !g_error_matches (tmp_error, G_IO_ERROR,
+                                   G_IO_ERROR_CANCELLED))
+        {
+            failure = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 1, 1);
+            gdk_pixbuf_fill (failure, 0);
+            vnr_thumbnails_save (failure, fail_file, &info, 0, 0);
+            g_object_unref (failure);
+        }
+        g_free (root);
+    }
+
+    if (tmp_error != NULL)
+        g_propagate_error (error, tmp_error);
+    g_free (fail_file);
+    g_free (file);
+    vnr_thumbnails_info_clear (&info);
+    return thumbnail;
+}
+
+/**
+ * vnr_thumbnails_request:
+ * @path: an image file
+ * @size: the size of the thumbnail
+ * @cancellable: a #GCancellable, or %NULL
+ * @func: the function to hand the thumbnail to
+ * @user_data: data to pass to @func
+ *
+ * Gets the thumbnail of @path on the workers, as vnr_thumbnails_get()
+ * does, and calls @func with it from the main loop, or with %NULL if
+ * there is none. Requests are served in the order they are made.
+ *
+ * Once @cancellable is cancelled, @func is not called any more, so
+ * @user_data need only live until then. Must be called from the main
+ * thread.
+ **/
+void
+vnr_thumbnails_request (const gchar *path, VnrThumbnailSize size,
+                        GCancellable *cancellable, VnrThumbnailFunc func,
+                        gpointer user_data)
+{
+    VnrThumbnailJob *job = g_slice_new0 (VnrThumbnailJob);
+
+    if (thumbnail_group == NULL)
+        thumbnail_group = vnr_work_group_new (VNR_WORK_THUMBNAIL,
+                                              (GFunc) vnr_thumbnails_job,
+                                              NULL, -1, NULL, NULL);
+
+    job->path = g_strdup (path);
+    job->size = size;
+    job->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+    job->func = func;
+    job->user_data = user_data;
+    vnr_work_group_push (thumbnail_group, job);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __VNR_THUMBNAILS_H__
+#define __VNR_THUMBNAILS_H__
+
+#include <gtk/gtk.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * VnrThumbnailSize:
+ *
+ * The sizes of the freedesktop.org thumbnail cache.
+ **/
+typedef enum {
+    /* Up to 128 pixels */
+    VNR_THUMBNAIL_NORMAL,
+    /* Up to 256 pixels */
+    VNR_THUMBNAIL_LARGE
+} VnrThumbnailSize;
+
+typedef void (*VnrThumbnailFunc) (const gchar *path, GdkPixbuf *thumbnail,
+                                  gpointer user_data);
+
+/* Read-only properties */
+gint       vnr_thumbnails_get_pixels (VnrThumbnailSize size);
+
+/* Actions */
+GdkPixbuf *vnr_thumbnails_lookup  (const gchar *path, VnrThumbnailSize size);
+GdkPixbuf *vnr_thumbnails_get     (const gchar *path, VnrThumbnailSize size,
+                                   GCancellable *cancellable,
+                                   GError **error);
+void       vnr_thumbnails_request (const gchar *path, VnrThumbnailSize size,
+                                   GCancellable *cancellable,
+                                   VnrThumbnailFunc func,
+                                   gpointer user_data);
+
+G_END_DECLS
+#endif /* __VNR_THUMBNAILS_H__ */
@@ -0,0 +1,345 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "vnr-tile-source.h"
+#include "vnr-region-decoder.h"
+#include "vnr-workers.h"
+
+typedef struct _VnrTileSource VnrTileSource;
+
+/**
+ * VnrTileSource:
+ *
+ * Decodes the tiles a #UniImageView asks for from the region decoder
+ * of a load context, on a worker. The tiles wanted are decoded
+ * together, in one pass over the image, and handed to the view from
+ * the main loop as each is done. Asking for other tiles does not stop
+ * the pass: it drops the tiles no longer wanted and takes on the new
+ * ones it has not read past yet, the others waiting for the next pass.
+ * Tiles the pyramid of the image has are read from it rather than
+ * decoded.
+ **/
+struct _VnrTileSource {
+    UniTileSource parent;
+    gint ref_count;
+
+    VnrLoadContext *context;
+    VnrWorkGroup *group;
+
+    /* Only used from the main thread, NULL once the view let go */
+    UniImageView *view;
+
+    /* Protects the fields below, which the worker uses. @wanted has
+     * the tiles asked for that no pass has taken yet, and @changed is
+     * set until the running pass has seen the last request. */
+    GMutex lock;
+    GArray *wanted;
+    gboolean changed;
+    gboolean queued;
+    GCancellable *cancellable;
+};
+
+/* A decoded tile on its way to the view */
+typedef struct {
+    VnrTileSource *source;
+    UniTileKey key;
+    GdkPixbuf *pixbuf;
+} VnrTileSourceTile;
+
+/* The keys of a pass, by index, and the source they go to. The keys
+ * of tiles dropped from the pass get a level of -1. */
+typedef struct {
+    VnrTileSource *source;
+    GArray *keys;
+    gint level;
+} VnrTileSourcePass;
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static VnrTileSource *
+vnr_tile_source_ref (VnrTileSource *source)
+{
+    g_atomic_int_inc (&source->ref_count);
+    return source;
+}
+
+static void
+vnr_tile_source_unref (VnrTileSource *source)
+{
+    if (!g_atomic_int_dec_and_test (&source->ref_count))
+        return;
+
+    vnr_load_context_unref (source->context);
+    g_array_free (source->wanted, TRUE);
+    g_mutex_clear (&source->lock);
+    g_slice_free (VnrTileSource, source);
+}
+
+static gboolean
+vnr_tile_source_deliver (VnrTileSourceTile *tile)
+{
+    if (tile->source->view != NULL)
+        uni_image_view_add_tile (tile->source->view, &tile->key,
+                                 tile->pixbuf);
+
+    vnr_tile_source_unref (tile->source);
+    g_object_unref (tile->pixbuf);
+    g_slice_free (VnrTileSourceTile, tile);
+    return FALSE;
+}
+
+/* Runs on the worker, as each tile of a pass is complete */
+static void
+vnr_tile_source_decoded (guint index, GdkPixbuf *pixbuf, gpointer user_data)
+{
+    VnrTileSourcePass *pass = user_data;
+    VnrTileSourceTile *tile = g_slice_new (VnrTileSourceTile);
+
+    tile->source = vnr_tile_source_ref (pass->source);
+    tile->key = g_array_index (pass->keys, UniTileKey, index);
+    tile->pixbuf = g_object_ref (pixbuf);
+    g_idle_add ((GSourceFunc) vnr_tile_source_deliver, tile);
+}
+
+static gboolean
+vnr_tile_source_changed (VnrTileSource *source)
+{
+    gboolean changed;
+
+    g_mutex_lock (&source->lock);
+    changed = source->changed;
+    g_mutex_unlock (&source->lock);
+    return changed;
+}
+
+/* Hands over the tiles of @pass the pyramid has, leaving the others.
+ * Stops once other tiles are asked for, as the view asks again for
+ * those of @pass it still wants. */
+static gboolean
+vnr_tile_source_read_pyramid (VnrPyramid *pyramid, VnrTileSourcePass *pass,
+                              GCancellable *cancellable)
+{
+    GArray *missing = g_array_new (FALSE, FALSE, sizeof (UniTileKey));
+    GdkPixbuf *pixbuf;
+    gboolean complete;
+    guint i;
+
+    for (i = 0; i < pass->keys->len; i++)
+    {
+        UniTileKey *key = &g_array_index (pass->keys, UniTileKey, i);
+
+        if (g_cancellable_is_cancelled (cancellable) ||
+            vnr_tile_source_changed (pass->source))
+            break;
+        pixbuf = vnr_pyramid_get_tile (pyramid, key);
+        if (pixbuf == NULL)
+        {
+            g_array_append_val (missing, *key);
+            continue;
+        }
+        vnr_tile_source_decoded (i, pixbuf, pass);
+        g_object_unref (pixbuf);
+    }
+    complete = (i == pass->keys->len);
+    g_array_free (pass->keys, TRUE);
+    pass->keys = missing;
+    return complete;
+}
+
+static gboolean
+vnr_tile_source_key_equal (const UniTileKey *a, const UniTileKey *b)
+{
+    return a->level == b->level && a->col == b->col && a->row == b->row;
+}
+
+/* Runs on the worker every few rows of a pass: the pass keeps the tiles
+ * still wanted, drops the others and takes on the new ones it has not
+ * read past yet */
+static void
+vnr_tile_source_update (VnrRegionPass *region, gpointer user_data)
+{
+    VnrTileSourcePass *pass = user_data;
+    VnrTileSource *source = pass->source;
+    GdkRectangle rect;
+    guint i, j;
+
+    g_mutex_lock (&source->lock);
+    if (!source->changed)
+    {
+        g_mutex_unlock (&source->lock);
+        return;
+    }
+    source->changed = FALSE;
+
+    for (i = 0; i < pass->keys->len; i++)
+    {
+        UniTileKey *key = &g_array_index (pass->keys, UniTileKey, i);
+
+        for (j = 0; j < source->wanted->len; j++)
+            if (vnr_tile_source_key_equal (
+                    key, &g_array_index (source->wanted, UniTileKey, j)))
+                break;
+        if (j < source->wanted->len)
+        {
+            g_array_remove_index (source->wanted, j);
+            continue;
+        }
+        vnr_region_pass_drop (region, i);
+        key->level = -1;
+    }
+
+    for (i = 0; i < source->wanted->len;)
+    {
+        UniTileKey *key = &g_array_index (source->wanted, UniTileKey, i);
+
+        uni_tile_get_rect (key, &rect);
+        if (key->level != pass->level || !vnr_region_pass_add (region, &rect))
+        {
+            i++;
+            continue;
+        }
+        g_array_append_val (pass->keys, *key);
+        g_array_remove_index (source->wanted, i);
+    }
+    g_mutex_unlock (&source->lock);
+}
+
+/* Runs on the worker: decodes the tiles wanted until none are left */
+static void
+vnr_tile_source_job (VnrTileSource *source, gpointer user_data)
+{
+    VnrRegionDecoder *decoder;
+    VnrPyramid *pyramid;
+    VnrTileSourcePass pass;
+    GCancellable *cancellable;
+    GdkRectangle *rects;
+    guint i;
+
+    decoder = vnr_load_context_get_region_decoder (source->context);
+    pyramid = vnr_load_context_get_pyramid (source->context);
+    pass.source = source;
+
+    for (;;)
+    {
+        g_mutex_lock (&source->lock);
+        if (source->wanted->len == 0)
+        {
+            source->queued = FALSE;
+            g_mutex_unlock (&source->lock);
+            break;
+        }
+        pass.keys = source->wanted;
+        source->wanted = g_array_new (FALSE, FALSE, sizeof (UniTileKey));
+        source->changed = FALSE;
+        cancellable = source->cancellable = g_cancellable_new ();
+        g_mutex_unlock (&source->lock);
+
+        /* The view asks for the tiles of a single level at a time */
+        pass.level = g_array_index (pass.keys, UniTileKey, 0).level;
+
+        if ((pyramid == NULL ||
+             vnr_tile_source_read_pyramid (pyramid, &pass, cancellable)) &&
+            pass.keys->len > 0)
+        {
+            rects = g_new (GdkRectangle, pass.keys->len);
+            for (i = 0; i < pass.keys->len; i++)
+                uni_tile_get_rect (&g_array_index (pass.keys, UniTileKey, i),
+                                   &rects[i]);
+            vnr_region_decoder_decode_areas (
+                decoder, rects, pass.keys->len, 1.0 / (1 << pass.level),
+                vnr_tile_source_decoded, vnr_tile_source_update, &pass,
+                cancellable, NULL);
+            g_free (rects);
+        }
+        g_array_free (pass.keys, TRUE);
+
+        g_mutex_lock (&source->lock);
+        source->cancellable = NULL;
+        g_mutex_unlock (&source->lock);
+        g_object_unref (cancellable);
+    }
+    vnr_tile_source_unref (source);
+}
+
+static void
+vnr_tile_source_request (UniTileSource *parent,
+                         const UniTileKey *keys, guint n_keys)
+{
+    VnrTileSource *source = (VnrTileSource *) parent;
+
+    g_mutex_lock (&source->lock);
+    g_array_set_size (source->wanted, 0);
+    g_array_append_vals (source->wanted, keys, n_keys);
+    source->changed = TRUE;
+    if (n_keys > 0 && !source->queued)
+    {
+        source->queued = TRUE;
+        vnr_work_group_push (source->group, vnr_tile_source_ref (source));
+    }
+    g_mutex_unlock (&source->lock);
+}
+
+static void
+vnr_tile_source_free (UniTileSource *parent)
+{
+    VnrTileSource *source = (VnrTileSource *) parent;
+
+    source->view = NULL;
+
+    g_mutex_lock (&source->lock);
+    g_array_set_size (source->wanted, 0);
+    if (source->cancellable != NULL)
+        g_cancellable_cancel (source->cancellable);
+    g_mutex_unlock (&source->lock);
+
+    vnr_work_group_free (source->group, TRUE, FALSE);
+    vnr_tile_source_unref (source);
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_tile_source_new:
+ * @context: a #VnrLoadContext with a region decoder
+ * @view: the view to hand the tiles to
+ * @returns: a new #UniTileSource, for uni_image_view_set_tile_source()
+ **/
+UniTileSource *
+vnr_tile_source_new (VnrLoadContext *context, UniImageView *view)
+{
+    VnrTileSource *source = g_slice_new0 (VnrTileSource);
+
+    source->parent.request = vnr_tile_source_request;
+    source->parent.free = vnr_tile_source_free;
+    source->ref_count = 1;
+    source->context = vnr_load_context_ref (context);
+    source->view = view;
+    source->wanted = g_array_new (FALSE, FALSE, sizeof (UniTileKey));
+    g_mutex_init (&source->lock);
+    source->group = vnr_work_group_new (VNR_WORK_CURRENT,
+                                        (GFunc) vnr_tile_source_job, NULL, 1,
+                                        (GDestroyNotify) vnr_tile_source_unref,
+                                        NULL);
+    return (UniTileSource *) source;
+}
@@ -22,6 +22,7 @@
 #include <gtk/gtk.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "vnr-tools.h"
 
 void
@@ -120,6 +121,47 @@ vnr_tools_get_list_from_array (gchar **files)
     return g_slist_reverse (uri_list);
 }
 
+/* Reads one path per line from the file @source, or from the standard
+ * input if it is "-". Relative paths are taken as relative to the
+ * current directory, as on the command line. */
+GSList *
+vnr_tools_read_path_list (const gchar *source, GError **error)
+{
+    GSList *path_list = NULL;
+    GIOChannel *channel;
+    gchar *line;
+    gsize terminator;
+
+    if (strcmp (source, "-") == 0)
+        channel = g_io_channel_unix_new (STDIN_FILENO);
+    else
+        channel = g_io_channel_new_file (source, "r", error);
+
+    if (channel == NULL)
+        return NULL;
+
+    /* Paths are in the file system encoding, not necessarily UTF-8 */
+    g_io_channel_set_encoding (channel, NULL, NULL);
+
+    while (g_io_channel_read_line (channel, &line, NULL, &terminator,
+                                   error) == G_IO_STATUS_NORMAL) {
+        line[terminator] = '\0';
+
+        if (line[0] != '\0') {
+            GFile *file = g_file_new_for_commandline_arg (line);
+            gchar *path = g_file_get_path (file);
+
+            g_object_unref (file);
+            if (path != NULL)
+                path_list = g_slist_prepend (path_list, path);
+        }
+        g_free (line);
+    }
+
+    g_io_channel_unref (channel);
+    return g_slist_reverse (path_list);
+}
+
 /* modified version of eog's
  * eog_util_parse_uri_string_list_to_file_list */
 GSList*
@@ -132,9 +174,12 @@ vnr_tools_parse_uri_string_list_to_file_list (const gchar *uri_list)
     uris = g_uri_list_extract_uris (uri_list);
 
     while (uris[i] != NULL) {
-        gchar* current_path = g_file_get_path (g_file_new_for_uri(uris[i]));
+        GFile *file = g_file_new_for_uri (uris[i]);
+        gchar* current_path = g_file_get_path (file);
+
+        g_object_unref (file);
         if(current_path != NULL)
-            file_list = g_slist_append (file_list, current_path);
+            file_list = g_slist_prepend (file_list, current_path);
         i++;
     }
 
@@ -152,29 +197,6 @@ compare_quarks (gconstpointer a, gconstpointer b)
     return quark - GPOINTER_TO_INT (b);
 }
 
-void
-get_position_of_element_in_list (GList *list, gint *current, gint *total)
-{
-    GList *it;
-    gint after, before;
-
-    after = before = 0;
-    it = list;
-
-    for(it = list; it != NULL; it = it->next)
-    {
-        after ++;
-    }
-
-    for(it = list; it != NULL; it = it->prev)
-    {
-        before ++;
-    }
-
-    *current = before;
-    *total = before + after - 1;
-}
-
 void
 vnr_tools_apply_embedded_orientation (GdkPixbufAnimation **anim)
 {
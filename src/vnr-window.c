@@ -35,16 +35,34 @@
 #include "uni-anim-view.h"
 #include "vnr-tools.h"
 #include "vnr-file.h"
+#include "vnr-file-list.h"
 #include "vnr-message-area.h"
 #include "vnr-properties-dialog.h"
 #include "vnr-crop.h"
+#include "vnr-sequence.h"
 #include "uni-exiv2.hpp"
 #include "uni-utils.h"
+#include "vnr-workers.h"
+#include "vnr-tile-source.h"
+#include "vnr-thumbnails.h"
+#include "vnr-grid.h"
 
 /* Timeout to hide the toolbar in fullscreen mode */
 #define FULLSCREEN_TIMEOUT 1000
 #define DARK_BACKGROUND_COLOR "#222222"
 
+/* A request to show an image, decoded by a worker. */
+typedef struct {
+    VnrWindow *window;
+    gchar *path;
+    GCancellable *cancellable;
+
+    VnrLoadContext *context;
+    GdkPixbufFormat *format;
+    GdkPixbufAnimation *pixbuf;
+    GError *error;
+} VnrWindowOpen;
+
 G_DEFINE_TYPE (VnrWindow, vnr_window, GTK_TYPE_WINDOW);
 
 static void vnr_window_unfullscreen (VnrWindow *window);
@@ -52,7 +70,12 @@ static void stop_slideshow(VnrWindow *window);
 static void start_slideshow(VnrWindow *window);
 static void restart_slideshow(VnrWindow *window);
 static void allow_slideshow(VnrWindow *window);
+static void stop_sequence(VnrWindow *window, gboolean reopen);
+static void stop_grid(VnrWindow *window, gboolean reopen);
+static void vnr_window_cancel_open (VnrWindow *window);
+static void vnr_window_request_open (VnrWindow *window);
 static gint get_top_widgets_height(VnrWindow *window);
+static void vnr_window_cmd_resize (GtkToggleAction *action, VnrWindow *window);
 
 static void leave_fs_cb (GtkButton *button, VnrWindow *window);
 static void toggle_show_next_cb (GtkToggleButton *togglebutton, VnrWindow *window);
@@ -98,6 +121,8 @@ const gchar *ui_definition = "<ui>"
       "<separator/>"
       "<menuitem name=\"Fullscreen\" action=\"ViewFullscreen\"/>"
       "<menuitem name=\"Slideshow\" action=\"ViewSlideshow\"/>"
+      "<menuitem name=\"Sequence\" action=\"ViewSequence\"/>"
+      "<menuitem name=\"Grid\" action=\"ViewGrid\"/>"
       "<separator/>"
       "<menuitem name=\"ResizeWindow\" action=\"ViewResizeWindow\"/>"
     "</menu>"
@@ -117,6 +142,13 @@ const gchar *ui_definition = "<ui>"
       "<separator/>"
       "<menuitem name=\"GoFirst\" action=\"GoFirst\"/>"
       "<menuitem name=\"GoLast\" action=\"GoLast\"/>"
+      "<separator/>"
+      "<menu action=\"GoSort\">"
+        "<menuitem action=\"SortName\"/>"
+        "<menuitem action=\"SortDate\"/>"
+        "<menuitem action=\"SortSize\"/>"
+        "<menuitem action=\"SortType\"/>"
+      "</menu>"
     "</menu>"
     "<menu action=\"Help\">"
       "<menuitem action=\"HelpAbout\"/>"
@@ -149,6 +181,8 @@ const gchar *ui_definition = "<ui>"
       "<menuitem action=\"ViewStatusbar\"/>"
       "<menuitem name=\"Fullscreen\" action=\"ViewFullscreen\"/>"
       "<menuitem name=\"Slideshow\" action=\"ViewSlideshow\"/>"
+      "<menuitem name=\"Sequence\" action=\"ViewSequence\"/>"
+      "<menuitem name=\"Grid\" action=\"ViewGrid\"/>"
       "<separator/>"
       "<menuitem name=\"ResizeWindow\" action=\"ViewResizeWindow\"/>"
     "</menu>"
@@ -252,7 +286,7 @@ vnr_window_update_openwith_menu (VnrWindow *window)
     GList *apps;
     guint action_id = 0;
 
-    file = g_file_new_for_path ((gchar*)VNR_FILE(window->file_list->data)->path);
+    file = g_file_new_for_path ((gchar*)vnr_file_list_get_current(window->file_list)->path);
     file_info = g_file_query_info (file,
                        G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
                        0, NULL, NULL);
@@ -395,9 +429,10 @@ update_fs_filename_label(VnrWindow *window)
     gint position, total;
     char *buf;
 
-    get_position_of_element_in_list(window->file_list, &position, &total);
+    position = vnr_file_list_get_position(window->file_list) + 1;
+    total = vnr_file_list_get_length(window->file_list);
     buf = g_strdup_printf ("%s - %i/%i",
-                           VNR_FILE(window->file_list->data)->display_name,
+                           vnr_file_list_get_current(window->file_list)->display_name,
                            position, total);
 
     gtk_label_set_text(GTK_LABEL(window->fs_filename_label), buf);
@@ -408,7 +443,7 @@ update_fs_filename_label(VnrWindow *window)
 static gboolean
 next_image_src(VnrWindow *window)
 {
-    if(g_list_length(g_list_first(window->file_list)) <= 1)
+    if(vnr_file_list_get_length(window->file_list) <= 1)
         return FALSE;
     else
         vnr_window_next(window, FALSE);
@@ -710,6 +745,160 @@ allow_slideshow(VnrWindow *window)
     gtk_widget_set_sensitive(window->toggle_btn, TRUE);
 }
 
+static void
+sequence_frame_cb (const gchar *path, GdkPixbuf *frame, VnrWindow *window)
+{
+    vnr_file_list_set_current_path (window->file_list, path);
+    window->current_image_width = gdk_pixbuf_get_width (frame);
+    window->current_image_height = gdk_pixbuf_get_height (frame);
+
+    uni_image_view_set_pixbuf (UNI_IMAGE_VIEW (window->view), frame, FALSE);
+    zoom_changed_cb (UNI_IMAGE_VIEW (window->view), window);
+}
+
+static void
+sequence_stats_cb (gdouble fps, guint dropped, VnrWindow *window)
+{
+    zoom_changed_cb (UNI_IMAGE_VIEW (window->view), window);
+}
+
+static void
+start_sequence(VnrWindow *window)
+{
+    if(window->sequence != NULL || window->file_list == NULL)
+        return;
+
+    stop_grid(window, FALSE);
+    stop_slideshow(window);
+    vnr_window_cancel_open(window);
+
+    /* Frames go straight to the view, so nothing may be left playing
+     * on it. Editing is disabled as every frame replaces the image. */
+    vnr_anim_loader_free (window->anim_loader);
+    window->anim_loader = NULL;
+    uni_anim_view_set_is_playing (UNI_ANIM_VIEW (window->view), FALSE);
+    gtk_action_group_set_sensitive(window->actions_static_image, FALSE);
+
+    window->sequence = vnr_sequence_new (window->file_list,
+                                         window->prefs->sequence_fps,
+                                         (VnrSequenceFrameFunc)sequence_frame_cb,
+                                         (VnrSequenceStatsFunc)sequence_stats_cb,
+                                         window);
+}
+
+/* Stops the sequence player. If @reopen is FALSE, the caller is about
+ * to open another image, or close the current one. */
+static void
+stop_sequence(VnrWindow *window, gboolean reopen)
+{
+    VnrSequence *sequence = window->sequence;
+    GtkAction *action;
+
+    if(sequence == NULL)
+        return;
+
+    window->sequence = NULL;
+    vnr_sequence_free (sequence);
+
+    action = gtk_action_group_get_action (window->actions_collection,
+                                          "ViewSequence");
+    gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (action), FALSE);
+
+    if(reopen)
+        vnr_window_open(window, FALSE);
+}
+
+static gboolean
+grid_is_shown(VnrWindow *window)
+{
+    return window->grid_scroll != NULL
+           && gtk_widget_get_visible(window->grid_scroll);
+}
+
+static void
+grid_activated_cb (VnrGrid *grid, guint position, VnrWindow *window)
+{
+    if(position == vnr_file_list_get_position(window->file_list))
+        stop_grid(window, TRUE);
+    else
+        vnr_window_goto(window, position);
+}
+
+/* Shows the collection as a contact sheet in place of the image. The
+ * image is kept, but its actions are disabled meanwhile. */
+static void
+start_grid(VnrWindow *window)
+{
+    if(grid_is_shown(window) || window->file_list == NULL)
+        return;
+
+    stop_sequence(window, TRUE);
+    stop_slideshow(window);
+
+    if(window->grid == NULL)
+    {
+        window->grid = vnr_grid_new();
+        window->grid_scroll = gtk_scrolled_window_new(NULL, NULL);
+        gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(window->grid_scroll),
+                                       GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+        gtk_container_add(GTK_CONTAINER(window->grid_scroll), window->grid);
+        gtk_box_pack_end(GTK_BOX(window->layout), window->grid_scroll,
+                         TRUE, TRUE, 0);
+        g_signal_connect(G_OBJECT(window->grid), "activated",
+                         G_CALLBACK(grid_activated_cb), window);
+    }
+
+    /* An image still being decoded is opened once the grid is left */
+    window->grid_reopen = window->open_cancellable != NULL;
+    vnr_window_cancel_open(window);
+
+    window->grid_image_sensitive =
+        gtk_action_group_get_sensitive(window->actions_image);
+    window->grid_static_image_sensitive =
+        gtk_action_group_get_sensitive(window->actions_static_image);
+    gtk_action_group_set_sensitive(window->actions_image, FALSE);
+    gtk_action_group_set_sensitive(window->actions_static_image, FALSE);
+
+    vnr_grid_set_list(VNR_GRID(window->grid), window->file_list);
+    gtk_widget_hide(window->scroll_view);
+    gtk_widget_show_all(window->grid_scroll);
+    gtk_widget_grab_focus(window->grid);
+}
+
+/* Puts the image back in place of the grid. If @reopen is FALSE, the
+ * caller is about to open another image, or close the current one. */
+static void
+stop_grid(VnrWindow *window, gboolean reopen)
+{
+    GtkAction *action;
+
+    if(!grid_is_shown(window))
+        return;
+
+    gtk_widget_hide(window->grid_scroll);
+    vnr_grid_set_list(VNR_GRID(window->grid), NULL);
+    gtk_widget_show(window->scroll_view);
+    gtk_widget_grab_focus(window->view);
+
+    action = gtk_action_group_get_action (window->actions_collection,
+                                          "ViewGrid");
+    gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (action), FALSE);
+
+    /* The image shown is not the current one until it is decoded, so
+     * it stays uneditable until then */
+    if(window->grid_reopen)
+    {
+        if(reopen)
+            vnr_window_request_open(window);
+        return;
+    }
+
+    gtk_action_group_set_sensitive(window->actions_image,
+                                   window->grid_image_sensitive);
+    gtk_action_group_set_sensitive(window->actions_static_image,
+                                   window->grid_static_image_sensitive);
+}
+
 static gint
 get_top_widgets_height(VnrWindow *window)
 {
@@ -771,9 +960,6 @@ rotate_pixbuf(VnrWindow *window, GdkPixbufRotation angle)
     window->current_image_width = gdk_pixbuf_get_width (result);
     window->current_image_height = gdk_pixbuf_get_height (result);
 
-    if(gtk_widget_get_visible(window->props_dlg))
-        vnr_properties_dialog_update_image(VNR_PROPERTIES_DIALOG(window->props_dlg));
-
     /* Extra conditions. Rotating 180 degrees is also flipping horizontal and vertical */
     if((window->modifications & (4))^((angle==GDK_PIXBUF_ROTATE_CLOCKWISE)<<2))
         window->modifications ^= 3;
@@ -781,6 +967,9 @@ rotate_pixbuf(VnrWindow *window, GdkPixbufRotation angle)
     window->modifications ^= 4;
     gtk_action_group_set_sensitive(window->action_save, window->modifications);
 
+    if(gtk_widget_get_visible(window->props_dlg))
+        vnr_properties_dialog_update_image(VNR_PROPERTIES_DIALOG(window->props_dlg));
+
     if(window->modifications == 0 && window->prefs->behavior_modify != VNR_PREFS_MODIFY_IGNORE)
     {
         vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
@@ -826,9 +1015,6 @@ flip_pixbuf(VnrWindow *window, gboolean horizontal)
 
     uni_anim_view_set_static(UNI_ANIM_VIEW(window->view), result);
 
-    if(gtk_widget_get_visible(window->props_dlg))
-        vnr_properties_dialog_update_image(VNR_PROPERTIES_DIALOG(window->props_dlg));
-
     if(!window->cursor_is_hidden)
         gdk_window_set_cursor (gtk_widget_get_window(GTK_WIDGET(window)),
                                gdk_cursor_new(GDK_LEFT_PTR));
@@ -839,6 +1025,9 @@ flip_pixbuf(VnrWindow *window, gboolean horizontal)
 
     gtk_action_group_set_sensitive(window->action_save, window->modifications);
 
+    if(gtk_widget_get_visible(window->props_dlg))
+        vnr_properties_dialog_update_image(VNR_PROPERTIES_DIALOG(window->props_dlg));
+
     if(window->modifications == 0)
     {
         vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
@@ -860,6 +1049,285 @@ flip_pixbuf(VnrWindow *window, gboolean horizontal)
                                           G_CALLBACK(save_image_cb));
 }
 
+/* Decodes the image of @context, unless it is an animation, which is
+ * left to a #VnrAnimLoader on the main loop. Runs on a worker when
+ * navigating. */
+static GdkPixbufAnimation *
+vnr_window_decode (VnrLoadContext *context, GdkPixbufFormat *format,
+                   GCancellable *cancellable, GError **error)
+{
+    GdkPixbufAnimation *pixbuf;
+    GdkPixbuf *overview;
+    gint64 longest, shown;
+    gint width, height;
+
+    if (vnr_anim_loader_supports_format (format))
+        return NULL;
+
+    pixbuf = vnr_load_context_load (context, cancellable, error);
+    if (pixbuf != NULL)
+        vnr_tools_apply_embedded_orientation (&pixbuf);
+
+    /* Images over the pixel budget are decoded to an overview, which
+     * is laid out at the size of the image */
+    if (pixbuf == NULL || !gdk_pixbuf_animation_is_static_image (pixbuf) ||
+        !vnr_load_context_get_size (context, &width, &height))
+        return pixbuf;
+
+    overview = gdk_pixbuf_animation_get_static_image (pixbuf);
+    shown = MAX (gdk_pixbuf_get_width (overview),
+                 gdk_pixbuf_get_height (overview));
+    longest = MAX (width, height);
+    if (vnr_load_context_get_region_decoder (context) != NULL)
+        uni_pixbuf_set_image_size (overview, width, height);
+    else if (longest > shown)
+        /* It may have been turned around since */
+        uni_pixbuf_set_image_size (overview,
+                                   gdk_pixbuf_get_width (overview) * longest / shown,
+                                   gdk_pixbuf_get_height (overview) * longest / shown);
+    return pixbuf;
+}
+
+/* Shows the image of @context, decoded into @pixbuf unless it is an
+ * animation, or @error. Takes over @context, @pixbuf and @error. */
+static gboolean
+vnr_window_show (VnrWindow *window, VnrLoadContext *context,
+                 GdkPixbufFormat *format, GdkPixbufAnimation *pixbuf,
+                 GError *error, gboolean fit_to_screen)
+{
+    UniFittingMode last_fit_mode;
+    gboolean reduced = FALSE;
+    Size size;
+
+    vnr_anim_loader_free (window->anim_loader);
+    window->anim_loader = NULL;
+    vnr_load_context_unref (window->load_context);
+    window->load_context = context;
+
+    /* Animations are shown as soon as their first frame is decoded */
+    if (context != NULL && pixbuf == NULL && error == NULL)
+    {
+        window->anim_loader = vnr_anim_loader_new (context, &error);
+        if (window->anim_loader != NULL)
+            pixbuf = g_object_ref (vnr_anim_loader_get_animation (window->anim_loader));
+    }
+
+    if (error != NULL)
+    {
+        vnr_load_context_unref (window->load_context);
+        window->load_context = NULL;
+
+        vnr_message_area_show(VNR_MESSAGE_AREA (window->msg_area),
+                              TRUE, error->message, TRUE);
+        g_error_free (error);
+
+        if(gtk_widget_get_visible(window->props_dlg))
+            vnr_properties_dialog_clear(VNR_PROPERTIES_DIALOG(window->props_dlg));
+        return FALSE;
+    }
+
+    if(vnr_message_area_is_visible(VNR_MESSAGE_AREA(window->msg_area)))
+    {
+        vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
+    }
+
+    gtk_action_group_set_sensitive(window->actions_image, TRUE);
+    gtk_action_group_set_sensitive(window->action_wallpaper, TRUE);
+
+    g_free(window->writable_format_name);
+    if(format != NULL && gdk_pixbuf_format_is_writable (format))
+        window->writable_format_name = gdk_pixbuf_format_get_name (format);
+    else
+        window->writable_format_name = NULL;
+
+    if (gdk_pixbuf_animation_is_static_image (pixbuf))
+    {
+        size = uni_pixbuf_get_image_size (gdk_pixbuf_animation_get_static_image (pixbuf));
+        reduced = (size.width != gdk_pixbuf_animation_get_width (pixbuf));
+    }
+    else
+    {
+        size.width = gdk_pixbuf_animation_get_width (pixbuf);
+        size.height = gdk_pixbuf_animation_get_height (pixbuf);
+    }
+    window->current_image_width = size.width;
+    window->current_image_height = size.height;
+    window->modifications = 0;
+
+    if(fit_to_screen)
+    {
+        gint img_h, img_w;          /* Width and Height of the pixbuf */
+
+        img_w = window->current_image_width;
+        img_h = window->current_image_height;
+
+        vnr_tools_fit_to_size (&img_w, &img_h, window->max_width, window->max_height);
+
+        gtk_window_resize (GTK_WINDOW (window), img_w, img_h + get_top_widgets_height(window));
+    }
+
+    last_fit_mode = UNI_IMAGE_VIEW(window->view)->fitting;
+
+    /* Return TRUE if the image is static. Edits of an overview would
+     * be saved at its size. */
+    if ( uni_anim_view_set_anim (UNI_ANIM_VIEW (window->view), pixbuf) && !reduced )
+        gtk_action_group_set_sensitive(window->actions_static_image, TRUE);
+    else
+        gtk_action_group_set_sensitive(window->actions_static_image, FALSE);
+
+    /* Zooming into an overview shows the tiles under the viewport */
+    if (reduced && vnr_load_context_get_region_decoder (context) != NULL)
+    {
+        UniImageView *view = UNI_IMAGE_VIEW (window->view);
+        uni_image_view_set_tile_source (view, vnr_tile_source_new (context, view));
+
+        /* Later visits read the tiles from disk instead. The cache
+         * size is in megabytes. */
+        if (vnr_load_context_get_pyramid (context) == NULL)
+            vnr_pyramid_build_async (vnr_load_context_get_path (context),
+                                     (guint64) MAX (window->prefs->pyramid_cache_size, 1) << 20);
+    }
+
+    if (window->anim_loader != NULL)
+        vnr_anim_loader_start (window->anim_loader, UNI_ANIM_VIEW (window->view));
+
+    if(window->mode != VNR_WINDOW_MODE_NORMAL && window->prefs->fit_on_fullscreen)
+    {
+        uni_image_view_set_zoom_mode (UNI_IMAGE_VIEW(window->view), VNR_PREFS_ZOOM_FIT);
+    }
+    else if(window->prefs->zoom == VNR_PREFS_ZOOM_LAST_USED )
+    {
+        uni_image_view_set_fitting (UNI_IMAGE_VIEW(window->view), last_fit_mode);
+        zoom_changed_cb(UNI_IMAGE_VIEW(window->view), window);
+    }
+    else
+    {
+        uni_image_view_set_zoom_mode (UNI_IMAGE_VIEW(window->view), window->prefs->zoom);
+    }
+
+    if ( window->prefs->auto_resize ) {
+        vnr_window_cmd_resize(NULL, window);
+    }
+
+    if(gtk_widget_get_visible(window->props_dlg))
+        vnr_properties_dialog_update(VNR_PROPERTIES_DIALOG(window->props_dlg));
+
+    vnr_window_update_openwith_menu (window);
+
+    g_object_unref(pixbuf);
+    return TRUE;
+}
+
+static void
+vnr_window_open_free (VnrWindowOpen *open)
+{
+    vnr_load_context_unref (open->context);
+    if (open->pixbuf != NULL)
+        g_object_unref (open->pixbuf);
+    g_clear_error (&open->error);
+    g_object_unref (open->cancellable);
+    g_object_unref (open->window);
+    g_free (open->path);
+    g_slice_free (VnrWindowOpen, open);
+}
+
+static gboolean
+vnr_window_open_done (VnrWindowOpen *open)
+{
+    VnrWindow *window = open->window;
+
+    /* Only the latest request is shown */
+    if (!g_cancellable_is_cancelled (open->cancellable))
+    {
+        g_object_unref (window->open_cancellable);
+        window->open_cancellable = NULL;
+
+        vnr_window_show (window, open->context, open->format, open->pixbuf,
+                         open->error, FALSE);
+        open->context = NULL;
+        open->pixbuf = NULL;
+        open->error = NULL;
+
+        if(!window->cursor_is_hidden)
+            gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
+                                  gdk_cursor_new(GDK_LEFT_PTR));
+    }
+
+    vnr_window_open_free (open);
+    return FALSE;
+}
+
+/* Runs on a worker: reads and decodes the image of a request, unless
+ * a newer one came in meanwhile. */
+static void
+vnr_window_open_job (VnrWindowOpen *open, gpointer user_data)
+{
+    if (!g_cancellable_is_cancelled (open->cancellable))
+    {
+        open->context = vnr_load_context_new (open->path, &open->error);
+        if (open->context != NULL)
+        {
+            vnr_load_context_set_max_pixels (open->context,
+                (guint64) open->window->prefs->max_megapixels * 1000000);
+            open->format = vnr_load_context_get_format (open->context);
+            open->pixbuf = vnr_window_decode (open->context, open->format,
+                                              open->cancellable, &open->error);
+        }
+    }
+    g_idle_add ((GSourceFunc) vnr_window_open_done, open);
+}
+
+/* Drops the request to show an image that is pending, if any */
+static void
+vnr_window_cancel_open (VnrWindow *window)
+{
+    if (window->open_cancellable == NULL)
+        return;
+
+    g_cancellable_cancel (window->open_cancellable);
+    g_object_unref (window->open_cancellable);
+    window->open_cancellable = NULL;
+
+    if(!window->cursor_is_hidden)
+        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
+                              gdk_cursor_new(GDK_LEFT_PTR));
+}
+
+/* Shows the current image without waiting for it. The image shown
+ * stays up until the new one is decoded; requests made meanwhile
+ * replace it, so that only the image the user stops at is decoded.
+ *
+ * The list already points at the new image, so the image shown can
+ * no longer be edited or saved: its pixels would be written over the
+ * new file. */
+static void
+vnr_window_request_open (VnrWindow *window)
+{
+    VnrWindowOpen *open;
+
+    vnr_window_cancel_open (window);
+    update_fs_filename_label(window);
+
+    window->modifications = 0;
+    gtk_action_group_set_sensitive(window->actions_image, FALSE);
+    gtk_action_group_set_sensitive(window->actions_static_image, FALSE);
+    gtk_action_group_set_sensitive(window->action_save, FALSE);
+    if(!vnr_message_area_is_critical(VNR_MESSAGE_AREA(window->msg_area)))
+        vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
+
+    if(!window->cursor_is_hidden)
+        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
+                              gdk_cursor_new(GDK_WATCH));
+
+    window->open_cancellable = g_cancellable_new ();
+
+    open = g_slice_new0 (VnrWindowOpen);
+    open->window = g_object_ref (window);
+    open->path = g_strdup (vnr_file_list_get_current (window->file_list)->path);
+    open->cancellable = g_object_ref (window->open_cancellable);
+    vnr_work_group_push (window->open_group, open);
+}
+
 /*************************************************************/
 /***** Private signal handlers *******************************/
 /*************************************************************/
@@ -871,7 +1339,7 @@ open_with_launch_application_cb (GtkAction *action, VnrWindow *window)
     GFile *file;
     GList *files = NULL;
 
-    file = g_file_new_for_path ((gchar*)VNR_FILE(window->file_list->data)->path);
+    file = g_file_new_for_path ((gchar*)vnr_file_list_get_current(window->file_list)->path);
 
     app = g_object_get_data (G_OBJECT (action), "app");
     files = g_list_append (files, file);
@@ -952,6 +1420,14 @@ static void
 save_image_cb (GtkWidget *widget, VnrWindow *window)
 {
     GError *error = NULL;
+    gchar *path;
+
+    /* Edits are saved to the file they were made on, which the list
+     * may have moved away from while the next image is decoded */
+    if(window->load_context == NULL)
+        return;
+    path = g_strdup(vnr_load_context_get_path(window->load_context));
+
     if(!window->cursor_is_hidden)
         gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)), gdk_cursor_new(GDK_WATCH));
     /* This makes the cursor show NOW */
@@ -961,7 +1437,19 @@ save_image_cb (GtkWidget *widget, VnrWindow *window)
         vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
 
     /* Store exiv2 metadata to cache, so we can restore it afterwards */
-    uni_read_exiv2_to_cache(VNR_FILE(window->file_list->data)->path);
+    {
+        const guchar *data;
+        gsize length;
+
+        data = vnr_load_context_get_data(window->load_context, &length);
+        uni_read_exiv2_to_cache(data, length);
+
+        /* The file is about to be truncated under its mapping */
+        vnr_anim_loader_free(window->anim_loader);
+        window->anim_loader = NULL;
+        vnr_load_context_unref(window->load_context);
+        window->load_context = NULL;
+    }
 
     if(g_strcmp0(window->writable_format_name, "jpeg" ) == 0)
     {
@@ -969,7 +1457,7 @@ save_image_cb (GtkWidget *widget, VnrWindow *window)
         quality = g_strdup_printf ("%i", window->prefs->jpeg_quality);
 
         gdk_pixbuf_save (uni_image_view_get_pixbuf(UNI_IMAGE_VIEW(window->view)),
-                         VNR_FILE(window->file_list->data)->path, "jpeg",
+                         path, "jpeg",
                          &error, "quality", quality, NULL);
         g_free(quality);
     }
@@ -979,17 +1467,20 @@ save_image_cb (GtkWidget *widget, VnrWindow *window)
         compression = g_strdup_printf ("%i", window->prefs->png_compression);
 
         gdk_pixbuf_save (uni_image_view_get_pixbuf(UNI_IMAGE_VIEW(window->view)),
-                         VNR_FILE(window->file_list->data)->path, "png",
+                         path, "png",
                          &error, "compression", compression, NULL);
         g_free(compression);
     }
     else
     {
         gdk_pixbuf_save (uni_image_view_get_pixbuf(UNI_IMAGE_VIEW(window->view)),
-                         VNR_FILE(window->file_list->data)->path,
-                         window->writable_format_name, &error, NULL);
+                         path, window->writable_format_name, &error, NULL);
     }
-    uni_write_exiv2_from_cache(VNR_FILE(window->file_list->data)->path);
+    uni_write_exiv2_from_cache(path);
+
+    /* Later edits are saved to the same file, with its new metadata */
+    window->load_context = vnr_load_context_new(path, NULL);
+    g_free(path);
 
     if(!window->cursor_is_hidden)
         gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)), gdk_cursor_new(GDK_LEFT_PTR));
@@ -1138,13 +1629,27 @@ zoom_changed_cb (UniImageView *view, VnrWindow *window)
      * (vnr_window_close isn't called on the current image) */
     if(gtk_action_group_get_sensitive (window->actions_image))
     {
-        get_position_of_element_in_list(window->file_list, &position, &total);
+        position = vnr_file_list_get_position(window->file_list) + 1;
+        total = vnr_file_list_get_length(window->file_list);
         buf = g_strdup_printf ("%s%s - %i/%i - %ix%i - %i%%", (window->modifications)?"*":"",
-                               VNR_FILE(window->file_list->data)->display_name,
+                               vnr_file_list_get_current(window->file_list)->display_name,
                                position, total,
                                window->current_image_width, window->current_image_height,
                                (int)(view->zoom*100.));
 
+        if(window->sequence != NULL)
+        {
+            gchar *stats;
+            gdouble fps;
+            guint dropped;
+
+            vnr_sequence_get_stats (window->sequence, &fps, &dropped);
+            stats = g_strdup_printf (_("%s - %.1f/%i fps, %u dropped"), buf,
+                                     fps, window->prefs->sequence_fps, dropped);
+            g_free(buf);
+            buf = stats;
+        }
+
         gtk_window_set_title (GTK_WINDOW(window), buf);
 
         gint context_id = gtk_statusbar_get_context_id(GTK_STATUSBAR(window->statusbar), "statusbar");
@@ -1166,7 +1671,7 @@ window_drag_begin_cb (GtkWidget *widget,
 {
     gchar *uris[2];
 
-    uris[0] = g_filename_to_uri((gchar*)VNR_FILE(VNR_WINDOW(user_data)->file_list->data)->path, NULL, NULL);
+    uris[0] = g_filename_to_uri((gchar*)vnr_file_list_get_current(VNR_WINDOW(user_data)->file_list)->path, NULL, NULL);
     uris[1] = NULL;
 
     gtk_selection_data_set_uris (data, uris);
@@ -1310,38 +1815,66 @@ vnr_window_cmd_reload (GtkAction *action, VnrWindow *window)
 }
 
 
-static gboolean
-file_size_is_small(char *filename) {
+/* The preview of the open dialog, once its thumbnail is ready */
+static void
+preview_thumbnail_cb(const gchar *path, GdkPixbuf *thumbnail, gpointer data)
+{
+    GtkWidget *preview = GTK_WIDGET(data);
+    GtkWidget *chooser = gtk_widget_get_toplevel(preview);
 
-    struct stat st;
-    int four_mb = 4 * 1024 * 1024;
+    /* The dialog was closed, the preview going with it */
+    if(!GTK_IS_FILE_CHOOSER(chooser))
+        return;
 
-    if(filename != NULL && stat(filename, &st) == 0) {
-        return st.st_size < four_mb;
-    }
-    return FALSE;
+    gtk_image_set_from_pixbuf(GTK_IMAGE(preview), thumbnail);
+    gtk_file_chooser_set_preview_widget_active(GTK_FILE_CHOOSER(chooser),
+                                               thumbnail != NULL);
 }
 
 static void
-update_preview_cb(GtkFileChooser *file_chooser, gpointer data)
+preview_cancellable_free(GCancellable *cancellable)
 {
-    GtkWidget *preview = GTK_WIDGET(data);
-    char *filename = gtk_file_chooser_get_preview_filename(file_chooser);
-    gboolean has_preview = FALSE;
+    g_cancellable_cancel(cancellable);
+    g_object_unref(cancellable);
+}
 
-    if(file_size_is_small(filename)) {
-        GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_size(filename, 256, 256, NULL);
-        has_preview = pixbuf != NULL;
+static void
+update_preview_cb(GtkFileChooser *file_chooser, gpointer data)
+{
+    GtkWidget *preview = GTK_WIDGET(data);
+    char *filename = gtk_file_chooser_get_preview_filename(file_chooser);
+    GCancellable *cancellable;
+    GdkPixbuf *pixbuf = NULL;
 
-        gtk_image_set_from_pixbuf(GTK_IMAGE(preview), pixbuf);
-        if(pixbuf) {
-            g_object_unref(pixbuf);
-        }
-    }
-    gtk_file_chooser_set_preview_widget_active(file_chooser, has_preview);
-    if(filename != NULL) {
+    /* Replacing the cancellable of the last request cancels it */
+    g_object_set_data(G_OBJECT(preview), "vnr-preview-cancellable", NULL);
+
+    if(filename == NULL || !g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+        gtk_image_clear(GTK_IMAGE(preview));
+        gtk_file_chooser_set_preview_widget_active(file_chooser, FALSE);
         g_free(filename);
+        return;
     }
+
+    /* Thumbnails already made are shown at once, the others are made
+     * on the workers while a placeholder is shown */
+    pixbuf = vnr_thumbnails_lookup(filename, VNR_THUMBNAIL_LARGE);
+    if(pixbuf != NULL) {
+        gtk_image_set_from_pixbuf(GTK_IMAGE(preview), pixbuf);
+        g_object_unref(pixbuf);
+    } else {
+        gtk_image_set_from_icon_name(GTK_IMAGE(preview), "image-loading",
+                                     GTK_ICON_SIZE_DIALOG);
+
+        cancellable = g_cancellable_new();
+        g_object_set_data_full(G_OBJECT(preview), "vnr-preview-cancellable",
+                               cancellable,
+                               (GDestroyNotify) preview_cancellable_free);
+        vnr_thumbnails_request(filename, VNR_THUMBNAIL_LARGE, cancellable,
+                               preview_thumbnail_cb, preview);
+    }
+    gtk_file_chooser_set_preview_widget_active(file_chooser, TRUE);
+    g_free(filename);
 }
 
 static void
@@ -1378,13 +1911,16 @@ vnr_window_cmd_open(GtkAction *action, VnrWindow *window)
     gtk_file_chooser_set_filter (GTK_FILE_CHOOSER(dialog), img_filter);
 
     preview = gtk_image_new();
+    gtk_widget_set_size_request(preview,
+                                vnr_thumbnails_get_pixels(VNR_THUMBNAIL_LARGE),
+                                -1);
     gtk_file_chooser_set_preview_widget(GTK_FILE_CHOOSER(dialog), preview);
     g_signal_connect(GTK_FILE_CHOOSER(dialog), "update-preview",
                      G_CALLBACK(update_preview_cb), preview);
 
     if(window->file_list != NULL)
     {
-        gchar *dirname = g_path_get_dirname (VNR_FILE(window->file_list->data)->path);
+        gchar *dirname = g_path_get_dirname (vnr_file_list_get_current(window->file_list)->path);
         gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER(dialog), dirname);
         g_free(dirname);
     }
@@ -1415,7 +1951,7 @@ vnr_window_cmd_open_dir(GtkAction *action, VnrWindow *window)
 
     if(window->file_list != NULL)
     {
-        gchar *dirname = g_path_get_dirname (VNR_FILE(window->file_list->data)->path);
+        gchar *dirname = g_path_get_dirname (vnr_file_list_get_current(window->file_list)->path);
         gtk_file_chooser_set_current_folder (GTK_FILE_CHOOSER(dialog), dirname);
         g_free(dirname);
     }
@@ -1488,17 +2024,17 @@ vnr_set_wallpaper(GtkAction *action, VnrWindow *win)
                 execlp("gconftool-2", "gconftool-2",
                         "--set", "/desktop/gnome/background/picture_filename",
                         "--type", "string",
-                        VNR_FILE(win->file_list->data)->path,
+                        vnr_file_list_get_current(win->file_list)->path,
                         NULL);
                 break;
             case VNR_PREFS_DESKTOP_MATE:
                 execlp("gsettings", "gsettings",
                         "set", "org.mate.background",
-                        "picture-filename", VNR_FILE(win->file_list->data)->path,
+                        "picture-filename", vnr_file_list_get_current(win->file_list)->path,
                         NULL);
                 break;
             case VNR_PREFS_DESKTOP_GNOME3:
-                tmp = g_strdup_printf("file://%s", VNR_FILE(win->file_list->data)->path);
+                tmp = g_strdup_printf("file://%s", vnr_file_list_get_current(win->file_list)->path);
                 execlp("gsettings", "gsettings",
                         "set", "org.gnome.desktop.background",
                         "picture-uri", tmp,
@@ -1512,33 +2048,33 @@ vnr_set_wallpaper(GtkAction *action, VnrWindow *win)
                         "-p", tmp,
                         "--type", "string",
                         "--set",
-                        VNR_FILE(win->file_list->data)->path,
+                        vnr_file_list_get_current(win->file_list)->path,
                         NULL);
                 break;
             case VNR_PREFS_DESKTOP_LXDE:
                 execlp("pcmanfm", "pcmanfm",
                         "--set-wallpaper",
-                        VNR_FILE(win->file_list->data)->path,
+                        vnr_file_list_get_current(win->file_list)->path,
                         NULL);
                 break;
             case VNR_PREFS_DESKTOP_PUPPY:
                 execlp("set_bg", "set_bg",
-                        VNR_FILE(win->file_list->data)->path,
+                        vnr_file_list_get_current(win->file_list)->path,
                         NULL);
                 break;
             case VNR_PREFS_DESKTOP_FLUXBOX:
                 execlp("fbsetbg", "fbsetbg",
-                        "-f", VNR_FILE(win->file_list->data)->path,
+                        "-f", vnr_file_list_get_current(win->file_list)->path,
                         NULL);
                 break;
             case VNR_PREFS_DESKTOP_NITROGEN:
                 execlp("nitrogen", "nitrogen",
                         "--set-zoom-fill", "--save",
-                        VNR_FILE(win->file_list->data)->path,
+                        vnr_file_list_get_current(win->file_list)->path,
                         NULL);
                 break;
             case VNR_PREFS_DESKTOP_CINNAMON:
-                tmp = g_strdup_printf("file://%s", VNR_FILE(win->file_list->data)->path);
+                tmp = g_strdup_printf("file://%s", vnr_file_list_get_current(win->file_list)->path);
                 execlp("gsettings", "gsettings",
                         "set", "org.cinnamon.desktop.background",
                         "picture-uri", tmp,
@@ -1631,6 +2167,8 @@ vnr_window_cmd_slideshow (GtkAction *action, VnrWindow *window)
 
     if (slideshow && window->mode != VNR_WINDOW_MODE_SLIDESHOW)
     {
+        stop_grid(window, TRUE);
+
         /* ! Uncomment to force Fullscreen along with Slideshow */
         if(window->mode == VNR_WINDOW_MODE_NORMAL)
         {
@@ -1646,6 +2184,47 @@ vnr_window_cmd_slideshow (GtkAction *action, VnrWindow *window)
     }
 }
 
+static void
+vnr_window_cmd_sort (GtkAction *action, GtkRadioAction *current,
+                     VnrWindow *window)
+{
+    int order = gtk_radio_action_get_current_value (current);
+
+    vnr_prefs_set_sort_order (window->prefs, order);
+
+    if (window->file_list == NULL)
+        return;
+
+    /* The list is only permuted, the files stay in memory */
+    vnr_file_list_set_order (window->file_list, order);
+    vnr_readahead_cancel (window->readahead);
+    if (grid_is_shown (window))
+        vnr_grid_list_changed (VNR_GRID (window->grid));
+    zoom_changed_cb (UNI_IMAGE_VIEW (window->view), window);
+}
+
+static void
+vnr_window_cmd_sequence (GtkAction *action, VnrWindow *window)
+{
+    g_assert(window != NULL && VNR_IS_WINDOW(window));
+
+    if(gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (action)))
+        start_sequence(window);
+    else
+        stop_sequence(window, TRUE);
+}
+
+static void
+vnr_window_cmd_grid (GtkAction *action, VnrWindow *window)
+{
+    g_assert(window != NULL && VNR_IS_WINDOW(window));
+
+    if(gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (action)))
+        start_grid(window);
+    else
+        stop_grid(window, TRUE);
+}
+
 static void
 vnr_window_cmd_delete(GtkAction *action, VnrWindow *window)
 {
@@ -1659,6 +2238,8 @@ vnr_window_cmd_delete(GtkAction *action, VnrWindow *window)
     /* Used to get rid of the "may be used uninitialised" warning */
     markup = prompt = warning = NULL;
 
+    stop_sequence(window, FALSE);
+
     if(window->mode == VNR_WINDOW_MODE_SLIDESHOW)
     {
        stop_slideshow(window);
@@ -1677,7 +2258,7 @@ vnr_window_cmd_delete(GtkAction *action, VnrWindow *window)
 
     g_return_if_fail (window->file_list != NULL);
 
-    file_path = VNR_FILE(window->file_list->data)->path;
+    file_path = vnr_file_list_get_current(window->file_list)->path;
 
     if(window->prefs->confirm_delete)
     {
@@ -1686,7 +2267,7 @@ vnr_window_cmd_delete(GtkAction *action, VnrWindow *window)
         /* I18N: The '%s' is replaced with the name of the file to be deleted. */
         prompt = g_strdup_printf (_("Are you sure you want to\n"
                                     "permanently delete \"%s\"?"),
-                                  VNR_FILE(window->file_list->data)->display_name);
+                                  vnr_file_list_get_current(window->file_list)->display_name);
         markup = g_markup_printf_escaped ("<span weight=\"bold\" size=\"larger\">%s</span>\n\n%s",
                                           prompt, warning);
 
@@ -1722,26 +2303,14 @@ vnr_window_cmd_delete(GtkAction *action, VnrWindow *window)
         }
         else
         {
-            GList *next;
-
-            next = g_list_next(window->file_list);
-            if(next == NULL)
-                next = g_list_first(window->file_list);
-
-            if(g_list_length(g_list_first(window->file_list)) != 1)
-                window->file_list = g_list_delete_link (window->file_list, window->file_list);
-            else
-            {
-                g_list_free(window->file_list);
-                next = NULL;
-            }
+            vnr_file_list_remove_current(window->file_list);
 
-            if(next == NULL)
+            if(vnr_file_list_get_length(window->file_list) == 0)
             {
                 vnr_window_close(window);
                 gtk_action_group_set_sensitive(window->actions_collection, FALSE);
                 deny_slideshow(window);
-                vnr_window_set_list(window, NULL, FALSE);
+                vnr_window_set_list(window, NULL, TRUE);
                 vnr_message_area_show(VNR_MESSAGE_AREA (window->msg_area), TRUE,
                                       _("The given locations contain no images."),
                                       TRUE);
@@ -1753,7 +2322,7 @@ vnr_window_cmd_delete(GtkAction *action, VnrWindow *window)
             }
             else
             {
-                vnr_window_set_list(window, next, FALSE);
+                vnr_window_set_list(window, window->file_list, FALSE);
                 if(window->prefs->confirm_delete && !window->cursor_is_hidden)
                     gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(dlg)),
                                           gdk_cursor_new(GDK_WATCH));
@@ -1849,6 +2418,7 @@ static const GtkActionEntry action_entries_window[] = {
     { "View",  NULL, N_("_View") },
     { "Image",  NULL, N_("_Image") },
     { "Go",    NULL, N_("_Go") },
+    { "GoSort", NULL, N_("_Sort Images") },
     { "Help",  NULL, N_("_Help") },
 
     { "FileOpen", GTK_STOCK_FILE, N_("Open _Image..."), "<control>O",
@@ -1967,10 +2537,31 @@ static const GtkToggleActionEntry toggle_entries_window[] = {
       G_CALLBACK (vnr_window_cmd_statusbar) },
 };
 
+static const GtkRadioActionEntry radio_entries_sort[] = {
+    { "SortName", NULL, N_("By _Name"), NULL,
+      N_("Sort the images by name"),
+      VNR_FILE_LIST_ORDER_NAME },
+    { "SortDate", NULL, N_("By _Date Modified"), NULL,
+      N_("Sort the images by the time they were last modified"),
+      VNR_FILE_LIST_ORDER_MTIME },
+    { "SortSize", NULL, N_("By _Size"), NULL,
+      N_("Sort the images by file size"),
+      VNR_FILE_LIST_ORDER_SIZE },
+    { "SortType", NULL, N_("By _Type"), NULL,
+      N_("Sort the images by file extension"),
+      VNR_FILE_LIST_ORDER_EXTENSION },
+};
+
 static const GtkToggleActionEntry toggle_entries_collection[] = {
     { "ViewSlideshow", GTK_STOCK_NETWORK, N_("Sli_deshow"), "F5",
       N_("Show in slideshow mode"),
       G_CALLBACK (vnr_window_cmd_slideshow) },
+    { "ViewSequence", GTK_STOCK_MEDIA_PLAY, N_("Play as Se_quence"), "<control>F5",
+      N_("Play the images as the frames of a video"),
+      G_CALLBACK (vnr_window_cmd_sequence) },
+    { "ViewGrid", NULL, N_("_Thumbnails"), "<control>T",
+      N_("Show the images of the collection as thumbnails"),
+      G_CALLBACK (vnr_window_cmd_grid) },
 };
 
 static const GtkActionEntry action_entries_collection[] = {
@@ -2003,6 +2594,17 @@ vnr_window_key_press (GtkWidget *widget, GdkEventKey *event)
     toolbar_focus_child = gtk_container_get_focus_child(GTK_CONTAINER(window->toolbar));
     msg_area_focus_child = gtk_container_get_focus_child(GTK_CONTAINER(window->msg_area));
 
+    /* The grid moves its cursor with the keys the image is browsed with */
+    if (grid_is_shown(window))
+    {
+        if (event->keyval == GDK_KEY_Escape)
+        {
+            stop_grid(window, TRUE);
+            return TRUE;
+        }
+        return GTK_WIDGET_CLASS (vnr_window_parent_class)->key_press_event (widget, event);
+    }
+
     switch(event->keyval){
         case GDK_KEY_Left:
             if (event->state & GDK_MOD1_MASK)
@@ -2052,7 +2654,9 @@ vnr_window_key_press (GtkWidget *widget, GdkEventKey *event)
             break;
         case GDK_KEY_Escape:
         case 'q':
-            if(window->mode != VNR_WINDOW_MODE_NORMAL)
+            if(window->sequence != NULL)
+                stop_sequence(window, TRUE);
+            else if(window->mode != VNR_WINDOW_MODE_NORMAL)
                 vnr_window_unfullscreen(window);
             else
                 gtk_main_quit();
@@ -2153,6 +2757,19 @@ vnr_window_init (VnrWindow * window)
 
     window->writable_format_name = NULL;
     window->file_list = NULL;
+    window->dir_cancellable = NULL;
+    window->dir_monitor = NULL;
+    window->readahead = vnr_readahead_new ();
+    window->anim_loader = NULL;
+    window->load_context = NULL;
+    window->open_cancellable = NULL;
+    window->open_group = vnr_work_group_new (VNR_WORK_CURRENT,
+                                             (GFunc) vnr_window_open_job,
+                                             NULL, -1, NULL, NULL);
+    window->sequence = NULL;
+    window->grid = NULL;
+    window->grid_scroll = NULL;
+    window->grid_reopen = FALSE;
     window->fs_controls = NULL;
     window->fs_source = NULL;
     window->ss_timeout = 5;
@@ -2182,6 +2799,12 @@ vnr_window_init (VnrWindow * window)
                                   action_entries_window,
                                   G_N_ELEMENTS (action_entries_window),
                                   window);
+    gtk_action_group_add_radio_actions (window->actions_window,
+                                        radio_entries_sort,
+                                        G_N_ELEMENTS (radio_entries_sort),
+                                        window->prefs->sort_order,
+                                        G_CALLBACK (vnr_window_cmd_sort),
+                                        window);
 
     gtk_ui_manager_insert_action_group (window->ui_mngr,
                                         window->actions_window, 0);
@@ -2453,114 +3076,62 @@ gboolean
 vnr_window_open (VnrWindow * window, gboolean fit_to_screen)
 {
     VnrFile *file;
-    GdkPixbufAnimation *pixbuf;
-    GdkPixbufFormat *format;
-    UniFittingMode last_fit_mode;
+    VnrLoadContext *context;
+    GdkPixbufAnimation *pixbuf = NULL;
+    GdkPixbufFormat *format = NULL;
     GError *error = NULL;
 
     if(window->file_list == NULL)
         return FALSE;
 
-    file = VNR_FILE(window->file_list->data);
+    vnr_window_cancel_open (window);
+    file = vnr_file_list_get_current(window->file_list);
 
     update_fs_filename_label(window);
 
-    pixbuf = gdk_pixbuf_animation_new_from_file (file->path, &error);
-
-    if (error != NULL)
+    /* The file is read once; the format is told by the loader which
+     * then decodes it */
+    context = vnr_load_context_new (file->path, &error);
+    if (context != NULL)
     {
-        vnr_message_area_show(VNR_MESSAGE_AREA (window->msg_area),
-                              TRUE, error->message, TRUE);
-
-        if(gtk_widget_get_visible(window->props_dlg))
-            vnr_properties_dialog_clear(VNR_PROPERTIES_DIALOG(window->props_dlg));
-        return FALSE;
+        vnr_load_context_set_max_pixels (context,
+            (guint64) window->prefs->max_megapixels * 1000000);
+        format = vnr_load_context_get_format (context);
+        pixbuf = vnr_window_decode (context, format, NULL, &error);
     }
 
-    if(vnr_message_area_is_visible(VNR_MESSAGE_AREA(window->msg_area)))
-    {
-        vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
-    }
-
-    gtk_action_group_set_sensitive(window->actions_image, TRUE);
-    gtk_action_group_set_sensitive(window->action_wallpaper, TRUE);
-
-    format = gdk_pixbuf_get_file_info (file->path, NULL, NULL);
-
-    g_free(window->writable_format_name);
-    if(gdk_pixbuf_format_is_writable (format))
-        window->writable_format_name = gdk_pixbuf_format_get_name (format);
-    else
-        window->writable_format_name = NULL;
-
-    vnr_tools_apply_embedded_orientation (&pixbuf);
-    window->current_image_width = gdk_pixbuf_animation_get_width (pixbuf);
-    window->current_image_height = gdk_pixbuf_animation_get_height (pixbuf);
-    window->modifications = 0;
-
-    if(fit_to_screen)
-    {
-        gint img_h, img_w;          /* Width and Height of the pixbuf */
-
-        img_w = window->current_image_width;
-        img_h = window->current_image_height;
-
-        vnr_tools_fit_to_size (&img_w, &img_h, window->max_width, window->max_height);
-
-        gtk_window_resize (GTK_WINDOW (window), img_w, img_h + get_top_widgets_height(window));
-    }
-
-    last_fit_mode = UNI_IMAGE_VIEW(window->view)->fitting;
-
-    /* Return TRUE if the image is static */
-    if ( uni_anim_view_set_anim (UNI_ANIM_VIEW (window->view), pixbuf) )
-        gtk_action_group_set_sensitive(window->actions_static_image, TRUE);
-    else
-        gtk_action_group_set_sensitive(window->actions_static_image, FALSE);
-
-    if(window->mode != VNR_WINDOW_MODE_NORMAL && window->prefs->fit_on_fullscreen)
-    {
-        uni_image_view_set_zoom_mode (UNI_IMAGE_VIEW(window->view), VNR_PREFS_ZOOM_FIT);
-    }
-    else if(window->prefs->zoom == VNR_PREFS_ZOOM_LAST_USED )
-    {
-        uni_image_view_set_fitting (UNI_IMAGE_VIEW(window->view), last_fit_mode);
-        zoom_changed_cb(UNI_IMAGE_VIEW(window->view), window);
-    }
-    else
-    {
-        uni_image_view_set_zoom_mode (UNI_IMAGE_VIEW(window->view), window->prefs->zoom);
-    }
-
-    if ( window->prefs->auto_resize ) {
-        vnr_window_cmd_resize(NULL, window);
-    }
-
-    if(gtk_widget_get_visible(window->props_dlg))
-        vnr_properties_dialog_update(VNR_PROPERTIES_DIALOG(window->props_dlg));
-
-    vnr_window_update_openwith_menu (window);
-
-    g_object_unref(pixbuf);
-    return TRUE;
+    return vnr_window_show (window, context, format, pixbuf, error,
+                            fit_to_screen);
 }
 
 void
 vnr_window_open_from_list(VnrWindow *window, GSList *uri_list)
 {
-    GList *file_list = NULL;
+    VnrFileList *file_list = NULL;
     GError *error = NULL;
+    gboolean load_dir = FALSE;
+    gboolean load_paths = FALSE;
 
     if (g_slist_length(uri_list) == 1)
     {
-        vnr_file_load_single_uri (uri_list->data, &file_list, window->prefs->show_hidden, &error);
+        load_dir = vnr_file_load_single_image (uri_list->data, &file_list, window->prefs->show_hidden);
+        if (!load_dir && window->prefs->recursive)
+            load_paths = g_file_test (uri_list->data, G_FILE_TEST_IS_DIR);
+        if (!load_dir && !load_paths)
+            vnr_file_load_single_uri (uri_list->data, &file_list, window->prefs->show_hidden, &error);
     }
     else
     {
-        vnr_file_load_uri_list (uri_list, &file_list, window->prefs->show_hidden, &error);
+        load_paths = TRUE;
     }
 
-    if(error != NULL && file_list != NULL)
+    if(load_paths)
+    {
+        vnr_window_close(window);
+        vnr_window_set_list(window, NULL, TRUE);
+        vnr_window_load_paths_async(window, uri_list, window->prefs->recursive);
+    }
+    else if(error != NULL && file_list != NULL)
     {
         vnr_window_close(window);
         gtk_action_group_set_sensitive(window->actions_collection, FALSE);
@@ -2600,13 +3171,25 @@ vnr_window_open_from_list(VnrWindow *window, GSList *uri_list)
         if(!window->cursor_is_hidden)
             gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
                                   gdk_cursor_new(GDK_LEFT_PTR));
+
+        if(load_dir)
+            vnr_window_load_dir_async(window, uri_list->data);
+        if(g_slist_length(uri_list) == 1)
+            vnr_window_watch_dir(window, uri_list->data);
     }
 }
 
 void
 vnr_window_close(VnrWindow *window)
 {
+    stop_sequence(window, FALSE);
+    stop_grid(window, FALSE);
     gtk_window_set_title (GTK_WINDOW (window), "Viewnior");
+    vnr_window_cancel_open (window);
+    vnr_anim_loader_free (window->anim_loader);
+    window->anim_loader = NULL;
+    vnr_load_context_unref (window->load_context);
+    window->load_context = NULL;
     uni_anim_view_set_anim (UNI_ANIM_VIEW (window->view), NULL);
     gtk_action_group_set_sensitive(window->actions_image, FALSE);
     gtk_action_group_set_sensitive(window->action_wallpaper, FALSE);
@@ -2614,11 +3197,34 @@ vnr_window_close(VnrWindow *window)
 }
 
 void
-vnr_window_set_list (VnrWindow *window, GList *list, gboolean free_current)
+vnr_window_set_list (VnrWindow *window, VnrFileList *list, gboolean free_current)
 {
-    if (free_current == TRUE && window->file_list != NULL)
-        g_list_free (window->file_list);
-    if (g_list_length(g_list_first(list)) > 1)
+    stop_sequence(window, FALSE);
+    if (window->file_list != list || list == NULL)
+        stop_grid(window, FALSE);
+
+    /* The directory being read belongs to the list being replaced */
+    if ((free_current || list == NULL) && window->dir_cancellable != NULL)
+    {
+        g_cancellable_cancel (window->dir_cancellable);
+        g_object_unref (window->dir_cancellable);
+        window->dir_cancellable = NULL;
+    }
+
+    /* The monitor applies changes to the list being replaced */
+    if (window->file_list != list || list == NULL)
+    {
+        vnr_dir_monitor_free (window->dir_monitor);
+        window->dir_monitor = NULL;
+        vnr_readahead_cancel (window->readahead);
+        vnr_window_cancel_open (window);
+    }
+
+    if (free_current == TRUE && window->file_list != list)
+        vnr_file_list_free (window->file_list);
+    if (list != NULL)
+        vnr_file_list_set_order (list, window->prefs->sort_order);
+    if (vnr_file_list_get_length(list) > 1)
     {
         gtk_action_group_set_sensitive(window->actions_collection, TRUE);
         allow_slideshow(window);
@@ -2631,36 +3237,195 @@ vnr_window_set_list (VnrWindow *window, GList *list, gboolean free_current)
     window->file_list = list;
 }
 
+static void
+dir_batch_cb (VnrFileList *batch, gboolean done, VnrWindow *window)
+{
+    if (batch != NULL && window->file_list == NULL)
+    {
+        /* First images of a tree: show one while the rest is read */
+        vnr_window_set_list(window, batch, FALSE);
+        vnr_window_close(window);
+        vnr_window_open(window, FALSE);
+    }
+    else if (batch != NULL)
+    {
+        vnr_file_list_merge (window->file_list, batch);
+        if (grid_is_shown (window))
+            vnr_grid_list_changed (VNR_GRID (window->grid));
+
+        if (vnr_file_list_get_length(window->file_list) > 1)
+        {
+            gtk_action_group_set_sensitive(window->actions_collection, TRUE);
+            allow_slideshow(window);
+        }
+
+        /* Update the position shown in the title */
+        zoom_changed_cb (UNI_IMAGE_VIEW (window->view), window);
+    }
+
+    if (done)
+    {
+        g_object_unref (window->dir_cancellable);
+        window->dir_cancellable = NULL;
+
+        if (window->file_list == NULL)
+            vnr_message_area_show(VNR_MESSAGE_AREA (window->msg_area), TRUE,
+                                  _("The given locations contain no images."),
+                                  TRUE);
+    }
+}
+
+static void
+dir_changed_cb (gboolean current_changed, VnrWindow *window)
+{
+    if (vnr_file_list_get_length(window->file_list) == 0)
+    {
+        vnr_window_close(window);
+        gtk_action_group_set_sensitive(window->actions_collection, FALSE);
+        deny_slideshow(window);
+        vnr_window_set_list(window, NULL, TRUE);
+        vnr_message_area_show(VNR_MESSAGE_AREA (window->msg_area), TRUE,
+                              _("The given locations contain no images."),
+                              TRUE);
+
+        if(gtk_widget_get_visible(window->props_dlg))
+            vnr_properties_dialog_clear(VNR_PROPERTIES_DIALOG(window->props_dlg));
+        return;
+    }
+
+    if (vnr_file_list_get_length(window->file_list) > 1)
+    {
+        gtk_action_group_set_sensitive(window->actions_collection, TRUE);
+        allow_slideshow(window);
+    }
+    else
+    {
+        gtk_action_group_set_sensitive(window->actions_collection, FALSE);
+        deny_slideshow(window);
+    }
+
+    if (grid_is_shown (window))
+    {
+        vnr_grid_list_changed (VNR_GRID (window->grid));
+        window->grid_reopen |= current_changed;
+        return;
+    }
+
+    /* Only the image shown is reloaded, and only if it was replaced or
+     * modified. A running sequence shows its own frames. */
+    if (current_changed && window->sequence == NULL)
+    {
+        vnr_window_close(window);
+        vnr_window_open(window, FALSE);
+    }
+    else
+        zoom_changed_cb (UNI_IMAGE_VIEW (window->view), window);
+}
+
+/**
+ * vnr_window_watch_dir:
+ * @window: a #VnrWindow
+ * @path: the file or directory the list of @window was made from
+ *
+ * Keeps the list up to date as files are added to, removed from or
+ * modified in the directory of @path, or @path itself if it is a
+ * directory.
+ **/
+void
+vnr_window_watch_dir (VnrWindow *window, const gchar *path)
+{
+    gchar *dir;
+
+    vnr_dir_monitor_free (window->dir_monitor);
+    window->dir_monitor = NULL;
+
+    if (window->file_list == NULL)
+        return;
+
+    if (g_file_test (path, G_FILE_TEST_IS_DIR))
+        dir = g_strdup (path);
+    else
+        dir = g_path_get_dirname (path);
+
+    window->dir_monitor = vnr_dir_monitor_new (dir, window->file_list,
+                                               window->prefs->show_hidden,
+                                               (VnrDirMonitorFunc)dir_changed_cb,
+                                               window);
+    g_free (dir);
+}
+
+/* Cancels the reading of a directory still going on */
+static void
+restart_dir_load (VnrWindow *window)
+{
+    if (window->dir_cancellable != NULL)
+    {
+        g_cancellable_cancel (window->dir_cancellable);
+        g_object_unref (window->dir_cancellable);
+    }
+    window->dir_cancellable = g_cancellable_new ();
+}
+
+/**
+ * vnr_window_load_dir_async:
+ * @window: a #VnrWindow
+ * @path: the image making up the list of @window
+ *
+ * Adds the other images in the directory of @path to the list, as
+ * they are found. Navigation is enabled as soon as there is more than
+ * one image.
+ **/
+void
+vnr_window_load_dir_async (VnrWindow *window, const gchar *path)
+{
+    gchar *dir;
+
+    restart_dir_load (window);
+
+    dir = g_path_get_dirname (path);
+    vnr_file_load_dir_async (dir, window->prefs->show_hidden,
+                             window->dir_cancellable,
+                             (VnrFileBatchFunc)dir_batch_cb, window);
+    g_free (dir);
+}
+
+/**
+ * vnr_window_load_paths_async:
+ * @window: a #VnrWindow, whose list was cleared
+ * @paths: a list of paths to files and directories
+ * @recursive: whether to list the subdirectories of directories too
+ *
+ * Lists the images among @paths and in the directories among them,
+ * as they are found. The first ones found are shown right away.
+ **/
+void
+vnr_window_load_paths_async (VnrWindow *window, GSList *paths,
+                             gboolean recursive)
+{
+    restart_dir_load (window);
+
+    vnr_file_load_paths_async (paths, window->prefs->show_hidden, recursive,
+                               window->dir_cancellable,
+                               (VnrFileBatchFunc)dir_batch_cb, window);
+}
+
 gboolean
 vnr_window_next (VnrWindow *window, gboolean rem_timeout){
-    GList *next;
+    stop_sequence(window, FALSE);
+    stop_grid(window, FALSE);
 
     /* Don't reload current image
      * if the list contains only one (or no) image */
-    if (g_list_length(g_list_first(window->file_list)) <2)
+    if (vnr_file_list_get_length(window->file_list) <2)
         return FALSE;
 
     if(window->mode == VNR_WINDOW_MODE_SLIDESHOW && rem_timeout)
         g_source_remove (window->ss_source_tag);
 
-    next = g_list_next(window->file_list);
-    if(next == NULL)
-    {
-        next = g_list_first(window->file_list);
-    }
-
-    window->file_list = next;
+    vnr_file_list_next(window->file_list);
 
-    if(!window->cursor_is_hidden)
-        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
-                              gdk_cursor_new(GDK_WATCH));
-    /* This makes the cursor show NOW */
-    gdk_flush();
-
-    vnr_window_open(window, FALSE);
-    if(!window->cursor_is_hidden)
-        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
-                              gdk_cursor_new(GDK_LEFT_PTR));
+    vnr_window_request_open(window);
+    vnr_readahead_update(window->readahead, window->file_list, 1);
 
     if(window->mode == VNR_WINDOW_MODE_SLIDESHOW && rem_timeout)
         window->ss_source_tag = g_timeout_add_seconds (window->ss_timeout,
@@ -2672,34 +3437,21 @@ vnr_window_next (VnrWindow *window, gboolean rem_timeout){
 
 gboolean
 vnr_window_prev (VnrWindow *window){
-    GList *prev;
+    stop_sequence(window, FALSE);
+    stop_grid(window, FALSE);
 
     /* Don't reload current image
      * if the list contains only one (or no) image */
-    if (g_list_length(g_list_first(window->file_list)) <2)
+    if (vnr_file_list_get_length(window->file_list) <2)
         return FALSE;
 
     if(window->mode == VNR_WINDOW_MODE_SLIDESHOW)
         g_source_remove (window->ss_source_tag);
 
-    prev = g_list_previous(window->file_list);
-    if(prev == NULL)
-    {
-        prev = g_list_last(window->file_list);
-    }
+    vnr_file_list_prev(window->file_list);
 
-    window->file_list = prev;
-
-    if(!window->cursor_is_hidden)
-        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
-                              gdk_cursor_new(GDK_WATCH));
-    /* This makes the cursor show NOW */
-    gdk_flush();
-
-    vnr_window_open(window, FALSE);
-    if(!window->cursor_is_hidden)
-        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
-                              gdk_cursor_new(GDK_LEFT_PTR));
+    vnr_window_request_open(window);
+    vnr_readahead_update(window->readahead, window->file_list, -1);
 
     if(window->mode == VNR_WINDOW_MODE_SLIDESHOW)
         window->ss_source_tag = g_timeout_add_seconds (window->ss_timeout,
@@ -2709,56 +3461,43 @@ vnr_window_prev (VnrWindow *window){
     return TRUE;
 }
 
+/**
+ * vnr_window_goto:
+ * @window: a #VnrWindow
+ * @position: the position of an image in the list, starting at 0
+ *
+ * Moves to the image at @position, which is shown once decoded.
+ **/
 gboolean
-vnr_window_first (VnrWindow *window){
-    GList *prev;
+vnr_window_goto (VnrWindow *window, guint position){
+    stop_sequence(window, FALSE);
+    stop_grid(window, FALSE);
 
-    prev = g_list_first(window->file_list);
+    if (position >= vnr_file_list_get_length(window->file_list))
+        return FALSE;
 
     if(vnr_message_area_is_critical(VNR_MESSAGE_AREA(window->msg_area)))
     {
         vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
     }
 
-    window->file_list = prev;
+    /* A jump leaves what was read ahead behind */
+    vnr_readahead_cancel(window->readahead);
+    vnr_file_list_set_position(window->file_list, position);
 
-    if(!window->cursor_is_hidden)
-        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
-                              gdk_cursor_new(GDK_WATCH));
-    /* This makes the cursor show NOW */
-    gdk_flush();
-
-    vnr_window_open(window, FALSE);
-    if(!window->cursor_is_hidden)
-        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
-                              gdk_cursor_new(GDK_LEFT_PTR));
+    vnr_window_request_open(window);
+    vnr_readahead_update(window->readahead, window->file_list, 1);
     return TRUE;
 }
 
 gboolean
-vnr_window_last (VnrWindow *window){
-    GList *prev;
-
-    prev = g_list_last(window->file_list);
-
-    if(vnr_message_area_is_critical(VNR_MESSAGE_AREA(window->msg_area)))
-    {
-        vnr_message_area_hide(VNR_MESSAGE_AREA(window->msg_area));
-    }
-
-    window->file_list = prev;
-
-    if(!window->cursor_is_hidden)
-        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
-                              gdk_cursor_new(GDK_WATCH));
-    /* This makes the cursor show NOW */
-    gdk_flush();
+vnr_window_first (VnrWindow *window){
+    return vnr_window_goto(window, 0);
+}
 
-    vnr_window_open(window, FALSE);
-    if(!window->cursor_is_hidden)
-        gdk_window_set_cursor(gtk_widget_get_window(GTK_WIDGET(window)),
-                              gdk_cursor_new(GDK_LEFT_PTR));
-    return TRUE;
+gboolean
+vnr_window_last (VnrWindow *window){
+    return vnr_window_goto(window, vnr_file_list_get_length(window->file_list) - 1);
 }
 
 void
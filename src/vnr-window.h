@@ -24,6 +24,12 @@
 #include <glib-object.h>
 #include <gtk/gtk.h>
 #include "vnr-prefs.h"
+#include "vnr-anim-loader.h"
+#include "vnr-sequence.h"
+#include "vnr-file-list.h"
+#include "vnr-dir-monitor.h"
+#include "vnr-readahead.h"
+#include "vnr-workers.h"
 
 G_BEGIN_DECLS
 
@@ -74,8 +80,20 @@ struct _VnrWindow {
 
     GtkWidget *view;
     GtkWidget *scroll_view;
-
-    GList *file_list;
+    VnrAnimLoader *anim_loader;
+    /* Bytes of the current image, shared by everything reading it */
+    VnrLoadContext *load_context;
+    /* Pending request to show the current image, decoded by a worker */
+    VnrWorkGroup *open_group;
+    GCancellable *open_cancellable;
+
+    VnrFileList *file_list;
+    /* Reading of the rest of the directory, after opening one image */
+    GCancellable *dir_cancellable;
+    /* Keeps the list in sync with the directory it was read from */
+    VnrDirMonitor *dir_monitor;
+    /* Gets the next files into the page cache while one is shown */
+    VnrReadahead *readahead;
 
     VnrPrefs *prefs;
 
@@ -103,6 +121,15 @@ struct _VnrWindow {
     guint ss_source_tag;
     gint ss_timeout;
     GtkWidget *ss_timeout_widget;
+    /* Sequence player, while the collection is played as a video */
+    VnrSequence *sequence;
+    /* Contact sheet of the collection, NULL until first shown */
+    GtkWidget *grid;
+    GtkWidget *grid_scroll;
+    /* State of the image shown, put back when leaving the grid */
+    gboolean grid_reopen;
+    gboolean grid_image_sensitive;
+    gboolean grid_static_image_sensitive;
 
     GtkActionGroup *action_wallpaper;
 };
@@ -121,11 +148,16 @@ gboolean vnr_window_open     (VnrWindow *win, gboolean fit_to_screen);
 void     vnr_window_open_from_list (VnrWindow *window, GSList *uri_list);
 void     vnr_window_close    (VnrWindow *win);
 
-void     vnr_window_set_list (VnrWindow *win, GList *list, gboolean free_current);
+void     vnr_window_set_list (VnrWindow *win, VnrFileList *list, gboolean free_current);
+void     vnr_window_load_dir_async (VnrWindow *window, const gchar *path);
+void     vnr_window_load_paths_async (VnrWindow *window, GSList *paths,
+                                      gboolean recursive);
+void     vnr_window_watch_dir (VnrWindow *window, const gchar *path);
 gboolean vnr_window_next     (VnrWindow *win, gboolean rem_timeout);
 gboolean vnr_window_prev     (VnrWindow *win);
 gboolean vnr_window_first    (VnrWindow *win);
 gboolean vnr_window_last     (VnrWindow *win);
+gboolean vnr_window_goto     (VnrWindow *win, guint position);
 void     deny_slideshow      (VnrWindow *window);
 void     vnr_window_apply_preferences (VnrWindow *window);
 void     vnr_window_toggle_fullscreen (VnrWindow *win);
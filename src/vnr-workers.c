@@ -0,0 +1,390 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <unistd.h>
+#include "vnr-workers.h"
+
+#define VNR_WORKERS_MAX 32
+
+/* Interval at which the statistics are printed when debugging, in
+ * seconds. */
+#define VNR_WORKERS_LOG_INTERVAL 5
+
+/**
+ * VnrWorkGroup:
+ *
+ * Jobs of one kind, run by the process-wide workers, like a
+ * #GThreadPool sharing its threads with all the others. Every group
+ * belongs to a priority class; free workers serve the most urgent
+ * class first, and the groups of a class in turn.
+ *
+ * Jobs queued when the cancellable of the group is cancelled are
+ * dropped rather than run. Waiting for a group runs its queued jobs
+ * on the waiting thread, so a worker may wait for a group of its own
+ * without tying up the pool.
+ **/
+struct _VnrWorkGroup {
+    VnrWorkPriority priority;
+    GFunc func;
+    gpointer user_data;
+    guint max_threads;
+    GDestroyNotify destroy;
+    GCancellable *cancellable;
+
+    /* Guarded by the lock of the workers */
+    GQueue queue;
+    guint running;
+    gboolean waiting;
+    /* Freed by its owner, to be destroyed once idle */
+    gboolean orphaned;
+};
+
+typedef struct {
+    gpointer data;
+    gint64 queued;
+} VnrWork;
+
+static struct {
+    GMutex lock;
+    /* Signalled when there is work, and when jobs of a group end */
+    GCond work_cond;
+    GCond done_cond;
+
+    /* Live groups of each class, in the order they take turns */
+    GQueue groups[VNR_WORK_N_PRIORITIES];
+    VnrWorkStats stats[VNR_WORK_N_PRIORITIES];
+    guint n_threads;
+} workers;
+
+static GOnce workers_once = G_ONCE_INIT;
+
+/*************************************************************/
+/***** Private actions ***************************************/
+/*************************************************************/
+
+static gboolean
+vnr_workers_log_stats (gpointer user_data)
+{
+    static const gchar *names[VNR_WORK_N_PRIORITIES] = {
+        "current", "neighbour", "thumbnail", "metadata", "warming"
+    };
+    guint p;
+
+    for (p = 0; p < VNR_WORK_N_PRIORITIES; p++)
+    {
+        VnrWorkStats stats;
+        guint64 started;
+
+        vnr_workers_get_stats (p, &stats);
+        started = MAX (stats.done + stats.running, 1);
+        g_printerr ("workers: %-9s queued %u, running %u, done %"
+                    G_GUINT64_FORMAT ", dropped %" G_GUINT64_FORMAT
+                    ", wait %.1f ms (max %.1f), run %.1f ms\n",
+                    names[p], stats.queued, stats.running, stats.done,
+                    stats.dropped, stats.wait_total / 1000.0 / started,
+                    stats.wait_max / 1000.0,
+                    stats.run_total / 1000.0 / MAX (stats.done, 1));
+    }
+    return TRUE;
+}
+
+/* Takes the next job to run, in a group that is below its share of
+ * the workers. Called with the lock held. */
+static VnrWorkGroup *
+vnr_workers_pick (VnrWork **work)
+{
+    guint p;
+
+    for (p = 0; p < VNR_WORK_N_PRIORITIES; p++)
+    {
+        GList *link;
+
+        for (link = workers.groups[p].head; link != NULL; link = link->next)
+        {
+            VnrWorkGroup *group = link->data;
+
+            if (group->queue.length == 0 ||
+                group->running >= group->max_threads)
+                continue;
+
+            *work = g_queue_pop_head (&group->queue);
+            g_queue_unlink (&workers.groups[p], link);
+            g_queue_push_tail_link (&workers.groups[p], link);
+            return group;
+        }
+    }
+    return NULL;
+}
+
+static void
+vnr_work_group_destroy (VnrWorkGroup *group)
+{
+    g_queue_remove (&workers.groups[group->priority], group);
+    if (group->cancellable != NULL)
+        g_object_unref (group->cancellable);
+    g_slice_free (VnrWorkGroup, group);
+}
+
+/* Runs @work, or drops it if its group was cancelled. Called with the
+ * lock held, which is released meanwhile. */
+static void
+vnr_workers_run (VnrWorkGroup *group, VnrWork *work)
+{
+    VnrWorkStats *stats = &workers.stats[group->priority];
+    gint64 start = g_get_monotonic_time ();
+    gboolean drop;
+
+    drop = group->cancellable != NULL &&
+           g_cancellable_is_cancelled (group->cancellable);
+
+    stats->queued--;
+    group->running++;
+    if (!drop)
+    {
+        stats->running++;
+        stats->wait_total += start - work->queued;
+        stats->wait_max = MAX (stats->wait_max, start - work->queued);
+    }
+    g_mutex_unlock (&workers.lock);
+
+    if (!drop)
+        group->func (work->data, group->user_data);
+    else if (group->destroy != NULL)
+        group->destroy (work->data);
+    g_slice_free (VnrWork, work);
+
+    g_mutex_lock (&workers.lock);
+    group->running--;
+    if (drop)
+    {
+        stats->dropped++;
+    }
+    else
+    {
+        stats->running--;
+        stats->done++;
+        stats->run_total += g_get_monotonic_time () - start;
+    }
+
+    /* A worker skipping the group for being busy may take it now */
+    if (group->queue.length != 0)
+        g_cond_signal (&workers.work_cond);
+    if (group->waiting)
+        g_cond_broadcast (&workers.done_cond);
+    else if (group->orphaned && group->running == 0 &&
+             group->queue.length == 0)
+        vnr_work_group_destroy (group);
+}
+
+static gpointer
+vnr_workers_main (gpointer data)
+{
+    g_mutex_lock (&workers.lock);
+    for (;;)
+    {
+        VnrWork *work;
+        VnrWorkGroup *group = vnr_workers_pick (&work);
+
+        if (group != NULL)
+            vnr_workers_run (group, work);
+        else
+            g_cond_wait (&workers.work_cond, &workers.lock);
+    }
+    return NULL;
+}
+
+static gpointer
+vnr_workers_init (gpointer data)
+{
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    guint i;
+
+    g_mutex_init (&workers.lock);
+    g_cond_init (&workers.work_cond);
+    g_cond_init (&workers.done_cond);
+    for (i = 0; i < VNR_WORK_N_PRIORITIES; i++)
+        g_queue_init (&workers.groups[i]);
+
+    /* Jobs wait on the disk about as much as they decode, so there are
+     * more workers than processors. */
+    workers.n_threads = CLAMP (2 * cpus, 4, VNR_WORKERS_MAX);
+    for (i = 0; i < workers.n_threads; i++)
+        g_thread_unref (g_thread_new ("vnr-worker", vnr_workers_main, NULL));
+
+    if (g_getenv ("VIEWNIOR_DEBUG_WORKERS") != NULL)
+        g_timeout_add_seconds (VNR_WORKERS_LOG_INTERVAL,
+                               vnr_workers_log_stats, NULL);
+    return NULL;
+}
+
+/*************************************************************/
+/***** Constructors ******************************************/
+/*************************************************************/
+
+/**
+ * vnr_work_group_new:
+ * @priority: the class of the jobs
+ * @func: the function running a job
+ * @user_data: data passed to @func along with each job
+ * @max_threads: the most workers running jobs of the group at once,
+ *   or -1 for no limit
+ * @destroy: function freeing the data of a job which is dropped, or
+ *   %NULL
+ * @cancellable: a #GCancellable dropping the queued jobs, or %NULL
+ * @returns: a new #VnrWorkGroup
+ **/
+VnrWorkGroup *
+vnr_work_group_new (VnrWorkPriority priority, GFunc func, gpointer user_data,
+                    gint max_threads, GDestroyNotify destroy,
+                    GCancellable *cancellable)
+{
+    VnrWorkGroup *group = g_slice_new0 (VnrWorkGroup);
+
+    g_once (&workers_once, vnr_workers_init, NULL);
+
+    group->priority = priority;
+    group->func = func;
+    group->user_data = user_data;
+    group->max_threads = max_threads < 0 ? G_MAXUINT : MAX (max_threads, 1);
+    group->destroy = destroy;
+    group->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+    g_queue_init (&group->queue);
+
+    g_mutex_lock (&workers.lock);
+    g_queue_push_tail (&workers.groups[priority], group);
+    g_mutex_unlock (&workers.lock);
+    return group;
+}
+
+/**
+ * vnr_work_group_free:
+ * @group: a #VnrWorkGroup
+ * @immediate: whether to drop the queued jobs rather than run them
+ * @wait: whether to return only once the jobs are over
+ *
+ * Like g_thread_pool_free(). When waiting, the queued jobs are run on
+ * the calling thread as well as by the workers.
+ **/
+void
+vnr_work_group_free (VnrWorkGroup *group, gboolean immediate, gboolean wait)
+{
+    GDestroyNotify destroy = group->destroy;
+    GQueue dropped = G_QUEUE_INIT;
+    VnrWork *work;
+
+    g_mutex_lock (&workers.lock);
+
+    if (immediate)
+    {
+        workers.stats[group->priority].queued -= group->queue.length;
+        workers.stats[group->priority].dropped += group->queue.length;
+        dropped = group->queue;
+        g_queue_init (&group->queue);
+    }
+
+    if (wait)
+    {
+        group->waiting = TRUE;
+        while (group->running != 0 || group->queue.length != 0)
+        {
+            if (group->queue.length != 0 &&
+                group->running < group->max_threads)
+                vnr_workers_run (group, g_queue_pop_head (&group->queue));
+            else
+                g_cond_wait (&workers.done_cond, &workers.lock);
+        }
+        vnr_work_group_destroy (group);
+    }
+    else if (group->running == 0 && group->queue.length == 0)
+    {
+        vnr_work_group_destroy (group);
+    }
+    else
+    {
+        group->orphaned = TRUE;
+    }
+    g_mutex_unlock (&workers.lock);
+
+    while ((work = g_queue_pop_head (&dropped)) != NULL)
+    {
+        if (destroy != NULL)
+            destroy (work->data);
+        g_slice_free (VnrWork, work);
+    }
+}
+
+/*************************************************************/
+/***** Actions ***********************************************/
+/*************************************************************/
+
+/**
+ * vnr_work_group_push:
+ * @group: a #VnrWorkGroup
+ * @data: the job to queue
+ *
+ * Queues @data to be passed to the function of @group by a worker.
+ **/
+void
+vnr_work_group_push (VnrWorkGroup *group, gpointer data)
+{
+    VnrWork *work = g_slice_new (VnrWork);
+
+    work->data = data;
+    work->queued = g_get_monotonic_time ();
+
+    g_mutex_lock (&workers.lock);
+    g_queue_push_tail (&group->queue, work);
+    workers.stats[group->priority].queued++;
+    g_cond_signal (&workers.work_cond);
+    g_mutex_unlock (&workers.lock);
+}
+
+/*************************************************************/
+/***** Read-only properties **********************************/
+/*************************************************************/
+
+/**
+ * vnr_workers_get_n_threads:
+ * @returns: the number of workers shared by all groups
+ **/
+guint
+vnr_workers_get_n_threads (void)
+{
+    g_once (&workers_once, vnr_workers_init, NULL);
+    return workers.n_threads;
+}
+
+/**
+ * vnr_workers_get_stats:
+ * @priority: a priority class
+ * @stats: return location for the statistics of @priority
+ *
+ * Setting VIEWNIOR_DEBUG_WORKERS in the environment prints these
+ * every few seconds.
+ **/
+void
+vnr_workers_get_stats (VnrWorkPriority priority, VnrWorkStats *stats)
+{
+    g_once (&workers_once, vnr_workers_init, NULL);
+
+    g_mutex_lock (&workers.lock);
+    *stats = workers.stats[priority];
+    g_mutex_unlock (&workers.lock);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __VNR_WORKERS_H__
+#define __VNR_WORKERS_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VnrWorkGroup VnrWorkGroup;
+typedef struct _VnrWorkStats VnrWorkStats;
+
+/**
+ * VnrWorkPriority:
+ *
+ * Classes of background work, most urgent first. A free worker always
+ * takes a job of the most urgent class that has one queued.
+ **/
+typedef enum {
+    /* The image on screen, or work its caller is blocked on */
+    VNR_WORK_CURRENT,
+    /* Images likely to be shown next */
+    VNR_WORK_NEIGHBOUR,
+    /* Thumbnails in view */
+    VNR_WORK_THUMBNAIL,
+    /* Listing files and reading what is known about them */
+    VNR_WORK_METADATA,
+    /* Filling caches ahead of any need */
+    VNR_WORK_WARMING,
+    VNR_WORK_N_PRIORITIES
+} VnrWorkPriority;
+
+/**
+ * VnrWorkStats:
+ *
+ * What the workers did with the jobs of one priority class since
+ * startup. Times are in microseconds.
+ **/
+struct _VnrWorkStats {
+    guint queued;
+    guint running;
+    guint64 done;
+    /* Jobs dropped before they started */
+    guint64 dropped;
+    /* Time jobs spent queued before starting, and running */
+    gint64 wait_total;
+    gint64 wait_max;
+    gint64 run_total;
+};
+
+/* Constructors */
+VnrWorkGroup *vnr_work_group_new  (VnrWorkPriority priority, GFunc func,
+                                   gpointer user_data, gint max_threads,
+                                   GDestroyNotify destroy,
+                                   GCancellable *cancellable);
+void          vnr_work_group_free (VnrWorkGroup *group, gboolean immediate,
+                                   gboolean wait);
+
+/* Actions */
+void          vnr_work_group_push (VnrWorkGroup *group, gpointer data);
+
+/* Read-only properties */
+guint         vnr_workers_get_n_threads (void);
+void          vnr_workers_get_stats     (VnrWorkPriority priority,
+                                         VnrWorkStats *stats);
+
+G_END_DECLS
+#endif /* __VNR_WORKERS_H__ */
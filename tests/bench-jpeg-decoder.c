@@ -0,0 +1,216 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Times the decoding of a JPEG file with restart markers in bands on
+ * the workers against decoding it whole on one thread, the way
+ * gdk-pixbuf does. The file is made up unless one is given:
+ *
+ *   bench-jpeg-decoder [--runs N] [--size WxH] [FILE]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <jpeglib.h>
+#include <gtk/gtk.h>
+#include "vnr-jpeg-decoder.h"
+#include "vnr-workers.h"
+
+static gint runs = 5;
+static gchar *size = NULL;
+static gchar **files = NULL;
+
+static GOptionEntry opt_entries[] = {
+    {"runs", 'n', 0, G_OPTION_ARG_INT, &runs, "Times each decoder is run", "N"},
+    {"size", 's', 0, G_OPTION_ARG_STRING, &size, "Size of the made up image", "WxH"},
+    {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files, NULL, "[FILE]"},
+    {NULL}
+};
+
+/* Makes up a photo sized image, with a restart marker at each row of
+ * MCUs, as cameras write them */
+static guchar *
+make_jpeg (gint width, gint height, gsize *length)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *data = NULL;
+    unsigned long data_length = 0;
+    guchar *row;
+    gint x;
+
+    cinfo.err = jpeg_std_error (&jerr);
+    jpeg_create_compress (&cinfo);
+    jpeg_mem_dest (&cinfo, &data, &data_length);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults (&cinfo);
+    jpeg_set_quality (&cinfo, 90, TRUE);
+    cinfo.restart_in_rows = 1;
+
+    row = g_malloc ((gsize) width * 3);
+    jpeg_start_compress (&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        gint y = cinfo.next_scanline;
+        JSAMPROW rows = row;
+
+        for (x = 0; x < width * 3; x++)
+            row[x] = (x * 7 + y * 3 + ((x / 3) ^ y)) & 0xff;
+        jpeg_write_scanlines (&cinfo, &rows, 1);
+    }
+    jpeg_finish_compress (&cinfo);
+    jpeg_destroy_compress (&cinfo);
+    g_free (row);
+
+    *length = data_length;
+    return data;
+}
+
+static GdkPixbuf *
+decode_whole (const guchar *data, gsize length)
+{
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new_with_type ("jpeg", NULL);
+    GdkPixbuf *pixbuf = NULL;
+
+    if (gdk_pixbuf_loader_write (loader, data, length, NULL) &&
+        gdk_pixbuf_loader_close (loader, NULL))
+        pixbuf = g_object_ref (gdk_pixbuf_loader_get_pixbuf (loader));
+    g_object_unref (loader);
+    return pixbuf;
+}
+
+static GdkPixbuf *
+decode_bands (const guchar *data, gsize length)
+{
+    VnrJpegDecoder *decoder = vnr_jpeg_decoder_new (data, length);
+    GdkPixbuf *pixbuf;
+
+    if (decoder == NULL)
+        return NULL;
+    pixbuf = vnr_jpeg_decoder_decode (decoder, NULL, NULL);
+    vnr_jpeg_decoder_free (decoder);
+    return pixbuf;
+}
+
+static int
+compare_times (gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Returns the median time of @runs decodings, in microseconds, or -1
+ * if @decode fails */
+static gint64
+time_decoder (GdkPixbuf *(*decode) (const guchar *, gsize),
+              const guchar *data, gsize length)
+{
+    gint64 *times = g_new (gint64, runs), median;
+    gint i;
+
+    for (i = 0; i < runs; i++)
+    {
+        gint64 start = g_get_monotonic_time ();
+        GdkPixbuf *pixbuf = decode (data, length);
+
+        if (pixbuf == NULL)
+        {
+            g_free (times);
+            return -1;
+        }
+        times[i] = g_get_monotonic_time () - start;
+        g_object_unref (pixbuf);
+    }
+
+    qsort (times, runs, sizeof (gint64), compare_times);
+    median = times[runs / 2];
+    g_free (times);
+    return median;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *opt_context;
+    GError *error = NULL;
+    guchar *data;
+    gsize length;
+    gint width = 6000, height = 4000;
+    gint64 whole, bands;
+    VnrJpegDecoder *decoder;
+
+    opt_context = g_option_context_new (NULL);
+    g_option_context_add_main_entries (opt_context, opt_entries, NULL);
+    if (!g_option_context_parse (opt_context, &argc, &argv, &error))
+    {
+        g_printerr ("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free (opt_context);
+
+    if (size != NULL && sscanf (size, "%dx%d", &width, &height) != 2)
+    {
+        g_printerr ("Invalid size: %s\n", size);
+        return 1;
+    }
+    runs = MAX (runs, 1);
+
+    if (files != NULL && files[0] != NULL)
+    {
+        if (!g_file_get_contents (files[0], (gchar **) &data, &length, &error))
+        {
+            g_printerr ("%s\n", error->message);
+            return 1;
+        }
+    }
+    else
+        data = make_jpeg (width, height, &length);
+
+    decoder = vnr_jpeg_decoder_new (data, length);
+    if (decoder == NULL)
+    {
+        g_printerr ("The image is not split into bands: it has no restart "
+                    "markers, is too small, or there is a single processor "
+                    "online.\n");
+        return 77;
+    }
+    vnr_jpeg_decoder_get_size (decoder, &width, &height);
+    vnr_jpeg_decoder_free (decoder);
+
+    whole = time_decoder (decode_whole, data, length);
+    bands = time_decoder (decode_bands, data, length);
+    if (whole < 0 || bands < 0)
+    {
+        g_printerr ("The image could not be decoded.\n");
+        return 1;
+    }
+
+    g_print ("%dx%d, %" G_GSIZE_FORMAT " bytes, %u workers, median of %d runs\n",
+             width, height, length, vnr_workers_get_n_threads (), runs);
+    g_print ("whole:  %8.1f ms\n", whole / 1000.0);
+    g_print ("bands:  %8.1f ms\n", bands / 1000.0);
+    g_print ("speedup: %.2f\n", (gdouble) whole / bands);
+
+    g_free (data);
+    return 0;
+}
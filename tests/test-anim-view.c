@@ -0,0 +1,268 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Widgets need a display, so the tests are skipped without one. */
+
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include "uni-anim-view.h"
+
+#define WIDTH 64
+#define HEIGHT 48
+#define SQUARE 8
+#define N_FRAMES 6
+
+static const guchar palette[4][3] = {
+    { 0xff, 0xff, 0xff }, { 0xff, 0x00, 0x00 },
+    { 0x00, 0xff, 0x00 }, { 0x00, 0x00, 0xff }
+};
+
+static gchar *tmp_dir;
+
+/* Palette index of the pixel at @x, @y of frame @n: a square moving
+ * right, of another colour in each frame */
+static guchar
+frame_pixel (guint n, gint x, gint y)
+{
+    if (x >= (gint) n * SQUARE && x < (gint) (n + 1) * SQUARE &&
+        y < SQUARE)
+        return 1 + n % 3;
+    return 0;
+}
+
+static void
+put16 (GByteArray *gif, guint value)
+{
+    guint8 bytes[2] = { value & 0xff, value >> 8 };
+
+    g_byte_array_append (gif, bytes, 2);
+}
+
+/* Appends the codes of the LZW stream to @gif in sub-blocks */
+static void
+put_codes (GByteArray *gif, const guint *codes, guint n_codes, guint bits)
+{
+    GByteArray *data = g_byte_array_new ();
+    guint32 buffer = 0;
+    guint filled = 0, i;
+
+    for (i = 0; i < n_codes; i++)
+    {
+        buffer |= codes[i] << filled;
+        filled += bits;
+        while (filled >= 8)
+        {
+            guint8 byte = buffer & 0xff;
+
+            g_byte_array_append (data, &byte, 1);
+            buffer >>= 8;
+            filled -= 8;
+        }
+    }
+    if (filled > 0)
+    {
+        guint8 byte = buffer & 0xff;
+
+        g_byte_array_append (data, &byte, 1);
+    }
+
+    for (i = 0; i < data->len; i += 255)
+    {
+        guint8 length = MIN (255, data->len - i);
+
+        g_byte_array_append (gif, &length, 1);
+        g_byte_array_append (gif, data->data + i, length);
+    }
+    g_byte_array_append (gif, (const guint8 *) "", 1);
+    g_byte_array_free (data, TRUE);
+}
+
+/* Writes an endlessly looping GIF of N_FRAMES frames. Pixels are
+ * coded one by one, with a clear code every other pixel so that codes
+ * stay 3 bits long. */
+static gchar *
+make_gif (void)
+{
+    static const guint8 loop[] = {
+        0x21, 0xff, 0x0b, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E',
+        '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00
+    };
+    GByteArray *gif = g_byte_array_new ();
+    gchar *path = g_build_filename (tmp_dir, "anim.gif", NULL);
+    guint *codes = g_new (guint, WIDTH * HEIGHT * 3 / 2 + 2);
+    guint8 byte;
+    guint n;
+
+    g_byte_array_append (gif, (const guint8 *) "GIF89a", 6);
+    put16 (gif, WIDTH);
+    put16 (gif, HEIGHT);
+    /* Global palette of 4 colours */
+    byte = 0x91;
+    g_byte_array_append (gif, &byte, 1);
+    g_byte_array_append (gif, (const guint8 *) "\0\0", 2);
+    g_byte_array_append (gif, &palette[0][0], sizeof (palette));
+    g_byte_array_append (gif, loop, sizeof (loop));
+
+    for (n = 0; n < N_FRAMES; n++)
+    {
+        /* Kept in place, shown for 100 ms */
+        static const guint8 control[] = { 0x21, 0xf9, 0x04, 0x04 };
+        guint n_codes = 0;
+        gint x, y;
+
+        g_byte_array_append (gif, control, sizeof (control));
+        put16 (gif, 10);
+        g_byte_array_append (gif, (const guint8 *) "\0\0", 2);
+
+        byte = 0x2c;
+        g_byte_array_append (gif, &byte, 1);
+        put16 (gif, 0);
+        put16 (gif, 0);
+        put16 (gif, WIDTH);
+        put16 (gif, HEIGHT);
+        g_byte_array_append (gif, (const guint8 *) "", 1);
+
+        /* Minimum code size 2: clear is 4, end of data 5 */
+        byte = 2;
+        g_byte_array_append (gif, &byte, 1);
+        for (y = 0; y < HEIGHT; y++)
+        {
+            for (x = 0; x < WIDTH; x++)
+            {
+                if (x % 2 == 0)
+                    codes[n_codes++] = 4;
+                codes[n_codes++] = frame_pixel (n, x, y);
+            }
+        }
+        codes[n_codes++] = 5;
+        put_codes (gif, codes, n_codes, 3);
+    }
+
+    byte = 0x3b;
+    g_byte_array_append (gif, &byte, 1);
+    g_assert (g_file_set_contents (path, (const gchar *) gif->data,
+                                   gif->len, NULL));
+
+    g_free (codes);
+    g_byte_array_free (gif, TRUE);
+    return path;
+}
+
+/* Checks that @pixbuf shows frame @n */
+static void
+assert_frame (GdkPixbuf *pixbuf, guint n)
+{
+    gint chans = gdk_pixbuf_get_n_channels (pixbuf);
+    gint stride = gdk_pixbuf_get_rowstride (pixbuf);
+    const guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    gint x, y;
+
+    g_assert_cmpint (gdk_pixbuf_get_width (pixbuf), ==, WIDTH);
+    g_assert_cmpint (gdk_pixbuf_get_height (pixbuf), ==, HEIGHT);
+
+    for (y = 0; y < HEIGHT; y++)
+    {
+        for (x = 0; x < WIDTH; x++)
+        {
+            const guchar *p = pixels + y * stride + x * chans;
+            const guchar *color = palette[frame_pixel (n, x, y)];
+
+            g_assert_cmpuint (p[0], ==, color[0]);
+            g_assert_cmpuint (p[1], ==, color[1]);
+            g_assert_cmpuint (p[2], ==, color[2]);
+        }
+    }
+}
+
+/* The frames of the first loop are kept as palette indices, whatever
+ * pixbufs the loader composites them into. After that, the animation
+ * is played from them. */
+static void
+test_store (void)
+{
+    gchar *path = make_gif ();
+    GdkPixbufAnimation *anim;
+    UniAnimView *aview;
+    GError *error = NULL;
+    guint n;
+
+    anim = gdk_pixbuf_animation_new_from_file (path, &error);
+    g_assert_no_error (error);
+    g_assert (!gdk_pixbuf_animation_is_static_image (anim));
+
+    aview = UNI_ANIM_VIEW (uni_anim_view_new ());
+    g_object_ref_sink (aview);
+    g_assert (!uni_anim_view_set_anim (aview, anim));
+    g_object_unref (anim);
+
+    assert_frame (UNI_IMAGE_VIEW (aview)->pixbuf, 0);
+    for (n = 1; n < N_FRAMES; n++)
+    {
+        g_signal_emit_by_name (aview, "step");
+        g_assert_cmpint (aview->frame, ==, n);
+        assert_frame (UNI_IMAGE_VIEW (aview)->pixbuf, n);
+        g_assert (aview->store != NULL);
+        g_assert_cmpuint (aview->store->len, ==, n + 1);
+    }
+
+    /* Back at the first frame, the loop is complete */
+    g_signal_emit_by_name (aview, "step");
+    g_assert (aview->store_complete);
+    g_assert (aview->anim == NULL);
+    g_assert_cmpuint (aview->store->len, ==, N_FRAMES);
+    g_assert_cmpint (aview->frame, ==, 0);
+    assert_frame (UNI_IMAGE_VIEW (aview)->pixbuf, 0);
+
+    /* A byte per pixel, rather than three or four */
+    g_assert_cmpuint (aview->store_size, <, N_FRAMES * WIDTH * HEIGHT * 2);
+
+    for (n = 1; n <= N_FRAMES; n++)
+    {
+        g_signal_emit_by_name (aview, "step");
+        g_assert_cmpint (aview->frame, ==, n % N_FRAMES);
+        assert_frame (UNI_IMAGE_VIEW (aview)->pixbuf, n % N_FRAMES);
+    }
+
+    g_object_unref (aview);
+    g_remove (path);
+    g_free (path);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int result;
+
+    g_test_init (&argc, &argv, NULL);
+
+    /* Skipped, as meson counts it */
+    if (!gtk_init_check (&argc, &argv))
+        return 77;
+
+    tmp_dir = g_dir_make_tmp ("viewnior-test-XXXXXX", NULL);
+    g_assert (tmp_dir != NULL);
+
+    g_test_add_func ("/anim-view/store", test_store);
+
+    result = g_test_run ();
+
+    g_rmdir (tmp_dir);
+    g_free (tmp_dir);
+    return result;
+}
@@ -0,0 +1,286 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include "vnr-file.h"
+#include "vnr-file-list.h"
+
+/* Names of the files of @list in its order, separated by spaces */
+static gchar *
+list_names (VnrFileList *list)
+{
+    GString *names = g_string_new (NULL);
+    guint i;
+
+    for (i = 0; i < vnr_file_list_get_length (list); i++)
+    {
+        if (i > 0)
+            g_string_append_c (names, ' ');
+        g_string_append (names, vnr_file_list_get_nth_entry (list, i)->name);
+    }
+    return g_string_free (names, FALSE);
+}
+
+static void
+assert_names (VnrFileList *list, const gchar *expected)
+{
+    gchar *names = list_names (list);
+
+    g_assert_cmpstr (names, ==, expected);
+    g_free (names);
+}
+
+/* Adds the files named in @names, separated by spaces, to @list, with
+ * their position in @names as modification time and size */
+static void
+add_names (VnrFileList *list, const gchar *dir, const gchar *names)
+{
+    gchar **split = g_strsplit (names, " ", -1);
+    guint i;
+
+    for (i = 0; split[i] != NULL; i++)
+        vnr_file_list_add (list, dir, split[i], split[i], i, i);
+    g_strfreev (split);
+}
+
+static VnrFileList *
+new_sorted (const gchar *dir, const gchar *names)
+{
+    VnrFileList *list = vnr_file_list_new ();
+
+    add_names (list, dir, names);
+    vnr_file_list_sort (list);
+    return list;
+}
+
+/* Names are sorted as a person would, numbers by their value */
+static void
+test_sort (void)
+{
+    VnrFileList *list = new_sorted ("/photos",
+                                    "img10.jpg b.png img2.jpg a.png img1.jpg");
+    guint i;
+
+    assert_names (list, "a.png b.png img1.jpg img2.jpg img10.jpg");
+    g_assert_cmpuint (vnr_file_list_get_position (list), ==, 0);
+    for (i = 0; i < vnr_file_list_get_length (list); i++)
+        g_assert (vnr_file_list_get_nth_entry (list, i)->collate_key != NULL);
+
+    vnr_file_list_free (list);
+}
+
+/* Lists longer than a chunk get their keys made on the workers */
+static void
+test_sort_long (void)
+{
+    VnrFileList *list = vnr_file_list_new ();
+    GRand *rand = g_rand_new_with_seed (42);
+    guint *order, n = 10000, i;
+
+    order = g_new (guint, n);
+    for (i = 0; i < n; i++)
+        order[i] = i;
+    for (i = n - 1; i > 0; i--)
+    {
+        guint j = g_rand_int_range (rand, 0, i + 1), t = order[i];
+
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        gchar *name = g_strdup_printf ("frame%u.png", order[i]);
+
+        vnr_file_list_add (list, "/frames", name, name, 0, 0);
+        g_free (name);
+    }
+    vnr_file_list_sort (list);
+
+    for (i = 0; i < n; i++)
+    {
+        gchar *name = g_strdup_printf ("frame%u.png", i);
+
+        g_assert_cmpstr (vnr_file_list_get_nth_entry (list, i)->name, ==,
+                         name);
+        g_free (name);
+    }
+
+    g_free (order);
+    g_rand_free (rand);
+    vnr_file_list_free (list);
+}
+
+/* Keys which were already made, as read from a directory index, are
+ * kept rather than made again */
+static void
+test_sort_keeps_keys (void)
+{
+    VnrFileList *list = new_sorted ("/photos", "a.png b.png");
+    VnrFileEntry entry = { 0 };
+
+    entry.dir = "/photos";
+    entry.name = entry.display_name = "z.png";
+    entry.collate_key = "";
+    vnr_file_list_add_entry (list, &entry);
+
+    vnr_file_list_sort (list);
+    assert_names (list, "z.png a.png b.png");
+    g_assert_cmpstr (vnr_file_list_get_nth_entry (list, 0)->collate_key, ==,
+                     "");
+
+    vnr_file_list_free (list);
+}
+
+static void
+test_find (void)
+{
+    VnrFileList *list = new_sorted ("/photos", "c.png a.png b.png");
+    VnrFileList *other = new_sorted ("/photos/old", "b.png");
+    guint position = 0;
+
+    vnr_file_list_merge (list, other);
+    assert_names (list, "a.png b.png b.png c.png");
+
+    g_assert (vnr_file_list_find (list, "/photos/c.png", &position));
+    g_assert_cmpuint (position, ==, 3);
+
+    /* Files of the same name in different directories */
+    g_assert (vnr_file_list_find (list, "/photos/b.png", &position));
+    g_assert_cmpstr (vnr_file_list_get_nth_entry (list, position)->dir, ==,
+                     "/photos");
+    g_assert (vnr_file_list_find (list, "/photos/old/b.png", &position));
+    g_assert_cmpstr (vnr_file_list_get_nth_entry (list, position)->dir, ==,
+                     "/photos/old");
+
+    /* Names which are not listed, or not in that directory */
+    g_assert (!vnr_file_list_find (list, "/photos/d.png", NULL));
+    g_assert (!vnr_file_list_find (list, "/photos/old/a.png", NULL));
+
+    /* The names gathered by the first lookup follow the changes */
+    g_assert (vnr_file_list_remove (list, "/photos/c.png"));
+    g_assert (!vnr_file_list_find (list, "/photos/c.png", NULL));
+    g_assert (vnr_file_list_remove (list, "/photos/b.png"));
+    g_assert (vnr_file_list_find (list, "/photos/old/b.png", NULL));
+    vnr_file_list_insert (list, "/photos", "d.png", "d.png", 0, 0);
+    g_assert (vnr_file_list_find (list, "/photos/d.png", &position));
+    g_assert_cmpuint (position, ==, 2);
+
+    vnr_file_list_free (list);
+}
+
+/* Files are inserted at their place and the current file stays */
+static void
+test_insert (void)
+{
+    VnrFileList *list = new_sorted ("/photos", "b.png d.png f.png");
+
+    vnr_file_list_set_position (list, 1);
+    vnr_file_list_insert (list, "/photos", "c.png", "c.png", 0, 0);
+    vnr_file_list_insert (list, "/photos", "g.png", "g.png", 0, 0);
+    vnr_file_list_insert (list, "/photos", "a.png", "a.png", 0, 0);
+
+    assert_names (list, "a.png b.png c.png d.png f.png g.png");
+    g_assert_cmpuint (vnr_file_list_get_position (list), ==, 3);
+
+    vnr_file_list_free (list);
+}
+
+/* Batches are merged in, leaving out the files already listed */
+static void
+test_merge (void)
+{
+    VnrFileList *list = new_sorted ("/photos", "b.png d.png");
+
+    vnr_file_list_set_position (list, 1);
+    vnr_file_list_merge (list, new_sorted ("/photos", "a.png d.png e.png"));
+    vnr_file_list_merge (list, new_sorted ("/photos", "c.png"));
+
+    assert_names (list, "a.png b.png c.png d.png e.png");
+    g_assert_cmpstr (vnr_file_list_get_nth_entry (list,
+                         vnr_file_list_get_position (list))->name, ==,
+                     "d.png");
+
+    vnr_file_list_free (list);
+}
+
+/* Other orders are kept as files come and go */
+static void
+test_order (void)
+{
+    VnrFileList *list = vnr_file_list_new ();
+
+    /* Sizes given by the position in the names */
+    add_names (list, "/photos", "c.png a.png d.png");
+    vnr_file_list_sort (list);
+    vnr_file_list_set_position (list, 2);
+
+    vnr_file_list_set_order (list, VNR_FILE_LIST_ORDER_SIZE);
+    assert_names (list, "c.png a.png d.png");
+    g_assert_cmpuint (vnr_file_list_get_position (list), ==, 2);
+
+    vnr_file_list_insert (list, "/photos", "b.png", "b.png", 0, 1);
+    assert_names (list, "c.png a.png b.png d.png");
+    g_assert_cmpuint (vnr_file_list_get_position (list), ==, 3);
+
+    g_assert (vnr_file_list_update (list, "/photos/c.png", 0, 5));
+    assert_names (list, "a.png b.png d.png c.png");
+    g_assert_cmpuint (vnr_file_list_get_position (list), ==, 2);
+
+    vnr_file_list_remove_current (list);
+    assert_names (list, "a.png b.png c.png");
+    g_assert_cmpstr (vnr_file_list_get_nth_entry (list,
+                         vnr_file_list_get_position (list))->name, ==,
+                     "c.png");
+
+    vnr_file_list_set_order (list, VNR_FILE_LIST_ORDER_NAME);
+    assert_names (list, "a.png b.png c.png");
+
+    vnr_file_list_free (list);
+}
+
+/* Names a loader is known for are taken as images, and so are names
+ * which tell nothing of the type, as opening the file finds out */
+static void
+test_name_is_image (void)
+{
+    g_assert (vnr_file_name_is_image ("photo.jpg"));
+    g_assert (vnr_file_name_is_image ("photo.JPG"));
+    g_assert (vnr_file_name_is_image ("frame.0001.png"));
+    g_assert (vnr_file_name_is_image ("scan0001"));
+    g_assert (!vnr_file_name_is_image ("notes.txt"));
+    g_assert (!vnr_file_name_is_image ("photo.jpg.part"));
+}
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/file-list/sort", test_sort);
+    g_test_add_func ("/file-list/sort-long", test_sort_long);
+    g_test_add_func ("/file-list/sort-keeps-keys", test_sort_keeps_keys);
+    g_test_add_func ("/file-list/find", test_find);
+    g_test_add_func ("/file-list/insert", test_insert);
+    g_test_add_func ("/file-list/merge", test_merge);
+    g_test_add_func ("/file-list/order", test_order);
+    g_test_add_func ("/file/name-is-image", test_name_is_image);
+
+    return g_test_run ();
+}
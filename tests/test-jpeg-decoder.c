@@ -0,0 +1,404 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The decoder is built in, so that the splitting into bands can be
+ * checked without going through the number of processors online. */
+#include "vnr-jpeg-decoder.c"
+
+typedef struct {
+    gint width;
+    gint height;
+    guint mcu_width;
+    guint mcu_height;
+    /* Intervals per row of MCUs if negative */
+    gint restart;
+} PlanCase;
+
+static const PlanCase plan_cases[] = {
+    { 6000, 4000, 16, 16, -1 },
+    { 6000, 4000, 16, 16, 7 },
+    { 6000, 4000, 16, 8, -2 },
+    { 3000, 2000, 8, 8, 1 },
+    { 1001, 999, 16, 16, 5 },
+    { 4000, 6000, 8, 16, 250 },
+    { 640, 48, 16, 16, -1 },
+};
+
+/* Makes up a photo sized image with a restart marker every @restart
+ * MCUs, or at each row of MCUs if it is 0 */
+static guchar *
+make_jpeg (gint width, gint height, gint restart, gsize *length)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *data = NULL;
+    unsigned long data_length = 0;
+    guchar *row;
+    gint x;
+
+    cinfo.err = jpeg_std_error (&jerr);
+    jpeg_create_compress (&cinfo);
+    jpeg_mem_dest (&cinfo, &data, &data_length);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults (&cinfo);
+    jpeg_set_quality (&cinfo, 90, TRUE);
+    if (restart > 0)
+        cinfo.restart_interval = restart;
+    else
+        cinfo.restart_in_rows = 1;
+
+    row = g_malloc ((gsize) width * 3);
+    jpeg_start_compress (&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        gint y = cinfo.next_scanline;
+        JSAMPROW rows = row;
+
+        for (x = 0; x < width * 3; x++)
+            row[x] = (x * 7 + y * 3 + ((x / 3) ^ y)) & 0xff;
+        jpeg_write_scanlines (&cinfo, &rows, 1);
+    }
+    jpeg_finish_compress (&cinfo);
+    jpeg_destroy_compress (&cinfo);
+    g_free (row);
+
+    *length = data_length;
+    return data;
+}
+
+/* Decodes @data whole on this thread: the image the bands add up to */
+static guchar *
+decode_whole (const guchar *data, gsize length, gint *rowstride)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    guchar *pixels;
+
+    cinfo.err = jpeg_std_error (&jerr);
+    jpeg_create_decompress (&cinfo);
+    jpeg_mem_src (&cinfo, data, length);
+    jpeg_read_header (&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress (&cinfo);
+
+    *rowstride = cinfo.output_width * 3;
+    pixels = g_malloc ((gsize) *rowstride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = pixels + (gsize) cinfo.output_scanline * *rowstride;
+
+        jpeg_read_scanlines (&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress (&cinfo);
+    jpeg_destroy_decompress (&cinfo);
+    return pixels;
+}
+
+/* Does what vnr_jpeg_decoder_new() does, but splits @data into @n
+ * bands whatever its size and the processors online */
+static VnrJpegDecoder *
+new_decoder (const guchar *data, gsize length, guint n)
+{
+    VnrJpegDecoder *decoder = g_slice_new0 (VnrJpegDecoder);
+    guint restart, mcu_width, mcu_height;
+    guint64 mcus;
+
+    decoder->data = data;
+    decoder->length = length;
+    decoder->orientation = 1;
+
+    g_assert (vnr_jpeg_decoder_parse_headers (decoder, &restart,
+                                              &mcu_width, &mcu_height));
+    g_assert_cmpuint (restart, >, 0);
+    g_assert (vnr_jpeg_decoder_find_markers (decoder));
+
+    mcus = (guint64) ((decoder->width + mcu_width - 1) / mcu_width) *
+           ((decoder->height + mcu_height - 1) / mcu_height);
+    decoder->n_intervals = (mcus + restart - 1) / restart;
+    g_assert_cmpuint (decoder->markers->len + 1, ==, decoder->n_intervals);
+
+    vnr_jpeg_decoder_plan (decoder, restart, mcu_width, mcu_height, n);
+    return decoder;
+}
+
+/* The bands fill the image from top to bottom, each one decoding whole
+ * rows of MCUs which start and end at a restart marker */
+static void
+test_plan (void)
+{
+    guint c, n, i;
+
+    for (c = 0; c < G_N_ELEMENTS (plan_cases); c++)
+    {
+        const PlanCase *pc = &plan_cases[c];
+        guint columns = (pc->width + pc->mcu_width - 1) / pc->mcu_width;
+        guint rows = (pc->height + pc->mcu_height - 1) / pc->mcu_height;
+        guint restart = pc->restart < 0 ? columns * -pc->restart
+                                        : (guint) pc->restart;
+
+        for (n = 2; n <= 9; n++)
+        {
+            VnrJpegDecoder decoder = { NULL };
+            gint y = 0;
+
+            decoder.width = pc->width;
+            decoder.height = pc->height;
+            decoder.n_intervals = ((guint64) columns * rows + restart - 1) /
+                                  restart;
+            vnr_jpeg_decoder_plan (&decoder, restart, pc->mcu_width,
+                                   pc->mcu_height, n);
+
+            g_assert_cmpuint (decoder.n_bands, >=, 1);
+            g_assert_cmpuint (decoder.n_bands, <=, n);
+            /* Each band gets a row of MCUs starting an interval */
+            if (rows / n >= restart / vnr_jpeg_gcd (columns, restart))
+                g_assert_cmpuint (decoder.n_bands, ==, n);
+
+            for (i = 0; i < decoder.n_bands; i++)
+            {
+                VnrJpegBand *band = &decoder.bands[i];
+                gboolean last = i + 1 == decoder.n_bands;
+
+                g_assert_cmpint (band->y, ==, y);
+                g_assert_cmpint (band->height, >, 0);
+                g_assert_cmpint (band->top, <=, band->y);
+                g_assert_cmpint (band->top + band->rows, >=,
+                                 band->y + band->height);
+                g_assert_cmpint (band->top + band->rows, <=, pc->height);
+
+                g_assert_cmpuint (band->first, <, band->last);
+                g_assert_cmpuint ((guint64) band->first * restart % columns,
+                                  ==, 0);
+                g_assert_cmpuint ((guint64) band->first * restart / columns *
+                                  pc->mcu_height, ==, band->top);
+                if (last)
+                {
+                    g_assert_cmpuint (band->last, ==, decoder.n_intervals);
+                    g_assert_cmpint (band->top + band->rows, ==, pc->height);
+                }
+                else
+                {
+                    g_assert_cmpuint ((guint64) band->last * restart %
+                                      columns, ==, 0);
+                    g_assert_cmpuint ((guint64) band->last * restart /
+                                      columns * pc->mcu_height, ==,
+                                      band->top + band->rows);
+                }
+                y += band->height;
+            }
+            g_assert_cmpint (y, ==, pc->height);
+            g_free (decoder.bands);
+        }
+    }
+}
+
+/* Images too small to split, or split into a single band, are left
+ * to gdk-pixbuf */
+static void
+test_plan_single (void)
+{
+    VnrJpegDecoder decoder = { NULL };
+
+    decoder.width = 640;
+    decoder.height = 480;
+    decoder.n_intervals = 30;
+    vnr_jpeg_decoder_plan (&decoder, 40, 16, 16, 1);
+    g_assert_cmpuint (decoder.n_bands, ==, 0);
+    g_assert (decoder.bands == NULL);
+}
+
+/* Stuffed bytes and fill bytes are not markers, and the scan ends at
+ * the first marker which is not a restart marker */
+static void
+test_find_markers (void)
+{
+    static const guchar data[] = {
+        0x12, 0xff, 0x00, 0x34, 0xff, 0xd0, 0x56, 0xff, 0xff, 0xd1,
+        0x78, 0xff, 0xd7, 0xff, 0xd9
+    };
+    VnrJpegDecoder decoder = { NULL };
+    const gsize *markers;
+
+    decoder.data = data;
+    decoder.length = sizeof data;
+    g_assert (vnr_jpeg_decoder_find_markers (&decoder));
+
+    markers = (const gsize *) decoder.markers->data;
+    g_assert_cmpuint (decoder.markers->len, ==, 3);
+    g_assert_cmpuint (markers[0], ==, 4);
+    g_assert_cmpuint (markers[1], ==, 8);
+    g_assert_cmpuint (markers[2], ==, 11);
+    g_assert_cmpuint (decoder.end, ==, 13);
+    g_array_free (decoder.markers, TRUE);
+
+    /* Truncated before the end of the image */
+    decoder.length = sizeof data - 1;
+    g_assert (!vnr_jpeg_decoder_find_markers (&decoder));
+    g_array_free (decoder.markers, TRUE);
+
+    /* Another frame after the scan */
+    decoder.length = 8;
+    decoder.data = (const guchar *) "\x12\x34\xff\xd0\x56\xff\xc4\x00";
+    g_assert (!vnr_jpeg_decoder_find_markers (&decoder));
+    g_array_free (decoder.markers, TRUE);
+}
+
+/* The image decoded in bands is the same as the image decoded whole */
+static void
+test_decode (void)
+{
+    gint restarts[] = { 0, 7 };
+    guint r, n;
+
+    for (r = 0; r < G_N_ELEMENTS (restarts); r++)
+    {
+        guchar *data, *whole;
+        gsize length;
+        gint rowstride;
+
+        data = make_jpeg (640, 480, restarts[r], &length);
+        whole = decode_whole (data, length, &rowstride);
+
+        for (n = 2; n <= 5; n++)
+        {
+            VnrJpegDecoder *decoder = new_decoder (data, length, n);
+            GdkPixbuf *pixbuf;
+            GError *error = NULL;
+            gint y;
+
+            g_assert_cmpuint (decoder->n_bands, >=, 2);
+            pixbuf = vnr_jpeg_decoder_decode (decoder, NULL, &error);
+            g_assert_no_error (error);
+            g_assert_cmpint (gdk_pixbuf_get_width (pixbuf), ==, 640);
+            g_assert_cmpint (gdk_pixbuf_get_height (pixbuf), ==, 480);
+
+            /* Markers every row of MCUs leave room for the chroma to be
+             * upsampled across the seams, others only away from them */
+            for (y = 0; y < 480; y++)
+            {
+                gboolean seam = FALSE;
+                guint i;
+
+                for (i = 1; i < decoder->n_bands; i++)
+                    if (ABS (y - decoder->bands[i].y) <= 16)
+                        seam = TRUE;
+                if (seam && restarts[r] != 0)
+                    continue;
+
+                g_assert (memcmp (gdk_pixbuf_get_pixels (pixbuf) +
+                                  y * gdk_pixbuf_get_rowstride (pixbuf),
+                                  whole + y * rowstride, rowstride) == 0);
+            }
+
+            g_object_unref (pixbuf);
+            vnr_jpeg_decoder_free (decoder);
+        }
+
+        g_free (whole);
+        free (data);
+    }
+}
+
+static void
+put16 (guchar *p, guint value, gboolean big_endian)
+{
+    p[big_endian ? 0 : 1] = value >> 8;
+    p[big_endian ? 1 : 0] = value & 0xff;
+}
+
+static void
+put32 (guchar *p, guint32 value, gboolean big_endian)
+{
+    put16 (p + (big_endian ? 0 : 2), value >> 16, big_endian);
+    put16 (p + (big_endian ? 2 : 0), value & 0xffff, big_endian);
+}
+
+/* Builds an APP1 segment holding an Exif IFD with a single entry */
+static guchar *
+make_exif (gboolean big_endian, guint tag, guint value, gsize *length)
+{
+    guchar *segment, *tiff, *entry;
+
+    *length = 6 + 8 + 2 + 12 + 4;
+    segment = g_malloc0 (*length);
+    tiff = segment + 6;
+    entry = tiff + 8 + 2;
+
+    memcpy (segment, "Exif\0\0", 6);
+    memcpy (tiff, big_endian ? "MM" : "II", 2);
+    put16 (tiff + 2, 42, big_endian);
+    put32 (tiff + 4, 8, big_endian);
+    put16 (tiff + 8, 1, big_endian);
+
+    /* A SHORT, which is stored in the first bytes of the value */
+    put16 (entry, tag, big_endian);
+    put16 (entry + 2, 3, big_endian);
+    put32 (entry + 4, 1, big_endian);
+    put16 (entry + 8, value, big_endian);
+    return segment;
+}
+
+static void
+test_orientation (void)
+{
+    guchar *segment;
+    gsize length;
+    gint big_endian;
+
+    for (big_endian = 0; big_endian <= 1; big_endian++)
+    {
+        segment = make_exif (big_endian, 0x0112, 6, &length);
+        g_assert_cmpint (vnr_jpeg_parse_orientation (segment, length), ==, 6);
+
+        /* Cut in the middle of the entry */
+        g_assert_cmpint (vnr_jpeg_parse_orientation (segment, 6 + 8 + 2 + 6),
+                         ==, 0);
+
+        /* Not Exif */
+        segment[0] = 'X';
+        g_assert_cmpint (vnr_jpeg_parse_orientation (segment, length), ==, 0);
+        g_free (segment);
+
+        segment = make_exif (big_endian, 0x0112, 9, &length);
+        g_assert_cmpint (vnr_jpeg_parse_orientation (segment, length), ==, 0);
+        g_free (segment);
+
+        segment = make_exif (big_endian, 0x0110, 6, &length);
+        g_assert_cmpint (vnr_jpeg_parse_orientation (segment, length), ==, 0);
+        g_free (segment);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/jpeg-decoder/plan", test_plan);
+    g_test_add_func ("/jpeg-decoder/plan-single", test_plan_single);
+    g_test_add_func ("/jpeg-decoder/find-markers", test_find_markers);
+    g_test_add_func ("/jpeg-decoder/decode", test_decode);
+    g_test_add_func ("/jpeg-decoder/orientation", test_orientation);
+
+    return g_test_run ();
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+#include "vnr-region-decoder.h"
+
+#define WIDTH 256
+#define HEIGHT 2048
+#define AREA 64
+/* Rows read between calls to the update function */
+#define ROWS 64
+
+typedef struct {
+    guint updates;
+    guint delivered;
+    gint index;
+    GdkPixbuf *pixbuf;
+} Run;
+
+/* A PNG image whose pixels tell where they are: the row in red and
+ * green, the column in blue */
+static gchar *
+make_png (gsize *length)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        WIDTH, HEIGHT);
+    gint stride = gdk_pixbuf_get_rowstride (pixbuf);
+    guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    gchar *data = NULL;
+    gint x, y;
+
+    for (y = 0; y < HEIGHT; y++)
+    {
+        for (x = 0; x < WIDTH; x++)
+        {
+            guchar *p = pixels + y * stride + x * 3;
+
+            p[0] = y & 0xff;
+            p[1] = y >> 8;
+            p[2] = x;
+        }
+    }
+    g_assert (gdk_pixbuf_save_to_buffer (pixbuf, &data, length, "png",
+                                         NULL, NULL));
+    g_object_unref (pixbuf);
+    return data;
+}
+
+static void
+assert_area (GdkPixbuf *pixbuf, const GdkRectangle *rect)
+{
+    gint stride = gdk_pixbuf_get_rowstride (pixbuf);
+    gint chans = gdk_pixbuf_get_n_channels (pixbuf);
+    const guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+    gint x, y;
+
+    g_assert_cmpint (gdk_pixbuf_get_width (pixbuf), ==, rect->width);
+    g_assert_cmpint (gdk_pixbuf_get_height (pixbuf), ==, rect->height);
+    for (y = 0; y < rect->height; y++)
+    {
+        for (x = 0; x < rect->width; x++)
+        {
+            const guchar *p = pixels + y * stride + x * chans;
+
+            g_assert_cmpuint (p[0], ==, (rect->y + y) & 0xff);
+            g_assert_cmpuint (p[1], ==, (rect->y + y) >> 8);
+            g_assert_cmpuint (p[2], ==, rect->x + x);
+        }
+    }
+}
+
+static void
+decoded (guint index, GdkPixbuf *pixbuf, gpointer user_data)
+{
+    Run *run = user_data;
+
+    run->delivered++;
+    run->index = index;
+    run->pixbuf = g_object_ref (pixbuf);
+}
+
+static const GdkRectangle first = { 0, 1024, AREA, AREA };
+static const GdkRectangle later = { 64, 1536, AREA, AREA };
+static const GdkRectangle above = { 0, 0, AREA, AREA };
+
+/* Swaps the first area for a later one before any row is read, then
+ * tries one the pass has read past, ROWS * 2 rows on */
+static void
+update (VnrRegionPass *pass, gpointer user_data)
+{
+    Run *run = user_data;
+
+    run->updates++;
+    if (run->updates == 1)
+    {
+        g_assert (vnr_region_pass_add (pass, &later));
+        vnr_region_pass_drop (pass, 0);
+    }
+    else if (run->updates == 3)
+        g_assert (!vnr_region_pass_add (pass, &above));
+}
+
+/* A pass goes on with the areas it is given while it runs, rather than
+ * reading the image again from the top */
+static void
+test_update (void)
+{
+    VnrRegionDecoder *decoder;
+    GError *error = NULL;
+    Run run = { 0 };
+    gchar *data;
+    gsize length;
+
+    data = make_png (&length);
+    decoder = vnr_region_decoder_new ((const guchar *) data, length);
+    g_assert (decoder != NULL);
+
+    g_assert (vnr_region_decoder_decode_areas (decoder, &first, 1, 1.0,
+                                               decoded, update, &run,
+                                               NULL, &error));
+    g_assert_no_error (error);
+    g_assert_cmpuint (run.updates, >=, 3);
+    g_assert_cmpuint (run.delivered, ==, 1);
+    g_assert_cmpint (run.index, ==, 1);
+    assert_area (run.pixbuf, &later);
+
+    /* Nothing is read past the last area */
+    g_assert_cmpuint (run.updates, <=, (later.y + AREA) / ROWS + 1);
+
+    g_object_unref (run.pixbuf);
+    vnr_region_decoder_free (decoder);
+    g_free (data);
+}
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/region-decoder/update", test_update);
+
+    return g_test_run ();
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The player is built in, so that the frames due and shown can be
+ * followed from here. */
+#include <glib/gstdio.h>
+#include "vnr-sequence.c"
+
+#define FPS 100
+#define N_FRAMES 4
+
+typedef struct {
+    GMutex lock;
+    GCond cond;
+    guint blocked;
+    gboolean open;
+} Gate;
+
+static gchar *tmp_dir;
+
+static void
+frame_cb (const gchar *path, GdkPixbuf *frame, gpointer user_data)
+{
+}
+
+static void
+stats_cb (gdouble fps, guint dropped, gpointer user_data)
+{
+}
+
+/* Keeps a worker busy until the gate opens */
+static void
+block_job (gpointer data, gpointer user_data)
+{
+    Gate *gate = user_data;
+
+    g_mutex_lock (&gate->lock);
+    gate->blocked++;
+    while (!gate->open)
+        g_cond_wait (&gate->cond, &gate->lock);
+    g_mutex_unlock (&gate->lock);
+}
+
+static guint
+frame_due (VnrSequence *sequence)
+{
+    return (g_get_monotonic_time () - sequence->start) * sequence->fps
+           / G_USEC_PER_SEC;
+}
+
+/* Runs the main loop until @frame is shown, or gives up after a few
+ * seconds */
+static gboolean
+run_until_shown (VnrSequence *sequence, guint frame)
+{
+    gint64 end = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+
+    while (sequence->shown < frame)
+    {
+        if (g_get_monotonic_time () > end)
+            return FALSE;
+        g_main_context_iteration (NULL, TRUE);
+    }
+    return TRUE;
+}
+
+static VnrFileList *
+make_frames (void)
+{
+    VnrFileList *list = vnr_file_list_new ();
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 8, 8);
+    guint i;
+
+    gdk_pixbuf_fill (pixbuf, 0x336699ff);
+    for (i = 0; i < N_FRAMES; i++)
+    {
+        gchar *name = g_strdup_printf ("frame%u.png", i);
+        gchar *path = g_build_filename (tmp_dir, name, NULL);
+
+        g_assert (gdk_pixbuf_save (pixbuf, path, "png", NULL, NULL));
+        vnr_file_list_add (list, tmp_dir, name, name, 0, 0);
+        g_free (path);
+        g_free (name);
+    }
+    vnr_file_list_sort (list);
+
+    g_object_unref (pixbuf);
+    return list;
+}
+
+/* Playback goes on once the workers are back after falling further
+ * behind than the frames decoded ahead */
+static void
+test_stall (void)
+{
+    VnrFileList *list = make_frames ();
+    VnrSequence *sequence;
+    VnrWorkGroup *blockers;
+    Gate gate = { { 0 } };
+    guint n_threads, i, due;
+
+    g_mutex_init (&gate.lock);
+    g_cond_init (&gate.cond);
+
+    sequence = vnr_sequence_new (list, FPS, frame_cb, stats_cb, NULL);
+    g_assert (run_until_shown (sequence, 1));
+
+    /* Takes up every worker, as no job is more urgent */
+    n_threads = vnr_workers_get_n_threads ();
+    blockers = vnr_work_group_new (VNR_WORK_CURRENT, block_job, &gate,
+                                   n_threads, NULL, NULL);
+    for (i = 0; i < n_threads; i++)
+        vnr_work_group_push (blockers, GUINT_TO_POINTER (i + 1));
+
+    g_mutex_lock (&gate.lock);
+    while (gate.blocked < n_threads)
+        g_cond_wait (&gate.cond, &gate.lock);
+    g_mutex_unlock (&gate.lock);
+
+    /* The frames decoded before the stall are used up, then playback
+     * falls behind by more than it decodes ahead */
+    while (frame_due (sequence) <= sequence->shown + 2 * sequence->ahead)
+        g_main_context_iteration (NULL, TRUE);
+    due = frame_due (sequence);
+
+    g_mutex_lock (&gate.lock);
+    gate.open = TRUE;
+    g_cond_broadcast (&gate.cond);
+    g_mutex_unlock (&gate.lock);
+    vnr_work_group_free (blockers, FALSE, TRUE);
+
+    g_assert (run_until_shown (sequence, due + 1));
+
+    vnr_sequence_free (sequence);
+    vnr_file_list_free (list);
+    g_cond_clear (&gate.cond);
+    g_mutex_clear (&gate.lock);
+}
+
+static void
+remove_tree (const gchar *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    const gchar *name;
+
+    if (dir != NULL)
+    {
+        while ((name = g_dir_read_name (dir)) != NULL)
+        {
+            gchar *child = g_build_filename (path, name, NULL);
+
+            remove_tree (child);
+            g_free (child);
+        }
+        g_dir_close (dir);
+    }
+    g_remove (path);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int result;
+
+    tmp_dir = g_dir_make_tmp ("viewnior-test-XXXXXX", NULL);
+    g_assert (tmp_dir != NULL);
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/sequence/stall", test_stall);
+
+    result = g_test_run ();
+
+    remove_tree (tmp_dir);
+    g_free (tmp_dir);
+    return result;
+}
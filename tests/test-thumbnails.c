@@ -0,0 +1,230 @@
+/*
+ * Copyright © 2009-2018 Siyan Panayotov <contact@siyanpanayotov.com>
+ *
+ * This file is part of Viewnior.
+ *
+ * Viewnior is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Viewnior is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Viewnior.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The thumbnails are cached in a directory of their own, which
+ * XDG_CACHE_HOME points to. */
+
+#include <utime.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include "config.h"
+#include "vnr-thumbnails.h"
+
+static gchar *tmp_dir;
+
+/* Writes a square PNG image named @name, @size pixels wide */
+static gchar *
+make_image (const gchar *name, gint size)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
+                                        size, size);
+    gchar *path = g_build_filename (tmp_dir, name, NULL);
+
+    gdk_pixbuf_fill (pixbuf, 0x336699ff);
+    g_assert (gdk_pixbuf_save (pixbuf, path, "png", NULL, NULL));
+    g_object_unref (pixbuf);
+    return path;
+}
+
+/* Where the freedesktop.org specification puts the thumbnail of @path:
+ * in @dir of the cache, named after the MD5 of the URI */
+static gchar *
+cache_file (const gchar *path, const gchar *dir)
+{
+    gchar *uri, *checksum, *name, *file;
+
+    uri = g_filename_to_uri (path, NULL, NULL);
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+    name = g_strconcat (checksum, ".png", NULL);
+    file = g_build_filename (g_get_user_cache_dir (), "thumbnails", dir,
+                             name, NULL);
+
+    g_free (name);
+    g_free (checksum);
+    g_free (uri);
+    return file;
+}
+
+static void
+assert_size (GdkPixbuf *pixbuf, gint size)
+{
+    g_assert (pixbuf != NULL);
+    g_assert_cmpint (gdk_pixbuf_get_width (pixbuf), ==, size);
+    g_assert_cmpint (gdk_pixbuf_get_height (pixbuf), ==, size);
+}
+
+/* Thumbnails are written where other programs look for them, with
+ * what the specification asks them to record */
+static void
+test_cache (void)
+{
+    gchar *path = make_image ("cache.png", 400);
+    gchar *file = cache_file (path, "normal");
+    gchar *uri, *mtime;
+    GdkPixbuf *thumbnail, *cached;
+    GError *error = NULL;
+    GStatBuf st;
+
+    g_assert (vnr_thumbnails_lookup (path, VNR_THUMBNAIL_NORMAL) == NULL);
+
+    thumbnail = vnr_thumbnails_get (path, VNR_THUMBNAIL_NORMAL, NULL, &error);
+    g_assert_no_error (error);
+    assert_size (thumbnail, 128);
+    g_object_unref (thumbnail);
+
+    cached = gdk_pixbuf_new_from_file (file, &error);
+    g_assert_no_error (error);
+    assert_size (cached, 128);
+
+    uri = g_filename_to_uri (path, NULL, NULL);
+    g_assert (g_stat (path, &st) == 0);
+    mtime = g_strdup_printf ("%" G_GINT64_FORMAT, (gint64) st.st_mtime);
+    g_assert_cmpstr (gdk_pixbuf_get_option (cached, "tEXt::Thumb::URI"), ==,
+                     uri);
+    g_assert_cmpstr (gdk_pixbuf_get_option (cached, "tEXt::Thumb::MTime"),
+                     ==, mtime);
+    g_assert_cmpstr (gdk_pixbuf_get_option (cached,
+                                            "tEXt::Thumb::Image::Width"),
+                     ==, "400");
+    g_assert_cmpstr (gdk_pixbuf_get_option (cached,
+                                            "tEXt::Thumb::Image::Height"),
+                     ==, "400");
+    g_object_unref (cached);
+
+    thumbnail = vnr_thumbnails_lookup (path, VNR_THUMBNAIL_NORMAL);
+    assert_size (thumbnail, 128);
+    g_object_unref (thumbnail);
+
+    /* Large thumbnails have a directory of their own */
+    thumbnail = vnr_thumbnails_get (path, VNR_THUMBNAIL_LARGE, NULL, &error);
+    g_assert_no_error (error);
+    assert_size (thumbnail, 256);
+    g_object_unref (thumbnail);
+    g_free (file);
+    file = cache_file (path, "large");
+    g_assert (g_file_test (file, G_FILE_TEST_IS_REGULAR));
+
+    g_free (mtime);
+    g_free (uri);
+    g_free (file);
+    g_free (path);
+}
+
+/* Thumbnails of images modified since are not used */
+static void
+test_stale (void)
+{
+    gchar *path = make_image ("stale.png", 400);
+    GdkPixbuf *thumbnail;
+    struct utimbuf times;
+    GStatBuf st;
+
+    thumbnail = vnr_thumbnails_get (path, VNR_THUMBNAIL_NORMAL, NULL, NULL);
+    g_assert (thumbnail != NULL);
+    g_object_unref (thumbnail);
+
+    g_assert (g_stat (path, &st) == 0);
+    times.actime = times.modtime = st.st_mtime + 10;
+    g_assert (g_utime (path, &times) == 0);
+    g_assert (vnr_thumbnails_lookup (path, VNR_THUMBNAIL_NORMAL) == NULL);
+
+    /* Made again for the image as it is now */
+    thumbnail = vnr_thumbnails_get (path, VNR_THUMBNAIL_NORMAL, NULL, NULL);
+    g_assert (thumbnail != NULL);
+    g_object_unref (thumbnail);
+    thumbnail = vnr_thumbnails_lookup (path, VNR_THUMBNAIL_NORMAL);
+    g_assert (thumbnail != NULL);
+    g_object_unref (thumbnail);
+
+    g_free (path);
+}
+
+/* Files no thumbnail can be made of are remembered, and not tried
+ * again */
+static void
+test_failure (void)
+{
+    gchar *path = g_build_filename (tmp_dir, "broken.png", NULL);
+    gchar *fail_dir = g_build_filename ("fail", "viewnior-" PACKAGE_VERSION,
+                                        NULL);
+    gchar *file = cache_file (path, fail_dir);
+    GError *error = NULL;
+
+    g_assert (g_file_set_contents (path, "not an image", -1, NULL));
+
+    g_assert (vnr_thumbnails_get (path, VNR_THUMBNAIL_NORMAL, NULL,
+                                  &error) == NULL);
+    g_assert (error != NULL);
+    g_clear_error (&error);
+    g_assert (g_file_test (file, G_FILE_TEST_IS_REGULAR));
+
+    g_assert (vnr_thumbnails_get (path, VNR_THUMBNAIL_NORMAL, NULL,
+                                  &error) == NULL);
+    g_assert_error (error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED);
+    g_clear_error (&error);
+
+    g_free (file);
+    g_free (fail_dir);
+    g_free (path);
+}
+
+static void
+remove_tree (const gchar *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    const gchar *name;
+
+    if (dir != NULL)
+    {
+        while ((name = g_dir_read_name (dir)) != NULL)
+        {
+            gchar *child = g_build_filename (path, name, NULL);
+
+            remove_tree (child);
+            g_free (child);
+        }
+        g_dir_close (dir);
+    }
+    g_remove (path);
+}
+
+int
+main (int argc, char *argv[])
+{
+    gchar *cache_dir;
+    int result;
+
+    tmp_dir = g_dir_make_tmp ("viewnior-test-XXXXXX", NULL);
+    g_assert (tmp_dir != NULL);
+    cache_dir = g_build_filename (tmp_dir, "cache", NULL);
+    g_setenv ("XDG_CACHE_HOME", cache_dir, TRUE);
+
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/thumbnails/cache", test_cache);
+    g_test_add_func ("/thumbnails/stale", test_stale);
+    g_test_add_func ("/thumbnails/failure", test_failure);
+
+    result = g_test_run ();
+
+    remove_tree (tmp_dir);
+    g_free (cache_dir);
+    g_free (tmp_dir);
+    return result;
+}